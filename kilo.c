@@ -1,1193 +1,9287 @@
-#define _DEFAULT_SOURCE
-#define _BSD_SOURCE
-#define _GNU_SOURCE
-#include <ctype.h>
-#include <errno.h>
-#include <fcntl.h>
-#include <stdio.h>
-#include <stdarg.h>
-#include <stdlib.h>
-#include <string.h>
-#include <sys/ioctl.h>
-#include <sys/types.h>
-#include <termios.h>
-#include <time.h>
-#include <unistd.h>
-
-/*** defines ***/
-#define KILO_VERSION "0.0.1"
-#define KILO_TAB_STOP 8   // 制表符大小
-#define KILO_QUIT_TIMES 3 // 退出次数为3才能不保存退出
-
-#define CTRL_KEY(k) ((k) & 0x1f)
-
-enum editorKey
-{
-  BACKSPACE = 127,
-  ARROW_LEFT = 1000,
-  ARROW_RIGHT,
-  ARROW_UP,
-  ARROW_DOWN,
-  DEL_KEY,
-  HOME_KEY,
-  END_KEY,
-  PAGE_UP,
-  PAGE_DOWN
-};
-enum editorHighlight
-{
-  HL_NORMAL = 0,
-  HL_COMMENT,
-  HL_MLCOMMENT,
-  HL_KEYWORD1,
-  HL_KEYWORD2,
-  HL_STRING,
-  HL_NUMBER,
-  HL_MATCH
-};
-#define HL_HIGHLIGHT_NUMBERS (1 << 0)
-#define HL_HIGHLIGHT_STRINGS (1 << 1)
-/*** data ***/
-struct editorSyntax
-{
-  char *filetype;
-  char **filematch;
-  char **keywords;
-  char *singleline_comment_start;
-  char *multiline_comment_start;
-  char *multiline_comment_end;
-  int flags;
-};
-typedef struct erow
-{
-  int idx;
-  int size;
-  int rsize;
-  char *chars;
-  char *render;
-  unsigned char *hl; // 0-255之间的整数，数组的每个值对应render中的一个字符，告诉用户该字符是否是字符串的一部分，或注释，或数字
-  int hl_open_comment;
-} erow; // 编辑行
-struct editorConfig
-{
-  int cx, cy;
-  int rx;
-  int rowoff;
-  int coloff;
-  int screenrows;
-  int screencols;
-  int numrows;
-  erow *row;
-  int dirty;
-  char *filename;
-  char statusmsg[80];    // 显示消息
-  time_t statusmsg_time; // 存储消息的时间戳，以便在显示后几秒钟内删除消息
-  struct editorSyntax *syntax;
-  struct termios orig_termios;
-};
-struct editorConfig E;
-/*** filetypes ***/
-char *C_HL_extensions[] = {".c", ".h", ".cpp", NULL}; // 用于高亮显示C语言文件的文件扩展名
-char *C_HL_keywords[] = {
-    "switch", "if", "while", "for", "break", "continue", "return", "else",
-    "struct", "union", "typedef", "static", "enum", "class", "case",
-    "int|", "long|", "double|", "float|", "char|", "unsigned|", "signed|",
-    "void|", NULL}; // 用于高亮显示C语言文件的关键字
-struct editorSyntax HLDB[] = {
-    // 高亮C文件时打开该标志
-    {"c",
-     C_HL_extensions,
-     C_HL_keywords,
-     "//", "/*", "*/",
-     HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS},
-};
-#define HLDB_ENTRIES (sizeof(HLDB) / sizeof(HLDB[0])) // 高亮数据库
-/*** prototypes ***/
-void editorSetStatusMessage(const char *fmt, ...);
-void editorRefreshScreen();
-char *editorPrompt(char *prompt, void (*callback)(char *, int));
-/*** terminal ***/
-void die(const char *s)
-{
-  write(STDOUT_FILENO, "\x1b[2J", 4);
-  write(STDOUT_FILENO, "\x1b[H", 3); // 清除屏幕并退出
-  perror(s);                         // 检查全局errno变量，打印一个错误信息
-  exit(1);                           // 以退出状态1退出程序
-}
-void disableRawMode()
-{
-  if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &E.orig_termios) == -1)
-    die("tcsetattr");
-}
-void enableRawMode()
-{
-  if (tcgetattr(STDIN_FILENO, &E.orig_termios) == -1)
-    die("tcgetattr");
-  atexit(disableRawMode); // 注册disableRawMode()函数，通过调用exit()函数，确保程序退出时，中断属性保持我们找到它们
-  struct termios raw = E.orig_termios;
-  // 使用tcgetattr()将当前属性读入一个结构体中
-
-  raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON); // IXON关闭ctrl s/q，前者用于软件流控制，后者组织数据传输到中断,ICRNL关闭终端将用户输入的任何回车符转换为换行符，BRKINT开启时，一个终端条件将导致向程序发送一个SIGINT信号，就像按下ctrl-c键，INPCK启用奇偶检验，似乎不适用于现代终端仿真器，ISTRIP会导致每个输入字节的第8位被移除
-  raw.c_oflag &= ~(OPOST);                                  // 关闭OPOST标志来关闭所有输出处理功能
-  raw.c_cflag |= (CS8);                                     // 掩码，将字符大小（CS）设置为梅子姐8位
-  raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);          // 将修改后的结构体传递给tcsetarr()以新的中断属性协会,关闭规范模式，诸子皆读取输入,ISIG关闭两个信号，SIGINT和SIGTSTP导致终止和挂起，ctrl c/z
-  raw.c_cc[VMIN] = 0;
-  raw.c_cc[VTIME] = 1;
-  if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == -1)
-    die("tcsetattr"); // 将程序的标准输入设置为文本文件或管道而不是终端，尝试echo test | ./kilo
-}
-int editorReadKey()
-{ // 等待一个按键操作，并返回它，涉及读取表示单个按键操作的多字节,有许多没有处理的键转义序列，如F1-F12，忽略这些键
-  int nread;
-  char c;
-  while ((nread = read(STDIN_FILENO, &c, 1)) != 1)
-  {
-    if (nread == -1 && errno != EAGAIN)
-      die("read");
-  }
-  if (c == '\x1b')
-  { // 如果我们读取到一个转义字符，我们立即将两个额外的字节读入 seq 缓冲区。如果其中任何一个读取超时（0.1 秒后），那么我们假设用户只是按下了 Escape 键，并返回该键。否则，我们查看该转义序列是否是一个箭头键转义序列。如果是，我们只需返回相应的 w a s d 字符即可。如果不是我们认识的转义序列，我们只需返回转义字符。
-    char seq[3];
-    if (read(STDIN_FILENO, &seq[0], 1) != 1)
-      return '\x1b';
-    if (read(STDIN_FILENO, &seq[1], 1) != 1)
-      return '\x1b';
-    if (seq[0] == '[')
-    {
-      if (seq[1] >= '0' && seq[1] <= '9')
-      {
-        if (read(STDIN_FILENO, &seq[2], 1) != 1)
-          return '\x1b';
-        if (seq[2] == '~')
-        {
-          switch (seq[1])
-          {
-          case '1':
-            return HOME_KEY;
-          case '3':
-            return DEL_KEY;
-          case '4':
-            return END_KEY;
-          case '5':
-            return PAGE_UP;
-          case '6':
-            return PAGE_DOWN;
-          case '7':
-            return HOME_KEY;
-          case '8':
-            return END_KEY;
-          }
-        }
-      }
-      else
-      {
-        switch (seq[1])
-        {
-        case 'A':
-          return ARROW_UP;
-        case 'B':
-          return ARROW_DOWN;
-        case 'C':
-          return ARROW_RIGHT;
-        case 'D':
-          return ARROW_LEFT;
-        case 'H':
-          return HOME_KEY;
-        case 'F':
-          return END_KEY;
-        }
-      }
-    }
-    else if (seq[0] == '0')
-    {
-      switch (seq[1])
-      {
-      case 'H':
-        return HOME_KEY;
-      case 'F':
-        return END_KEY;
-      }
-    }
-    return '\x1b';
-  }
-  else
-  {
-    return c;
-  }
-}
-int getCursorPosition(int *rows, int *cols)
-{ // 获取光标位置，n查询终端的状态信息
-  char buf[32];
-  unsigned int i = 0;
-  if (write(STDOUT_FILENO, "\x1b[6n", 4) != 4)
-    return -1;
-  while (i < sizeof(buf) - 1)
-  {
-    if (read(STDIN_FILENO, &buf[i], 1) != 1)
-      break;
-    if (buf[i] == 'R')
-      break;
-    i++;
-  }
-  buf[i] = '\0';
-  if (buf[0] != '\x1b' || buf[1] != '[')
-    return -1;
-  if (sscanf(&buf[2], "%d;%d", rows, cols) != 2)
-    return -1;
-  return 0;
-}
-int getWindowSize(int *rows, int *cols)
-{
-  struct winsize ws;
-
-  if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == -1 || ws.ws_col == 0)
-  {
-    if (write(STDOUT_FILENO, "\x1b[999C\x1b[999B", 12) != 12)
-      return -1;
-    return getCursorPosition(rows, cols); // ioctl()将终端的列数和行数放入指定的winsize结构体中，没有简单的将光标移动到右下角的命令
-  }
-  else
-  {
-    *cols = ws.ws_col;
-    *rows = ws.ws_row;
-    return 0;
-  }
-}
-/*** syntax highlighting***/
-int is_separator(int c)
-{
-  return isspace(c) || c == '\0' || strchr(",.()+-/*=~%<>[];", c) != NULL; // 接受一个字符，如果被认为是分隔符，则返回true
-}
-void editorUpdateSyntax(erow *row)
-{
-  row->hl = realloc(row->hl, row->rsize);
-  memset(row->hl, HL_NORMAL, row->rsize);
-  if (E.syntax == NULL)
-    return;
-  char **keywords = E.syntax->keywords;
-  char *scs = E.syntax->singleline_comment_start;
-  char *mcs = E.syntax->multiline_comment_start;
-  char *mce = E.syntax->multiline_comment_end;
-  int scs_len = scs ? strlen(scs) : 0;
-  int mcs_len = mcs ? strlen(mcs) : 0;
-  int mce_len = mce ? strlen(mce) : 0;
-  int prev_sep = 1;  // 用于跟踪前一个字符是否是分隔符,假定行首是一个分隔符
-  int in_string = 0; // 用于跟踪是否在字符串中
-  int in_comment = (row->idx > 0 && E.row[row->idx - 1].hl_open_comment);
-
-  int i = 0;
-  while (i < row->rsize) // 每次迭代消费多个字符
-  {
-    char c = row->render[i];
-    unsigned char prev_hl = (i > 0) ? row->hl[i - 1] : HL_NORMAL; // 保存前一个字符的高亮
-    if (scs_len && !in_string && !in_comment)                     // 如果不在字符串中，
-    {
-      if (!strncmp(&row->render[i], scs, scs_len)) // 那么检查是否是注释的开始
-      {
-        memset(&row->hl[i], HL_COMMENT, row->rsize - i); // 如果是注释的开始，那么将剩余的行设置为注释高亮
-        break;
-      }
-    }
-
-    if (mcs_len && mce_len && !in_string) // 确保不在字符串中
-    {
-      if (in_comment)
-      {
-        row->hl[i] = HL_MLCOMMENT;
-        if (!strncmp(&row->render[i], mce, mce_len))
-        {
-          memset(&row->hl[i], HL_MLCOMMENT, mce_len);
-          i += mce_len;
-          in_comment = 0;
-          prev_sep = 1;
-          continue;
-        }
-        else
-        {
-          i++;
-          continue;
-        }
-      }
-      else if (!strncmp(&row->render[i], mcs, mcs_len))
-      {
-        memset(&row->hl[i], HL_MLCOMMENT, mcs_len);
-        i += mcs_len;
-        in_comment = 1;
-        continue;
-      }
-    }
-    if (E.syntax->flags & HL_HIGHLIGHT_STRINGS)
-    {
-      if (in_string)
-      {
-        row->hl[i] = HL_STRING;              // 如果在字符串中，那么将当前字符设置为字符串高亮
-        if (c == '\\' && i + 1 < row->rsize) // 考虑转义字符，如果出现\'或\"，那么将下一个字符设置为字符串高亮
-
-        {
-          row->hl[i + 1] = HL_STRING;
-          i += 2;
-          continue;
-        }
-        if (c == in_string)
-          in_string = 0;
-        i++;
-        prev_sep = 1;
-        continue;
-      }
-      else // 如果不在字符串中，那么检查是否是字符串的开始，通过检查双引号或单引号
-      {
-        if (c == '"' || c == '\'')
-        {
-          in_string = c;
-          row->hl[i] = HL_STRING;
-          i++;
-          continue;
-        }
-      }
-    }
-    if (E.syntax->flags & HL_HIGHLIGHT_NUMBERS) // 用if语句包裹了数字高亮代码，以检查当前文件类型是否应该高亮显示数字
-    {
-      if ((isdigit(c) && (prev_sep || prev_hl == HL_NUMBER)) || (c == '.' && prev_hl == HL_NUMBER)) // 如果前一个字符是分隔符或者前一个字符是数字，那么这个字符是数字,增加支持高亮显示包含小数点的数字
-      {
-        row->hl[i] = HL_NUMBER; // 设置高亮
-        i++;
-        prev_sep = 0; // 如果是数字，那么检查下一个字符
-        continue;
-      }
-    }
-    if (prev_sep) // 如果前一个字符是分隔符，那么检查是否是关键字,关键词前后都需要右分隔符，否则，avoid,voided,voided,avoided中的void将被突出显示为关键词
-    {
-      int j;
-      for (j = 0; keywords[j]; j++)
-      {
-        int klen = strlen(keywords[j]);
-        int kw2 = keywords[j][klen - 1] == '|';
-        if (kw2)
-          klen--;
-        if (!strncmp(&row->render[i], keywords[j], klen) &&
-            is_separator(row->render[i + klen]))
-        {
-          memset(&row->hl[i], kw2 ? HL_KEYWORD2 : HL_KEYWORD1, klen);
-          i += klen;
-          break;
-        }
-      }
-      if (keywords[j] != NULL)
-      {
-        prev_sep = 0;
-        continue;
-      }
-    }
-
-    prev_sep = is_separator(c); // 如果不是数字，那么检查是否是分隔符
-    i++;
-  }
-  int changed = (row->hl_open_comment != in_comment);
-  row->hl_open_comment = in_comment;
-  if (changed && row->idx + 1 < E.numrows)
-    editorUpdateSyntax(&E.row[row->idx + 1]);
-}
-int editorSyntaxToColor(int hl)
-{
-  switch (hl)
-  {
-  case HL_COMMENT:
-  case HL_MLCOMMENT:
-    return 36; // 评论着色为青色
-  case HL_KEYWORD1:
-    return 33; // 关键字着色为黄色
-  case HL_KEYWORD2:
-    return 32; // 类型着色为绿色
-  case HL_STRING:
-    return 35; // 字符串着色为紫色
-  case HL_NUMBER:
-    return 31; // 数字着色为红色
-  case HL_MATCH:
-    return 34; // 搜索结果，蓝色
-  default:
-    return 37; // 默认颜色foreground
-  }
-}
-void editorSelectSyntaxHighlight() // 将当前文件名与HLDB中的filematch字段之一进行匹配，如果匹配成功，将E.syntax设置为该文件类型
-{
-  E.syntax = NULL;
-  if (E.filename == NULL)
-    return;
-  // char *ext = strrchr(E.filename, '.'); // 查找.字符的最后出现设置，从而获得文件扩展部分的指针，没有扩展名，则ext将是NULL
-  for (unsigned int j = 0; j < HLDB_ENTRIES; j++)
-  {
-    struct editorSyntax *s = &HLDB[j];
-    unsigned int i = 0;
-    while (s->filematch[i])
-    {
-      // int is_ext = (s->filematch[i][0] == '.');
-      char *p = strstr(E.filename, s->filematch[i]);
-      if (p != NULL)
-      {
-        int patlen = strlen(s->filematch[i]); // 文件名长度
-        // if ((is_ext && ext && !strcmp(ext, s->filematch[i])) ||(!is_ext && strstr(E.filename, s->filematch[i]))) // 使用strcmp()查看文件名是否以该扩展名结尾{
-        if (s->filematch[i][0] != '.' || p[patlen] == '\0')
-        {
-          E.syntax = s;
-          int filerow;
-          for (filerow = 0; filerow < E.numrows; filerow++)
-          {
-            editorUpdateSyntax(&E.row[filerow]);
-          }
-          return;
-        }
-      }
-      i++;
-    }
-  }
-}
-/*** row operations ***/
-int editorRowCxToRx(erow *row, int cx)
-{
-  int rx = 0;
-  int j;
-  for (j = 0; j < cx; j++)
-  {
-    if (row->chars[j] == '\t')
-      rx += (KILO_TAB_STOP - 1) - (rx % KILO_TAB_STOP);
-    rx++;
-  }
-  return rx;
-}
-int editorRowRxToCx(erow *row, int rx) // 将rx转换为cx
-{
-  int cur_rx = 0;
-  int cx;
-  for (cx = 0; cx < row->size; cx++)
-  {
-    if (row->chars[cx] == '\t')
-      cur_rx += (KILO_TAB_STOP - 1) - (cur_rx % KILO_TAB_STOP);
-    cur_rx++;
-    if (cur_rx > rx)
-      return cx;
-  }
-  return cx;
-}
-void editorUpdateRow(erow *row) // 从chars复制每个字符到render
-{
-  int tabs = 0;
-  int j;
-  for (j = 0; j < row->size; j++)
-    if (row->chars[j] == '\t')
-      tabs++;
-  free(row->render);
-  row->render = malloc(row->size + tabs * (KILO_TAB_STOP - 1) + 1); // 为每个制表符分配7个空间
-  int idx = 0;
-  for (j = 0; j < row->size; j++)
-  {
-    if (row->chars[j] == '\t')
-    {
-      row->render[idx++] = ' ';
-      while (idx % KILO_TAB_STOP != 0)
-        row->render[idx++] = ' ';
-    }
-    else
-    {
-      row->render[idx++] = row->chars[j];
-    }
-  }
-  row->render[idx] = '\0';
-  row->rsize = idx;
-
-  editorUpdateSyntax(row);
-}
-
-void editorInsertRow(int at, char *s, size_t len)
-{
-  if (at < 0 || at > E.numrows)
-    return;
-  E.row = realloc(E.row, sizeof(erow) * (E.numrows + 1));               // 重新分配内存以容纳新行
-  memmove(&E.row[at + 1], &E.row[at], sizeof(erow) * (E.numrows - at)); // 将新行插入到行数组的末尾
-  // int at = E.numrows;
-  for (int j = at + 1; j <= E.numrows; j++)
-    E.row[j].idx++;
-  E.row[at].idx = at;
-  E.row[at].size = len;              // 将新行插入到行数组的末尾
-  E.row[at].chars = malloc(len + 1); // 为新行分配内存
-  memcpy(E.row[at].chars, s, len);   // 将新行复制到新分配的内存中
-  E.row[at].chars[len] = '\0';
-  E.row[at].rsize = 0;
-  E.row[at].render = NULL;
-  E.row[at].hl = NULL;
-  E.row[at].hl_open_comment = 0;
-  editorUpdateRow(&E.row[at]);
-  E.numrows++;
-  E.dirty++;
-}
-void editorFreeRow(erow *row) // 释放删除的erow所拥有的内存
-{
-  free(row->render);
-  free(row->chars);
-  free(row->hl);
-}
-void editorDelRow(int at) // 行首退格，将当前行的内容追加到上一行，然后删除
-{
-  if (at < 0 || at >= E.numrows)
-    return;
-  editorFreeRow(&E.row[at]);
-  memmove(&E.row[at], &E.row[at + 1], sizeof(erow) * (E.numrows - at - 1));
-  for (int j = at; j < E.numrows - 1; j++)
-    E.row[j].idx--;
-  E.numrows--;
-  E.dirty++;
-}
-void editorRowInsertChar(erow *row, int at, int c) // 在指定位置将单个字符插入到erow
-{
-  if (at < 0 || at > row->size)
-    at = row->size;
-  row->chars = realloc(row->chars, row->size + 2);
-  memmove(&row->chars[at + 1], &row->chars[at], row->size - at + 1);
-  row->size++;
-  row->chars[at] = c;
-  editorUpdateRow(row);
-  E.dirty++;
-}
-void editorRowAppendString(erow *row, char *s, size_t len)
-{
-  row->chars = realloc(row->chars, row->size + len + 1);
-  memcpy(&row->chars[row->size], s, len);
-  row->size += len;
-  row->chars[row->size] = '\0';
-  editorUpdateRow(row);
-  E.dirty++;
-}
-void editorRowDelChar(erow *row, int at) // 删除左侧的字符
-{
-  if (at < 0 || at >= row->size)
-    return;
-  memmove(&row->chars[at], &row->chars[at + 1], row->size - at);
-  row->size--;
-  editorUpdateRow(row);
-  E.dirty++;
-}
-void editorInsertChar(int c)
-{
-  if (E.cy == E.numrows)
-  { // 在文件末尾插入新行
-    editorInsertRow(E.numrows, "", 0);
-  }
-  editorRowInsertChar(&E.row[E.cy], E.cx, c);
-  E.cx++;
-}
-void editorInsertNewline()
-{ // 处理enter键
-  if (E.cx == 0)
-  {
-    editorInsertRow(E.cy, "", 0);
-  }
-  else
-  {
-    erow *row = &E.row[E.cy];
-    editorInsertRow(E.cy + 1, &row->chars[E.cx], row->size - E.cx);
-    row = &E.row[E.cy];
-    row->size = E.cx;
-    row->chars[row->size] = '\0';
-    editorUpdateRow(row);
-  }
-  E.cy++;
-  E.cx = 0;
-}
-void editorDelChar()
-{
-  if (E.cy == E.numrows)
-    return; // 如果光标已经超过文件末尾，那么就没有东西可以删除了，就立即return
-  if (E.cx == 0 && E.cy == 0)
-    return; // 如果光标在文件的开头，那么就没有东西可以删除了，就立即return
-  erow *row = &E.row[E.cy];
-  if (E.cx > 0)
-  {
-    editorRowDelChar(row, E.cx - 1);
-    E.cx--;
-  }
-  else
-  {
-    E.cx = E.row[E.cy - 1].size;
-    editorRowAppendString(&E.row[E.cy - 1], row->chars, row->size);
-    editorDelRow(E.cy);
-    E.cy--;
-  }
-}
-
-/*** file i/o ***/
-char *editorRowsToString(int *buflen)
-{ // 将E.row中的所有行连接成一个单独的字符串，以便将其写入磁盘
-  int totlen = 0;
-  int j;
-  for (j = 0; j < E.numrows; j++)
-    totlen += E.row[j].size + 1;
-  *buflen = totlen; // 将每行文本的长度相加，为每行添加一个换行符1，将总长度保存到buflen中
-  char *buf = malloc(totlen);
-  char *p = buf;
-  for (j = 0; j < E.numrows; j++)
-  {
-    memcpy(p, E.row[j].chars, E.row[j].size); // 在分配所需的内存之后，遍历行，并将每行的内容memcpy()到缓冲区的末尾
-    p += E.row[j].size;
-    *p = '\n';
-    p++;
-  }
-  return buf;
-}
-
-void editorOpen(char *filename)
-{
-  free(E.filename);
-  E.filename = strdup(filename); // 将文件名复制到E.filename中
-  editorSelectSyntaxHighlight();
-  FILE *fp = fopen(filename, "r");
-  if (!fp)
-    die("fopen");
-  char *line = NULL;
-  size_t linecap = 0;
-  ssize_t linelen;
-  while ((linelen = getline(&line, &linecap, fp)) != -1)
-  { // 将整个文件读取到E.row中
-    while (linelen > 0 && (line[linelen - 1] == '\n' ||
-                           line[linelen - 1] == '\r'))
-      linelen--;
-    // editorAppendRow(line, linelen);
-    editorInsertRow(E.numrows, line, linelen);
-  }
-  free(line);
-  fclose(fp);
-  E.dirty = 0; // 重置文件状态
-}
-void editorSave()
-{
-  if (E.filename == NULL)
-  {
-    E.filename = editorPrompt("Save as: %s (ESC to cancel)", NULL); // windows的bash需要按三次escape,将NULL传递给editorpormpt()以防不想使用回调
-    if (E.filename == NULL)
-    {
-      editorSetStatusMessage("Save aborted");
-      return;
-    }
-    editorSelectSyntaxHighlight();
-  }
-  int len;
-  char *buf = editorRowsToString(&len);
-  int fd = open(E.filename, O_RDWR | O_CREAT, 0644);
-  if (fd != -1)
-  { // 添加错误处理
-    if (ftruncate(fd, len) != -1)
-    {
-      if (write(fd, buf, len) == len)
-      {
-
-        close(fd);
-        free(buf);
-        E.dirty = 0;
-        editorSetStatusMessage("%d bytes written to disk", len);
-        return;
-      }
-    }
-    close(fd);
-  }
-  free(buf);
-  editorSetStatusMessage("Can't save! I/O error: %s", strerror(errno)); // 通知消息，是否保存成功
-}
-
-/*** find ***/
-void editorFindCallback(char *query, int key)
-{
-  static int last_match = -1; //-1向后搜索
-  static int direction = 1;   // 1向前搜索
-  static int saved_hl_line;
-  static char *saved_hl = NULL;
-  if (saved_hl)
-  {
-    memcpy(E.row[saved_hl_line].hl, saved_hl, E.row[saved_hl_line].rsize);
-    free(saved_hl);
-    saved_hl = NULL;
-  }
-  if (key == '\r' || key == '\x1b') // \r是enter键，\x1b是escape,按下这两个键意味着即将离开搜索模式
-  {
-    last_match = -1;
-    direction = 1;
-    return;
-  }
-  else if (key == ARROW_RIGHT || key == ARROW_DOWN)
-  {
-    direction = 1;
-  }
-  else if (key == ARROW_LEFT || key == ARROW_UP)
-  {
-    direction = -1;
-  }
-  else
-  {
-    last_match = -1;
-    direction = 1;
-  }
-  if (last_match == -1)
-    direction = 1;
-  int current = last_match; // 当前索引为current，找到匹配项时将last_match设置为current,这样如果用户按下箭头键，我们将从该店开始下一次搜索
-  int i;
-  for (i = 0; i < E.numrows; i++)
-  {
-    current += direction;
-    if (current == -1)
-      current = E.numrows - 1;
-    else if (current == E.numrows)
-      current = 0;
-    erow *row = &E.row[current];
-    char *match = strstr(row->render, query);
-    if (match)
-    {
-      last_match = current;
-      E.cy = current;
-      E.cx = editorRowRxToCx(row, match - row->render);
-      E.rowoff = E.numrows;
-
-      saved_hl_line = current;       // 静态变量，知道哪一行的hl需要恢复
-      saved_hl = malloc(row->rsize); // 动态分配的数组，没有需要恢复的内容时，指向NULL
-      memcpy(saved_hl, row->hl, row->rsize);
-      memset(&row->hl[match - row->render], HL_MATCH, strlen(query));
-      break;
-    }
-  }
-}
-void editorFind()
-{
-  int saved_cx = E.cx; // 保存为了后序搜索取消后恢复这些值
-  int saved_cy = E.cy;
-  int saved_coloff = E.coloff;
-  int saved_rowoff = E.rowoff;
-
-  char *query = editorPrompt("Search: %s (Use ESC/aRROWS/Enter)", editorFindCallback);
-  if (query)
-  {
-    free(query);
-  }
-  else
-  { // 如果query等于NULL,等于他们按了Escape，恢复保存的值
-    E.cx = saved_cx;
-    E.cy = saved_cy;
-    E.coloff = saved_coloff;
-    E.rowoff = saved_rowoff;
-  }
-}
-
-/*** append buffer ***/
-struct abuf
-{
-  char *b;
-  int len;
-};
-
-#define ABUF_INIT {NULL, 0}
-
-void abAppend(struct abuf *ab, const char *s, int len)
-{
-  char *new = realloc(ab->b, ab->len + len); // 请求realloc()给我们一块内存，大小位当前字符串的大小加上要追加的字符串大小
-
-  if (new == NULL)
-    return;
-  memcpy(&new[ab->len], s, len); // 赋值缓冲区当前数据末尾的字符串s，并更新abuf的指针和长度到新值
-  ab->b = new;
-  ab->len += len;
-}
-void abFree(struct abuf *ab)
-{ // 释放由abuf使用的动态内存
-  free(ab->b);
-}
-/*** output ***/
-void editorScroll()
-{
-  E.rx = 0;
-  if (E.cy < E.numrows)
-  {
-    E.rx = editorRowCxToRx(&E.row[E.cy], E.cx);
-  } // 设置E.rx为光标所在行的渲染偏移量
-  if (E.cy < E.rowoff) // 水平滚动，检查光标是否在可见窗口上发过，如果是，则向上滚动到光标位置
-  {
-    E.rowoff = E.cy;
-  }
-  if (E.cy >= E.rowoff + E.screenrows) // 检查光标是否在可见窗口底部
-  {
-    E.rowoff = E.cy - E.screenrows + 1;
-  }
-  if (E.rx < E.coloff) // 垂直滚动
-  {
-    E.coloff = E.rx;
-  }
-  if (E.rx >= E.coloff + E.screencols)
-  {
-    E.coloff = E.rx - E.screencols + 1;
-  }
-}
-void editorDrawRows(struct abuf *ab)
-{
-  int y;
-  for (y = 0; y < E.screenrows; y++)
-  {
-    int filerow = y + E.rowoff; // 将屏幕行号转换为文本缓冲区行号
-    if (filerow >= E.numrows)   // 检查是否正在绘制属于文本缓冲区的行，或者是否正在绘制文本缓冲区结束后的行
-    {
-      if (E.numrows == 0 && y == E.screenrows / 3) // 待定，欢迎信息仅在用户不带参数启动程序时显示，而不是在打开文件时显示，以为欢迎信息可能会妨碍文件显示
-      {
-        char welcome[80];
-        int welcomelen = snprintf(welcome, sizeof(welcome),
-                                  "Kilo editor -- version %s", KILO_VERSION); // 欢迎信息
-        if (welcomelen > E.screencols)
-          welcomelen = E.screencols;
-        int padding = (E.screencols - welcomelen) / 2; // 居中
-        if (padding)
-        {
-          abAppend(ab, "~", 1);
-          padding--;
-        }
-        while (padding--)
-          abAppend(ab, " ", 1);
-        abAppend(ab, welcome, welcomelen);
-      }
-      else
-      {
-        abAppend(ab, "~", 1);
-      }
-    }
-    else
-    { // 确保不会超出屏幕的末尾
-      int len = E.row[filerow].rsize - E.coloff;
-      if (len < 0)
-        len = 0;
-      if (len > E.screencols)
-        len = E.screencols;
-      char *c = &E.row[filerow].render[E.coloff];
-      unsigned char *hl = &E.row[filerow].hl[E.coloff];
-      int current_color = -1; //-1是默认颜色
-      int j;
-      for (j = 0; j < len; j++)
-      {
-        if (iscntrl(c[j]))
-        {
-          char sym = (c[j] <= 26) ? '@' + c[j] : '?';
-          abAppend(ab, "\x1b[7m", 4);
-          abAppend(ab, &sym, 1);
-          abAppend(ab, "\x1b[m", 3);
-          if (current_color != -1)
-          {
-            char buf[16];
-            int clen = snprintf(buf, sizeof(buf), "\x1b[%dm", current_color); // 打印当前颜色的转移序列
-            abAppend(ab, buf, clen);
-          }
-        }
-        else if (hl[j] == HL_NORMAL)
-        { // 如果当前字符是控制字符，那么我们将其显示为问号，否则我们将其显示为@加上字符的ASCII值
-          if (current_color != -1)
-          {
-            abAppend(ab, "\x1b[39m", 5);
-            current_color = -1;
-          }
-          abAppend(ab, &c[j], 1);
-        }
-        else
-        {
-          int color = editorSyntaxToColor(hl[j]);
-          if (color != current_color)
-          {
-            current_color = color;
-            char buf[16];
-            int clen = snprintf(buf, sizeof(buf), "\x1b[%dm", color);
-            abAppend(ab, buf, clen);
-          }
-          abAppend(ab, &c[j], 1);
-        }
-      }
-      abAppend(ab, "\x1b[39m", 5);
-    }
-
-    abAppend(ab, "\x1b[K", 3); // K逐行删除
-                               // if (y < E.screenrows - 1)
-    //{
-    abAppend(ab, "\r\n", 2); // 最后一行不打印""\r\n
-  }
-  // }
-}
-
-void editorDrawStatusBar(struct abuf *ab) // 状态栏反转颜色
-{
-  abAppend(ab, "\x1b[7m", 4);
-  char status[80], rstatus[80];
-  int len = snprintf(status, sizeof(status), "%.20s - %d lines %s",
-                     E.filename ? E.filename : "[No Name]", E.numrows,
-                     E.dirty ? "(modified)" : ""); // 状态栏显示文件修改状态，通过在文件名后显示 (modified) 来展示 E.dirty 的状态。
-  int rlen = snprintf(rstatus, sizeof(rstatus), "%s | %d/%d",
-                      E.syntax ? E.syntax->filetype : "no ft", E.cy + 1, E.numrows);
-  if (len > E.screencols)
-    len = E.screencols;
-  abAppend(ab, status, len); // 显示文件名前20个字符和行数，如果没有文件名则显示[No Name]
-  while (len < E.screencols)
-  {
-    if (E.screencols - len == rlen)
-    {
-      abAppend(ab, rstatus, rlen);
-      break;
-    }
-    else
-    {
-      abAppend(ab, " ", 1);
-      len++;
-    }
-  }
-  abAppend(ab, "\x1b[m", 3);
-  abAppend(ab, "\r\n", 2); // 状态栏下一行留出空间显示消息
-}
-void editorDrawMessageBar(struct abuf *ab)
-{
-  abAppend(ab, "\x1b[K", 3);
-  int msglen = strlen(E.statusmsg);
-  if (msglen > E.screencols)
-    msglen = E.screencols;
-  if (msglen && time(NULL) - E.statusmsg_time < 5)
-    abAppend(ab, E.statusmsg, msglen);
-}
-void editorRefreshScreen()
-{
-  editorScroll();
-  struct abuf ab = ABUF_INIT;    // 初始化一个新的abuf，称为ab，替换所有WRITE为abAppend
-  abAppend(&ab, "\x1b[?25l", 6); // 重置模式
-  // \x1b是住哪一字符,J命令清楚屏幕，参数是2，表示清楚整个屏幕，<esc>[1J 将清除屏幕到光标处，而 <esc>[0J 将清除从光标到屏幕末尾的屏幕。此外， 0 是 J 的默认参数，因此仅使用 <esc>[J 本身也会清除从光标到屏幕末尾的屏幕。
-  abAppend(&ab, "\x1b[H", 3); // 重新定位光标到屏幕左上角
-  editorDrawRows(&ab);
-  editorDrawStatusBar(&ab);
-  editorDrawMessageBar(&ab);
-
-  char buf[32];
-  snprintf(buf, sizeof(buf), "\x1b[%d;%dH", (E.cy - E.rowoff) + 1, (E.rx - E.coloff) + 1); // E.cy不再指向屏幕上光标位置，而是光标在文本文件中的位置
-  abAppend(&ab, buf, strlen(buf));
-  // abAppend(&ab, "\x1b[H", 3);    // 绘制完成后，重新定位光标到屏幕左上角
-  abAppend(&ab, "\x1b[?25h", 6); // 设置模式
-  write(STDOUT_FILENO, ab.b, ab.len);
-  abFree(&ab);
-}
-void editorSetStatusMessage(const char *fmt, ...)
-{
-  va_list ap;
-  va_start(ap, fmt);
-  vsnprintf(E.statusmsg, sizeof(E.statusmsg), fmt, ap);
-  va_end(ap);
-  E.statusmsg_time = time(NULL);
-}
-
-/*** input ***/
-char *editorPrompt(char *prompt, void (*callback)(char *, int)) // 提示用户在保存新文件是输入文件名，在状态栏中显示提示，允许用户在提示后输入一行文本
-{
-  size_t bufsize = 128;
-  char *buf = malloc(bufsize);
-  size_t buflen = 0;
-  buf[0] = '\0';
-  while (1)
-  {
-    editorSetStatusMessage(prompt, buf);
-    editorRefreshScreen();
-    int c = editorReadKey();
-    if (c == DEL_KEY || c == CTRL_KEY('h') || c == BACKSPACE) // 允许在输入提示中按下backspace
-    {
-      if (buflen != 0)
-        buf[--buflen] = '\0';
-    }
-    else if (c == '\x1b')
-    {
-
-      editorSetStatusMessage("");
-      if (callback)
-        callback(buf, c);
-      free(buf);
-      return NULL;
-    }
-    else if (c == '\r')
-    {
-      if (buflen != 0)
-      {
-        editorSetStatusMessage("");
-        if (callback)
-          callback(buf, c);
-        return buf;
-      }
-    }
-    else if (!iscntrl(c) && c < 128)
-    {
-      if (buflen == bufsize - 1)
-      {
-        bufsize *= 2;
-        buf = realloc(buf, bufsize);
-      }
-      buf[buflen++] = c;
-      buf[buflen] = '\0';
-    }
-    if (callback)
-      callback(buf, c);
-  } //??
-}
-void editorMoveCursor(int key)
-{
-  erow *row = (E.cy >= E.numrows) ? NULL : &E.row[E.cy]; // 由于 E.cy 允许位于文件最后一行之后，我们使用三元运算符来检查光标是否位于实际行上。如果是，则 row 变量将指向光标所在的 erow ，在我们允许光标向右移动之前，我们会检查 E.cx 是否位于该行末尾的左侧。
-  switch (key)
-  {
-  case ARROW_LEFT:
-    if (E.cx != 0)
-    {
-      E.cx--;
-    }
-    else if (E.cy > 0)
-    {
-      E.cy--;
-      E.cx = E.row[E.cy].size; // 允许用户在行首按下左箭头移动到上一行的末尾
-    }
-    break;
-  case ARROW_RIGHT:
-    // if (E.cx != E.screencols - 1)//允许滚动到右侧
-    //{
-    // E.cx++;
-    //}
-    if (row && E.cx < row->size)
-    {
-      E.cx++;
-    }
-    else if (row && E.cx == row->size)
-    {
-      E.cy++;
-      E.cx = 0;
-    }
-    break;
-  case ARROW_UP:
-    if (E.cy != 0)
-    {
-      E.cy--;
-    }
-    break;
-  case ARROW_DOWN:
-    if (E.cy < E.numrows)
-    {
-      E.cy++;
-    }
-    break;
-  }
-  // 纠正如果最终超出了所在行的末尾情况
-  row = (E.cy >= E.numrows) ? NULL : &E.row[E.cy];
-  int rowlen = row ? row->size : 0;
-  if (E.cx > rowlen)
-  {
-    E.cx = rowlen;
-  }
-}
-void editorProcessKeypress()
-{ // 等待按键，将把各种ctrl键组合和其他特殊键映射到不同的编辑器功能，并将任何字母数字和其他可打印键的字符插入到正在编辑的文本中
-  static int quit_times = KILO_QUIT_TIMES;
-  int c = editorReadKey();
-  switch (c)
-  {
-  case '\r':
-    editorInsertNewline();
-    break;
-  case CTRL_KEY('q'):
-    if (E.dirty && quit_times > 0)
-    {
-      editorSetStatusMessage("WARNING!!! File has unsaved changes. "
-                             "Press Ctrl-Q %d more times to quit.",
-                             quit_times);
-      quit_times--;
-      return;
-    }
-    write(STDOUT_FILENO, "\x1b[2J", 4);
-    write(STDOUT_FILENO, "\x1b[H", 3);
-    exit(0);
-    break;
-  case CTRL_KEY('S'):
-    editorSave();
-    break;
-  case HOME_KEY:
-    E.cx = 0;
-    break;
-  case END_KEY:
-    if (E.cy < E.numrows)
-      E.cx = E.row[E.cy].size;
-    break;
-  case CTRL_KEY('f'): // 搜索
-    editorFind();
-    break;
-  case BACKSPACE:
-  case CTRL_KEY('h'):
-  case DEL_KEY:
-    if (c == DEL_KEY)
-      editorMoveCursor(ARROW_RIGHT);
-    editorDelChar();
-    break;
-  case PAGE_UP:
-  case PAGE_DOWN:
-  {
-    if (c == PAGE_UP)
-    {
-      E.cy = E.rowoff;
-    }
-    else if (c == PAGE_DOWN)
-    {
-      E.cy = E.rowoff + E.screenrows - 1;
-      if (E.cy > E.numrows)
-        E.cy = E.numrows;
-    }
-    int times = E.screenrows;
-    while (times--)
-      editorMoveCursor(c == PAGE_UP ? ARROW_UP : ARROW_DOWN);
-  }
-  break;
-
-  case ARROW_UP:
-  case ARROW_DOWN:
-  case ARROW_LEFT:
-  case ARROW_RIGHT:
-    editorMoveCursor(c);
-    break;
-
-  case CTRL_KEY('l'):
-  case '\x1b':
-    break;
-
-  default:
-    editorInsertChar(c);
-    break;
-  }
-  quit_times = KILO_QUIT_TIMES; // 当按下除ctrl_q之外的任何键时，重置退出次数
-}
-
-void initEditor()
-{
-  E.cx = 0; // 光标水平，列
-  E.cy = 0; // 光标垂直，行
-  E.rx = 0;
-  E.rowoff = 0; // 默认情况下将滚动到文件顶部
-  E.coloff = 0;
-  E.numrows = 0;
-  E.row = NULL;
-  E.dirty = 0;
-  E.filename = NULL;
-  E.statusmsg[0] = '\0';
-  E.statusmsg_time = 0;
-  E.syntax = NULL;
-
-  if (getWindowSize(&E.screenrows, &E.screencols) == -1)
-    die("getWindowSize");
-  E.screenrows -= 2; // 空出两行显示状态栏和消息
-}
-int main(int argc, char *argv[])
-{
-  enableRawMode();
-  initEditor(); // 初始化E结构体中的所有字段
-  if (argc >= 2)
-  {
-    editorOpen(argv[1]);
-  }
-  editorSetStatusMessage("HELP: Ctrl-S = save | Ctrl-Q = quit | Ctrl-F = find");
-  while (1)
-  {
-    editorRefreshScreen();
-    editorProcessKeypress();
-  }
-
-  return 0;
-}
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*** defines ***/
+#define KILO_VERSION "0.0.1"
+#define KILO_TAB_STOP 8   // 制表符大小
+#define KILO_QUIT_TIMES 3 // 退出次数为3才能不保存退出
+#define KILO_UNDO_LEVELS 1000     // 最多保留的撤销步数
+#define KILO_PAR_MIN_ROWS 8192    // 行数超过该值时才启用多线程
+#define KILO_MAX_THREADS 16
+#define KILO_SAVE_CHUNK (1 << 20) // 后台保存每次write的字节数
+#define KILO_DRAW_CACHE (4 << 20) // 各行绘制缓存的总字节数超过该值时，清掉屏幕外的行
+#define KILO_FPS 60               // 默认的帧率上限，可用环境变量KILO_FPS修改，0表示不限
+#define KILO_IDLE_ROWS 2048       // 空闲时每一片预先高亮的行数
+#define KILO_IDLE_AHEAD 8         // 空闲时只高亮到视口以下这么多屏，更远的行翻到时再算
+#define KILO_LOAD_ROWS 16384      // 分片载入文件时每一片读入的行数
+#define KILO_INTERN_CHUNK (1 << 20) // 行池每次申请的块大小，超过四分之一块的行不去重
+#define KILO_ROW_MEM_MB 256         // 各行render、cells和高亮的默认内存预算，可用环境变量KILO_ROW_MEM（MB）修改
+#define KILO_FOLD_SCAN 100000       // 找花括号折叠范围时向上、向下最多扫描的行数
+#define KILO_WORD_MIN 3             // 补全索引只收至少这么长的标识符
+#define KILO_WORD_MAX 64            // 更长的不收
+#define KILO_WORD_ROWS 8192         // 空闲时每一片收录的行数
+#define KILO_WORD_INSERT 64         // 未排序的新词不超过这么多时逐个插入，否则归并
+#define KILO_WORD_CANDS 100         // 补全最多列出的候选数
+#define KILO_DIFF_DMAX 1024         // 一段Myers最多走的编辑步数，超过就按两边都只出现一次的行切开
+#define KILO_DIFF_COST (1 << 25)    // 一段Myers最多做的比较次数，约为(n+m)*D
+
+#define CTRL_KEY(k) ((k) & 0x1f)
+
+enum editorKey
+{
+  BACKSPACE = 127,
+  ARROW_LEFT = 1000,
+  ARROW_RIGHT,
+  ARROW_UP,
+  ARROW_DOWN,
+  DEL_KEY,
+  HOME_KEY,
+  END_KEY,
+  PAGE_UP,
+  PAGE_DOWN
+};
+enum editorHighlight
+{
+  HL_NORMAL = 0,
+  HL_COMMENT,
+  HL_MLCOMMENT,
+  HL_KEYWORD1,
+  HL_KEYWORD2,
+  HL_STRING,
+  HL_NUMBER,
+  HL_MATCH
+};
+#define HL_HIGHLIGHT_NUMBERS (1 << 0)
+#define HL_HIGHLIGHT_STRINGS (1 << 1)
+/*** data ***/
+struct editorSyntax
+{
+  char *filetype;
+  char **filematch;
+  char **keywords;
+  char *singleline_comment_start;
+  char *multiline_comment_start;
+  char *multiline_comment_end;
+  int flags;
+  struct hlmatcher *matcher; // 首次高亮时构建的字符分类表和关键字哈希
+};
+#define ROW_RENDER (1 << 0)       // render和cells过期
+#define ROW_HL (1 << 1)           // 高亮过期，或上一行的多行注释状态变了
+#define ROW_OPEN_COMMENT (1 << 2) // 行尾仍在多行注释中
+#define ROW_DRAWN (1 << 3)        // view->draw中缓存的终端字节仍然有效
+#define ROW_SHARED (1 << 4)       // chars在行池中，render、cells和hl也属于行池条目，不能原地修改或释放
+#define ROW_SHED (1 << 5)         // 超出内存预算时丢掉了render和hl，多行注释状态仍然有效，editorRowRender时一起重建
+#define ROW_WORDS (1 << 6)        // 这一行的标识符已计入补全索引
+#define ROW_FRESH (1 << 7)        // 后台保存开始后才复制出来的chars，不在快照里，可以原地修改
+#define ROW_DIRTY (ROW_RENDER | ROW_HL)
+#define ROW_INDEX(row) ((int)((row) - E.row)) // 行号由在E.row中的位置得出，插入删除时不用逐行改写
+struct cursor
+{
+  int cx, cy;
+};
+struct rowcell // 一个字素簇在chars和render中的起始偏移，以及它的起始显示列
+{
+  int cx;
+  int rb;
+  int col;
+};
+struct rowDraw // 一行按(coloff, cols)序列化好的终端字节
+{
+  char *b;
+  int len;
+  int cap;
+  int coloff, cols;
+};
+struct rowView // 渲染出来的部分：只有渲染过的行才有，丢掉时整个释放
+{
+  char *render;
+  unsigned char *hl;     // 0-255之间的整数，数组的每个值对应render中的一个字符，告诉用户该字符是否是字符串的一部分，或注释，或数字
+  struct rowcell *cells; // 含非ASCII字符的行才有，最后一项是行尾哨兵；纯ASCII行为NULL，此时列号等于render下标
+  int *wraps;            // 折行模式下每个屏幕行的起始显示列，纯ASCII行不需要
+  int rsize;
+  int ncells;
+  int nwraps;
+  int wrapw; // 计算wraps时的屏幕宽度，0表示需要重新计算
+  struct rowDraw draw;
+};
+typedef struct erow // 屏幕外的行只有chars、长度和标志，一行24字节；render、高亮和绘制缓存都在view里
+{
+  char *chars;
+  struct rowView *view; // NULL表示还没渲染或已经丢掉
+  int size;
+  unsigned char flags; // ROW_RENDER、ROW_HL、ROW_OPEN_COMMENT
+} erow; // 编辑行
+struct fold // 收起的折叠，首行start可见，(start, end]行隐藏
+{
+  int start, end;
+};
+struct foldRange // 合并后的隐藏区间[lo, hi]，before是之前各区间隐藏的行数
+{
+  int lo, hi;
+  int before;
+};
+struct undoLine
+{
+  char *chars;
+  int size;
+};
+struct undoEntry // 按行记录的修改：当前的[at, at+nnew)行原来是old中的nold行
+{
+  int at;
+  int nold;
+  int nnew;
+  struct undoLine *old;
+  int *from; // 非NULL时是重排：原来的第k行现在是第at+from[k]行，为-1时内容按顺序放在old中
+};
+struct undoGroup // 一次撤销恢复的所有修改
+{
+  struct undoEntry *e;
+  int n;
+  int cap;
+  int cx, cy; // 修改前的光标位置
+};
+struct undoStack
+{
+  struct undoGroup *g;
+  int n;
+  int cap;
+};
+struct textSpan // 剪切或复制的文本，各行以'\0'结尾连续存放；粘贴出的行直接指向其中，原地修改前才复制出来
+{
+  char *base;
+  size_t len;
+  long refs; // 指向其中的行数，加上剪贴板自己的一个
+};
+struct clipboard
+{
+  struct textSpan *span;
+  struct undoLine *lines; // 指向span中的各行
+  int n;
+};
+struct internLine // 行池中的一种行内容，后面紧跟size+1字节的chars；内容相同的行共用chars，也共用由它生成的render、cells和hl
+{
+  struct internLine *next; // 同一个哈希桶里的下一项
+  struct textSpan *span;   // 所在的块
+  char *render;            // 第一次显示时生成，NULL表示还没有
+  struct rowcell *cells;
+  unsigned char *hl[2];        // 行首不在/在多行注释中时的高亮，NULL表示还没算
+  struct editorSyntax *syntax; // hl是按哪个语法算的
+  unsigned int hash;
+  int size;
+  int rsize;
+  int ncells;
+  signed char open[2]; // 对应的行尾多行注释状态
+};
+struct internPool
+{
+  int on; // 设置了KILO_INTERN=1时，载入文件经过行池去重
+  struct internLine **buckets;
+  unsigned int mask;
+  struct textSpan *chunk; // 正在追加的块；行池一直持有每个块的一个引用，条目不会被释放
+  size_t used;
+  long rows;      // 经过行池载入的行数
+  long unique;    // 其中不同内容的种数
+  size_t bytes;   // 这些行的chars原本要占的字节数
+  size_t pooled;  // 行池中chars实际占的字节数
+};
+struct wordEntry // 补全索引中的一个词，后面紧跟len+1字节的内容
+{
+  struct wordEntry *next; // 同一个哈希桶里的下一项
+  unsigned int hash;
+  int len;
+  int count; // 在收录过的行里出现的次数，0表示已经没有了，等清理
+};
+struct wordIndex
+{
+  int on; // 设置KILO_WORDS=0时关闭
+  int from; // 这一行之前的行都已收录
+  struct wordEntry **buckets;
+  unsigned int mask;
+  struct wordEntry **sorted; // 全部条目，[0, nsorted)按字典序排好，之后是还没排的新词
+  size_t n, nsorted, cap;
+  size_t dead; // count为0的条目数
+  struct wordEntry **cand; // 上一次补全的候选，按排名
+  int ncand;
+  int pick;            // 当前用的是第几个候选
+  int cy, start, cx;   // 补全的行、词的开始和插入后的光标位置，连按时据此换成下一个
+};
+struct diffSeg // 和磁盘上不同的一段：当前的[c, c+cn)行对应磁盘上的[d, d+dn)行
+{
+  int c, cn;
+  int d, dn;
+  int dirty; // 改过之后还没重新比较
+};
+struct diffState
+{
+  int on;               // 显示差异标记栏
+  struct diffSeg *segs; // 按c排序，互不重叠；段之外的行和磁盘上的行一一对应
+  int nsegs, capsegs;
+  int ndirty;
+  int full;             // 对应关系不再可信（文件在外面被改过，或保存期间又改了），下次整个重比
+  unsigned int *disk;   // 磁盘上各行的哈希
+  int ndisk;
+  int disk_ok;          // disk是按当前基准读的
+  off_t size;           // 基准文件的大小和修改时间
+  struct timespec mtime;
+  unsigned int gen;      // 每次修改加一，比较结果据此判断是否过期
+  unsigned int base;     // 每次换基准（保存、换缓冲）加一
+  unsigned int save_gen; // 开始保存时的gen
+  struct diffJob *job;   // 正在后台比较
+};
+struct frameStats // 主循环的调度状态和按键到画面的延迟统计，时间单位是微秒
+{
+  long long interval; // 两帧之间的最小间隔
+  long long last;     // 上一帧画完的时间
+  long long input;    // 最早一个还没画出来的按键的处理时间，0表示没有
+  int pending;        // 有还没画出来的修改
+  long frames;
+  long dropped;       // 被后来的按键取代、没有画出来的帧
+  long nlat;
+  long long lat_sum, lat_max;
+  long long start;    // 进程启动的时间
+  long long first;    // 启动到第一帧画完用的时间，0表示还没画
+};
+struct editorConfig
+{
+  int cx, cy;
+  int rx;
+  int rowoff;
+  int coloff;
+  int wrap;           // 软折行模式
+  int wrapoff;        // 折行模式下顶部行从第几个屏幕行开始显示
+  int wrap_y, wrap_x; // 折行模式下光标的屏幕位置
+  int screenrows;
+  int screencols;
+  int numrows;
+  int rowcap; // E.row已分配的行数
+  erow *row;
+  int dirty;
+  char *filename;
+  char statusmsg[80];    // 显示消息
+  time_t statusmsg_time; // 存储消息的时间戳，以便在显示后几秒钟内删除消息
+  struct editorSyntax *syntax;
+  struct termios orig_termios;
+  struct undoStack undo;
+  struct undoStack redo;
+  int undo_break; // 下一次修改开始新的撤销组
+  int undo_lock;  // 打开文件或执行撤销时不记录
+  struct journal *journal; // 交换日志，没有文件名时为NULL
+  struct viewer *view;     // 只读查看大文件时不为NULL，此时E.row不用
+  struct hexView *hex;     // 按十六进制查看二进制文件时不为NULL，此时E.row也不用
+  struct saveJob *save;    // 正在后台保存时不为NULL
+  struct loadJob *load;    // 文件还没载入完时不为NULL
+  struct cursor *cursors;  // 主光标之外的光标，按(cy, cx)排序
+  int ncursors;
+  int block_row; // 列块选择的起始行，-1表示没有开始
+  int sel;            // 有选择时为1，选择是从(sel_cy, sel_cx)到光标
+  int sel_cx, sel_cy;
+  struct clipboard clip;
+  int stale_from; // 这一行之前的render和高亮都是最新的，INT_MAX表示全部最新
+  long drawbytes;       // 所有绘制缓存占用的字节数
+  const char **shown;   // 终端上每个文本屏幕行显示的是哪一行，用chars指针作标识，NULL表示需要重画
+  int shown_rowoff;     // 上一帧的rowoff，-1表示不能靠滚动终端复用上一帧
+  struct frameStats frame;
+  long derived;       // 各行render、cells和高亮大约占用的字节数，工作线程也会改，用原子操作
+  long derived_limit; // 超过时在空闲片里丢掉离视口最远的行
+  long shed;          // 累计丢掉过派生数据的行数
+  int pressure_fd;    // cgroup的memory.pressure触发器，-1表示没有
+  struct grepJob *grep; // 最近一次目录搜索，结果缓冲在前台或暂存着
+  struct fold *folds;   // 收起的折叠，按start排序
+  int nfolds;
+  struct foldRange *hidden; // 所有折叠隐藏的行，不相交且有序
+  int nhidden;
+};
+struct editorConfig E;
+/*** filetypes ***/
+char *C_HL_extensions[] = {".c", ".h", ".cpp", NULL}; // 用于高亮显示C语言文件的文件扩展名
+char *C_HL_keywords[] = {
+    "switch", "if", "while", "for", "break", "continue", "return", "else",
+    "struct", "union", "typedef", "static", "enum", "class", "case",
+    "int|", "long|", "double|", "float|", "char|", "unsigned|", "signed|",
+    "void|", NULL}; // 用于高亮显示C语言文件的关键字
+struct editorSyntax HLDB[] = {
+    // 高亮C文件时打开该标志
+    {"c",
+     C_HL_extensions,
+     C_HL_keywords,
+     "//", "/*", "*/",
+     HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS,
+     NULL},
+};
+#define HLDB_ENTRIES (sizeof(HLDB) / sizeof(HLDB[0])) // 高亮数据库
+/*** prototypes ***/
+void editorSetStatusMessage(const char *fmt, ...);
+void editorRefreshScreen();
+char *editorPrompt(char *prompt, void (*callback)(char *, int), int allow_empty);
+void editorUndoSaveRow(int at);
+void editorUndoInsertRow(int at);
+void editorUndoInsertRows(int at, int n);
+void editorUndoDelRow(int at, erow *row);
+void editorUndoTakeRow(int at);
+struct undoEntry *editorUndoPush(int at, int nold, int nnew);
+void editorJournalInsertRow(int at);
+void editorJournalAppendRows(int op, int at, int n);
+void editorJournalCompact(struct journal *j, int snapshot);
+void editorDiffRows(int op, int at, int n);
+void editorUpdateRender(erow *row);
+long editorRowBytes(const erow *row);
+struct rowView *editorRowView(erow *row);
+void editorInsertSpanRows(int at, const struct undoLine *lines, int n, struct textSpan *span);
+void editorJournalDelRow(int at);
+void editorJournalSetRow(int at);
+void editorJournalPatchRow(int at, int off, int del, int ins);
+void editorJournalOpen(int replay);
+void editorJournalSaved();
+void editorJournalClose(int remove);
+char *editorJournalPath(const char *filename);
+char *editorRowsToString(size_t *buflen);
+int editorSaveKeep(char *p);
+int editorSavePoll(int wait);
+void editorRowRender(erow *row);
+void editorRowsFlush(int upto);
+void editorMoveCursor(int key);
+void editorViewRefresh();
+void editorViewProcessKeypress();
+void editorHexRefresh();
+void editorHexProcessKeypress();
+long long editorNow();
+int editorGrepShown();
+void editorFoldShift(int at, int n);
+void editorWordsAdd(erow *row);
+void editorWordsDrop(erow *row);
+void editorWordsShift(int at, int n);
+int editorRowNext(int r);
+int editorRowPrev(int r);
+/*** terminal ***/
+void die(const char *s)
+{
+  write(STDOUT_FILENO, "\x1b[2J", 4);
+  write(STDOUT_FILENO, "\x1b[H", 3); // 清除屏幕并退出
+  perror(s);                         // 检查全局errno变量，打印一个错误信息
+  exit(1);                           // 以退出状态1退出程序
+}
+void disableRawMode()
+{
+  if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &E.orig_termios) == -1)
+    die("tcsetattr");
+}
+void enableRawMode()
+{
+  if (tcgetattr(STDIN_FILENO, &E.orig_termios) == -1)
+    die("tcgetattr");
+  atexit(disableRawMode); // 注册disableRawMode()函数，通过调用exit()函数，确保程序退出时，中断属性保持我们找到它们
+  struct termios raw = E.orig_termios;
+  // 使用tcgetattr()将当前属性读入一个结构体中
+
+  raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON); // IXON关闭ctrl s/q，前者用于软件流控制，后者组织数据传输到中断,ICRNL关闭终端将用户输入的任何回车符转换为换行符，BRKINT开启时，一个终端条件将导致向程序发送一个SIGINT信号，就像按下ctrl-c键，INPCK启用奇偶检验，似乎不适用于现代终端仿真器，ISTRIP会导致每个输入字节的第8位被移除
+  raw.c_oflag &= ~(OPOST);                                  // 关闭OPOST标志来关闭所有输出处理功能
+  raw.c_cflag |= (CS8);                                     // 掩码，将字符大小（CS）设置为梅子姐8位
+  raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);          // 将修改后的结构体传递给tcsetarr()以新的中断属性协会,关闭规范模式，诸子皆读取输入,ISIG关闭两个信号，SIGINT和SIGTSTP导致终止和挂起，ctrl c/z
+  raw.c_cc[VMIN] = 0;
+  raw.c_cc[VTIME] = 1;
+  if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == -1)
+    die("tcsetattr"); // 将程序的标准输入设置为文本文件或管道而不是终端，尝试echo test | ./kilo
+}
+int editorReadKey()
+{ // 等待一个按键操作，并返回它，涉及读取表示单个按键操作的多字节,有许多没有处理的键转义序列，如F1-F12，忽略这些键
+  int nread;
+  char c;
+  while ((nread = read(STDIN_FILENO, &c, 1)) != 1)
+  {
+    if (nread == -1 && errno != EAGAIN)
+      die("read");
+    if (E.save) // 后台保存时每次读超时刷新一下进度
+    {
+      editorSavePoll(0);
+      editorRefreshScreen();
+    }
+  }
+  if (c == '\x1b')
+  { // 如果我们读取到一个转义字符，我们立即将两个额外的字节读入 seq 缓冲区。如果其中任何一个读取超时（0.1 秒后），那么我们假设用户只是按下了 Escape 键，并返回该键。否则，我们查看该转义序列是否是一个箭头键转义序列。如果是，我们只需返回相应的 w a s d 字符即可。如果不是我们认识的转义序列，我们只需返回转义字符。
+    char seq[3];
+    if (read(STDIN_FILENO, &seq[0], 1) != 1)
+      return '\x1b';
+    if (read(STDIN_FILENO, &seq[1], 1) != 1)
+      return '\x1b';
+    if (seq[0] == '[')
+    {
+      if (seq[1] >= '0' && seq[1] <= '9')
+      {
+        if (read(STDIN_FILENO, &seq[2], 1) != 1)
+          return '\x1b';
+        if (seq[2] == '~')
+        {
+          switch (seq[1])
+          {
+          case '1':
+            return HOME_KEY;
+          case '3':
+            return DEL_KEY;
+          case '4':
+            return END_KEY;
+          case '5':
+            return PAGE_UP;
+          case '6':
+            return PAGE_DOWN;
+          case '7':
+            return HOME_KEY;
+          case '8':
+            return END_KEY;
+          }
+        }
+      }
+      else
+      {
+        switch (seq[1])
+        {
+        case 'A':
+          return ARROW_UP;
+        case 'B':
+          return ARROW_DOWN;
+        case 'C':
+          return ARROW_RIGHT;
+        case 'D':
+          return ARROW_LEFT;
+        case 'H':
+          return HOME_KEY;
+        case 'F':
+          return END_KEY;
+        }
+      }
+    }
+    else if (seq[0] == '0')
+    {
+      switch (seq[1])
+      {
+      case 'H':
+        return HOME_KEY;
+      case 'F':
+        return END_KEY;
+      }
+    }
+    return '\x1b';
+  }
+  else
+  {
+    return c;
+  }
+}
+int getCursorPosition(int *rows, int *cols)
+{ // 获取光标位置，n查询终端的状态信息
+  char buf[32];
+  unsigned int i = 0;
+  if (write(STDOUT_FILENO, "\x1b[6n", 4) != 4)
+    return -1;
+  while (i < sizeof(buf) - 1)
+  {
+    if (read(STDIN_FILENO, &buf[i], 1) != 1)
+      break;
+    if (buf[i] == 'R')
+      break;
+    i++;
+  }
+  buf[i] = '\0';
+  if (buf[0] != '\x1b' || buf[1] != '[')
+    return -1;
+  if (sscanf(&buf[2], "%d;%d", rows, cols) != 2)
+    return -1;
+  return 0;
+}
+int getWindowSize(int *rows, int *cols)
+{
+  struct winsize ws;
+
+  if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == -1 || ws.ws_col == 0)
+  {
+    if (write(STDOUT_FILENO, "\x1b[999C\x1b[999B", 12) != 12)
+      return -1;
+    return getCursorPosition(rows, cols); // ioctl()将终端的列数和行数放入指定的winsize结构体中，没有简单的将光标移动到右下角的命令
+  }
+  else
+  {
+    *cols = ws.ws_col;
+    *rows = ws.ws_row;
+    return 0;
+  }
+}
+/*** workers ***/
+int editorParallelJobs(int n) // 根据工作量决定线程数，工作量小时只用当前线程
+{
+  if (n < KILO_PAR_MIN_ROWS)
+    return 1;
+  long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+  if (ncpu < 1)
+    ncpu = 1;
+  if (ncpu > KILO_MAX_THREADS)
+    ncpu = KILO_MAX_THREADS;
+  return ncpu;
+}
+void editorParallelRun(void *(*fn)(void *), void *jobs, size_t jobsize, int njobs) // 每个job一个线程，最后一个在当前线程执行，全部完成后返回
+{
+  pthread_t tid[KILO_MAX_THREADS];
+  int started[KILO_MAX_THREADS];
+  for (int j = 0; j < njobs - 1; j++)
+    started[j] = pthread_create(&tid[j], NULL, fn, (char *)jobs + jobsize * j) == 0;
+  fn((char *)jobs + jobsize * (njobs - 1));
+  for (int j = 0; j < njobs - 1; j++)
+  {
+    if (started[j])
+      pthread_join(tid[j], NULL);
+    else
+      fn((char *)jobs + jobsize * j); // 创建线程失败时退回串行
+  }
+}
+/*** syntax highlighting***/
+int is_separator(int c)
+{
+  return isspace(c) || c == '\0' || strchr(",.()+-/*=~%<>[];", c) != NULL; // 接受一个字符，如果被认为是分隔符，则返回true
+}
+#define HC_SEP (1 << 0)   // 分隔符
+#define HC_SPACE (1 << 1) // 空白，连续的空白可以整段跳过
+#define HC_DIGIT (1 << 2)
+#define HC_QUOTE (1 << 3) // 字符串的开始
+#define HC_SCS (1 << 4)   // 单行注释的首字节
+#define HC_MCS (1 << 5)   // 多行注释的首字节
+struct hlkeyword
+{
+  const char *s;
+  int len;
+  int type;
+  int order; // 在keywords中的下标，多个关键字同时匹配时取靠前的
+};
+struct hlmatcher // 每种语法只构建一次的字符分类表和关键字哈希表
+{
+  unsigned char cls[256];
+  struct hlkeyword *table; // 开放寻址，存放不含分隔符的关键字
+  unsigned int mask;
+  struct hlkeyword *special; // 含分隔符的关键字，只能逐个比较
+  int nspecial;
+  int skip_word; // 标识符字节都不会开始字符串或注释，可以整段跳过
+  int scs_len, mcs_len, mce_len;
+};
+static unsigned int editorHashBytes(const char *s, int len)
+{
+  unsigned int h = 2166136261u;
+  for (int i = 0; i < len; i++)
+    h = (h ^ (unsigned char)s[i]) * 16777619u;
+  return h;
+}
+static int editorIsWordByte(int c) // SIMD跳过的字节集合：[0-9A-Za-z_]和UTF-8多字节序列
+{
+  return isalnum(c) || c == '_' || c >= 0x80;
+}
+struct hlmatcher *editorSyntaxMatcher(struct editorSyntax *syn)
+{
+  if (syn->matcher)
+    return syn->matcher;
+  struct hlmatcher *m = calloc(1, sizeof(struct hlmatcher));
+  char *scs = syn->singleline_comment_start;
+  char *mcs = syn->multiline_comment_start;
+  char *mce = syn->multiline_comment_end;
+  m->scs_len = scs ? strlen(scs) : 0;
+  m->mcs_len = mcs ? strlen(mcs) : 0;
+  m->mce_len = mce ? strlen(mce) : 0;
+  if (!m->mcs_len || !m->mce_len)
+    m->mcs_len = m->mce_len = 0;
+
+  for (int c = 0; c < 256; c++)
+  {
+    if (c < 0x80 && is_separator(c))
+      m->cls[c] |= HC_SEP;
+    if (isdigit(c))
+      m->cls[c] |= HC_DIGIT;
+    if ((syn->flags & HL_HIGHLIGHT_STRINGS) && (c == '"' || c == '\''))
+      m->cls[c] |= HC_QUOTE;
+  }
+  if (m->scs_len)
+    m->cls[(unsigned char)scs[0]] |= HC_SCS;
+  if (m->mcs_len)
+    m->cls[(unsigned char)mcs[0]] |= HC_MCS;
+
+  int nkw = 0;
+  while (syn->keywords && syn->keywords[nkw])
+    nkw++;
+  unsigned int size = 16;
+  while (size < (unsigned int)nkw * 2)
+    size *= 2;
+  m->table = calloc(size, sizeof(struct hlkeyword));
+  m->mask = size - 1;
+  m->special = malloc(sizeof(struct hlkeyword) * (nkw + 1));
+  int space_kw = 0;
+  for (int j = 0; j < nkw; j++)
+  {
+    struct hlkeyword k = {syn->keywords[j], strlen(syn->keywords[j]), HL_KEYWORD1, j};
+    if (k.len && k.s[k.len - 1] == '|')
+    {
+      k.len--;
+      k.type = HL_KEYWORD2;
+    }
+    if (k.len == 0)
+      continue;
+    if (isspace((unsigned char)k.s[0]))
+      space_kw = 1;
+    int sep = 0;
+    for (int i = 0; i < k.len; i++)
+      sep |= m->cls[(unsigned char)k.s[i]] & HC_SEP;
+    if (sep)
+    {
+      m->special[m->nspecial++] = k;
+      continue;
+    }
+    unsigned int h = editorHashBytes(k.s, k.len) & m->mask;
+    while (m->table[h].s && !(m->table[h].len == k.len && !memcmp(m->table[h].s, k.s, k.len)))
+      h = (h + 1) & m->mask;
+    if (!m->table[h].s) // 重复的关键字保留第一个
+      m->table[h] = k;
+  }
+
+  for (int c = 0; c < 256; c++)
+    if (isspace(c) && !space_kw && !(m->cls[c] & (HC_SCS | HC_MCS)))
+      m->cls[c] |= HC_SPACE;
+  m->skip_word = 1;
+  for (int c = 0; c < 256; c++)
+    if (editorIsWordByte(c) && (m->cls[c] & (HC_QUOTE | HC_SCS | HC_MCS)))
+      m->skip_word = 0;
+  syn->matcher = m;
+  return m;
+}
+static int editorSkipWord(const unsigned char *s, int i, int n) // 返回i之后第一个不属于标识符的字节位置
+{
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i d0 = _mm_set1_epi8('0' - 1), d9 = _mm_set1_epi8('9' + 1);
+  const __m128i a0 = _mm_set1_epi8('a' - 1), az = _mm_set1_epi8('z' + 1);
+  const __m128i bit = _mm_set1_epi8(0x20), us = _mm_set1_epi8('_');
+  while (i + 16 <= n)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+    __m128i lo = _mm_or_si128(v, bit);
+    __m128i w = _mm_cmplt_epi8(v, zero); // 有符号比较，>=0x80的字节为负
+    w = _mm_or_si128(w, _mm_and_si128(_mm_cmpgt_epi8(v, d0), _mm_cmplt_epi8(v, d9)));
+    w = _mm_or_si128(w, _mm_and_si128(_mm_cmpgt_epi8(lo, a0), _mm_cmplt_epi8(lo, az)));
+    w = _mm_or_si128(w, _mm_cmpeq_epi8(v, us));
+    int mask = _mm_movemask_epi8(w);
+    if (mask != 0xFFFF)
+      return i + __builtin_ctz(~mask);
+    i += 16;
+  }
+#endif
+  while (i < n && editorIsWordByte(s[i]))
+    i++;
+  return i;
+}
+static int editorSkipClass(const struct hlmatcher *m, const unsigned char *s, int i, int n, int cls)
+{
+#ifdef __SSE2__
+  if (cls == HC_SPACE && m->cls[' '] & HC_SPACE) // 缩进几乎都是空格，先按16字节比较
+  {
+    const __m128i sp = _mm_set1_epi8(' ');
+    while (i + 16 <= n)
+    {
+      int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(s + i)), sp));
+      if (mask != 0xFFFF)
+      {
+        i += __builtin_ctz(~mask);
+        break;
+      }
+      i += 16;
+    }
+  }
+#endif
+  while (i < n && (m->cls[s[i]] & cls))
+    i++;
+  return i;
+}
+static int editorFindEither(const unsigned char *s, int i, int n, int a, int b) // 查找a或b第一次出现的位置，没有则返回n
+{
+#ifdef __SSE2__
+  const __m128i va = _mm_set1_epi8(a), vb = _mm_set1_epi8(b);
+  while (i + 16 <= n)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+    int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)));
+    if (mask)
+      return i + __builtin_ctz(mask);
+    i += 16;
+  }
+#endif
+  while (i < n && s[i] != a && s[i] != b)
+    i++;
+  return i;
+}
+static int editorFindDelim(const char *s, int i, int n, const char *d, int dlen) // 查找结束符，没有则返回-1
+{
+  while (i + dlen <= n)
+  {
+    const char *p = memchr(s + i, d[0], n - i - dlen + 1);
+    if (p == NULL)
+      return -1;
+    i = p - s;
+    if (!memcmp(p, d, dlen))
+      return i;
+    i++;
+  }
+  return -1;
+}
+static int editorMatchKeyword(const struct hlmatcher *m, const char *s, int i, int n, int *type) // 返回在i处匹配的关键字长度
+{
+  const struct hlkeyword *best = NULL;
+  for (int k = 0; k < m->nspecial; k++)
+  {
+    const struct hlkeyword *kw = &m->special[k];
+    if (i + kw->len <= n && !memcmp(s + i, kw->s, kw->len) && (m->cls[(unsigned char)s[i + kw->len]] & HC_SEP))
+    {
+      best = kw;
+      break;
+    }
+  }
+  int j = editorSkipWord((const unsigned char *)s, i, n); // 关键字必须恰好是到下一个分隔符为止的整段
+  while (j < n && !(m->cls[(unsigned char)s[j]] & HC_SEP))
+    j++;
+  if (j > i)
+  {
+    unsigned int h = editorHashBytes(s + i, j - i) & m->mask;
+    for (; m->table[h].s; h = (h + 1) & m->mask)
+    {
+      const struct hlkeyword *kw = &m->table[h];
+      if (kw->len == j - i && !memcmp(kw->s, s + i, kw->len))
+      {
+        if (!best || kw->order < best->order)
+          best = kw;
+        break;
+      }
+    }
+  }
+  if (!best)
+    return 0;
+  *type = best->type;
+  return best->len;
+}
+int editorHighlightRow(erow *row, int in_comment) // 只写row->view->hl，返回行尾是否仍在多行注释中；不读写其他行，可以并行调用
+{
+  struct rowView *v = row->view;
+  v->hl = realloc(v->hl, v->rsize);
+  memset(v->hl, HL_NORMAL, v->rsize);
+  if (E.syntax == NULL)
+    return 0;
+  struct hlmatcher *m = editorSyntaxMatcher(E.syntax);
+  const char *render = v->render;
+  const unsigned char *r = (const unsigned char *)render;
+  unsigned char *hl = v->hl;
+  int n = v->rsize;
+  int numbers = E.syntax->flags & HL_HIGHLIGHT_NUMBERS;
+  int prev_sep = 1;  // 用于跟踪前一个字符是否是分隔符,假定行首是一个分隔符
+  int in_string = 0; // 用于跟踪是否在字符串中
+
+  int i = 0;
+  while (i < n) // 按状态消费整段字符
+  {
+    if (in_comment) // 直接查找多行注释的结束符
+    {
+      int end = editorFindDelim(render, i, n, E.syntax->multiline_comment_end, m->mce_len);
+      if (end < 0)
+      {
+        memset(&hl[i], HL_MLCOMMENT, n - i);
+        break;
+      }
+      memset(&hl[i], HL_MLCOMMENT, end + m->mce_len - i);
+      i = end + m->mce_len;
+      in_comment = 0;
+      prev_sep = 1;
+      continue;
+    }
+    if (in_string) // 查找结束引号或转义符，\'或\"不会结束字符串
+    {
+      int j = editorFindEither(r, i, n, in_string, '\\');
+      memset(&hl[i], HL_STRING, (j < n ? j + 1 : n) - i);
+      if (j < n && r[j] == '\\' && j + 1 < n)
+      {
+        hl[j + 1] = HL_STRING;
+        i = j + 2;
+        continue;
+      }
+      if (j < n && r[j] == in_string)
+      {
+        in_string = 0;
+        prev_sep = 1;
+      }
+      i = j + 1;
+      continue;
+    }
+
+    int c = r[i];
+    int cls = m->cls[c];
+    if (cls & HC_SPACE)
+    {
+      i = editorSkipClass(m, r, i, n, HC_SPACE);
+      prev_sep = 1;
+      continue;
+    }
+    if ((cls & HC_SCS) && !strncmp(&render[i], E.syntax->singleline_comment_start, m->scs_len))
+    {
+      memset(&hl[i], HL_COMMENT, n - i); // 如果是注释的开始，那么将剩余的行设置为注释高亮
+      break;
+    }
+    if ((cls & HC_MCS) && !strncmp(&render[i], E.syntax->multiline_comment_start, m->mcs_len))
+    {
+      memset(&hl[i], HL_MLCOMMENT, m->mcs_len);
+      i += m->mcs_len;
+      in_comment = 1;
+      continue;
+    }
+    if (cls & HC_QUOTE)
+    {
+      in_string = c;
+      hl[i++] = HL_STRING;
+      continue;
+    }
+    if (numbers)
+    {
+      int prev_num = i > 0 && hl[i - 1] == HL_NUMBER;
+      if (((cls & HC_DIGIT) && (prev_sep || prev_num)) || (c == '.' && prev_num)) // 增加支持高亮显示包含小数点的数字
+      {
+        hl[i++] = HL_NUMBER;
+        prev_sep = 0;
+        continue;
+      }
+    }
+    if (prev_sep) // 关键词前后都需要分隔符，否则avoid,voided中的void将被突出显示为关键词
+    {
+      int type, klen = editorMatchKeyword(m, render, i, n, &type);
+      if (klen)
+      {
+        memset(&hl[i], type, klen);
+        i += klen;
+        prev_sep = 0;
+        continue;
+      }
+    }
+
+    prev_sep = (cls & HC_SEP) != 0;
+    i++;
+    if (!prev_sep && m->skip_word) // 标识符的剩余部分不会是数字或关键字的开始
+      i = editorSkipWord(r, i, n);
+  }
+  return in_comment;
+}
+int editorSyntaxToColor(int hl)
+{
+  switch (hl)
+  {
+  case HL_COMMENT:
+  case HL_MLCOMMENT:
+    return 36; // 评论着色为青色
+  case HL_KEYWORD1:
+    return 33; // 关键字着色为黄色
+  case HL_KEYWORD2:
+    return 32; // 类型着色为绿色
+  case HL_STRING:
+    return 35; // 字符串着色为紫色
+  case HL_NUMBER:
+    return 31; // 数字着色为红色
+  case HL_MATCH:
+    return 34; // 搜索结果，蓝色
+  default:
+    return 37; // 默认颜色foreground
+  }
+}
+struct editorSyntax **syntax_loaded = NULL; // 从语法文件加载的定义，每个文件只解析一次
+int syntax_nloaded = 0;
+char **syntax_missing = NULL; // 找过但不存在的语法文件路径，同一扩展名不再重复open
+int syntax_nmissing = 0;
+struct syntaxIndex // 一个目录中各语法文件match行列出的模式，按扩展名找不到文件时用它找，例如.yml在yaml.syn里
+{
+  char *dir;
+  char **pattern;
+  char **path; // 和pattern一一对应
+  int n;
+};
+struct syntaxIndex *syntax_index = NULL;
+int syntax_nindex = 0;
+int editorSyntaxDirs(const char *dirs[2]) // 语法文件目录：设置了$KILO_SYNTAX_DIR时只用它，否则先~/.kilo/syntax，再程序旁边的syntax/
+{
+  static char home[1024], exe[1024];
+  const char *env = getenv("KILO_SYNTAX_DIR");
+  if (env && *env)
+  {
+    dirs[0] = env;
+    return 1;
+  }
+  int n = 0;
+  if (getenv("HOME"))
+  {
+    snprintf(home, sizeof(home), "%s/.kilo/syntax", getenv("HOME"));
+    dirs[n++] = home;
+  }
+  ssize_t len = readlink("/proc/self/exe", exe, sizeof(exe) - sizeof("syntax"));
+  exe[len > 0 ? len : 0] = '\0';
+  char *slash = strrchr(exe, '/');
+  if (slash) // 不安装也能用源码树里的syntax/
+  {
+    strcpy(slash + 1, "syntax");
+    dirs[n++] = exe;
+  }
+  return n;
+}
+static void editorSyntaxAppend(char ***list, int *n, const char *word, int kw2) // 向以NULL结尾的字符串数组追加一项
+{
+  *list = realloc(*list, sizeof(char *) * (*n + 2));
+  int len = strlen(word);
+  char *s = malloc(len + 2);
+  memcpy(s, word, len);
+  if (kw2)
+    s[len++] = '|';
+  s[len] = '\0';
+  (*list)[(*n)++] = s;
+  (*list)[*n] = NULL;
+}
+struct editorSyntax *editorLoadSyntaxFile(const char *path, const char *pattern)
+{
+  FILE *fp = fopen(path, "r");
+  if (!fp)
+    return NULL;
+  struct editorSyntax *s = calloc(1, sizeof(struct editorSyntax));
+  int nmatch = 0, nkw = 0;
+  s->keywords = calloc(1, sizeof(char *));
+  char *line = NULL;
+  size_t linecap = 0;
+  int lineno = 0;
+  while (getline(&line, &linecap, fp) != -1)
+  {
+    lineno++;
+    char *save, *key = strtok_r(line, " \t\r\n", &save);
+    if (key == NULL || key[0] == '#') // 空行和注释
+      continue;
+    char *val = strtok_r(NULL, " \t\r\n", &save);
+    if (!strcmp(key, "filetype") && val)
+    {
+      free(s->filetype);
+      s->filetype = strdup(val);
+    }
+    else if (!strcmp(key, "match") || !strcmp(key, "keywords") || !strcmp(key, "types"))
+    {
+      for (; val; val = strtok_r(NULL, " \t\r\n", &save))
+      {
+        if (key[0] == 'm')
+          editorSyntaxAppend(&s->filematch, &nmatch, val, 0);
+        else
+          editorSyntaxAppend(&s->keywords, &nkw, val, key[0] == 't'); // types高亮为第二类关键字
+      }
+    }
+    else if (!strcmp(key, "comment") && val)
+    {
+      free(s->singleline_comment_start);
+      s->singleline_comment_start = strdup(val);
+    }
+    else if (!strcmp(key, "comment_start") && val)
+    {
+      free(s->multiline_comment_start);
+      s->multiline_comment_start = strdup(val);
+    }
+    else if (!strcmp(key, "comment_end") && val)
+    {
+      free(s->multiline_comment_end);
+      s->multiline_comment_end = strdup(val);
+    }
+    else if (!strcmp(key, "numbers"))
+      s->flags |= HL_HIGHLIGHT_NUMBERS;
+    else if (!strcmp(key, "strings"))
+      s->flags |= HL_HIGHLIGHT_STRINGS;
+    else
+      editorSetStatusMessage("%s:%d: unknown directive '%s'", path, lineno, key);
+  }
+  free(line);
+  fclose(fp);
+  int listed = 0;
+  for (int i = 0; i < nmatch; i++)
+    listed |= !strcmp(s->filematch[i], pattern);
+  if (!listed) // 文件总能匹配查找它时用的扩展名，之后不会重复解析
+    editorSyntaxAppend(&s->filematch, &nmatch, pattern, 0);
+  if (!s->filetype)
+    s->filetype = strdup(pattern[0] == '.' ? pattern + 1 : pattern);
+  editorSyntaxMatcher(s); // 加载时就构建分类表和关键字哈希
+  syntax_loaded = realloc(syntax_loaded, sizeof(struct editorSyntax *) * (syntax_nloaded + 1));
+  syntax_loaded[syntax_nloaded++] = s;
+  return s;
+}
+static int editorSyntaxPattern(const char *pattern, const char *filename)
+{
+  const char *p = strstr(filename, pattern);
+  return p && (pattern[0] != '.' || p[strlen(pattern)] == '\0'); // 以.开头的模式必须出现在文件名末尾
+}
+int editorSyntaxMatches(struct editorSyntax *s, const char *filename)
+{
+  for (unsigned int i = 0; s->filematch[i]; i++)
+    if (editorSyntaxPattern(s->filematch[i], filename))
+      return 1;
+  return 0;
+}
+struct syntaxIndex *editorSyntaxIndex(const char *dir) // 第一次用到时读一遍目录中各文件的match行，其余指令不解析
+{
+  for (int j = 0; j < syntax_nindex; j++)
+    if (!strcmp(syntax_index[j].dir, dir))
+      return &syntax_index[j];
+  syntax_index = realloc(syntax_index, sizeof(struct syntaxIndex) * (syntax_nindex + 1));
+  struct syntaxIndex *ix = &syntax_index[syntax_nindex++];
+  memset(ix, 0, sizeof(struct syntaxIndex));
+  ix->dir = strdup(dir);
+  DIR *d = opendir(dir);
+  struct dirent *de;
+  char *line = NULL;
+  size_t linecap = 0;
+  while (d && (de = readdir(d)) != NULL)
+  {
+    int len = strlen(de->d_name);
+    if (len < 5 || strcmp(de->d_name + len - 4, ".syn") != 0)
+      continue;
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+    FILE *fp = fopen(path, "r");
+    while (fp && getline(&line, &linecap, fp) != -1)
+    {
+      char *save, *key = strtok_r(line, " \t\r\n", &save);
+      if (key == NULL || strcmp(key, "match") != 0)
+        continue;
+      for (char *val; (val = strtok_r(NULL, " \t\r\n", &save)) != NULL;)
+      {
+        ix->pattern = realloc(ix->pattern, sizeof(char *) * (ix->n + 1));
+        ix->path = realloc(ix->path, sizeof(char *) * (ix->n + 1));
+        ix->pattern[ix->n] = strdup(val);
+        ix->path[ix->n++] = strdup(path);
+      }
+    }
+    if (fp)
+      fclose(fp);
+  }
+  free(line);
+  if (d)
+    closedir(d);
+  return ix;
+}
+struct editorSyntax *editorFindSyntax(const char *filename) // 先查已加载的定义，再按扩展名读取<dir>/<ext>.syn，没有时按各文件的match行找，最后回退到内置的HLDB
+{
+  for (int j = 0; j < syntax_nloaded; j++)
+    if (editorSyntaxMatches(syntax_loaded[j], filename))
+      return syntax_loaded[j];
+  const char *base = strrchr(filename, '/');
+  base = base ? base + 1 : filename;
+  const char *pattern = strrchr(base, '.');
+  pattern = pattern ? pattern : base; // 没有扩展名时用文件名本身，例如Makefile.syn
+  const char *ext = pattern[0] == '.' ? pattern + 1 : pattern;
+  const char *dirs[2];
+  int ndirs = *ext ? editorSyntaxDirs(dirs) : 0;
+  for (int d = 0; d < ndirs; d++)
+  {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s.syn", dirs[d], ext);
+    int missing = 0;
+    for (int j = 0; j < syntax_nmissing && !missing; j++)
+      missing = !strcmp(syntax_missing[j], path);
+    struct editorSyntax *s = missing ? NULL : editorLoadSyntaxFile(path, pattern);
+    if (s)
+      return s;
+    if (!missing)
+    {
+      syntax_missing = realloc(syntax_missing, sizeof(char *) * (syntax_nmissing + 1));
+      syntax_missing[syntax_nmissing++] = strdup(path);
+    }
+  }
+  for (int d = 0; d < ndirs; d++) // 文件名不是扩展名，例如.yml列在yaml.syn的match行里
+  {
+    struct syntaxIndex *ix = editorSyntaxIndex(dirs[d]);
+    for (int j = 0; j < ix->n; j++)
+    {
+      struct editorSyntax *s = editorSyntaxPattern(ix->pattern[j], filename) ? editorLoadSyntaxFile(ix->path[j], pattern) : NULL;
+      if (s)
+        return s;
+    }
+  }
+  for (unsigned int j = 0; j < HLDB_ENTRIES; j++)
+    if (editorSyntaxMatches(&HLDB[j], filename))
+      return &HLDB[j];
+  return NULL;
+}
+void editorSelectSyntaxHighlight() // 将当前文件名与语法定义的filematch字段之一进行匹配，如果匹配成功，将E.syntax设置为该文件类型
+{
+  E.syntax = E.filename ? editorFindSyntax(E.filename) : NULL;
+  for (int filerow = 0; filerow < E.numrows; filerow++) // 所有行的高亮都要重算，显示到哪里算到哪里
+  {
+    erow *row = &E.row[filerow];
+    row->flags |= ROW_HL;
+    if ((row->flags & ROW_SHARED) && row->view) // 行池条目重算时会释放旧语法的高亮，共享行先放手，不留悬空指针
+    {
+      row->view->hl = NULL;
+      row->flags &= ~ROW_DRAWN;
+    }
+  }
+  if (E.numrows > 0)
+    E.stale_from = 0;
+}
+/*** utf-8 ***/
+struct widthRange
+{
+  int lo, hi;
+};
+static const struct widthRange wide_ranges[] = { // 东亚宽字符、全角字符和emoji，占两列
+    {0x1100, 0x115F}, {0x231A, 0x231B}, {0x2329, 0x232A}, {0x23E9, 0x23EC}, {0x23F0, 0x23F0}, {0x23F3, 0x23F3},
+    {0x25FD, 0x25FE}, {0x2614, 0x2615}, {0x2648, 0x2653}, {0x267F, 0x267F}, {0x2693, 0x2693}, {0x26A1, 0x26A1},
+    {0x26AA, 0x26AB}, {0x26BD, 0x26BE}, {0x26C4, 0x26C5}, {0x26CE, 0x26CE}, {0x26D4, 0x26D4}, {0x26EA, 0x26EA},
+    {0x26F2, 0x26F3}, {0x26F5, 0x26F5}, {0x26FA, 0x26FA}, {0x26FD, 0x26FD}, {0x2705, 0x2705}, {0x270A, 0x270B},
+    {0x2728, 0x2728}, {0x274C, 0x274C}, {0x274E, 0x274E}, {0x2753, 0x2755}, {0x2757, 0x2757}, {0x2795, 0x2797},
+    {0x27B0, 0x27B0}, {0x27BF, 0x27BF}, {0x2B1B, 0x2B1C}, {0x2B50, 0x2B50}, {0x2B55, 0x2B55}, {0x2E80, 0x303E},
+    {0x3041, 0x33FF}, {0x3400, 0x4DBF}, {0x4E00, 0x9FFF}, {0xA000, 0xA4CF}, {0xA960, 0xA97F}, {0xAC00, 0xD7A3},
+    {0xF900, 0xFAFF}, {0xFE10, 0xFE19}, {0xFE30, 0xFE6F}, {0xFF00, 0xFF60}, {0xFFE0, 0xFFE6}, {0x16FE0, 0x16FE4},
+    {0x17000, 0x18CFF}, {0x1B000, 0x1B2FF}, {0x1F004, 0x1F004}, {0x1F0CF, 0x1F0CF}, {0x1F18E, 0x1F18E},
+    {0x1F191, 0x1F19A}, {0x1F200, 0x1F251}, {0x1F300, 0x1F320}, {0x1F32D, 0x1F335}, {0x1F337, 0x1F37C},
+    {0x1F37E, 0x1F393}, {0x1F3A0, 0x1F3CA}, {0x1F3CF, 0x1F3D3}, {0x1F3E0, 0x1F3F0}, {0x1F3F4, 0x1F3F4},
+    {0x1F3F8, 0x1F43E}, {0x1F440, 0x1F440}, {0x1F442, 0x1F4FC}, {0x1F4FF, 0x1F53D}, {0x1F54B, 0x1F54E},
+    {0x1F550, 0x1F567}, {0x1F57A, 0x1F57A}, {0x1F595, 0x1F596}, {0x1F5A4, 0x1F5A4}, {0x1F5FB, 0x1F64F},
+    {0x1F680, 0x1F6C5}, {0x1F6CC, 0x1F6CC}, {0x1F6D0, 0x1F6D2}, {0x1F6D5, 0x1F6D7}, {0x1F6EB, 0x1F6EC},
+    {0x1F6F4, 0x1F6FC}, {0x1F7E0, 0x1F7EB}, {0x1F90C, 0x1F93A}, {0x1F93C, 0x1F945}, {0x1F947, 0x1F9FF},
+    {0x1FA70, 0x1FAFF}, {0x20000, 0x2FFFD}, {0x30000, 0x3FFFD}};
+static const struct widthRange zero_ranges[] = { // 组合字符、零宽字符和变体选择符，不占列，并入前一个字素簇
+    {0x0300, 0x036F}, {0x0483, 0x0489}, {0x0591, 0x05BD}, {0x05BF, 0x05BF}, {0x05C1, 0x05C2}, {0x05C4, 0x05C5},
+    {0x05C7, 0x05C7}, {0x0610, 0x061A}, {0x064B, 0x065F}, {0x0670, 0x0670}, {0x06D6, 0x06DC}, {0x06DF, 0x06E4},
+    {0x06E7, 0x06E8}, {0x06EA, 0x06ED}, {0x0900, 0x0903}, {0x093A, 0x094F}, {0x0951, 0x0957}, {0x0962, 0x0963},
+    {0x0E31, 0x0E31}, {0x0E34, 0x0E3A}, {0x0E47, 0x0E4E}, {0x1160, 0x11FF}, {0x1AB0, 0x1AFF}, {0x1DC0, 0x1DFF},
+    {0x200B, 0x200F}, {0x202A, 0x202E}, {0x2060, 0x2064}, {0x20D0, 0x20FF}, {0xFE00, 0xFE0F}, {0xFE20, 0xFE2F},
+    {0xFEFF, 0xFEFF}, {0x1F3FB, 0x1F3FF}, {0xE0000, 0xE007F}, {0xE0100, 0xE01EF}};
+int editorInRanges(const struct widthRange *r, int n, int cp)
+{
+  int lo = 0, hi = n - 1;
+  if (cp < r[0].lo || cp > r[n - 1].hi)
+    return 0;
+  while (lo <= hi)
+  {
+    int mid = (lo + hi) / 2;
+    if (cp < r[mid].lo)
+      hi = mid - 1;
+    else if (cp > r[mid].hi)
+      lo = mid + 1;
+    else
+      return 1;
+  }
+  return 0;
+}
+int editorCharWidth(int cp) // 可打印字符的显示宽度，-1表示控制字符或非法字节，显示为一列反色符号
+{
+  if (cp < 0 || cp < 32 || cp == 127 || (cp >= 0x80 && cp < 0xA0))
+    return -1;
+  if (cp < 0x300)
+    return 1;
+  if (editorInRanges(zero_ranges, sizeof(zero_ranges) / sizeof(zero_ranges[0]), cp))
+    return 0;
+  if (editorInRanges(wide_ranges, sizeof(wide_ranges) / sizeof(wide_ranges[0]), cp))
+    return 2;
+  return 1;
+}
+int editorUtf8Decode(const char *str, int len, int *cp) // 解码一个UTF-8字符，返回字节数，非法序列返回1且cp为-1
+{
+  const unsigned char *s = (const unsigned char *)str;
+  int n, c = s[0];
+  if (c < 0x80)
+  {
+    *cp = c;
+    return 1;
+  }
+  if (c >= 0xC2 && c <= 0xDF)
+    n = 2, c &= 0x1F;
+  else if (c >= 0xE0 && c <= 0xEF)
+    n = 3, c &= 0x0F;
+  else if (c >= 0xF0 && c <= 0xF4)
+    n = 4, c &= 0x07;
+  else
+  {
+    *cp = -1;
+    return 1;
+  }
+  if (n > len)
+  {
+    *cp = -1;
+    return 1;
+  }
+  for (int i = 1; i < n; i++)
+  {
+    if ((s[i] & 0xC0) != 0x80)
+    {
+      *cp = -1;
+      return 1;
+    }
+    c = (c << 6) | (s[i] & 0x3F);
+  }
+  if ((n == 3 && (c < 0x800 || (c >= 0xD800 && c <= 0xDFFF))) || (n == 4 && (c < 0x10000 || c > 0x10FFFF))) // 过长编码和代理项
+  {
+    *cp = -1;
+    return 1;
+  }
+  *cp = c;
+  return n;
+}
+int editorScanAscii(const char *s, int len, int *tabs) // 行是否全是ASCII，是的话同时统计制表符个数
+{
+  int i = 0, t = 0;
+#ifdef __SSE2__
+  __m128i vtab = _mm_set1_epi8('\t'); // 一次检查32个字节：最高位为1说明不是ASCII
+  for (; i + 32 <= len; i += 32)
+  {
+    __m128i a = _mm_loadu_si128((const __m128i *)(s + i));
+    __m128i b = _mm_loadu_si128((const __m128i *)(s + i + 16));
+    if (_mm_movemask_epi8(_mm_or_si128(a, b)))
+      return 0;
+    unsigned int m = _mm_movemask_epi8(_mm_cmpeq_epi8(a, vtab)) | (_mm_movemask_epi8(_mm_cmpeq_epi8(b, vtab)) << 16);
+    t += __builtin_popcount(m);
+  }
+  for (; i + 16 <= len; i += 16)
+  {
+    __m128i a = _mm_loadu_si128((const __m128i *)(s + i));
+    if (_mm_movemask_epi8(a))
+      return 0;
+    t += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(a, vtab)));
+  }
+#endif
+  for (; i < len; i++)
+  {
+    if ((unsigned char)s[i] >= 0x80)
+      return 0;
+    t += (s[i] == '\t');
+  }
+  *tabs = t;
+  return 1;
+}
+void editorUpdateRowUtf8(erow *row) // 含非ASCII字节的行：按字素簇展开制表符，同时建立列缓存
+{
+  int tabs = 0, pads = 0;
+  for (int j = 0; j < row->size; j++)
+  {
+    unsigned char c = row->chars[j];
+    tabs += c == '\t';
+    pads += c >= 0xCC; // 零宽字符都不小于U+0300，首字节至少0xCC；每个可能开始一个字素簇，前面补一个空格
+  }
+  struct rowView *v = row->view;
+  free(v->render);
+  v->render = malloc(row->size + tabs * (KILO_TAB_STOP - 1) + pads + 1);
+  v->cells = malloc(sizeof(struct rowcell) * (row->size + 1));
+  int i = 0, idx = 0, col = 0, n = 0;
+  while (i < row->size)
+  {
+    int cp, w;
+    v->cells[n].cx = i;
+    v->cells[n].rb = idx;
+    v->cells[n].col = col;
+    n++;
+    if (row->chars[i] == '\t') // 制表位按显示列计算
+    {
+      v->render[idx++] = ' ';
+      col++;
+      while (col % KILO_TAB_STOP != 0)
+      {
+        v->render[idx++] = ' ';
+        col++;
+      }
+      i++;
+      continue;
+    }
+    int len = editorUtf8Decode(&row->chars[i], row->size - i, &cp);
+    w = editorCharWidth(cp);
+    if (w == 0)
+    {
+      v->render[idx++] = ' ';
+      w = 1;
+    }
+    else if (w < 0)
+      w = 1;
+    memcpy(&v->render[idx], &row->chars[i], len);
+    idx += len;
+    i += len;
+    int ri = (cp >= 0x1F1E6 && cp <= 0x1F1FF); // 两个区域指示符组成一面旗帜
+    int zwj = 0;
+    while (cp >= 0 && i < row->size) // 把后面的组合字符、零宽连接符连接的字符并入当前字素簇
+    {
+      int cp2;
+      int len2 = editorUtf8Decode(&row->chars[i], row->size - i, &cp2);
+      int w2 = editorCharWidth(cp2);
+      if (w2 == 0 || (zwj && w2 > 0))
+      {
+        if (zwj && w2 > w)
+          w = w2;
+      }
+      else if (ri && cp2 >= 0x1F1E6 && cp2 <= 0x1F1FF)
+      {
+        ri = 0;
+        w = 2;
+      }
+      else
+        break;
+      zwj = (cp2 == 0x200D);
+      memcpy(&v->render[idx], &row->chars[i], len2);
+      idx += len2;
+      i += len2;
+    }
+    col += w;
+  }
+  v->cells[n].cx = row->size; // 行尾哨兵
+  v->cells[n].rb = idx;
+  v->cells[n].col = col;
+  v->ncells = n + 1;
+  v->cells = realloc(v->cells, sizeof(struct rowcell) * v->ncells);
+  v->render[idx] = '\0';
+  v->rsize = idx;
+}
+int editorRowCell(erow *row, int off, int field) // 二分查找起始偏移不大于off的最后一个字素簇，field选择cx/rb/col
+{
+  int lo = 0, hi = row->view->ncells - 1;
+  while (lo < hi)
+  {
+    int mid = (lo + hi + 1) / 2;
+    struct rowcell *c = &row->view->cells[mid];
+    int v = field == 0 ? c->cx : field == 1 ? c->rb : c->col;
+    if (v <= off)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  return lo;
+}
+
+/*** text spans ***/
+struct textSpan **spans = NULL; // 按base排序，用来查一个chars指针属于哪个span
+int nspans = 0;
+
+struct textSpan *editorSpanOf(const char *p)
+{
+  int lo = 0, hi = nspans - 1;
+  while (lo <= hi)
+  {
+    int mid = (lo + hi) / 2;
+    struct textSpan *s = spans[mid];
+    if ((uintptr_t)p < (uintptr_t)s->base)
+      hi = mid - 1;
+    else if ((uintptr_t)p >= (uintptr_t)s->base + s->len)
+      lo = mid + 1;
+    else
+      return s;
+  }
+  return NULL;
+}
+struct textSpan *editorSpanNew(size_t len) // 引用计数为1，由调用者持有
+{
+  struct textSpan *s = malloc(sizeof(struct textSpan));
+  s->base = malloc(len ? len : 1);
+  s->len = len;
+  s->refs = 1;
+  int at = 0;
+  while (at < nspans && (uintptr_t)spans[at]->base < (uintptr_t)s->base)
+    at++;
+  spans = realloc(spans, sizeof(struct textSpan *) * (nspans + 1));
+  memmove(&spans[at + 1], &spans[at], sizeof(struct textSpan *) * (nspans - at));
+  spans[at] = s;
+  nspans++;
+  return s;
+}
+void editorSpanUnref(struct textSpan *s, long n)
+{
+  if (s == NULL || (s->refs -= n) > 0)
+    return;
+  int at = 0;
+  while (spans[at] != s)
+    at++;
+  memmove(&spans[at], &spans[at + 1], sizeof(struct textSpan *) * (nspans - at - 1));
+  nspans--;
+  free(s->base);
+  free(s);
+}
+void editorCharsFree(char *p) // 释放行或撤销记录中的chars；指向span的只减引用
+{
+  struct textSpan *s = nspans ? editorSpanOf(p) : NULL;
+  if (s)
+    editorSpanUnref(s, 1);
+  else if (!editorSaveKeep(p))
+    free(p);
+}
+void editorRowOwn(erow *row) // 原地修改或realloc chars之前调用，指向span的行和后台保存快照里的行先复制出来
+{
+  editorWordsDrop(row);
+  struct textSpan *s = nspans ? editorSpanOf(row->chars) : NULL;
+  if (s == NULL && (E.save == NULL || row->flags & ROW_FRESH))
+    return;
+  char *p = malloc(row->size + 1);
+  memcpy(p, row->chars, row->size + 1);
+  char *old = row->chars;
+  row->chars = p;
+  if (s)
+    editorSpanUnref(s, 1);
+  else
+    editorSaveKeep(old);
+  if (E.save)
+    row->flags |= ROW_FRESH;
+}
+
+/*** line interning ***/
+struct internPool intern = {0};
+
+static struct internLine *editorInternEntry(const erow *row) // 只对ROW_SHARED行有效
+{
+  return (struct internLine *)row->chars - 1;
+}
+struct internLine *editorInternLine(const char *s, int len) // 找到或加入内容为s的条目，行太长时返回NULL
+{
+  unsigned int h = editorHashBytes(s, len);
+  struct internLine *e;
+  if (intern.buckets)
+    for (e = intern.buckets[h & intern.mask]; e; e = e->next)
+      if (e->hash == h && e->size == len && memcmp(e + 1, s, len) == 0)
+        return e;
+  size_t need = (sizeof(struct internLine) + len + 1 + 7) & ~(size_t)7; // 条目按8字节对齐
+  if (need > KILO_INTERN_CHUNK / 4)
+    return NULL;
+  if (intern.buckets == NULL || intern.unique > (long)intern.mask) // 负载到1就加倍
+  {
+    unsigned int cap = intern.buckets ? (intern.mask + 1) * 2 : 1024;
+    struct internLine **b = calloc(cap, sizeof(struct internLine *));
+    for (unsigned int i = 0; intern.buckets && i <= intern.mask; i++)
+      while ((e = intern.buckets[i]) != NULL)
+      {
+        intern.buckets[i] = e->next;
+        e->next = b[e->hash & (cap - 1)];
+        b[e->hash & (cap - 1)] = e;
+      }
+    free(intern.buckets);
+    intern.buckets = b;
+    intern.mask = cap - 1;
+  }
+  if (intern.chunk == NULL || intern.used + need > intern.chunk->len)
+  {
+    intern.chunk = editorSpanNew(KILO_INTERN_CHUNK);
+    intern.used = 0;
+  }
+  e = (struct internLine *)(intern.chunk->base + intern.used);
+  intern.used += need;
+  memset(e, 0, sizeof(struct internLine));
+  e->span = intern.chunk;
+  e->syntax = E.syntax;
+  e->hash = h;
+  e->size = len;
+  memcpy(e + 1, s, len);
+  ((char *)(e + 1))[len] = '\0';
+  e->next = intern.buckets[h & intern.mask];
+  intern.buckets[h & intern.mask] = e;
+  intern.unique++;
+  intern.pooled += len + 1;
+  return e;
+}
+int editorInternRow(int at, const char *s, int len) // 插入一行，chars指向行池中的副本；不能去重时返回0
+{
+  struct internLine *e = editorInternLine(s, len);
+  if (e == NULL)
+    return 0;
+  struct undoLine line = {(char *)(e + 1), len};
+  editorInsertSpanRows(at, &line, 1, e->span);
+  E.row[at].flags |= ROW_SHARED;
+  intern.rows++;
+  intern.bytes += len + 1;
+  return 1;
+}
+void editorInternRender(erow *row) // 共享行的render和cells在条目上只生成一次
+{
+  struct internLine *e = editorInternEntry(row);
+  if (e->render == NULL)
+  {
+    erow tmp = {0};
+    tmp.chars = row->chars;
+    tmp.size = row->size;
+    editorUpdateRender(&tmp);
+    e->render = tmp.view->render;
+    e->cells = tmp.view->cells;
+    e->rsize = tmp.view->rsize;
+    e->ncells = tmp.view->ncells;
+    free(tmp.view);
+  }
+  struct rowView *v = editorRowView(row);
+  v->render = e->render;
+  v->cells = e->cells;
+  v->rsize = e->rsize;
+  v->ncells = e->ncells;
+  v->wrapw = 0;
+}
+int editorRowHighlight(erow *row, int in_comment) // 共享行按行首注释状态取条目上的高亮，其他行照常重算；只在主线程调用
+{
+  if (!(row->flags & ROW_SHARED))
+    return editorHighlightRow(row, in_comment);
+  struct internLine *e = editorInternEntry(row);
+  if (e->syntax != E.syntax) // 换了语法，之前的高亮作废；共享行在换语法时都已放手
+  {
+    free(e->hl[0]);
+    free(e->hl[1]);
+    e->hl[0] = e->hl[1] = NULL;
+    e->syntax = E.syntax;
+  }
+  if (e->hl[in_comment] == NULL)
+  {
+    struct rowView v = {0};
+    erow tmp = {0};
+    v.render = e->render;
+    v.rsize = e->rsize;
+    tmp.view = &v;
+    e->open[in_comment] = editorHighlightRow(&tmp, in_comment);
+    e->hl[in_comment] = v.hl;
+  }
+  row->view->hl = e->hl[in_comment];
+  return e->open[in_comment];
+}
+void editorRowUnshare(erow *row) // 原地修改hl之前调用，共享行换成自己的render、cells和hl副本，chars仍留在行池
+{
+  if (!(row->flags & ROW_SHARED))
+    return;
+  struct rowView *v = row->view;
+  char *render = malloc(v->rsize + 1);
+  memcpy(render, v->render, v->rsize + 1);
+  v->render = render;
+  unsigned char *hl = malloc(v->rsize ? v->rsize : 1);
+  memcpy(hl, v->hl, v->rsize);
+  v->hl = hl;
+  if (v->cells)
+  {
+    struct rowcell *cells = malloc(sizeof(struct rowcell) * v->ncells);
+    memcpy(cells, v->cells, sizeof(struct rowcell) * v->ncells);
+    v->cells = cells;
+  }
+  row->flags &= ~ROW_SHARED;
+  E.derived += editorRowBytes(row);
+}
+void editorInternReport()
+{
+  editorSetStatusMessage("Interned %ld lines into %ld unique (%.1fx), text %zuKB -> %zuKB",
+                         intern.rows, intern.unique, intern.unique ? (double)intern.rows / intern.unique : 0.0,
+                         intern.bytes / 1024, intern.pooled / 1024);
+}
+
+/*** row operations ***/
+int editorRowCxToRx(erow *row, int cx)
+{
+  editorRowRender(row);
+  if (row->view->cells)
+    return row->view->cells[editorRowCell(row, cx, 0)].col;
+  int rx = 0;
+  int j;
+  for (j = 0; j < cx; j++)
+  {
+    if (row->chars[j] == '\t')
+      rx += (KILO_TAB_STOP - 1) - (rx % KILO_TAB_STOP);
+    rx++;
+  }
+  return rx;
+}
+int editorRowRxToCx(erow *row, int rx) // 将rx转换为cx
+{
+  editorRowRender(row);
+  if (row->view->cells)
+  {
+    int k = editorRowCell(row, rx, 2);
+    return row->view->cells[k].cx;
+  }
+  int cur_rx = 0;
+  int cx;
+  for (cx = 0; cx < row->size; cx++)
+  {
+    if (row->chars[cx] == '\t')
+      cur_rx += (KILO_TAB_STOP - 1) - (cur_rx % KILO_TAB_STOP);
+    cur_rx++;
+    if (cur_rx > rx)
+      return cx;
+  }
+  return cx;
+}
+int editorRowCxToRb(erow *row, int cx) // chars下标转换为render下标，纯ASCII行与列号相同
+{
+  editorRowRender(row);
+  if (row->view->cells)
+    return row->view->cells[editorRowCell(row, cx, 0)].rb;
+  return editorRowCxToRx(row, cx);
+}
+int editorRowRbToCx(erow *row, int rb)
+{
+  editorRowRender(row);
+  if (row->view->cells)
+    return row->view->cells[editorRowCell(row, rb, 1)].cx;
+  return editorRowRxToCx(row, rb);
+}
+int editorRowPrevCx(erow *row, int cx) // 前一个字素簇的开始
+{
+  editorRowRender(row);
+  if (cx <= 0)
+    return 0;
+  if (row->view->cells)
+    return row->view->cells[editorRowCell(row, cx - 1, 0)].cx;
+  return cx - 1;
+}
+int editorRowNextCx(erow *row, int cx) // 后一个字素簇的开始
+{
+  editorRowRender(row);
+  if (cx >= row->size)
+    return row->size;
+  if (row->view->cells)
+    return row->view->cells[editorRowCell(row, cx, 0) + 1].cx;
+  return cx + 1;
+}
+int editorRowSnapCx(erow *row, int cx) // 把cx对齐到所在字素簇的开始，避免停在多字节字符中间
+{
+  editorRowRender(row);
+  if (cx > row->size)
+    cx = row->size;
+  if (row->view->cells)
+    return row->view->cells[editorRowCell(row, cx, 0)].cx;
+  return cx;
+}
+struct rowView *editorRowView(erow *row) // 第一次渲染时分配view
+{
+  if (row->view == NULL)
+    row->view = calloc(1, sizeof(struct rowView));
+  return row->view;
+}
+void editorRowDrawFree(erow *row) // 只丢掉这一行的绘制缓存
+{
+  struct rowView *v = row->view;
+  if (v == NULL || v->draw.b == NULL)
+    return;
+  E.drawbytes -= v->draw.cap;
+  free(v->draw.b);
+  memset(&v->draw, 0, sizeof(struct rowDraw));
+  row->flags &= ~ROW_DRAWN;
+}
+void editorRowViewFree(erow *row) // 整个释放view，共享行的render、cells和hl属于行池条目，不释放；只在主线程调用
+{
+  struct rowView *v = row->view;
+  if (v == NULL)
+    return;
+  __sync_fetch_and_sub(&E.derived, editorRowBytes(row));
+  if (!(row->flags & ROW_SHARED))
+  {
+    free(v->render);
+    free(v->hl);
+    free(v->cells);
+  }
+  free(v->wraps);
+  E.drawbytes -= v->draw.cap;
+  free(v->draw.b);
+  free(v);
+  row->view = NULL;
+  row->flags &= ~ROW_DRAWN;
+}
+void editorUpdateRender(erow *row) // 从chars复制每个字符到render，不更新高亮，只写该行，可以并行调用
+{
+  int tabs = 0;
+  int j;
+  struct rowView *v = editorRowView(row);
+  free(v->cells);
+  v->cells = NULL;
+  v->ncells = 0;
+  v->wrapw = 0; // 折行位置失效
+  if (!editorScanAscii(row->chars, row->size, &tabs))
+  {
+    editorUpdateRowUtf8(row);
+    return;
+  }
+  free(v->render);
+  v->render = malloc(row->size + tabs * (KILO_TAB_STOP - 1) + 1); // 为每个制表符分配7个空间
+  int idx = 0;
+  if (tabs == 0) // 纯ASCII且没有制表符，render与chars相同
+  {
+    memcpy(v->render, row->chars, row->size);
+    idx = row->size;
+  }
+  else
+  {
+    for (j = 0; j < row->size; j++)
+    {
+      if (row->chars[j] == '\t')
+      {
+        v->render[idx++] = ' ';
+        while (idx % KILO_TAB_STOP != 0)
+          v->render[idx++] = ' ';
+      }
+      else
+      {
+        v->render[idx++] = row->chars[j];
+      }
+    }
+  }
+  v->render[idx] = '\0';
+  v->rsize = idx;
+}
+void editorUpdateRow(erow *row) // 修改chars之后调用，只做标记，render和高亮由editorRowsFlush在显示前统一重建
+{
+  if (row->flags & ROW_SHARED) // chars已经换掉或复制出来了，不再用行池条目的render和高亮
+  {
+    if (row->view)
+    {
+      row->view->render = NULL;
+      row->view->hl = NULL;
+      row->view->cells = NULL;
+      row->view->rsize = row->view->ncells = 0;
+    }
+    row->flags &= ~ROW_SHARED;
+  }
+  row->flags = (row->flags | ROW_DIRTY) & ~(ROW_DRAWN | ROW_SHED); // 高亮反正要重算
+  if (ROW_INDEX(row) < E.stale_from)
+    E.stale_from = ROW_INDEX(row);
+  editorWordsAdd(row);
+}
+long editorRowBytes(const erow *row) // view和其中render、cells、hl大约占用的字节数，共享行的不算
+{
+  if ((row->flags & ROW_SHARED) || row->view == NULL || row->view->render == NULL)
+    return 0;
+  return sizeof(struct rowView) + 2 * (long)row->view->rsize + 1 + sizeof(struct rowcell) * row->view->ncells;
+}
+void editorRowRender(erow *row) // 需要读render或cells之前调用
+{
+  if (row->flags & ROW_RENDER)
+  {
+    long before = editorRowBytes(row);
+    if (row->flags & ROW_SHARED)
+      editorInternRender(row);
+    else
+      editorUpdateRender(row);
+    row->flags &= ~ROW_RENDER;
+    if (row->flags & ROW_SHED) // 行首的多行注释状态没变，按它重算丢掉的高亮；结果和原来一样，不用改flags
+    {
+      int r = ROW_INDEX(row);
+      editorHighlightRow(row, r > 0 && (E.row[r - 1].flags & ROW_OPEN_COMMENT));
+      row->flags &= ~ROW_SHED;
+    }
+    __sync_fetch_and_add(&E.derived, editorRowBytes(row) - before);
+  }
+}
+void editorRowShed(erow *row) // 丢掉已经算到最新的行的整个view：render、cells、hl、折行位置和绘制缓存，只在主线程调用
+{
+  if (row->view == NULL || (row->flags & (ROW_SHARED | ROW_DIRTY)))
+    return;
+  editorRowViewFree(row);
+  row->flags = (row->flags | ROW_RENDER | ROW_SHED) & ~ROW_DRAWN;
+  E.shed++;
+}
+
+void editorInsertRow(int at, char *s, size_t len)
+{
+  if (at < 0 || at > E.numrows)
+    return;
+  if (E.numrows == E.rowcap) // 按倍数扩容，逐行载入大文件时不用每行都realloc
+  {
+    E.rowcap = E.rowcap ? E.rowcap * 2 : 64;
+    E.row = realloc(E.row, sizeof(erow) * E.rowcap);
+  }
+  memmove(&E.row[at + 1], &E.row[at], sizeof(erow) * (E.numrows - at)); // 将新行插入到行数组的末尾
+  E.row[at].size = len;              // 将新行插入到行数组的末尾
+  E.row[at].chars = malloc(len + 1); // 为新行分配内存
+  memcpy(E.row[at].chars, s, len);   // 将新行复制到新分配的内存中
+  E.row[at].chars[len] = '\0';
+  E.row[at].view = NULL;
+  E.row[at].flags = 0;
+  editorUpdateRow(&E.row[at]);
+  E.numrows++;
+  if (at + 1 < E.numrows) // 下一行的多行注释输入状态可能变了
+    E.row[at + 1].flags |= ROW_HL;
+  editorFoldShift(at, 1);
+  editorWordsShift(at, 1);
+  E.dirty++;
+  editorUndoInsertRow(at);
+  editorJournalInsertRow(at);
+}
+void editorFreeRow(erow *row) // 释放删除的erow所拥有的内存
+{
+  editorRowViewFree(row);
+  editorCharsFree(row->chars);
+}
+void editorDelRows(int at, int n) // 删除[at, at+n)行，行数组只移动一次
+{
+  if (at < 0 || n <= 0 || at + n > E.numrows)
+    return;
+  for (int k = 0; k < n; k++)
+  {
+    editorWordsDrop(&E.row[at + k]);
+    editorUndoDelRow(at, &E.row[at + k]); // 撤销记录接管chars
+    editorFreeRow(&E.row[at + k]);
+  }
+  memmove(&E.row[at], &E.row[at + n], sizeof(erow) * (E.numrows - at - n));
+  E.numrows -= n;
+  E.dirty++;
+  editorFoldShift(at, -n);
+  editorWordsShift(at, -n);
+  if (at < E.numrows) // 接上来的行的多行注释输入状态可能变了
+  {
+    E.row[at].flags |= ROW_HL;
+    if (at < E.stale_from)
+      E.stale_from = at;
+  }
+  editorJournalAppendRows('D', at, n);
+}
+void editorDelRow(int at) // 行首退格，将当前行的内容追加到上一行，然后删除
+{
+  editorDelRows(at, 1);
+}
+void editorInsertSpanRows(int at, const struct undoLine *lines, int n, struct textSpan *span) // 插入n行，chars直接指向span中的文本不复制；render和高亮照常留到显示前
+{
+  if (at < 0 || at > E.numrows || n <= 0)
+    return;
+  if (E.numrows + n > E.rowcap)
+  {
+    while (E.numrows + n > E.rowcap)
+      E.rowcap = E.rowcap ? E.rowcap * 2 : 64;
+    E.row = realloc(E.row, sizeof(erow) * E.rowcap);
+  }
+  memmove(&E.row[at + n], &E.row[at], sizeof(erow) * (E.numrows - at));
+  memset(&E.row[at], 0, sizeof(erow) * n);
+  for (int k = 0; k < n; k++)
+  {
+    E.row[at + k].chars = lines[k].chars;
+    E.row[at + k].size = lines[k].size;
+    editorUpdateRow(&E.row[at + k]);
+  }
+  span->refs += n;
+  E.numrows += n;
+  if (at + n < E.numrows)
+    E.row[at + n].flags |= ROW_HL;
+  editorFoldShift(at, n);
+  editorWordsShift(at, n);
+  E.dirty++;
+  editorUndoInsertRows(at, n);
+  editorJournalAppendRows('I', at, n);
+}
+void editorRowInsertChar(erow *row, int at, int c) // 在指定位置将单个字符插入到erow
+{
+  if (at < 0 || at > row->size)
+    at = row->size;
+  editorUndoSaveRow(ROW_INDEX(row));
+  editorRowOwn(row);
+  row->chars = realloc(row->chars, row->size + 2);
+  memmove(&row->chars[at + 1], &row->chars[at], row->size - at + 1);
+  row->size++;
+  row->chars[at] = c;
+  editorUpdateRow(row);
+  editorJournalPatchRow(ROW_INDEX(row), at, 0, 1);
+  E.dirty++;
+}
+void editorRowAppendString(erow *row, char *s, size_t len)
+{
+  editorUndoSaveRow(ROW_INDEX(row));
+  editorRowOwn(row);
+  row->chars = realloc(row->chars, row->size + len + 1);
+  memcpy(&row->chars[row->size], s, len);
+  row->size += len;
+  row->chars[row->size] = '\0';
+  editorUpdateRow(row);
+  editorJournalPatchRow(ROW_INDEX(row), row->size - len, 0, len);
+  E.dirty++;
+}
+void editorRowDelChars(erow *row, int at, int len) // 删除从at开始的len个字节，多字节字符要整个删除
+{
+  if (at < 0 || at >= row->size)
+    return;
+  if (len > row->size - at)
+    len = row->size - at;
+  editorUndoSaveRow(ROW_INDEX(row));
+  editorRowOwn(row);
+  memmove(&row->chars[at], &row->chars[at + len], row->size - at - len + 1);
+  row->size -= len;
+  editorUpdateRow(row);
+  editorJournalPatchRow(ROW_INDEX(row), at, len, 0);
+  E.dirty++;
+}
+void editorInsertChar(int c)
+{
+  if (E.cy == E.numrows)
+  { // 在文件末尾插入新行
+    editorInsertRow(E.numrows, "", 0);
+  }
+  editorRowInsertChar(&E.row[E.cy], E.cx, c);
+  E.cx++;
+}
+void editorInsertNewline()
+{ // 处理enter键
+  if (E.cx == 0)
+  {
+    editorInsertRow(E.cy, "", 0);
+  }
+  else
+  {
+    erow *row = &E.row[E.cy];
+    editorInsertRow(E.cy + 1, &row->chars[E.cx], row->size - E.cx);
+    row = &E.row[E.cy];
+    editorUndoSaveRow(E.cy);
+    editorRowOwn(row);
+    int cut = row->size - E.cx;
+    row->size = E.cx;
+    row->chars[row->size] = '\0';
+    editorUpdateRow(row);
+    editorJournalPatchRow(E.cy, E.cx, cut, 0);
+  }
+  E.cy++;
+  E.cx = 0;
+}
+void editorDelChar()
+{
+  if (E.cy == E.numrows)
+    return; // 如果光标已经超过文件末尾，那么就没有东西可以删除了，就立即return
+  if (E.cx == 0 && E.cy == 0)
+    return; // 如果光标在文件的开头，那么就没有东西可以删除了，就立即return
+  erow *row = &E.row[E.cy];
+  if (E.cx > 0)
+  {
+    int prev = editorRowPrevCx(row, E.cx); // 删除光标前的整个字素簇
+    editorRowDelChars(row, prev, E.cx - prev);
+    E.cx = prev;
+  }
+  else
+  {
+    E.cx = E.row[E.cy - 1].size;
+    editorRowAppendString(&E.row[E.cy - 1], row->chars, row->size);
+    editorDelRow(E.cy);
+    E.cy--;
+  }
+}
+void editorRowReplace(erow *row, char *s, int len) // 用s替换整行内容，接管s的内存
+{
+  editorWordsDrop(row);
+  editorUndoTakeRow(ROW_INDEX(row));
+  editorCharsFree(row->chars);
+  row->chars = s;
+  row->size = len;
+  editorUpdateRow(row);
+  editorJournalSetRow(ROW_INDEX(row));
+  E.dirty++;
+}
+struct rowsJob
+{
+  const int *rows;
+  int lo, hi;
+  const int *in; // 重建前上一行的多行注释状态
+  int *out;      // 没有重新高亮的行为-1
+};
+void *editorRowsUpdateWorker(void *arg) // 每行只写自己的render、hl和flags，多行注释状态写到out，由主线程串联
+{
+  struct rowsJob *job = arg;
+  for (int k = job->lo; k < job->hi; k++)
+  {
+    erow *row = &E.row[job->rows[k]];
+    job->out[k] = -1;
+    if (row->flags & (ROW_SHARED | ROW_SHED)) // 多个线程可能同时填写同一个行池条目；重建丢掉的高亮要读上一行的状态。都留给主线程
+      continue;
+    editorRowRender(row);
+    if (row->flags & ROW_HL)
+      job->out[k] = editorHighlightRow(row, job->in[k]);
+  }
+  return NULL;
+}
+void editorRowsFlush(int upto) // 保证[0, upto]行的render和高亮是最新的；多行注释状态的变化只向下传到upto，之后的行留到需要时再算
+{
+  if (upto >= E.numrows)
+    upto = E.numrows - 1;
+  if (E.stale_from > upto)
+    return;
+  int from = E.stale_from;
+  int n = 0;
+  for (int r = from; r <= upto; r++)
+    n += (E.row[r].flags & ROW_DIRTY) != 0;
+  int *rows = NULL, *in = NULL, *out = NULL;
+  if (editorParallelJobs(n) > 1) // 脏行很多时先按当前状态并行重建，串联时只有上一行状态变了的才重算
+  {
+    rows = malloc(sizeof(int) * n * 3);
+    in = rows + n;
+    out = in + n;
+    n = 0;
+    for (int r = from; r <= upto; r++)
+    {
+      if (!(E.row[r].flags & ROW_DIRTY))
+        continue;
+      rows[n] = r;
+      in[n++] = r > 0 && (E.row[r - 1].flags & ROW_OPEN_COMMENT);
+    }
+    if (E.syntax)
+      editorSyntaxMatcher(E.syntax); // 分类表要在并行之前建好
+    int nj = editorParallelJobs(n);
+    struct rowsJob jobs[KILO_MAX_THREADS];
+    for (int j = 0; j < nj; j++)
+      jobs[j] = (struct rowsJob){rows, (long)n * j / nj, (long)n * (j + 1) / nj, in, out};
+    editorParallelRun(editorRowsUpdateWorker, jobs, sizeof(struct rowsJob), nj);
+  }
+  int carry = 0, k = 0;
+  int r;
+  for (r = from; r <= upto; r++)
+  {
+    erow *row = &E.row[r];
+    int prev = r > 0 && (E.row[r - 1].flags & ROW_OPEN_COMMENT);
+    int done = -1; // 并行阶段按同样的输入状态算出的结果
+    if (rows && k < n && rows[k] == r)
+    {
+      if (in[k] == prev)
+        done = out[k];
+      k++;
+    }
+    editorRowRender(row);
+    if (done < 0 && ((row->flags & ROW_HL) || carry))
+      done = editorRowHighlight(row, prev);
+    if (done >= 0)
+    {
+      carry = !(row->flags & ROW_OPEN_COMMENT) != !done;
+      row->flags = (row->flags & (ROW_SHARED | ROW_WORDS)) | (done ? ROW_OPEN_COMMENT : 0);
+    }
+    else
+    {
+      carry = 0;
+      row->flags &= ROW_OPEN_COMMENT | ROW_DRAWN | ROW_SHARED | ROW_WORDS;
+    }
+  }
+  if (carry && r < E.numrows) // 状态变化还要往下传，留给下一行
+    E.row[r].flags |= ROW_HL;
+  E.stale_from = r < E.numrows ? r : INT_MAX;
+  free(rows);
+}
+void editorRowsReplace(const int *rows, struct undoLine *res, int n) // 批量替换n行（行号递增），接管res中的内存，整体是一次撤销；render和高亮留到显示前再重建
+{
+  for (int k = 0; k < n; k++)
+  {
+    erow *row = &E.row[rows[k]];
+    editorWordsDrop(row);
+    editorUndoTakeRow(ROW_INDEX(row));
+    editorCharsFree(row->chars);
+    row->chars = res[k].chars;
+    row->size = res[k].size;
+    editorUpdateRow(row);
+    editorJournalSetRow(ROW_INDEX(row));
+    E.dirty++;
+  }
+}
+struct arrangeJob
+{
+  int lo, hi;
+  int at;
+  const int *src;
+  erow *row;
+};
+void *editorRowsGatherWorker(void *arg) // 按src把行结构搬到新数组，只复制erow，不碰行内容
+{
+  struct arrangeJob *job = arg;
+  for (int i = job->lo; i < job->hi; i++)
+  {
+    if (job->src[i] < 0)
+    {
+      memset(&job->row[i], 0, sizeof(erow));
+      continue;
+    }
+    if (i + 16 < job->hi && job->src[i + 16] >= 0) // 按排列取行是随机访问，提前取
+      __builtin_prefetch(&E.row[job->at + job->src[i + 16]]);
+    job->row[i] = E.row[job->at + job->src[i]];
+  }
+  return NULL;
+}
+void editorRowsArrangeInto(int at, int n, const int *src, int m, struct undoLine *add, struct undoEntry *inv) // [at, at+n)换成m行：第i行是原来的第at+src[i]行，src[i]为-1时按顺序接管add中的下一行；inv得到反向的重排，为NULL时不保存删掉的行
+{
+  int *from = malloc(sizeof(int) * (n > 0 ? n : 1));
+  for (int k = 0; k < n; k++)
+    from[k] = -1;
+  int nadd = 0;
+  for (int i = 0; i < m; i++)
+  {
+    if (src[i] >= 0)
+      from[src[i]] = i;
+    else
+      nadd++;
+  }
+  int ndrop = n - (m - nadd);
+  struct undoLine *old = inv ? malloc(sizeof(struct undoLine) * (ndrop > 0 ? ndrop : 1)) : NULL;
+  for (int k = 0, d = 0; k < n; k++) // 不再出现的行，内容交给撤销记录
+  {
+    if (from[k] >= 0)
+      continue;
+    erow *row = &E.row[at + k];
+    editorWordsDrop(row);
+    if (old)
+    {
+      old[d].chars = row->chars;
+      old[d++].size = row->size;
+      row->chars = NULL;
+    }
+    editorFreeRow(row);
+  }
+  erow *row = malloc(sizeof(erow) * (m > 0 ? m : 1));
+  int nj = editorParallelJobs(m);
+  struct arrangeJob jobs[KILO_MAX_THREADS];
+  for (int j = 0; j < nj; j++)
+    jobs[j] = (struct arrangeJob){(long)m * j / nj, (long)m * (j + 1) / nj, at, src, row};
+  editorParallelRun(editorRowsGatherWorker, jobs, sizeof(struct arrangeJob), nj);
+  int numrows = E.numrows - n + m;
+  if (numrows > E.rowcap)
+  {
+    while (numrows > E.rowcap)
+      E.rowcap = E.rowcap ? E.rowcap * 2 : 64;
+    E.row = realloc(E.row, sizeof(erow) * E.rowcap);
+  }
+  memmove(&E.row[at + m], &E.row[at + n], sizeof(erow) * (E.numrows - at - n));
+  memcpy(&E.row[at], row, sizeof(erow) * m);
+  free(row);
+  E.numrows = numrows;
+  editorFoldShift(at, -n);
+  editorFoldShift(at, m);
+  editorWordsShift(at, -n);
+  editorWordsShift(at, m);
+  for (int i = 0, a = 0; i < m; i++)
+  {
+    erow *r = &E.row[at + i];
+    if (src[i] >= 0) // 搬过来的行render不变，上一行换了，多行注释状态要重新串联
+    {
+      r->flags |= ROW_HL;
+      continue;
+    }
+    r->chars = add[a].chars;
+    r->size = add[a++].size;
+    editorUpdateRow(r);
+  }
+  if (at + m < E.numrows)
+    E.row[at + m].flags |= ROW_HL;
+  if (at < E.stale_from)
+    E.stale_from = at;
+  E.dirty++;
+  if (E.journal && n + m > E.numrows) // 动了大半个文件，逐行记录比全文快照还大，直接写快照
+  {
+    editorDiffRows('D', at, n);
+    editorDiffRows('I', at, m);
+    editorJournalCompact(E.journal, 1);
+  }
+  else
+  {
+    if (n)
+      editorJournalAppendRows('D', at, n);
+    if (m)
+      editorJournalAppendRows('I', at, m);
+  }
+  if (inv == NULL)
+  {
+    free(from);
+    return;
+  }
+  inv->at = at;
+  inv->nold = n;
+  inv->nnew = m;
+  inv->old = old;
+  inv->from = from;
+}
+void editorRowsArrange(int at, int n, const int *src, int m) // 重排或筛选[at, at+n)行，整体是一次撤销，撤销记录只保存去掉的行
+{
+  struct undoEntry *e = NULL;
+  if (!E.undo_lock)
+  {
+    E.undo_break = 1;
+    e = editorUndoPush(at, n, m);
+    free(e->old);
+  }
+  editorRowsArrangeInto(at, n, src, m, NULL, e);
+  E.undo_break = 1; // 后面的修改不能并进这一项
+}
+
+/*** folding ***/
+// 收起的折叠按首行排序放在E.folds，可以嵌套；它们隐藏的行合并成不相交的区间放在E.hidden，
+// 每个区间带着之前隐藏的行数，行号和可见序号的换算、跳过隐藏行都是二分查找
+int editorFoldActive() // 折行模式下不折叠
+{
+  return E.nhidden > 0 && !E.wrap;
+}
+void editorFoldBefore(int i) // 从第i个区间起重算之前隐藏的行数
+{
+  int total = i > 0 ? E.hidden[i - 1].before + E.hidden[i - 1].hi - E.hidden[i - 1].lo + 1 : 0;
+  for (; i < E.nhidden; i++)
+  {
+    E.hidden[i].before = total;
+    total += E.hidden[i].hi - E.hidden[i].lo + 1;
+  }
+}
+void editorFoldIndex() // 折叠变了以后重建隐藏区间；屏幕上的行按指针比较，收起的首行不进缓存，不用清E.shown
+{
+  E.hidden = realloc(E.hidden, sizeof(struct foldRange) * (E.nfolds ? E.nfolds : 1));
+  E.nhidden = 0;
+  for (int i = 0; i < E.nfolds; i++)
+  {
+    int lo = E.folds[i].start + 1, hi = E.folds[i].end;
+    struct foldRange *last = E.nhidden ? &E.hidden[E.nhidden - 1] : NULL;
+    if (last && lo <= last->hi + 1) // 嵌套或相邻的并到一起
+    {
+      if (hi > last->hi)
+        last->hi = hi;
+    }
+    else
+      E.hidden[E.nhidden++] = (struct foldRange){lo, hi, 0};
+  }
+  editorFoldBefore(0);
+}
+int editorFoldRangeAt(int r) // 从r或r之前开始的最后一个隐藏区间，没有时返回-1
+{
+  int lo = 0, hi = E.nhidden - 1, at = -1;
+  while (lo <= hi)
+  {
+    int mid = (lo + hi) / 2;
+    if (E.hidden[mid].lo <= r)
+    {
+      at = mid;
+      lo = mid + 1;
+    }
+    else
+      hi = mid - 1;
+  }
+  return at;
+}
+int editorRowHidden(int r)
+{
+  if (!editorFoldActive())
+    return 0;
+  int i = editorFoldRangeAt(r);
+  return i >= 0 && r <= E.hidden[i].hi;
+}
+int editorRowNext(int r) // 下一个可见行，可能是E.numrows
+{
+  r++;
+  if (!editorFoldActive())
+    return r;
+  int i = editorFoldRangeAt(r);
+  return i >= 0 && r <= E.hidden[i].hi ? E.hidden[i].hi + 1 : r;
+}
+int editorRowPrev(int r) // 上一个可见行
+{
+  r--;
+  if (!editorFoldActive())
+    return r;
+  int i = editorFoldRangeAt(r);
+  return i >= 0 && r <= E.hidden[i].hi ? E.hidden[i].lo - 1 : r;
+}
+int editorRowFolded(int r) // r是收起的折叠首行时返回藏在它后面的行数
+{
+  if (!editorFoldActive())
+    return 0;
+  int i = editorFoldRangeAt(r + 1);
+  return i >= 0 && E.hidden[i].lo == r + 1 ? E.hidden[i].hi - E.hidden[i].lo + 1 : 0;
+}
+int editorRowVisIndex(int r) // r之前有几个可见行
+{
+  if (!editorFoldActive())
+    return r;
+  int i = editorFoldRangeAt(r - 1);
+  if (i < 0)
+    return r;
+  int hi = E.hidden[i].hi < r - 1 ? E.hidden[i].hi : r - 1;
+  return r - E.hidden[i].before - (hi - E.hidden[i].lo + 1);
+}
+int editorRowAtVisIndex(int v) // 第v个可见行的行号，超过末尾时接着往后数
+{
+  if (!editorFoldActive())
+    return v;
+  int lo = 0, hi = E.nhidden - 1, at = -1;
+  while (lo <= hi) // 区间开始处的可见序号lo-before是递增的
+  {
+    int mid = (lo + hi) / 2;
+    if (E.hidden[mid].lo - E.hidden[mid].before <= v)
+    {
+      at = mid;
+      lo = mid + 1;
+    }
+    else
+      hi = mid - 1;
+  }
+  if (at < 0)
+    return v;
+  return v + E.hidden[at].before + E.hidden[at].hi - E.hidden[at].lo + 1;
+}
+void editorFoldReveal(int r) // 展开藏着第r行的折叠
+{
+  int k = 0;
+  for (int i = 0; i < E.nfolds; i++)
+    if (!(E.folds[i].start < r && r <= E.folds[i].end))
+      E.folds[k++] = E.folds[i];
+  E.nfolds = k;
+  editorFoldIndex();
+}
+void editorFoldShift(int at, int n) // 在at处插入了n行（n<0时删除了-n行），跟着移动折叠；首行被删的折叠去掉
+{
+  if (E.nfolds == 0)
+    return;
+  int k = 0;
+  for (int i = 0; i < E.nfolds; i++)
+  {
+    struct fold f = E.folds[i];
+    if (n > 0)
+    {
+      if (f.start >= at)
+      {
+        f.start += n;
+        f.end += n;
+      }
+      else if (f.end >= at) // 插在折叠里面，折叠变长
+        f.end += n;
+    }
+    else
+    {
+      int d1 = at - n; // 删除的是[at, d1)
+      if (f.start >= at && f.start < d1)
+        continue;
+      if (f.start >= d1)
+      {
+        f.start += n;
+        f.end += n;
+      }
+      else
+      {
+        int hi = f.end < d1 - 1 ? f.end : d1 - 1;
+        if (hi >= at)
+          f.end -= hi - at + 1;
+        if (f.end <= f.start)
+          continue;
+      }
+    }
+    E.folds[k++] = f;
+  }
+  if (k < E.nfolds) // 去掉了折叠，隐藏区间可能拆开，重建
+  {
+    E.nfolds = k;
+    editorFoldIndex();
+    return;
+  }
+  int i = editorFoldRangeAt(at); // 其余情况区间个数不变，原地移动：删除跨不过区间之间的可见首行，at之后的区间都在删除范围后面
+  if (i >= 0 && n < 0)
+  {
+    int hi = E.hidden[i].hi < at - n - 1 ? E.hidden[i].hi : at - n - 1;
+    if (hi >= at)
+      E.hidden[i].hi -= hi - at + 1;
+  }
+  else if (i >= 0 && at <= E.hidden[i].hi) // 插在区间里面
+    E.hidden[i].hi += n;
+  i++;
+  for (int j = i; j < E.nhidden; j++)
+  {
+    E.hidden[j].lo += n;
+    E.hidden[j].hi += n;
+  }
+  editorFoldBefore(i > 0 ? i - 1 : 0);
+}
+void editorFoldAdd(struct fold f) // 按首行有序插入
+{
+  int i = E.nfolds;
+  while (i > 0 && E.folds[i - 1].start > f.start)
+    i--;
+  if (i > 0 && E.folds[i - 1].start == f.start && E.folds[i - 1].end == f.end)
+    return;
+  E.folds = realloc(E.folds, sizeof(struct fold) * (E.nfolds + 1));
+  memmove(&E.folds[i + 1], &E.folds[i], sizeof(struct fold) * (E.nfolds - i));
+  E.folds[i] = f;
+  E.nfolds++;
+}
+void editorFoldFlush(int r) // 判断折叠范围要用到第r行的高亮，向后扫描时一片一片地算
+{
+  if (r >= E.stale_from)
+    editorRowsFlush(r + KILO_IDLE_ROWS - 1);
+}
+void editorRowBraces(erow *row, int *opens, int *closes) // 不在字符串和注释里的花括号：行首先闭合了几层，行尾还开着几层
+{
+  editorRowRender(row);
+  struct rowView *v = row->view;
+  int d = 0, c = 0;
+  for (int i = 0; i < v->rsize; i++)
+  {
+    if (v->hl && v->hl[i] != HL_NORMAL)
+      continue;
+    if (v->render[i] == '{')
+      d++;
+    else if (v->render[i] == '}')
+    {
+      if (d)
+        d--;
+      else
+        c++;
+    }
+  }
+  *opens = d;
+  *closes = c;
+}
+int editorRowIndent(erow *row) // 行首空白的显示宽度，空行返回-1
+{
+  int w = 0;
+  for (int i = 0; i < row->size; i++)
+  {
+    if (row->chars[i] == ' ')
+      w++;
+    else if (row->chars[i] == '\t')
+      w += KILO_TAB_STOP - w % KILO_TAB_STOP;
+    else if (row->chars[i] != '\r')
+      return w;
+  }
+  return -1;
+}
+int editorFoldHeader(int h) // 单独一行的{折到上一行下面，函数名留在首行
+{
+  erow *row = &E.row[h];
+  int i = 0;
+  while (i < row->size && isspace((unsigned char)row->chars[i]))
+    i++;
+  if (h == 0 || i >= row->size || row->chars[i] != '{')
+    return h;
+  for (i++; i < row->size; i++)
+    if (!isspace((unsigned char)row->chars[i]))
+      return h;
+  return h - 1;
+}
+int editorFoldRegion(int c, struct fold *f) // 第c行所在的最内层区域：多行注释块、花括号块，都没有时按缩进
+{
+  editorFoldFlush(c);
+  if ((c > 0 && (E.row[c - 1].flags & ROW_OPEN_COMMENT)) || (E.row[c].flags & ROW_OPEN_COMMENT))
+  {
+    int s = c, e = c;
+    while (s > 0 && (E.row[s - 1].flags & ROW_OPEN_COMMENT))
+      s--;
+    while (e < E.numrows - 1 && (E.row[e].flags & ROW_OPEN_COMMENT))
+      editorFoldFlush(++e);
+    if (e > s)
+    {
+      *f = (struct fold){s, e};
+      return 1;
+    }
+  }
+  int o, cl, h = -1;
+  editorRowBraces(&E.row[c], &o, &cl);
+  if (o > 0)
+    h = c;
+  else if (c + 1 < E.numrows && editorFoldHeader(c + 1) == c) // 函数名那一行，{在下一行
+    h = c + 1;
+  else
+    for (int r = c - 1, depth = 0; r >= 0 && c - r <= KILO_FOLD_SCAN; r--) // depth是r和c之间多出来的}
+    {
+      editorRowBraces(&E.row[r], &o, &cl);
+      if (o > depth)
+      {
+        h = r;
+        break;
+      }
+      depth += cl - o;
+    }
+  if (h >= 0)
+  {
+    editorRowBraces(&E.row[h], &o, &cl);
+    int depth = o;
+    for (int r = h + 1; r < E.numrows && r - h <= KILO_FOLD_SCAN; r++)
+    {
+      editorFoldFlush(r);
+      editorRowBraces(&E.row[r], &o, &cl);
+      depth -= cl;
+      if (depth <= 0) // 闭合的那一行留着可见
+      {
+        h = editorFoldHeader(h);
+        if (r - 1 > h)
+        {
+          *f = (struct fold){h, r - 1};
+          return 1;
+        }
+        break;
+      }
+      depth += o;
+    }
+  }
+  int ind = editorRowIndent(&E.row[c]); // 按缩进：c下面缩进更深时c是首行，否则向上找缩进更浅的行
+  if (ind < 0)
+    return 0;
+  int next = c + 1;
+  while (next < E.numrows && editorRowIndent(&E.row[next]) < 0)
+    next++;
+  h = c;
+  if (next >= E.numrows || editorRowIndent(&E.row[next]) <= ind)
+  {
+    for (h = c - 1; h >= 0; h--)
+    {
+      int w = editorRowIndent(&E.row[h]);
+      if (w >= 0 && w < ind)
+        break;
+    }
+    if (h < 0)
+      return 0;
+  }
+  ind = editorRowIndent(&E.row[h]);
+  int e = h;
+  for (int r = h + 1; r < E.numrows; r++)
+  {
+    int w = editorRowIndent(&E.row[r]);
+    if (w >= 0 && w <= ind)
+      break;
+    if (w >= 0)
+      e = r;
+  }
+  if (e <= h)
+    return 0;
+  *f = (struct fold){h, e};
+  return 1;
+}
+void editorFoldToggle() // 光标在收起的折叠首行上时展开，否则收起光标所在的区域
+{
+  if (E.wrap || E.cy >= E.numrows)
+    return;
+  int k = 0;
+  for (int i = 0; i < E.nfolds; i++)
+    if (E.folds[i].start != E.cy)
+      E.folds[k++] = E.folds[i];
+  if (k < E.nfolds)
+  {
+    E.nfolds = k;
+    editorFoldIndex();
+    return;
+  }
+  struct fold f;
+  if (!editorFoldRegion(E.cy, &f))
+  {
+    editorSetStatusMessage("Nothing to fold here");
+    return;
+  }
+  editorFoldAdd(f);
+  editorFoldIndex();
+  E.cy = f.start;
+  if (E.cx > E.row[E.cy].size)
+    E.cx = E.row[E.cy].size;
+  E.cx = editorRowSnapCx(&E.row[E.cy], E.cx);
+  editorSetStatusMessage("Folded %d lines", f.end - f.start);
+}
+void editorFoldAll() // 没有折叠时收起所有顶层的花括号块和多行注释，有时全部展开
+{
+  if (E.wrap)
+    return;
+  if (E.nfolds)
+  {
+    E.nfolds = 0;
+    editorFoldIndex();
+    editorSetStatusMessage("Unfolded all");
+    return;
+  }
+  editorRowsFlush(E.numrows - 1);
+  int depth = 0, h = -1, cs = -1;
+  for (int r = 0; r < E.numrows; r++)
+  {
+    int o, cl;
+    editorRowBraces(&E.row[r], &o, &cl);
+    int was = depth;
+    depth = cl < depth ? depth - cl : 0;
+    if (was > 0 && depth == 0 && h >= 0)
+    {
+      if (r - 1 > h)
+        editorFoldAdd((struct fold){h, r - 1});
+      h = -1;
+    }
+    if (depth == 0 && o > 0)
+      h = editorFoldHeader(r);
+    depth += o;
+    if (depth == 0) // 顶层的多行注释，连同结束的那一行一起收起
+    {
+      int open = E.row[r].flags & ROW_OPEN_COMMENT;
+      int prev = r > 0 && (E.row[r - 1].flags & ROW_OPEN_COMMENT);
+      if (open && !prev)
+        cs = r;
+      else if (!open && prev && cs >= 0)
+      {
+        editorFoldAdd((struct fold){cs, r});
+        cs = -1;
+      }
+    }
+  }
+  editorFoldIndex();
+  if (editorRowHidden(E.cy)) // 光标移到藏起它的折叠首行
+  {
+    E.cy = E.hidden[editorFoldRangeAt(E.cy)].lo - 1;
+    E.cx = 0;
+  }
+  editorSetStatusMessage("Folded %d regions", E.nfolds);
+}
+
+/*** word index ***/
+// 补全用的标识符索引：哈希表记每个词在已收录的行里出现几次，另有一个按字典序排好的数组做前缀查找。
+// 收录过的行带ROW_WORDS；改动一行之前减掉它原来的词，改完再加上新的，不重扫文件；
+// words.from之后的行还没收录，由空闲片接着做
+struct wordIndex words = {0};
+
+int editorWordChar(int c) // 标识符字符，非ASCII字节也算
+{
+  return isalnum(c) || c == '_' || c >= 0x80;
+}
+struct wordEntry *editorWordsFind(const char *s, int len, int create)
+{
+  unsigned int h = editorHashBytes(s, len);
+  struct wordEntry *e;
+  if (words.buckets)
+    for (e = words.buckets[h & words.mask]; e; e = e->next)
+      if (e->hash == h && e->len == len && memcmp(e + 1, s, len) == 0)
+        return e;
+  if (!create)
+    return NULL;
+  if (words.buckets == NULL || words.n > (size_t)words.mask) // 负载到1就加倍
+  {
+    unsigned int cap = words.buckets ? (words.mask + 1) * 2 : 1024;
+    struct wordEntry **b = calloc(cap, sizeof(struct wordEntry *));
+    for (unsigned int i = 0; words.buckets && i <= words.mask; i++)
+      while ((e = words.buckets[i]) != NULL)
+      {
+        words.buckets[i] = e->next;
+        e->next = b[e->hash & (cap - 1)];
+        b[e->hash & (cap - 1)] = e;
+      }
+    free(words.buckets);
+    words.buckets = b;
+    words.mask = cap - 1;
+  }
+  if (words.n == words.cap)
+  {
+    words.cap = words.cap ? words.cap * 2 : 1024;
+    words.sorted = realloc(words.sorted, sizeof(struct wordEntry *) * words.cap);
+  }
+  e = malloc(sizeof(struct wordEntry) + len + 1);
+  e->hash = h;
+  e->len = len;
+  e->count = 0;
+  memcpy(e + 1, s, len);
+  ((char *)(e + 1))[len] = '\0';
+  e->next = words.buckets[h & words.mask];
+  words.buckets[h & words.mask] = e;
+  words.sorted[words.n++] = e; // 先追加在未排序的尾部
+  words.dead++;
+  return e;
+}
+void editorWordsRow(erow *row, int d) // 把一行里的标识符计数加上d
+{
+  const unsigned char *s = (const unsigned char *)row->chars;
+  for (int i = 0; i < row->size;)
+  {
+    if (!editorWordChar(s[i]))
+    {
+      i++;
+      continue;
+    }
+    int j = i;
+    while (j < row->size && editorWordChar(s[j]))
+      j++;
+    if (!isdigit(s[i]) && j - i >= KILO_WORD_MIN && j - i <= KILO_WORD_MAX)
+    {
+      struct wordEntry *e = editorWordsFind((const char *)s + i, j - i, d > 0);
+      if (e)
+      {
+        words.dead += (e->count + d == 0) - (e->count == 0);
+        e->count += d;
+      }
+    }
+    i = j;
+  }
+}
+void editorWordsAdd(erow *row) // 修改之后：已收录范围内的行重新加上它的词
+{
+  if (words.on && !(row->flags & ROW_WORDS) && ROW_INDEX(row) < words.from)
+  {
+    editorWordsRow(row, 1);
+    row->flags |= ROW_WORDS;
+  }
+}
+void editorWordsDrop(erow *row) // 修改或删除之前：减掉这一行原来的词
+{
+  if (row->flags & ROW_WORDS)
+  {
+    editorWordsRow(row, -1);
+    row->flags &= ~ROW_WORDS;
+  }
+}
+void editorWordsShift(int at, int n) // 在at处插入了n行（n<0时删除了-n行），调整已收录的范围
+{
+  if (!words.on || at >= words.from)
+    return;
+  if (n > 0)
+  {
+    words.from += n;
+    for (int r = at; r < at + n; r++) // editorUpdateRow时words.from还没加，有的行没收录上
+      editorWordsAdd(&E.row[r]);
+  }
+  else
+    words.from -= (at - n < words.from ? at - n : words.from) - at;
+}
+void editorWordsSlice(int n) // 空闲片：再收录n行
+{
+  int end = words.from + n < E.numrows ? words.from + n : E.numrows;
+  for (int r = words.from; r < end; r++)
+    if (!(E.row[r].flags & ROW_WORDS))
+    {
+      editorWordsRow(&E.row[r], 1);
+      E.row[r].flags |= ROW_WORDS;
+    }
+  words.from = end;
+}
+void editorWordsClear() // 换缓冲时清空，从头重新收录
+{
+  for (size_t i = 0; i < words.n; i++)
+    free(words.sorted[i]);
+  free(words.buckets);
+  free(words.sorted);
+  free(words.cand);
+  int on = words.on;
+  memset(&words, 0, sizeof(words));
+  words.on = on;
+  for (int r = 0; r < E.numrows; r++)
+    E.row[r].flags &= ~ROW_WORDS;
+}
+int editorWordCmp(const void *a, const void *b) // 按字节的字典序，带上结尾的'\0'，前缀排在前面
+{
+  const struct wordEntry *x = *(struct wordEntry *const *)a, *y = *(struct wordEntry *const *)b;
+  return memcmp(x + 1, y + 1, (x->len < y->len ? x->len : y->len) + 1);
+}
+int editorWordRank(const void *a, const void *b) // 候选按出现次数从多到少，再按长度和字典序
+{
+  const struct wordEntry *x = *(struct wordEntry *const *)a, *y = *(struct wordEntry *const *)b;
+  if (x->count != y->count)
+    return x->count > y->count ? -1 : 1;
+  if (x->len != y->len)
+    return x->len - y->len;
+  return editorWordCmp(a, b);
+}
+void editorWordsSort() // 查询前：失效的词过半时清掉，再把尾部的新词排好序并入
+{
+  if (words.dead > words.n / 2)
+  {
+    size_t k = 0, ks = 0;
+    for (size_t i = 0; i < words.n; i++)
+    {
+      struct wordEntry *e = words.sorted[i];
+      if (e->count > 0)
+      {
+        ks += i < words.nsorted;
+        words.sorted[k++] = e;
+        continue;
+      }
+      struct wordEntry **p = &words.buckets[e->hash & words.mask];
+      while (*p != e)
+        p = &(*p)->next;
+      *p = e->next;
+      free(e);
+    }
+    words.n = k;
+    words.nsorted = ks;
+    words.dead = 0;
+    words.ncand = 0; // 候选可能被释放了
+  }
+  if (words.nsorted == words.n)
+    return;
+  struct wordEntry **tail = words.sorted + words.nsorted;
+  size_t nt = words.n - words.nsorted;
+  qsort(tail, nt, sizeof(struct wordEntry *), editorWordCmp);
+  if (nt <= KILO_WORD_INSERT) // 编辑时新词很少，逐个二分插入，不用整个归并
+  {
+    for (size_t j = 0; j < nt; j++)
+    {
+      struct wordEntry *e = words.sorted[words.nsorted + j];
+      size_t lo = 0, hi = words.nsorted + j;
+      while (lo < hi)
+      {
+        size_t mid = (lo + hi) / 2;
+        if (editorWordCmp(&words.sorted[mid], &e) < 0)
+          lo = mid + 1;
+        else
+          hi = mid;
+      }
+      memmove(&words.sorted[lo + 1], &words.sorted[lo], sizeof(struct wordEntry *) * (words.nsorted + j - lo));
+      words.sorted[lo] = e;
+    }
+  }
+  else if (words.nsorted)
+  {
+    struct wordEntry **m = malloc(sizeof(struct wordEntry *) * words.cap);
+    size_t i = 0, j = 0, k = 0;
+    while (i < words.nsorted && j < nt)
+      m[k++] = editorWordCmp(&words.sorted[i], &tail[j]) <= 0 ? words.sorted[i++] : tail[j++];
+    while (i < words.nsorted)
+      m[k++] = words.sorted[i++];
+    while (j < nt)
+      m[k++] = tail[j++];
+    free(words.sorted);
+    words.sorted = m;
+  }
+  words.nsorted = words.n;
+}
+int editorWordsMatch(const char *p, int plen) // 以p开头的词（不含p本身）按排名放进words.cand，返回个数
+{
+  editorWordsSort();
+  if (words.cand == NULL)
+    words.cand = malloc(sizeof(struct wordEntry *) * KILO_WORD_CANDS);
+  size_t lo = 0, hi = words.n;
+  while (lo < hi) // 第一个不小于p的词
+  {
+    size_t mid = (lo + hi) / 2;
+    struct wordEntry *e = words.sorted[mid];
+    int c = memcmp(e + 1, p, e->len < plen ? e->len : plen);
+    if (c < 0 || (c == 0 && e->len < plen))
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  int n = 0;
+  for (size_t i = lo; i < words.n; i++)
+  {
+    struct wordEntry *e = words.sorted[i];
+    if (e->len < plen || memcmp(e + 1, p, plen) != 0)
+      break;
+    if (e->count == 0 || e->len == plen)
+      continue;
+    if (n == KILO_WORD_CANDS && editorWordRank(&e, &words.cand[n - 1]) >= 0) // 只留排名最前的几个
+      continue;
+    int k = n < KILO_WORD_CANDS ? n++ : n - 1;
+    for (; k > 0 && editorWordRank(&e, &words.cand[k - 1]) < 0; k--)
+      words.cand[k] = words.cand[k - 1];
+    words.cand[k] = e;
+  }
+  return n;
+}
+void editorComplete(int again) // 按索引补全光标前的标识符，连按时换成下一个候选
+{
+  if (!words.on || E.cy >= E.numrows)
+    return;
+  erow *row = &E.row[E.cy];
+  long long t = 0;
+  if (!again || words.ncand == 0 || words.cy != E.cy || words.cx != E.cx)
+  {
+    int start = E.cx;
+    while (start > 0 && editorWordChar((unsigned char)row->chars[start - 1]))
+      start--;
+    if (start == E.cx || isdigit((unsigned char)row->chars[start]))
+    {
+      editorSetStatusMessage("Nothing to complete");
+      return;
+    }
+    t = editorNow();
+    words.ncand = editorWordsMatch(row->chars + start, E.cx - start);
+    t = editorNow() - t;
+    if (words.ncand == 0)
+    {
+      editorSetStatusMessage("No completions for %.*s", E.cx - start > 40 ? 40 : E.cx - start, row->chars + start);
+      return;
+    }
+    words.cy = E.cy;
+    words.start = start;
+    words.pick = 0;
+  }
+  else
+    words.pick = (words.pick + 1) % words.ncand;
+  struct wordEntry *e = words.cand[words.pick];
+  int len = row->size - (E.cx - words.start) + e->len; // 换掉[start, cx)，后面的不动
+  char *s = malloc(len + 1);
+  memcpy(s, row->chars, words.start);
+  memcpy(s + words.start, e + 1, e->len);
+  memcpy(s + words.start + e->len, row->chars + E.cx, row->size - E.cx + 1);
+  editorRowReplace(row, s, len);
+  E.cx = words.cx = words.start + e->len;
+  char msg[80];
+  int m = again ? snprintf(msg, sizeof(msg), "%d/%d:", words.pick + 1, words.ncand)
+                : snprintf(msg, sizeof(msg), "%d/%d in %lldus:", words.pick + 1, words.ncand, t);
+  for (int k = 0; k < words.ncand && m < (int)sizeof(msg) - 1; k++) // 后面接着列出其他候选，放不下为止
+  {
+    struct wordEntry *c = words.cand[(words.pick + k) % words.ncand];
+    if (m + 1 + c->len >= (int)sizeof(msg))
+      break;
+    m += snprintf(msg + m, sizeof(msg) - m, " %s", (char *)(c + 1));
+  }
+  editorSetStatusMessage("%s", msg);
+}
+
+/*** diff ***/
+// 和磁盘上的文件比较：修改时只记下改过的段，空闲时把这些段的行哈希交给比较线程算Myers差异，结果拼回段表
+struct diffState diff = {0};
+
+struct diffJob // 主线程交给比较线程的一批段，结果按段放回
+{
+  char *path;         // 需要重读磁盘文件时不为NULL，线程填写disk
+  unsigned int *disk; // 不重读时借用diff.disk
+  int ndisk;
+  struct diffSeg *in; // 要重比的段，full时是整个文件
+  int nin;
+  unsigned int *cur;  // 各段当前行的哈希，依次排列
+  struct diffSeg *out;
+  int nout, capout;
+  int *split;         // in[i]的结果是out[split[i], split[i+1])
+  int full;
+  int bad;            // 段超出了磁盘文件的行数，对应关系已经不对
+  unsigned int gen, base;
+  int wake[2];
+  pthread_t thread;
+};
+struct diffSlot // 找唯一行用的开放寻址表项，na和nb都为0表示空槽
+{
+  unsigned int h;
+  int na, nb;
+  int ia, ib;
+};
+int editorGutter() // 差异标记栏占的列数
+{
+  return diff.on && E.filename ? 2 : 0;
+}
+int editorTextCols() // 文本区的列数
+{
+  return E.screencols - editorGutter();
+}
+void editorDiffBase(const struct stat *st) // 记下基准文件的大小和修改时间
+{
+  diff.size = st->st_size;
+  diff.mtime = st->st_mtim;
+}
+static int editorDiffAfter(int r) // 第一个结束位置在r之后的段
+{
+  struct diffSeg *s = diff.segs;
+  int lo = 0, hi = diff.nsegs;
+  while (lo < hi)
+  {
+    int mid = (lo + hi) / 2;
+    if (s[mid].c + s[mid].cn <= r)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+static int editorDiffRow(int at) // 改了一行：不在段里、或者所在的段是一行对一行时，当场和磁盘上对应的行比较，标记栏不用等比较线程；返回0时按一般的修改处理
+{
+  struct diffSeg *s = diff.segs;
+  int i = editorDiffAfter(at);
+  int inside = i < diff.nsegs && s[i].c <= at;
+  if (inside && (s[i].cn != 1 || s[i].dn != 1))
+    return 0;
+  int d = inside ? s[i].d : at;
+  for (int k = 0; k < i && !inside; k++)
+    d -= s[k].cn - s[k].dn;
+  if (d < 0 || d >= diff.ndisk)
+    return 0;
+  int same = editorHashBytes(E.row[at].chars, E.row[at].size) == diff.disk[d];
+  if (inside)
+  {
+    diff.ndirty -= s[i].dirty;
+    s[i].dirty = 0;
+    if (same) // 改回了磁盘上的内容
+    {
+      memmove(&s[i], &s[i + 1], sizeof(struct diffSeg) * (diff.nsegs - i - 1));
+      diff.nsegs--;
+    }
+    return 1;
+  }
+  if (same)
+    return 1;
+  if (diff.nsegs == diff.capsegs)
+  {
+    diff.capsegs = diff.capsegs ? diff.capsegs * 2 : 64;
+    diff.segs = s = realloc(diff.segs, sizeof(struct diffSeg) * diff.capsegs);
+  }
+  memmove(&s[i + 1], &s[i], sizeof(struct diffSeg) * (diff.nsegs - i));
+  s[i] = (struct diffSeg){at, 1, d, 1, 0};
+  diff.nsegs++;
+  return 1;
+}
+void editorDiffRows(int op, int at, int n) // 和日志收到同样的修改记录：I是在at处插入了n行，D是删除了n行，S是改了第at行
+{
+  if (E.load) // 载入的行就是磁盘上的
+    return;
+  int ndel = op == 'I' ? 0 : n, nins = op == 'D' ? 0 : n;
+  diff.gen++; // 比较线程手上的结果作废，已经算好的段不受影响
+  if (op == 'S' && n == 1 && diff.disk_ok && !diff.full && editorDiffRow(at))
+    return;
+  struct diffSeg *s = diff.segs;
+  int lo = 0, hi = diff.nsegs;
+  while (lo < hi) // 第一个结束位置不在at之前的段
+  {
+    int mid = (lo + hi) / 2;
+    if (s[mid].c + s[mid].cn < at)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  int i = lo, j = lo;
+  while (j < diff.nsegs && s[j].c <= at + ndel) // 和修改范围重叠或相接的段并进来
+    j++;
+  if (j == i + 1 && s[i].dirty && s[i].c <= at && at + ndel <= s[i].c + s[i].cn) // 在已经改过的段里面，只调整长度
+  {
+    s[i].cn += nins - ndel;
+  }
+  else
+  {
+    int off = 0; // 段i之前当前行数比磁盘多出的行数
+    for (int k = 0; k < i; k++)
+      off += s[k].cn - s[k].dn;
+    int c0 = at, c1 = at + ndel, d0, d1, mid = off;
+    for (int k = i; k < j; k++)
+      mid += s[k].cn - s[k].dn;
+    if (j > i && s[i].c < c0)
+      c0 = s[i].c;
+    if (j > i && s[j - 1].c + s[j - 1].cn > c1)
+      c1 = s[j - 1].c + s[j - 1].cn;
+    d0 = j > i && s[i].c == c0 ? s[i].d : c0 - off;
+    d1 = j > i && s[j - 1].c + s[j - 1].cn == c1 ? s[j - 1].d + s[j - 1].dn : c1 - mid;
+    for (int k = i; k < j; k++)
+      diff.ndirty -= s[k].dirty;
+    struct diffSeg seg = {c0, c1 - c0 - ndel + nins, d0, d1 - d0, 1};
+    int keep = seg.cn || seg.dn;
+    if (diff.nsegs - (j - i) + keep > diff.capsegs)
+    {
+      diff.capsegs = diff.capsegs ? diff.capsegs * 2 : 64;
+      diff.segs = s = realloc(diff.segs, sizeof(struct diffSeg) * diff.capsegs);
+    }
+    memmove(&s[i + keep], &s[j], sizeof(struct diffSeg) * (diff.nsegs - j));
+    diff.nsegs += i + keep - j;
+    if (keep)
+    {
+      s[i] = seg;
+      diff.ndirty++;
+    }
+    i += keep - 1;
+  }
+  if (nins != ndel)
+    for (int k = i + 1; k < diff.nsegs; k++)
+      s[k].c += nins - ndel;
+}
+char editorDiffSign(int r) // 第r行的标记：+新增，~修改，_下面删了行，^文件开头删了行，0表示没变
+{
+  struct diffSeg *s = diff.segs;
+  int lo = editorDiffAfter(r);
+  if (lo < diff.nsegs && s[lo].c <= r)
+    return s[lo].dn ? '~' : '+';
+  if (lo < diff.nsegs && s[lo].cn == 0 && s[lo].c == r + 1)
+    return '_';
+  if (r == 0 && diff.nsegs && s[0].c == 0 && s[0].cn == 0)
+    return '^';
+  return 0;
+}
+static void editorDiffEmit(struct diffJob *job, int c, int cn, int d, int dn)
+{
+  if (job->nout == job->capout)
+  {
+    job->capout = job->capout ? job->capout * 2 : 64;
+    job->out = realloc(job->out, sizeof(struct diffSeg) * job->capout);
+  }
+  struct diffSeg seg = {c, cn, d, dn, 0};
+  job->out[job->nout++] = seg;
+}
+static int editorDiffMyers(struct diffJob *job, const unsigned int *a, int n, const unsigned int *b, int m, int ao, int bo, int dmax) // a是磁盘上的行，b是当前的行；编辑步数超过dmax时返回0
+{
+  int off = dmax + 1;
+  int *v = malloc(sizeof(int) * (2 * dmax + 3)); // v[off+k]：对角线k上走得最远的x
+  int *trace = NULL; // 第d步的v[-d..d]从trace[d*d]开始
+  size_t cap = 0;
+  int found = -1;
+  v[off + 1] = 0;
+  for (int d = 0; d <= dmax && found < 0; d++)
+  {
+    if ((size_t)(d + 1) * (d + 1) > cap)
+    {
+      cap = (size_t)(d + 1) * (d + 1) * 2;
+      trace = realloc(trace, sizeof(int) * cap);
+    }
+    int *row = trace + (size_t)d * d;
+    for (int k = -d; k <= d; k += 2)
+    {
+      int x = k == -d || (k != d && v[off + k - 1] < v[off + k + 1]) ? v[off + k + 1] : v[off + k - 1] + 1;
+      int y = x - k;
+      while (x < n && y < m && a[x] == b[y])
+        x++, y++;
+      v[off + k] = x;
+      row[k + d] = x;
+      if (x >= n && y >= m)
+      {
+        found = d;
+        break;
+      }
+    }
+  }
+  free(v);
+  if (found < 0)
+  {
+    free(trace);
+    return 0;
+  }
+  int start = job->nout, open = 0, ex = 0, ey = 0, x = n, y = m;
+  for (int d = found; d > 0; d--) // 从终点往回走，连续的编辑合成一段，结果是倒序的
+  {
+    int *prev = trace + (size_t)(d - 1) * (d - 1) + (d - 1); // prev[k]是第d-1步对角线k上的x
+    int k = x - y;
+    int pk = k == -d || (k != d && prev[k - 1] < prev[k + 1]) ? k + 1 : k - 1;
+    int px = prev[pk], py = px - pk;
+    int mx = pk == k + 1 ? px : px + 1, my = mx - k; // 这一步编辑之后、对角线之前的位置
+    if (open && x > mx)
+    {
+      editorDiffEmit(job, bo + y, ey - y, ao + x, ex - x);
+      open = 0;
+    }
+    if (!open)
+    {
+      open = 1;
+      ex = mx;
+      ey = my;
+    }
+    x = px;
+    y = py;
+  }
+  if (open)
+    editorDiffEmit(job, bo + y, ey - y, ao + x, ex - x);
+  for (int i = start, j = job->nout - 1; i < j; i++, j--)
+  {
+    struct diffSeg t = job->out[i];
+    job->out[i] = job->out[j];
+    job->out[j] = t;
+  }
+  free(trace);
+  return 1;
+}
+static struct diffSlot *editorDiffSlot(struct diffSlot *t, unsigned int mask, unsigned int h)
+{
+  unsigned int i = h & mask;
+  while ((t[i].na || t[i].nb) && t[i].h != h)
+    i = (i + 1) & mask;
+  t[i].h = h;
+  return &t[i];
+}
+static void editorDiffRegion(struct diffJob *job, const unsigned int *a, int n, const unsigned int *b, int m, int ao, int bo) // 比较磁盘上的a[0, n)和当前的b[0, m)，它们分别从第ao、bo行开始
+{
+  while (n && m && a[0] == b[0]) // 去掉相同的头尾
+    a++, b++, n--, m--, ao++, bo++;
+  while (n && m && a[n - 1] == b[m - 1])
+    n--, m--;
+  if (n == 0 || m == 0)
+  {
+    if (n || m)
+      editorDiffEmit(job, bo, m, ao, n);
+    return;
+  }
+  int dmax = KILO_DIFF_COST / (n + m);
+  if (dmax > KILO_DIFF_DMAX)
+    dmax = KILO_DIFF_DMAX;
+  if (dmax > 0 && editorDiffMyers(job, a, n, b, m, ao, bo, dmax))
+    return;
+  // 差别太大时先用两边都只出现一次的行作锚点：按在a中的顺序取b中位置的最长递增子序列，锚点之间分别再比
+  unsigned int cap = 1;
+  while (cap < 2 * (unsigned int)(n + m))
+    cap *= 2;
+  struct diffSlot *t = calloc(cap, sizeof(struct diffSlot));
+  for (int i = 0; i < n; i++)
+  {
+    struct diffSlot *e = editorDiffSlot(t, cap - 1, a[i]);
+    e->na++;
+    e->ia = i;
+  }
+  for (int j = 0; j < m; j++)
+  {
+    struct diffSlot *e = editorDiffSlot(t, cap - 1, b[j]);
+    e->nb++;
+    e->ib = j;
+  }
+  int *pa = malloc(sizeof(int) * (n > 0 ? n : 1)), *pb = malloc(sizeof(int) * (n > 0 ? n : 1)), np = 0;
+  for (int i = 0; i < n; i++)
+  {
+    struct diffSlot *e = editorDiffSlot(t, cap - 1, a[i]);
+    if (e->na == 1 && e->nb == 1)
+    {
+      pa[np] = i;
+      pb[np++] = e->ib;
+    }
+  }
+  free(t);
+  int *tails = malloc(sizeof(int) * (np > 0 ? np : 1)), *link = malloc(sizeof(int) * (np > 0 ? np : 1)), len = 0;
+  for (int p = 0; p < np; p++) // 耐心排序求最长递增子序列，link指向前一个锚点
+  {
+    int l = 0, h = len;
+    while (l < h)
+    {
+      int mid = (l + h) / 2;
+      if (pb[tails[mid]] < pb[p])
+        l = mid + 1;
+      else
+        h = mid;
+    }
+    link[p] = l ? tails[l - 1] : -1;
+    tails[l] = p;
+    if (l == len)
+      len++;
+  }
+  if (len == 0)
+    editorDiffEmit(job, bo, m, ao, n); // 没有锚点，整段算修改
+  else
+  {
+    int *anchors = malloc(sizeof(int) * len);
+    for (int p = tails[len - 1], k = len; p >= 0; p = link[p])
+      anchors[--k] = p;
+    int i0 = 0, j0 = 0;
+    for (int k = 0; k <= len; k++)
+    {
+      int i1 = k < len ? pa[anchors[k]] : n, j1 = k < len ? pb[anchors[k]] : m;
+      editorDiffRegion(job, a + i0, i1 - i0, b + j0, j1 - j0, ao + i0, bo + j0);
+      i0 = i1 + 1;
+      j0 = j1 + 1;
+    }
+    free(anchors);
+  }
+  free(tails);
+  free(link);
+  free(pa);
+  free(pb);
+}
+static void editorDiffRead(struct diffJob *job) // 读磁盘文件，按载入时的规则切行（去掉行尾的\r）并算哈希
+{
+  int fd = open(job->path, O_RDONLY);
+  struct stat st;
+  int cap = 16;
+  job->disk = malloc(sizeof(unsigned int) * cap);
+  if (fd == -1) // 文件没了，当作空文件
+    return;
+  if (fstat(fd, &st) == 0 && st.st_size > 0)
+  {
+    char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map != MAP_FAILED)
+    {
+      madvise(map, st.st_size, MADV_SEQUENTIAL);
+      cap = st.st_size / 32 + 16;
+      job->disk = realloc(job->disk, sizeof(unsigned int) * cap);
+      for (char *p = map, *stop = map + st.st_size; p < stop;)
+      {
+        char *nl = memchr(p, '\n', stop - p);
+        char *end = nl ? nl : stop;
+        while (end > p && end[-1] == '\r')
+          end--;
+        if (job->ndisk == cap)
+        {
+          cap *= 2;
+          job->disk = realloc(job->disk, sizeof(unsigned int) * cap);
+        }
+        job->disk[job->ndisk++] = editorHashBytes(p, end - p);
+        p = nl ? nl + 1 : stop;
+      }
+      munmap(map, st.st_size);
+    }
+  }
+  close(fd);
+}
+void *editorDiffWorker(void *arg)
+{
+  struct diffJob *job = arg;
+  if (job->path)
+    editorDiffRead(job);
+  unsigned int *cur = job->cur;
+  for (int i = 0; i < job->nin; i++)
+  {
+    struct diffSeg *s = &job->in[i];
+    if (job->full)
+      s->dn = job->ndisk;
+    job->split[i] = job->nout;
+    if (s->d < 0 || s->d + s->dn > job->ndisk)
+    {
+      job->bad = 1;
+      break;
+    }
+    editorDiffRegion(job, job->disk + s->d, s->dn, cur, s->cn, s->d, s->c);
+    cur += s->cn;
+  }
+  job->split[job->nin] = job->nout;
+  if (write(job->wake[1], "d", 1) == -1)
+    return NULL;
+  return NULL;
+}
+int editorDiffStart() // 空闲时把改过的段交给比较线程，返回是否开始了
+{
+  if (!diff.on || diff.job || E.load || E.save || E.filename == NULL || (diff.ndirty == 0 && !diff.full))
+    return 0;
+  struct diffJob *job = calloc(1, sizeof(struct diffJob));
+  job->gen = diff.gen;
+  job->base = diff.base;
+  if (diff.disk_ok)
+  {
+    job->disk = diff.disk;
+    job->ndisk = diff.ndisk;
+  }
+  else
+  {
+    struct stat st;
+    job->path = strdup(E.filename);
+    if (stat(E.filename, &st) != 0 || st.st_size != diff.size ||
+        st.st_mtim.tv_sec != diff.mtime.tv_sec || st.st_mtim.tv_nsec != diff.mtime.tv_nsec)
+      diff.full = 1; // 文件在外面被改过或者没了，记下的对应关系不再成立
+  }
+  job->full = diff.full;
+  job->in = malloc(sizeof(struct diffSeg) * (job->full ? 1 : diff.ndirty));
+  if (job->full)
+  {
+    struct diffSeg all = {0, E.numrows, 0, 0, 1};
+    job->in[job->nin++] = all;
+  }
+  else
+    for (int k = 0; k < diff.nsegs; k++)
+      if (diff.segs[k].dirty)
+        job->in[job->nin++] = diff.segs[k];
+  long total = 0;
+  for (int i = 0; i < job->nin; i++)
+    total += job->in[i].cn;
+  job->cur = malloc(sizeof(unsigned int) * (total > 0 ? total : 1));
+  unsigned int *h = job->cur;
+  for (int i = 0; i < job->nin; i++) // 线程不碰行，只在这里算改过的行的哈希
+    for (int r = job->in[i].c; r < job->in[i].c + job->in[i].cn; r++)
+      *h++ = editorHashBytes(E.row[r].chars, E.row[r].size);
+  job->split = malloc(sizeof(int) * (job->nin + 1));
+  if (pipe(job->wake) == -1)
+    die("pipe");
+  diff.job = job;
+  if (pthread_create(&job->thread, NULL, editorDiffWorker, job) != 0)
+    die("pthread_create");
+  return 1;
+}
+void editorDiffFree(struct diffJob *job) // 线程已经回收
+{
+  close(job->wake[0]);
+  close(job->wake[1]);
+  if (job->path)
+    free(job->disk);
+  free(job->path);
+  free(job->in);
+  free(job->cur);
+  free(job->out);
+  free(job->split);
+  free(job);
+}
+void editorDiffDrain() // 比较线程做完了：没过期的结果换掉原来的脏段
+{
+  struct diffJob *job = diff.job;
+  char c;
+  if (read(job->wake[0], &c, 1) != 1)
+    return;
+  pthread_join(job->thread, NULL);
+  diff.job = NULL;
+  if (job->path && job->base == diff.base) // 读到的磁盘内容不管修改有没有过期都能留着用
+  {
+    free(diff.disk);
+    diff.disk = job->disk;
+    diff.ndisk = job->ndisk;
+    diff.disk_ok = 1;
+    job->disk = NULL;
+  }
+  if (job->base == diff.base && job->gen == diff.gen)
+  {
+    if (job->bad) // 脏段留着，整个重比时一起换掉
+      diff.full = 1;
+    else if (job->full)
+    {
+      free(diff.segs);
+      diff.segs = job->out;
+      diff.nsegs = job->nout;
+      diff.capsegs = job->capout;
+      job->out = NULL;
+      diff.full = 0;
+      diff.ndirty = 0;
+    }
+    else
+    {
+      int n = diff.nsegs - job->nin + job->nout, k = 0, i = 0;
+      struct diffSeg *segs = malloc(sizeof(struct diffSeg) * (n > 0 ? n : 1));
+      for (int s = 0; s < diff.nsegs; s++)
+      {
+        if (!diff.segs[s].dirty)
+          segs[k++] = diff.segs[s];
+        else // 重比的结果可能是没有差别
+        {
+          for (int o = job->split[i]; o < job->split[i + 1]; o++)
+            segs[k++] = job->out[o];
+          i++;
+        }
+      }
+      free(diff.segs);
+      diff.segs = segs;
+      diff.nsegs = diff.capsegs = n;
+      long rows = E.numrows; // 段之外一一对应，两边的行数要对得上
+      for (int s = 0; s < n; s++)
+        rows -= diff.segs[s].cn - diff.segs[s].dn;
+      if (rows != diff.ndisk)
+        diff.full = 1;
+      diff.ndirty = 0;
+    }
+    memset(E.shown, 0, sizeof(char *) * E.screenrows); // 标记栏变了，整屏重画
+    E.frame.pending = 1;
+  }
+  editorDiffFree(job);
+}
+void editorDiffClear() // 换缓冲或者保存后没有修改时，当前内容就是基准
+{
+  if (diff.job)
+  {
+    pthread_join(diff.job->thread, NULL);
+    editorDiffFree(diff.job);
+    diff.job = NULL;
+  }
+  free(diff.disk);
+  diff.disk = NULL;
+  diff.ndisk = diff.disk_ok = 0;
+  diff.nsegs = diff.ndirty = diff.full = 0;
+  diff.base++;
+}
+void editorDiffSaved() // 保存成功：新的基准是保存时的快照，保存期间又有修改时只能整个重比
+{
+  int full = diff.gen != diff.save_gen;
+  struct stat st;
+  editorDiffClear();
+  diff.full = full;
+  if (stat(E.filename, &st) == 0)
+    editorDiffBase(&st);
+}
+void editorDiffToggle()
+{
+  if (E.filename == NULL)
+  {
+    editorSetStatusMessage("No file to diff against");
+    return;
+  }
+  diff.on = !diff.on;
+  editorSetStatusMessage("Diff against disk %s", diff.on ? "on: + added, ~ changed, _ deleted below" : "off");
+}
+
+/*** undo ***/
+// 按行的撤销：每项记录一段连续的行在修改前的内容，撤销时整段换回，同时生成反向的重做记录
+void editorUndoFreeGroup(struct undoGroup *g)
+{
+  for (int i = 0; i < g->n; i++)
+  {
+    int n = g->e[i].nold;
+    if (g->e[i].from) // 重排只保存了不在当前内容中的行
+    {
+      n = 0;
+      for (int k = 0; k < g->e[i].nold; k++)
+        n += g->e[i].from[k] < 0;
+    }
+    for (int k = 0; k < n; k++)
+      editorCharsFree(g->e[i].old[k].chars);
+    free(g->e[i].old);
+    free(g->e[i].from);
+  }
+  free(g->e);
+}
+void editorUndoClear(struct undoStack *st)
+{
+  for (int i = 0; i < st->n; i++)
+    editorUndoFreeGroup(&st->g[i]);
+  st->n = 0;
+}
+void editorUndoPushGroup(struct undoStack *st, struct undoGroup g)
+{
+  if (st->n == KILO_UNDO_LEVELS) // 丢弃最旧的一步
+  {
+    editorUndoFreeGroup(&st->g[0]);
+    memmove(&st->g[0], &st->g[1], sizeof(struct undoGroup) * (st->n - 1));
+    st->n--;
+  }
+  if (st->n == st->cap)
+  {
+    st->cap = st->cap ? st->cap * 2 : 16;
+    st->g = realloc(st->g, sizeof(struct undoGroup) * st->cap);
+  }
+  st->g[st->n++] = g;
+}
+struct undoEntry *editorUndoLast() // 当前打开的撤销组中最后一项，没有则为NULL
+{
+  if (E.undo_break || E.undo.n == 0 || E.undo.g[E.undo.n - 1].n == 0)
+    return NULL;
+  struct undoGroup *g = &E.undo.g[E.undo.n - 1];
+  return &g->e[g->n - 1];
+}
+struct undoEntry *editorUndoPush(int at, int nold, int nnew) // 在当前撤销组中追加一项，必要时开始新组
+{
+  if (E.undo_break || E.undo.n == 0)
+  {
+    struct undoGroup g = {NULL, 0, 0, E.cx, E.cy};
+    editorUndoClear(&E.redo); // 新的修改使重做历史失效
+    editorUndoPushGroup(&E.undo, g);
+    E.undo_break = 0;
+  }
+  struct undoGroup *g = &E.undo.g[E.undo.n - 1];
+  if (g->n == g->cap)
+  {
+    g->cap = g->cap ? g->cap * 2 : 4;
+    g->e = realloc(g->e, sizeof(struct undoEntry) * g->cap);
+  }
+  struct undoEntry *e = &g->e[g->n++];
+  e->at = at;
+  e->nold = nold;
+  e->nnew = nnew;
+  e->old = malloc(sizeof(struct undoLine) * (nold > 0 ? nold : 1));
+  e->from = NULL;
+  return e;
+}
+int editorUndoCovered(int at) // 该行已经在上一项记录的范围内，原内容已经保存过
+{
+  struct undoEntry *e = editorUndoLast();
+  return e && at >= e->at && at < e->at + e->nnew;
+}
+struct undoLine *editorUndoSlot(int at) // 为即将修改的一行找保存位置，已经保存过返回NULL
+{
+  if (E.undo_lock || editorUndoCovered(at))
+    return NULL;
+  struct undoEntry *e = editorUndoLast();
+  if (e && at == e->at + e->nnew) // 紧接在上一项之后的行并入该项，批量修改连续的行只占一项
+  {
+    e->old = realloc(e->old, sizeof(struct undoLine) * (e->nold + 1));
+    e->nold++;
+    e->nnew++;
+    return &e->old[e->nold - 1];
+  }
+  return &editorUndoPush(at, 1, 1)->old[0];
+}
+void editorUndoSaveRow(int at) // 修改一行之前保存它的内容
+{
+  struct undoLine *l = editorUndoSlot(at);
+  if (l == NULL)
+    return;
+  erow *row = &E.row[at];
+  l->chars = malloc(row->size + 1);
+  memcpy(l->chars, row->chars, row->size + 1);
+  l->size = row->size;
+}
+void editorUndoTakeRow(int at) // 同editorUndoSaveRow，但直接接管行的chars而不复制
+{
+  struct undoLine *l = editorUndoSlot(at);
+  if (l == NULL)
+    return;
+  erow *row = &E.row[at];
+  l->chars = row->chars;
+  l->size = row->size;
+  row->chars = NULL;
+}
+void editorUndoInsertRows(int at, int n)
+{
+  if (E.undo_lock)
+    return;
+  struct undoEntry *e = editorUndoLast();
+  if (e && at >= e->at && at <= e->at + e->nnew) // 插入在上一项的范围内或紧邻其后，扩大该范围
+    e->nnew += n;
+  else
+    editorUndoPush(at, 0, n);
+}
+void editorUndoInsertRow(int at)
+{
+  editorUndoInsertRows(at, 1);
+}
+void editorUndoDelRow(int at, erow *row) // 删除at行之前调用，接管row的chars；批量删除时row是at之后还没移动的行
+{
+  if (E.undo_lock)
+    return;
+  struct undoEntry *e = editorUndoLast();
+  if (e && at >= e->at && at < e->at + e->nnew) // 删除的是本组新产生的行，不需要保存
+  {
+    e->nnew--;
+    return;
+  }
+  if (e && at == e->at + e->nnew) // 紧接在范围之后的行还是原来的内容，并入上一项
+  {
+    e->old = realloc(e->old, sizeof(struct undoLine) * (e->nold + 1));
+    e->nold++;
+  }
+  else
+    e = editorUndoPush(at, 1, 0);
+  e->old[e->nold - 1].chars = row->chars;
+  e->old[e->nold - 1].size = row->size;
+  row->chars = NULL;
+}
+void editorUndoApply(struct undoEntry *e, struct undoEntry *inv) // 把[at, at+nnew)换回old中的行，inv得到反向的修改
+{
+  if (e->from) // 重排：整段一次换回，反向记录也是重排
+  {
+    editorRowsArrangeInto(e->at, e->nnew, e->from, e->nold, e->old, inv);
+    free(e->old);
+    free(e->from);
+    return;
+  }
+  int common = e->nold < e->nnew ? e->nold : e->nnew;
+  inv->from = NULL;
+  inv->at = e->at;
+  inv->nold = e->nnew;
+  inv->nnew = e->nold;
+  inv->old = malloc(sizeof(struct undoLine) * (e->nnew ? e->nnew : 1));
+  for (int k = 0; k < common; k++) // 行数不变的部分直接交换内容，避免移动行数组
+  {
+    erow *row = &E.row[e->at + k];
+    editorWordsDrop(row);
+    inv->old[k].chars = row->chars;
+    inv->old[k].size = row->size;
+    row->chars = e->old[k].chars;
+    row->size = e->old[k].size;
+    row->flags &= ~ROW_FRESH; // 换回来的chars可能在保存快照里
+    editorUpdateRow(row);
+    editorJournalSetRow(ROW_INDEX(row));
+  }
+  for (int k = common; k < e->nnew; k++)
+  {
+    erow *row = &E.row[e->at + common];
+    editorWordsDrop(row);
+    inv->old[k].chars = row->chars;
+    inv->old[k].size = row->size;
+    row->chars = NULL;
+    editorDelRow(e->at + common);
+  }
+  for (int k = common; k < e->nold; k++)
+  {
+    editorInsertRow(e->at + k, e->old[k].chars, e->old[k].size);
+    editorCharsFree(e->old[k].chars);
+  }
+  free(e->old);
+}
+void editorUndoRedo(struct undoStack *from, struct undoStack *to) // 撤销或重做一组修改
+{
+  if (from->n == 0)
+  {
+    editorSetStatusMessage(from == &E.undo ? "Already at oldest change" : "Already at newest change");
+    return;
+  }
+  struct undoGroup *g = &from->g[--from->n];
+  struct undoGroup inv = {malloc(sizeof(struct undoEntry) * (g->n ? g->n : 1)), g->n, g->n, E.cx, E.cy};
+  E.undo_lock++;
+  for (int i = g->n - 1; i >= 0; i--) // 倒序应用，反向记录也就按倒序排列
+    editorUndoApply(&g->e[i], &inv.e[g->n - 1 - i]);
+  E.undo_lock--;
+  E.cy = g->cy < E.numrows ? g->cy : E.numrows;
+  E.cx = g->cx;
+  int rowlen = E.cy < E.numrows ? E.row[E.cy].size : 0;
+  if (E.cx > rowlen)
+    E.cx = rowlen;
+  free(g->e);
+  editorUndoPushGroup(to, inv);
+  E.undo_break = 1;
+  E.dirty++;
+}
+
+/*** file i/o ***/
+char *editorRowsToString(size_t *buflen)
+{ // 将E.row中的所有行连接成一个单独的字符串，以便将其写入磁盘
+  size_t totlen = 0;
+  int j;
+  for (j = 0; j < E.numrows; j++)
+    totlen += E.row[j].size + 1;
+  *buflen = totlen; // 将每行文本的长度相加，为每行添加一个换行符1，将总长度保存到buflen中
+  char *buf = malloc(totlen);
+  char *p = buf;
+  for (j = 0; j < E.numrows; j++)
+  {
+    memcpy(p, E.row[j].chars, E.row[j].size); // 在分配所需的内存之后，遍历行，并将每行的内容memcpy()到缓冲区的末尾
+    p += E.row[j].size;
+    *p = '\n';
+    p++;
+  }
+  return buf;
+}
+
+struct loadJob // 分片载入：先读够第一屏马上显示，其余的行在主循环空闲时接着读
+{
+  FILE *fp;
+  char *line;
+  size_t linecap;
+  off_t size; // 文件大小，用来显示进度
+  off_t done; // 已经读入的字节数
+};
+void editorLoadSlice(int nrows) // 再读入最多nrows行，读到文件尾时收尾并开始记录日志
+{
+  struct loadJob *job = E.load;
+  if (job == NULL)
+    return;
+  int dirty = E.dirty;
+  E.undo_lock++; // 载入文件不是可撤销的修改
+  ssize_t linelen = 0;
+  for (int n = 0; n < nrows && (linelen = getline(&job->line, &job->linecap, job->fp)) != -1; n++)
+  { // 将文件逐行读取到E.row中
+    job->done += linelen;
+    while (linelen > 0 && (job->line[linelen - 1] == '\n' ||
+                           job->line[linelen - 1] == '\r'))
+      linelen--;
+    if (!intern.on || !editorInternRow(E.numrows, job->line, linelen))
+      editorInsertRow(E.numrows, job->line, linelen);
+  }
+  E.undo_lock--;
+  E.dirty = dirty;
+  if (linelen != -1)
+    return;
+  free(job->line);
+  fclose(job->fp);
+  free(job);
+  E.load = NULL;
+  editorJournalOpen(1);
+  if (intern.rows)
+    editorInternReport();
+}
+void editorLoadFinish() // 修改或保存之前必须先读完整个文件
+{
+  if (E.load == NULL)
+    return;
+  editorSetStatusMessage("Loading %s...", E.filename);
+  editorRefreshScreen();
+  editorSetStatusMessage("");
+  editorLoadSlice(INT_MAX);
+}
+void editorOpen(char *filename)
+{
+  editorUndoClear(&E.undo);
+  editorUndoClear(&E.redo);
+  free(E.filename);
+  E.filename = strdup(filename); // 将文件名复制到E.filename中
+  editorSelectSyntaxHighlight();
+  FILE *fp = fopen(filename, "r");
+  if (!fp)
+    die("fopen");
+  struct stat st;
+  E.load = calloc(1, sizeof(struct loadJob));
+  E.load->fp = fp;
+  if (fstat(fileno(fp), &st) == 0)
+  {
+    E.load->size = st.st_size;
+    editorDiffBase(&st);
+  }
+  E.dirty = 0; // 重置文件状态
+  editorLoadSlice(E.screenrows + 1);
+}
+static int editorWriteAll(int fd, const char *p, size_t len)
+{
+  while (len > 0)
+  {
+    ssize_t n = write(fd, p, len);
+    if (n == -1 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return -1;
+    p += n;
+    len -= n;
+  }
+  return 0;
+}
+void editorSyncDir(const char *path) // fsync path所在的目录：改名替换文件后，改名本身要等目录落盘才算持久
+{
+  char *dir = strdup(path);
+  char *slash = strrchr(dir, '/');
+  if (slash)
+    *(slash == dir ? slash + 1 : slash) = '\0';
+  int fd = open(slash ? dir : ".", O_RDONLY | O_DIRECTORY);
+  if (fd != -1)
+  {
+    fsync(fd);
+    close(fd);
+  }
+  free(dir);
+}
+struct saveJob // 后台保存：主线程只记下各行的chars和长度，写线程拼成字节写盘，之后可以继续编辑
+{
+  char *path;
+  struct undoLine *lines; // 开始保存时的各行；保存期间这些chars不原地修改也不释放
+  int nlines;
+  struct textSpan **spans; // 开始保存时的span各持有一个引用，行指向的文本不会随之释放
+  int nspans;
+  char **kept; // 保存期间释放的chars，写完再真正释放
+  int nkept;
+  int keptcap;
+  size_t len;
+  size_t written; // 写线程更新，界面读取，由lock保护
+  int done;
+  int error; // 写失败时的errno
+  int dirty; // 开始保存时的E.dirty，之后的修改保存完仍然算未保存
+  int threaded; // 线程创建失败时已经同步写完，不用join
+  pthread_t thread;
+  pthread_mutex_t lock;
+};
+int editorSaveKeep(char *p) // 保存期间要释放的chars可能还在快照里，先留着，写完再释放；返回是否留下了
+{
+  struct saveJob *s = E.save;
+  if (s == NULL || p == NULL)
+    return 0;
+  if (s->nkept == s->keptcap)
+  {
+    s->keptcap = s->keptcap ? s->keptcap * 2 : 64;
+    s->kept = realloc(s->kept, sizeof(char *) * s->keptcap);
+  }
+  s->kept[s->nkept++] = p;
+  return 1;
+}
+static int editorSaveFlush(struct saveJob *s, int fd, char *buf, size_t *n) // 写出缓冲里攒的字节，界面可以显示进度
+{
+  if (*n && editorWriteAll(fd, buf, *n) == -1)
+    return -1;
+  pthread_mutex_lock(&s->lock);
+  s->written += *n;
+  pthread_mutex_unlock(&s->lock);
+  *n = 0;
+  return 0;
+}
+static int editorSaveAppend(struct saveJob *s, int fd, char *buf, size_t *n, const char *p, size_t len) // 追加到KILO_SAVE_CHUNK大的缓冲，满了就写出去
+{
+  while (len > 0)
+  {
+    size_t k = KILO_SAVE_CHUNK - *n < len ? KILO_SAVE_CHUNK - *n : len;
+    memcpy(buf + *n, p, k);
+    *n += k;
+    p += k;
+    len -= k;
+    if (*n == KILO_SAVE_CHUNK && editorSaveFlush(s, fd, buf, n) == -1)
+      return -1;
+  }
+  return 0;
+}
+void *editorSaveWriter(void *arg) // 写到同目录的临时文件，fsync后改名替换原文件，再fsync目录；中途出错或崩溃时原文件完好
+{
+  struct saveJob *s = arg;
+  int error = 0;
+  char *target = realpath(s->path, NULL); // 符号链接替换它指向的文件，不把链接换成普通文件
+  if (target == NULL)
+    target = strdup(s->path);
+  char *tmp = editorJournalPath(target);
+  strcpy(tmp + strlen(tmp) - 5, ".ksav");
+  int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  struct stat st;
+  if (fd == -1)
+    error = errno;
+  else if (stat(target, &st) == 0) // 保留原文件的权限
+    fchmod(fd, st.st_mode & 07777);
+  char *buf = malloc(KILO_SAVE_CHUNK);
+  size_t n = 0;
+  for (int i = 0; !error && i < s->nlines; i++) // 各行到这里才拼成字节
+    if (editorSaveAppend(s, fd, buf, &n, s->lines[i].chars, s->lines[i].size) == -1 || editorSaveAppend(s, fd, buf, &n, "\n", 1) == -1)
+      error = errno;
+  if (!error && editorSaveFlush(s, fd, buf, &n) == -1)
+    error = errno;
+  free(buf);
+  if (!error && fsync(fd) == -1)
+    error = errno;
+  if (fd != -1 && close(fd) == -1 && !error)
+    error = errno;
+  if (!error && rename(tmp, target) == -1)
+    error = errno;
+  if (error)
+    unlink(tmp);
+  else
+    editorSyncDir(target);
+  free(tmp);
+  free(target);
+  pthread_mutex_lock(&s->lock);
+  s->error = error;
+  s->done = 1;
+  pthread_mutex_unlock(&s->lock);
+  return NULL;
+}
+int editorSavePoll(int wait) // 后台保存结束后收尾，wait时等它写完；返回是否还在保存
+{
+  struct saveJob *s = E.save;
+  if (s == NULL)
+    return 0;
+  pthread_mutex_lock(&s->lock);
+  int done = s->done;
+  pthread_mutex_unlock(&s->lock);
+  if (!done && !wait)
+    return 1;
+  if (s->threaded)
+    pthread_join(s->thread, NULL);
+  E.save = NULL;
+  if (s->error == 0)
+  {
+    E.dirty -= s->dirty;
+    editorJournalSaved();
+    editorDiffSaved();
+    editorSetStatusMessage("%zu bytes written to disk", s->len);
+  }
+  else
+    editorSetStatusMessage("Can't save! I/O error: %s", strerror(s->error)); // 通知消息，是否保存成功
+  pthread_mutex_destroy(&s->lock);
+  for (int i = 0; i < s->nkept; i++) // 写线程不再读快照，推迟的释放现在做
+    free(s->kept[i]);
+  for (int i = 0; i < s->nspans; i++)
+    editorSpanUnref(s->spans[i], 1);
+  free(s->kept);
+  free(s->spans);
+  free(s->lines);
+  free(s->path);
+  free(s);
+  return 0;
+}
+struct saveJob *editorSaveSnapshot(const char *path) // 只记下各行的chars指针和长度，不复制内容；E.save指向它期间这些chars保持不变
+{
+  struct saveJob *s = calloc(1, sizeof(struct saveJob));
+  s->path = strdup(path);
+  s->nlines = E.numrows;
+  s->lines = malloc(sizeof(struct undoLine) * (E.numrows > 0 ? E.numrows : 1));
+  for (int j = 0; j < E.numrows; j++)
+  {
+    s->lines[j].chars = E.row[j].chars;
+    s->lines[j].size = E.row[j].size;
+    s->len += (size_t)E.row[j].size + 1;
+    E.row[j].flags &= ~ROW_FRESH; // 上次保存时复制出来的行这次也在快照里
+  }
+  s->nspans = nspans; // 粘贴的行和行池中的行指向span，span在写完之前不能释放
+  s->spans = malloc(sizeof(struct textSpan *) * (nspans > 0 ? nspans : 1));
+  for (int i = 0; i < nspans; i++)
+  {
+    s->spans[i] = spans[i];
+    spans[i]->refs++;
+  }
+  pthread_mutex_init(&s->lock, NULL);
+  return s;
+}
+void editorSave()
+{
+  if (E.save)
+  {
+    editorSetStatusMessage("Still saving, try again when it finishes");
+    return;
+  }
+  if (E.filename == NULL)
+  {
+    E.filename = editorPrompt("Save as: %s (ESC to cancel)", NULL, 0); // windows的bash需要按三次escape,将NULL传递给editorpormpt()以防不想使用回调
+    if (E.filename == NULL)
+    {
+      editorSetStatusMessage("Save aborted");
+      return;
+    }
+    editorSelectSyntaxHighlight();
+  }
+  struct saveJob *s = editorSaveSnapshot(E.filename); // 快照只复制行指针，拼接和写盘都交给写线程
+  s->dirty = E.dirty;
+  diff.save_gen = diff.gen;
+  E.save = s;
+  s->threaded = pthread_create(&s->thread, NULL, editorSaveWriter, s) == 0;
+  if (!s->threaded)
+    editorSaveWriter(s); // 开不了线程就同步写
+  editorSetStatusMessage("Saving %s ...", E.filename);
+}
+
+/*** journal ***/
+// 交换日志：每次修改行都往内存缓冲追加一条记录，后台线程批量写入.文件名.kswp并fdatasync，启动时发现日志就重放
+#define KILO_JOURNAL_FLUSH (64 * 1024)         // 缓冲超过该大小时立即唤醒写线程
+#define KILO_JOURNAL_INTERVAL_MS 200           // 写线程攒批的间隔
+#define KILO_JOURNAL_COMPACT (4 * 1024 * 1024) // 日志超过该大小且超过快照两倍时压缩成快照
+#define JOURNAL_REC_OVERHEAD 13                // 操作码1字节、行号4字节、长度4字节，末尾4字节校验
+#define JOURNAL_PATCH_HEAD 8                   // P记录的内容先是修改的起始偏移和删掉的字节数，各4字节，后面是插入的字节
+struct journalHeader
+{
+  char magic[8];
+  long long size; // 日志开始时磁盘文件的大小和修改时间，不一致说明文件被改过，日志作废
+  long long mtime_sec;
+  long long mtime_nsec;
+};
+struct journal
+{
+  char *path;
+  int fd; // 只由写线程使用
+  struct journalHeader hdr;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  char *buf; // 待写入的记录，主线程追加，写线程整块取走
+  size_t len, cap;
+  int restart; // buf是日志文件的全部新内容，写线程写临时文件后改名替换
+  int stop;
+  int error; // 写线程遇到的errno
+  int reported;
+  size_t last_set; // buf中最后一条记录是对last_set_at行的S记录时，它的偏移，用于合并同一行的连续修改
+  int last_set_at;
+  size_t logged; // 自上次快照以来记录的字节数
+  size_t base;   // 上次快照的大小
+};
+char *editorJournalPath(const char *filename) // a/b.c的日志是a/.b.c.kswp
+{
+  const char *base = strrchr(filename, '/');
+  int dirlen = base ? base - filename + 1 : 0;
+  base = base ? base + 1 : filename;
+  char *path = malloc(strlen(filename) + 7);
+  sprintf(path, "%.*s.%s.kswp", dirlen, filename, base);
+  return path;
+}
+void editorJournalStat(const char *filename, struct journalHeader *h)
+{
+  struct stat st;
+  memset(h, 0, sizeof(*h));
+  memcpy(h->magic, "KSWP2\n", 6);
+  if (stat(filename, &st) == 0)
+  {
+    h->size = st.st_size;
+    h->mtime_sec = st.st_mtim.tv_sec;
+    h->mtime_nsec = st.st_mtim.tv_nsec;
+  }
+}
+static void editorJournalPut(struct journal *j, int op, int at, const char *head, int headlen, const char *s, int len) // 内容是head接着s；调用者持有锁
+{
+  len += headlen;
+  size_t need = j->len + len + JOURNAL_REC_OVERHEAD;
+  if (need > j->cap)
+  {
+    j->cap = need * 2;
+    j->buf = realloc(j->buf, j->cap);
+  }
+  char *p = j->buf + j->len;
+  unsigned int uat = at, ulen = len;
+  p[0] = op;
+  memcpy(p + 1, &uat, 4);
+  memcpy(p + 5, &ulen, 4);
+  if (headlen)
+    memcpy(p + 9, head, headlen);
+  if (len > headlen)
+    memcpy(p + 9 + headlen, s, len - headlen);
+  unsigned int sum = editorHashBytes(p, 9 + len);
+  memcpy(p + 9 + len, &sum, 4);
+  j->len = need;
+  j->logged += len + JOURNAL_REC_OVERHEAD;
+}
+void *editorJournalWriter(void *arg)
+{
+  struct journal *j = arg;
+  char *out = NULL;
+  size_t outcap = 0;
+  pthread_mutex_lock(&j->lock);
+  for (;;)
+  {
+    while (j->len == 0 && !j->stop)
+      pthread_cond_wait(&j->cond, &j->lock);
+    if (!j->stop && !j->restart && j->len < KILO_JOURNAL_FLUSH) // 攒一会儿，连续输入合并成一次写入
+    {
+      struct timespec ts;
+      clock_gettime(CLOCK_REALTIME, &ts);
+      ts.tv_nsec += KILO_JOURNAL_INTERVAL_MS * 1000000L;
+      ts.tv_sec += ts.tv_nsec / 1000000000L;
+      ts.tv_nsec %= 1000000000L;
+      pthread_cond_timedwait(&j->cond, &j->lock, &ts);
+    }
+    if (j->len == 0 && j->stop)
+      break;
+    char *tmp = j->buf; // 交换缓冲区，写盘时不持有锁
+    j->buf = out;
+    out = tmp;
+    size_t tmpcap = j->cap;
+    j->cap = outcap;
+    outcap = tmpcap;
+    size_t len = j->len;
+    int restart = j->restart;
+    j->len = 0;
+    j->restart = 0;
+    j->last_set_at = -1;
+    pthread_mutex_unlock(&j->lock);
+
+    int err = 0;
+    if (restart)
+    {
+      char *tmppath = malloc(strlen(j->path) + 5);
+      sprintf(tmppath, "%s.tmp", j->path);
+      int fd = open(tmppath, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+      if (fd == -1 || editorWriteAll(fd, out, len) == -1 || fdatasync(fd) == -1 || rename(tmppath, j->path) == -1)
+      {
+        err = errno;
+        if (fd != -1)
+          close(fd);
+      }
+      else
+      {
+        if (j->fd != -1)
+          close(j->fd);
+        j->fd = fd;
+      }
+      free(tmppath);
+    }
+    else if (j->fd != -1 && (editorWriteAll(j->fd, out, len) == -1 || fdatasync(j->fd) == -1))
+      err = errno;
+
+    pthread_mutex_lock(&j->lock);
+    if (err && !j->error)
+      j->error = err;
+  }
+  pthread_mutex_unlock(&j->lock);
+  free(out);
+  return NULL;
+}
+void editorJournalCompact(struct journal *j, int snapshot) // 用文件头和全文快照替换日志，snapshot为0时只写文件头（刚保存过）
+{
+  size_t textlen = 0;
+  char *text = snapshot ? editorRowsToString(&textlen) : NULL;
+  pthread_mutex_lock(&j->lock);
+  j->len = 0; // 还没写出的记录已经包含在快照里了
+  if (j->cap < sizeof(j->hdr))
+  {
+    j->cap = sizeof(j->hdr);
+    j->buf = realloc(j->buf, j->cap);
+  }
+  memcpy(j->buf, &j->hdr, sizeof(j->hdr));
+  j->len = sizeof(j->hdr);
+  if (snapshot)
+    editorJournalPut(j, 'F', 0, NULL, 0, text, textlen);
+  j->restart = 1;
+  j->last_set_at = -1;
+  j->logged = 0;
+  j->base = textlen;
+  pthread_mutex_unlock(&j->lock);
+  pthread_cond_signal(&j->cond);
+  free(text);
+}
+static void editorJournalUnlock(struct journal *j, int wake) // 追加完记录后放锁：需要时唤醒写线程、报告写错误、压缩
+{
+  wake |= j->len >= KILO_JOURNAL_FLUSH;
+  int err = j->error && !j->reported ? j->error : 0;
+  if (err)
+    j->reported = 1;
+  int compact = j->logged > KILO_JOURNAL_COMPACT && j->logged > 2 * j->base;
+  pthread_mutex_unlock(&j->lock);
+  if (wake)
+    pthread_cond_signal(&j->cond);
+  if (err)
+    editorSetStatusMessage("Swap file error: %s", strerror(err));
+  if (compact)
+    editorJournalCompact(j, 1);
+}
+void editorJournalAppendRows(int op, int at, int n) // 一次追加n条记录：I是[at, at+n)各行，D是在at处删除n行；全部追加完才考虑压缩
+{
+  editorDiffRows(op, at, n); // 差异标记跟踪同样的修改，没有日志时也要记
+  struct journal *j = E.journal;
+  if (j == NULL)
+    return;
+  pthread_mutex_lock(&j->lock);
+  if (op == 'S' && j->last_set_at == at) // 同一行的连续修改只保留最后的内容
+  {
+    j->logged -= j->len - j->last_set;
+    j->len = j->last_set;
+  }
+  int wake = j->len == 0;
+  size_t start = j->len;
+  for (int k = 0; k < n; k++)
+  {
+    start = j->len;
+    if (op == 'D') // D记录在删除之后追加，不读行内容
+      editorJournalPut(j, op, at, NULL, 0, NULL, 0);
+    else
+      editorJournalPut(j, op, at + k, NULL, 0, E.row[at + k].chars, E.row[at + k].size);
+  }
+  j->last_set = start;
+  j->last_set_at = op == 'S' ? at : -1;
+  editorJournalUnlock(j, wake);
+}
+void editorJournalPatchRow(int at, int off, int del, int ins) // 修改之后调用：第at行从off开始的del个字节换成了现在的ins个字节；按键只记变化的部分，不在锁里复制整行
+{
+  editorDiffRows('S', at, 1);
+  struct journal *j = E.journal;
+  if (j == NULL)
+    return;
+  unsigned int head[2] = {off, del};
+  pthread_mutex_lock(&j->lock);
+  int wake = j->len == 0;
+  editorJournalPut(j, 'P', at, (const char *)head, JOURNAL_PATCH_HEAD, E.row[at].chars + off, ins);
+  j->last_set_at = -1;
+  editorJournalUnlock(j, wake);
+}
+void editorJournalAppend(int op, int at) { editorJournalAppendRows(op, at, 1); }
+void editorJournalInsertRow(int at) { editorJournalAppend('I', at); }
+void editorJournalDelRow(int at) { editorJournalAppend('D', at); } // 删除之后调用
+void editorJournalSetRow(int at) { editorJournalAppend('S', at); } // 修改之后调用
+int editorJournalReplay(int fd, const struct journalHeader *hdr, size_t *valid) // 返回重放的记录数，日志与磁盘文件不符时返回-1
+{
+  struct stat st;
+  if (fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(*hdr))
+    return -1;
+  size_t n = st.st_size;
+  char *buf = malloc(n);
+  size_t got = 0;
+  while (got < n)
+  {
+    ssize_t r = pread(fd, buf + got, n - got, got);
+    if (r <= 0)
+      break;
+    got += r;
+  }
+  if (got < sizeof(*hdr) || memcmp(buf, hdr, sizeof(*hdr)))
+  {
+    free(buf);
+    return -1;
+  }
+  n = got;
+  size_t p = sizeof(*hdr);
+  int count = 0;
+  while (p + JOURNAL_REC_OVERHEAD <= n) // 最后一条记录可能只写了一半，校验不过就停下
+  {
+    unsigned int at, len, sum;
+    memcpy(&at, buf + p + 1, 4);
+    memcpy(&len, buf + p + 5, 4);
+    if (len > n - p - JOURNAL_REC_OVERHEAD)
+      break;
+    memcpy(&sum, buf + p + 9 + len, 4);
+    if (sum != editorHashBytes(buf + p, 9 + len))
+      break;
+    char *s = buf + p + 9;
+    switch (buf[p])
+    {
+    case 'I':
+      editorInsertRow(at, s, len);
+      break;
+    case 'D':
+      editorDelRow(at);
+      break;
+    case 'S':
+      if ((int)at < E.numrows)
+      {
+        char *chars = malloc(len + 1);
+        memcpy(chars, s, len);
+        chars[len] = '\0';
+        editorRowReplace(&E.row[at], chars, len);
+      }
+      break;
+    case 'P': // 补丁：off处删掉del个字节，插入其余内容
+      if ((int)at < E.numrows && len >= JOURNAL_PATCH_HEAD)
+      {
+        unsigned int off, del, ins = len - JOURNAL_PATCH_HEAD;
+        memcpy(&off, s, 4);
+        memcpy(&del, s + 4, 4);
+        erow *row = &E.row[at];
+        if (off > (unsigned int)row->size || del > row->size - off)
+          break;
+        int size = row->size - del + ins;
+        char *chars = malloc(size + 1);
+        memcpy(chars, row->chars, off);
+        memcpy(chars + off, s + JOURNAL_PATCH_HEAD, ins);
+        memcpy(chars + off + ins, row->chars + off + del, row->size - off - del);
+        chars[size] = '\0';
+        editorRowReplace(row, chars, size);
+      }
+      break;
+    case 'F': // 快照：丢掉所有行，按换行符重新切分
+      while (E.numrows > 0)
+        editorDelRow(E.numrows - 1);
+      for (char *end = s + len; s < end;)
+      {
+        char *nl = memchr(s, '\n', end - s);
+        int linelen = nl ? nl - s : end - s;
+        editorInsertRow(E.numrows, s, linelen);
+        s += linelen + 1;
+      }
+      break;
+    }
+    p += len + JOURNAL_REC_OVERHEAD;
+    count++;
+  }
+  free(buf);
+  *valid = p;
+  return count;
+}
+void editorJournalOpen(int replay) // 打开文件或第一次保存后开始记录日志，replay时先恢复上次未保存的修改
+{
+  if (E.filename == NULL || E.journal)
+    return;
+  struct journal *j = calloc(1, sizeof(struct journal));
+  j->path = editorJournalPath(E.filename);
+  editorJournalStat(E.filename, &j->hdr);
+  j->last_set_at = -1;
+  j->fd = replay ? open(j->path, O_RDWR | O_APPEND) : -1;
+  if (j->fd != -1)
+  {
+    size_t valid = 0;
+    E.undo_lock++; // 恢复的修改不进入撤销历史
+    int count = editorJournalReplay(j->fd, &j->hdr, &valid);
+    E.undo_lock--;
+    if (count < 0)
+    {
+      close(j->fd);
+      j->fd = -1;
+      char *old = malloc(strlen(j->path) + 5);
+      sprintf(old, "%s.old", j->path);
+      rename(j->path, old);
+      editorSetStatusMessage("Swap file does not match %s, kept as %s", E.filename, old);
+      free(old);
+    }
+    else
+    {
+      if (ftruncate(j->fd, valid) == -1) // 去掉写了一半的记录
+        valid = 0;
+      j->base = valid;
+      if (count > 0)
+        editorSetStatusMessage("Recovered %d changes from %s", count, j->path);
+    }
+  }
+  if (j->fd == -1)
+  {
+    j->fd = open(j->path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0600);
+    if (j->fd == -1 || editorWriteAll(j->fd, (char *)&j->hdr, sizeof(j->hdr)) == -1)
+    {
+      if (j->fd != -1)
+        close(j->fd);
+      editorSetStatusMessage("Can't create swap file %s: %s", j->path, strerror(errno));
+      free(j->path);
+      free(j);
+      return;
+    }
+  }
+  pthread_mutex_init(&j->lock, NULL);
+  pthread_cond_init(&j->cond, NULL);
+  pthread_create(&j->thread, NULL, editorJournalWriter, j);
+  E.journal = j;
+}
+void editorJournalSaved() // 保存成功后日志从文件头重新开始；后台保存期间又有修改时，同时写入当前全文快照
+{
+  if (E.journal == NULL)
+  {
+    editorJournalOpen(0);
+    if (E.journal == NULL || E.dirty == 0)
+      return;
+  }
+  editorJournalStat(E.filename, &E.journal->hdr);
+  editorJournalCompact(E.journal, E.dirty > 0);
+}
+void editorJournalClose(int remove) // 停止写线程；正常退出时删除日志
+{
+  struct journal *j = E.journal;
+  if (j == NULL)
+    return;
+  E.journal = NULL;
+  pthread_mutex_lock(&j->lock);
+  j->stop = 1;
+  pthread_mutex_unlock(&j->lock);
+  pthread_cond_signal(&j->cond);
+  pthread_join(j->thread, NULL);
+  if (j->fd != -1)
+    close(j->fd);
+  if (remove)
+    unlink(j->path);
+  pthread_mutex_destroy(&j->lock);
+  pthread_cond_destroy(&j->cond);
+  free(j->buf);
+  free(j->path);
+  free(j);
+}
+
+/*** regex ***/
+// 正则表达式先编译成Thompson NFA，搜索时按需把NFA状态集合构造成DFA状态（懒惰DFA），不回溯，时间与输入长度成线性
+#define RX_MAX_NFA 20000    // NFA状态数上限，防止{m,n}展开过大
+#define RX_MAX_DSTATES 2048 // DFA缓存的状态数上限，超过后清空重建，内存有界
+#define RX_MIN_DSTATES 8    // DFA缓存开始时的容量，按需翻倍；简单的模式只用到几个状态
+#define RX_MAX_REPEAT 1000  // {m,n}中允许的最大次数
+#define RX_MAX_LIT 64       // 预过滤字面量的最大长度
+enum rxType
+{
+  RX_CHAR = 0, // 匹配set中的一个字节
+  RX_SPLIT,    // 两条epsilon边out和out1
+  RX_EPS,      // 一条epsilon边out
+  RX_BOL,      // 只在行首成立的epsilon边
+  RX_EOL,      // 只在行尾成立的epsilon边
+  RX_MATCH
+};
+struct rxnfa
+{
+  int type;
+  int out, out1;
+  unsigned char set[32]; // 256位字节集合
+};
+struct rxdstate
+{
+  int *nfa; // 排好序的NFA状态集合，只保留RX_CHAR、RX_EOL和RX_MATCH
+  int nnfa;
+  int accept;     // 此处已经匹配
+  int accept_eol; // 如果此处是行尾则匹配
+  int next[256]; // 转移表，-1表示尚未计算
+};
+struct rxdfa
+{
+  int start;      // NFA起始状态
+  int unanchored; // 非锚定时每一步都重新加入起始状态，相当于在模式前加.*
+  int startid[2]; // 起始DFA状态，下标表示行首断言是否成立，-1表示需要重新构造
+  struct rxdstate *st;
+  int nst;
+  int cap;
+  int *hash; // 开放寻址哈希表，保存DFA状态编号+1，0表示空槽，大小是cap的两倍
+  int hashcap;
+};
+typedef struct regex
+{
+  struct rxnfa *nfa; // 正向和反向两张NFA共用一个数组
+  int nnfa;
+  int capnfa;
+  int anchor_start; // 模式以^开头，只在literal时使用
+  int anchor_end;   // 模式以$结尾，只在literal时使用
+  int nullable;     // 能匹配空串
+  int literal;      // 模式只由字面字符组成，直接用memmem
+  char lit[RX_MAX_LIT]; // 任何匹配都必须包含的字面量，用于跳过不可能匹配的行
+  int litlen;
+  struct rxdfa fwd;  // 非锚定正向DFA，用来找最早的匹配结束位置
+  struct rxdfa anch; // 锚定正向DFA，用来找最长匹配
+  struct rxdfa rev;  // 锚定反向DFA，从结束位置往回找最左的开始位置
+  struct rxdfa revu; // 非锚定反向DFA，从行尾往回找所有匹配中最左的开始位置
+  // revu上一次扫描的结果：starts[i]表示有匹配能从starts_s[i]开始，覆盖[starts_from, starts_len)，供rxSearchNext继续使用
+  unsigned char *starts;
+  int startscap;
+  const char *starts_s;
+  int starts_from, starts_len;
+  // 构造DFA状态时用的临时空间
+  int *stack;
+  int *set;
+  unsigned int *mark;
+  unsigned int gen;
+} regex;
+struct rxfrag
+{
+  int start, end; // end总是一个out悬空的RX_EPS状态
+};
+struct rxparser
+{
+  const char *p;
+  regex *re;
+  const char *src; // 模式的开头，用于判断^和$是否在两端
+  int reverse;     // 构造反向NFA时连接顺序颠倒，^和$的角色互换
+  int err;
+  int depth;            // 括号嵌套深度，只在最外层收集字面量
+  char run[RX_MAX_LIT]; // 当前连续的字面量
+  int runlen;
+  int literal; // 到目前为止都是字面字符
+};
+
+int rxNewState(struct rxparser *ps, int type, int out, int out1)
+{
+  regex *re = ps->re;
+  if (re->nnfa >= RX_MAX_NFA)
+  {
+    ps->err = 1;
+    return 0;
+  }
+  if (re->nnfa == re->capnfa)
+  {
+    re->capnfa = re->capnfa ? re->capnfa * 2 : 64;
+    re->nfa = realloc(re->nfa, sizeof(struct rxnfa) * re->capnfa);
+  }
+  struct rxnfa *s = &re->nfa[re->nnfa];
+  s->type = type;
+  s->out = out;
+  s->out1 = out1;
+  memset(s->set, 0, sizeof(s->set));
+  return re->nnfa++;
+}
+struct rxfrag rxEmpty(struct rxparser *ps)
+{
+  struct rxfrag f;
+  f.start = f.end = rxNewState(ps, RX_EPS, -1, -1);
+  return f;
+}
+struct rxfrag rxSet(struct rxparser *ps, const unsigned char *set)
+{
+  struct rxfrag f;
+  f.end = rxNewState(ps, RX_EPS, -1, -1);
+  f.start = rxNewState(ps, RX_CHAR, f.end, -1);
+  if (!ps->err)
+    memcpy(ps->re->nfa[f.start].set, set, 32);
+  return f;
+}
+struct rxfrag rxConcat(struct rxparser *ps, struct rxfrag a, struct rxfrag b)
+{
+  struct rxfrag f;
+  if (ps->err)
+    return a;
+  if (ps->reverse) // 反向NFA中先匹配b再匹配a
+  {
+    ps->re->nfa[b.end].out = a.start;
+    f.start = b.start;
+    f.end = a.end;
+  }
+  else
+  {
+    ps->re->nfa[a.end].out = b.start;
+    f.start = a.start;
+    f.end = b.end;
+  }
+  return f;
+}
+struct rxfrag rxAlt(struct rxparser *ps, struct rxfrag a, struct rxfrag b)
+{
+  struct rxfrag f;
+  f.end = rxNewState(ps, RX_EPS, -1, -1);
+  f.start = rxNewState(ps, RX_SPLIT, a.start, b.start);
+  if (!ps->err)
+  {
+    ps->re->nfa[a.end].out = f.end;
+    ps->re->nfa[b.end].out = f.end;
+  }
+  return f;
+}
+struct rxfrag rxStar(struct rxparser *ps, struct rxfrag a)
+{
+  struct rxfrag f;
+  f.end = rxNewState(ps, RX_EPS, -1, -1);
+  f.start = rxNewState(ps, RX_SPLIT, a.start, f.end);
+  if (!ps->err)
+    ps->re->nfa[a.end].out = f.start;
+  return f;
+}
+struct rxfrag rxPlus(struct rxparser *ps, struct rxfrag a)
+{
+  struct rxfrag f;
+  f.end = rxNewState(ps, RX_EPS, -1, -1);
+  int split = rxNewState(ps, RX_SPLIT, a.start, f.end);
+  if (!ps->err)
+    ps->re->nfa[a.end].out = split;
+  f.start = a.start;
+  return f;
+}
+struct rxfrag rxQuest(struct rxparser *ps, struct rxfrag a)
+{
+  struct rxfrag f;
+  f.end = rxNewState(ps, RX_EPS, -1, -1);
+  f.start = rxNewState(ps, RX_SPLIT, a.start, f.end);
+  if (!ps->err)
+    ps->re->nfa[a.end].out = f.end;
+  return f;
+}
+struct rxfrag rxClone(struct rxparser *ps, struct rxfrag a, int lo, int hi) // 复制[lo,hi)范围内的片段，用于{m,n}
+{
+  int off = ps->re->nnfa - lo;
+  for (int i = lo; i < hi; i++)
+  {
+    struct rxnfa *s = &ps->re->nfa[i];
+    int k = rxNewState(ps, s->type, -1, -1);
+    if (ps->err)
+      return a;
+    s = &ps->re->nfa[i]; // rxNewState可能realloc
+    struct rxnfa *d = &ps->re->nfa[k];
+    memcpy(d->set, s->set, 32);
+    d->out = (s->out >= lo && s->out < hi) ? s->out + off : s->out;
+    d->out1 = (s->out1 >= lo && s->out1 < hi) ? s->out1 + off : s->out1;
+  }
+  a.start += off;
+  a.end += off;
+  return a;
+}
+void rxSetAdd(unsigned char *set, int c)
+{
+  set[c >> 3] |= 1 << (c & 7);
+}
+int rxSetHas(const unsigned char *set, int c)
+{
+  return set[c >> 3] & (1 << (c & 7));
+}
+int rxEscapeClass(int c, unsigned char *set) // 处理\d \w \s及其取反，返回0表示不是类转义
+{
+  int neg = isupper(c);
+  int lc = tolower(c);
+  if (lc != 'd' && lc != 'w' && lc != 's')
+    return 0;
+  unsigned char tmp[32];
+  memset(tmp, 0, sizeof(tmp));
+  for (int i = 0; i < 256; i++)
+  {
+    int in = (lc == 'd') ? (i >= '0' && i <= '9') : (lc == 'w') ? (isalnum(i) || i == '_')
+                                                                : (i == ' ' || (i >= '\t' && i <= '\r'));
+    if (in != neg)
+      rxSetAdd(tmp, i);
+  }
+  for (int i = 0; i < 32; i++)
+    set[i] |= tmp[i];
+  return 1;
+}
+int rxEscapeChar(int c) // \t \n等普通转义
+{
+  switch (c)
+  {
+  case 't':
+    return '\t';
+  case 'n':
+    return '\n';
+  case 'r':
+    return '\r';
+  default:
+    return c;
+  }
+}
+void rxLitBreak(struct rxparser *ps) // 字面量序列被打断，保留最长的那一段
+{
+  if (ps->depth == 0 && ps->runlen > ps->re->litlen)
+  {
+    memcpy(ps->re->lit, ps->run, ps->runlen);
+    ps->re->litlen = ps->runlen;
+  }
+  ps->runlen = 0;
+}
+struct rxfrag rxParseAlt(struct rxparser *ps);
+struct rxfrag rxParseAtom(struct rxparser *ps, int *litch) // litch返回单个字面字符，否则为-1
+{
+  unsigned char set[32];
+  memset(set, 0, sizeof(set));
+  *litch = -1;
+  int c = (unsigned char)*ps->p++;
+  if (c == '(')
+  {
+    ps->literal = 0;
+    rxLitBreak(ps); // 括号内的字面量不一定是必需的
+    ps->depth++;
+    struct rxfrag f = rxParseAlt(ps);
+    ps->depth--;
+    if (*ps->p != ')')
+    {
+      ps->err = 1;
+      return f;
+    }
+    ps->p++;
+    return f;
+  }
+  if (c == '.')
+  {
+    ps->literal = 0;
+    memset(set, 0xff, sizeof(set));
+    return rxSet(ps, set);
+  }
+  if (c == '^' || c == '$')
+  {
+    if (c == '^' && ps->p - 1 == ps->src)
+      ps->re->anchor_start = 1;
+    else if (c == '$' && *ps->p == '\0')
+      ps->re->anchor_end = 1;
+    else
+      ps->literal = 0;
+    struct rxfrag f;
+    f.end = rxNewState(ps, RX_EPS, -1, -1);
+    f.start = rxNewState(ps, ((c == '^') != ps->reverse) ? RX_BOL : RX_EOL, f.end, -1);
+    return f;
+  }
+  if (c == '[')
+  {
+    ps->literal = 0;
+    int neg = 0;
+    if (*ps->p == '^')
+    {
+      neg = 1;
+      ps->p++;
+    }
+    int first = 1;
+    while (*ps->p && (*ps->p != ']' || first)) // 开头的]当作普通字符
+    {
+      first = 0;
+      int lo = (unsigned char)*ps->p++;
+      if (lo == '\\' && *ps->p)
+      {
+        if (rxEscapeClass((unsigned char)*ps->p, set))
+        {
+          ps->p++;
+          continue;
+        }
+        lo = rxEscapeChar((unsigned char)*ps->p++);
+      }
+      int hi = lo;
+      if (ps->p[0] == '-' && ps->p[1] && ps->p[1] != ']')
+      {
+        ps->p++;
+        hi = (unsigned char)*ps->p++;
+        if (hi == '\\' && *ps->p)
+          hi = rxEscapeChar((unsigned char)*ps->p++);
+        if (hi < lo)
+        {
+          ps->err = 1;
+          return rxEmpty(ps);
+        }
+      }
+      for (int i = lo; i <= hi; i++)
+        rxSetAdd(set, i);
+    }
+    if (*ps->p != ']')
+    {
+      ps->err = 1;
+      return rxEmpty(ps);
+    }
+    ps->p++;
+    if (neg)
+      for (int i = 0; i < 32; i++)
+        set[i] = ~set[i];
+    return rxSet(ps, set);
+  }
+  if (c == '\\')
+  {
+    if (*ps->p == '\0')
+    {
+      ps->err = 1;
+      return rxEmpty(ps);
+    }
+    c = (unsigned char)*ps->p++;
+    if (rxEscapeClass(c, set))
+    {
+      ps->literal = 0;
+      return rxSet(ps, set);
+    }
+    c = rxEscapeChar(c);
+  }
+  else if (c == '*' || c == '+' || c == '?' || c == ')' || c == '|')
+  { // 不能出现在原子位置
+    ps->err = 1;
+    return rxEmpty(ps);
+  }
+  *litch = c;
+  rxSetAdd(set, c);
+  return rxSet(ps, set);
+}
+int rxParseInt(struct rxparser *ps)
+{
+  int n = -1;
+  while (isdigit((unsigned char)*ps->p))
+  {
+    n = (n < 0 ? 0 : n) * 10 + (*ps->p++ - '0');
+    if (n > RX_MAX_REPEAT)
+      ps->err = 1;
+  }
+  return n;
+}
+struct rxfrag rxParseRepeat(struct rxparser *ps)
+{
+  int lo = ps->re->nnfa; // 原子占用的状态是连续的[lo,hi)
+  int litch;
+  struct rxfrag f = rxParseAtom(ps, &litch);
+  int quantified = 0;
+  while (!ps->err && (*ps->p == '*' || *ps->p == '+' || *ps->p == '?' || *ps->p == '{'))
+  {
+    int q = *ps->p++;
+    int hi = ps->re->nnfa;
+    ps->literal = 0;
+    if (q == '*')
+      f = rxStar(ps, f);
+    else if (q == '+')
+      f = rxPlus(ps, f);
+    else if (q == '?')
+      f = rxQuest(ps, f);
+    else
+    {
+      int m = rxParseInt(ps), n = m;
+      if (*ps->p == ',')
+      {
+        ps->p++;
+        n = rxParseInt(ps); // 省略上限时为-1，表示无穷
+      }
+      if (m < 0 || *ps->p != '}' || (n >= 0 && n < m))
+      {
+        ps->err = 1;
+        break;
+      }
+      ps->p++;
+      int copies = m + (n < 0 ? 1 : n - m);
+      struct rxfrag *part = malloc(sizeof(struct rxfrag) * (copies > 0 ? copies : 1));
+      part[0] = f;
+      for (int i = 1; i < copies && !ps->err; i++) // 先复制出所有副本再连接，保证复制的是未连接的原始片段
+        part[i] = rxClone(ps, f, lo, hi);
+      struct rxfrag r = rxEmpty(ps);
+      for (int i = 0; i < copies && !ps->err; i++)
+      {
+        struct rxfrag x = part[i];
+        if (i >= m)
+          x = (n < 0) ? rxStar(ps, x) : rxQuest(ps, x);
+        r = rxConcat(ps, r, x);
+      }
+      free(part);
+      f = r;
+    }
+    quantified = (q == '+' && !quantified) ? 1 : 2; // x+至少出现一次，仍可作为字面量的结尾
+  }
+  if (litch >= 0 && quantified != 2)
+  {
+    if (ps->runlen < RX_MAX_LIT)
+      ps->run[ps->runlen++] = litch;
+    else
+      ps->literal = 0; // 字面量太长，退回DFA匹配
+    if (quantified)
+      rxLitBreak(ps);
+  }
+  else
+    rxLitBreak(ps);
+  return f;
+}
+struct rxfrag rxParseConcat(struct rxparser *ps)
+{
+  struct rxfrag f = rxEmpty(ps);
+  while (!ps->err && *ps->p && *ps->p != '|' && *ps->p != ')')
+    f = rxConcat(ps, f, rxParseRepeat(ps));
+  rxLitBreak(ps);
+  return f;
+}
+struct rxfrag rxParseAlt(struct rxparser *ps)
+{
+  struct rxfrag f = rxParseConcat(ps);
+  while (!ps->err && *ps->p == '|')
+  {
+    ps->p++;
+    ps->literal = 0;
+    if (ps->depth == 0) // 顶层的分支使得任何字面量都不是必需的
+    {
+      ps->re->litlen = 0;
+      ps->depth++;
+      f = rxAlt(ps, f, rxParseConcat(ps));
+      ps->depth--;
+      ps->re->litlen = 0;
+    }
+    else
+      f = rxAlt(ps, f, rxParseConcat(ps));
+  }
+  return f;
+}
+void rxDfaFlush(struct rxdfa *d)
+{
+  for (int i = 0; i < d->nst; i++)
+    free(d->st[i].nfa);
+  d->nst = 0;
+  d->startid[0] = d->startid[1] = -1;
+  memset(d->hash, 0, sizeof(int) * d->hashcap);
+}
+void rxDfaFree(struct rxdfa *d)
+{
+  rxDfaFlush(d);
+  free(d->st);
+  free(d->hash);
+}
+void rxFree(regex *re)
+{
+  if (re == NULL)
+    return;
+  rxDfaFree(&re->fwd);
+  rxDfaFree(&re->anch);
+  rxDfaFree(&re->rev);
+  rxDfaFree(&re->revu);
+  free(re->starts);
+  free(re->nfa);
+  free(re->stack);
+  free(re->set);
+  free(re->mark);
+  free(re);
+}
+void rxDfaInit(struct rxdfa *d, int start, int unanchored)
+{
+  d->start = start;
+  d->unanchored = unanchored;
+  d->startid[0] = d->startid[1] = -1;
+  d->cap = RX_MIN_DSTATES;
+  d->st = malloc(sizeof(struct rxdstate) * d->cap);
+  d->nst = 0;
+  d->hashcap = d->cap * 2;
+  d->hash = calloc(d->hashcap, sizeof(int));
+}
+int rxClosure(regex *re, int s, int n, int bol) // 把s的epsilon闭包加入re->set，返回新的集合大小，bol表示处在行首
+{
+  int sp = 0;
+  re->stack[sp++] = s;
+  while (sp)
+  {
+    int i = re->stack[--sp];
+    if (i < 0 || re->mark[i] == re->gen)
+      continue;
+    re->mark[i] = re->gen;
+    struct rxnfa *st = &re->nfa[i];
+    if (st->type == RX_SPLIT)
+    {
+      re->stack[sp++] = st->out1;
+      re->stack[sp++] = st->out;
+    }
+    else if (st->type == RX_EPS || (st->type == RX_BOL && bol))
+      re->stack[sp++] = st->out;
+    else if (st->type != RX_BOL)
+      re->set[n++] = i;
+  }
+  return n;
+}
+int rxIntCmp(const void *a, const void *b)
+{
+  return *(const int *)a - *(const int *)b;
+}
+unsigned int rxSetHash(const int *set, int n)
+{
+  unsigned int h = 2166136261u;
+  for (int i = 0; i < n; i++)
+    h = (h ^ (unsigned int)set[i]) * 16777619u;
+  return h;
+}
+void rxDfaGrow(struct rxdfa *d) // 容量翻倍，哈希表按新大小重建；状态编号不变，已有的转移表仍然有效
+{
+  d->cap *= 2;
+  d->st = realloc(d->st, sizeof(struct rxdstate) * d->cap);
+  d->hashcap = d->cap * 2;
+  free(d->hash);
+  d->hash = calloc(d->hashcap, sizeof(int));
+  for (int i = 0; i < d->nst; i++)
+  {
+    int slot = rxSetHash(d->st[i].nfa, d->st[i].nnfa) & (d->hashcap - 1);
+    while (d->hash[slot])
+      slot = (slot + 1) & (d->hashcap - 1);
+    d->hash[slot] = i + 1;
+  }
+}
+int rxDfaIntern(regex *re, struct rxdfa *d, int n) // 查找或新建re->set[0..n)对应的DFA状态
+{
+  qsort(re->set, n, sizeof(int), rxIntCmp);
+  unsigned int h = rxSetHash(re->set, n);
+  int slot = h & (d->hashcap - 1);
+  while (d->hash[slot])
+  {
+    struct rxdstate *st = &d->st[d->hash[slot] - 1];
+    if (st->nnfa == n && !memcmp(st->nfa, re->set, sizeof(int) * n))
+      return d->hash[slot] - 1;
+    slot = (slot + 1) & (d->hashcap - 1);
+  }
+  if (d->nst == d->cap) // 调用者保证nst小于RX_MAX_DSTATES
+  {
+    rxDfaGrow(d);
+    for (slot = h & (d->hashcap - 1); d->hash[slot]; slot = (slot + 1) & (d->hashcap - 1))
+      ;
+  }
+  struct rxdstate *st = &d->st[d->nst];
+  st->nfa = malloc(sizeof(int) * (n > 0 ? n : 1));
+  memcpy(st->nfa, re->set, sizeof(int) * n);
+  st->nnfa = n;
+  st->accept = st->accept_eol = 0;
+  for (int i = 0; i < n; i++)
+    if (re->nfa[re->set[i]].type == RX_MATCH)
+      st->accept = 1;
+  re->gen++;
+  for (int i = 0; i < n && !st->accept_eol; i++) // 沿着行尾断言继续走epsilon边，看能否到达MATCH
+  {
+    if (re->nfa[st->nfa[i]].type != RX_EOL)
+      continue;
+    int sp = 0;
+    re->stack[sp++] = re->nfa[st->nfa[i]].out;
+    while (sp)
+    {
+      int k = re->stack[--sp];
+      if (k < 0 || re->mark[k] == re->gen)
+        continue;
+      re->mark[k] = re->gen;
+      struct rxnfa *x = &re->nfa[k];
+      if (x->type == RX_MATCH)
+        st->accept_eol = 1;
+      else if (x->type == RX_SPLIT)
+      {
+        re->stack[sp++] = x->out1;
+        re->stack[sp++] = x->out;
+      }
+      else if (x->type == RX_EPS || x->type == RX_EOL)
+        re->stack[sp++] = x->out;
+    }
+  }
+  memset(st->next, -1, sizeof(st->next));
+  d->hash[slot] = d->nst + 1;
+  return d->nst++;
+}
+int rxDfaStart(regex *re, struct rxdfa *d, int bol)
+{
+  if (d->startid[bol] < 0)
+  {
+    if (d->nst >= RX_MAX_DSTATES) // 另一个起始状态填满了缓存
+      rxDfaFlush(d);
+    re->gen++;
+    d->startid[bol] = rxDfaIntern(re, d, rxClosure(re, d->start, 0, bol));
+  }
+  return d->startid[bol];
+}
+int rxDfaNext(regex *re, struct rxdfa *d, int cur, int c) // 计算cur经过字节c后的DFA状态
+{
+  int n = 0;
+  struct rxdstate *st = &d->st[cur];
+  re->gen++;
+  for (int i = 0; i < st->nnfa; i++)
+  {
+    struct rxnfa *s = &re->nfa[st->nfa[i]];
+    if (s->type == RX_CHAR && rxSetHas(s->set, c))
+      n = rxClosure(re, s->out, n, 0);
+  }
+  if (d->unanchored)
+    n = rxClosure(re, d->start, n, 0);
+  if (d->nst >= RX_MAX_DSTATES) // 缓存已满，清空后重新开始，re->set中的集合不受影响
+  {
+    rxDfaFlush(d);
+    return rxDfaIntern(re, d, n);
+  }
+  int next = rxDfaIntern(re, d, n);
+  d->st[cur].next[c] = next;
+  return next;
+}
+#define RX_STEP(re, d, cur, c) \
+  ((d)->st[cur].next[c] >= 0 ? (d)->st[cur].next[c] : rxDfaNext(re, d, cur, c))
+regex *rxCompile(const char *pattern)
+{
+  regex *re = calloc(1, sizeof(regex));
+  struct rxparser ps;
+  memset(&ps, 0, sizeof(ps));
+  ps.re = re;
+  ps.literal = 1;
+  ps.src = pattern;
+  for (int pass = 0; pass < 2 && !ps.err; pass++) // 第一遍构造正向NFA，第二遍构造反向NFA
+  {
+    ps.p = pattern;
+    ps.reverse = pass;
+    ps.depth = 0;
+    ps.runlen = 0;
+    struct rxfrag f = rxParseAlt(&ps);
+    if (*ps.p != '\0') // 多余的)
+      ps.err = 1;
+    int m = rxNewState(&ps, RX_MATCH, -1, -1);
+    if (ps.err)
+      break;
+    re->nfa[f.end].out = m;
+    if (pass == 0)
+      re->fwd.start = f.start;
+    else
+      re->rev.start = f.start;
+  }
+  if (ps.err)
+  {
+    rxFree(re);
+    return NULL;
+  }
+  re->literal = ps.literal;
+  re->stack = malloc(sizeof(int) * (re->nnfa * 2 + 1));
+  re->set = malloc(sizeof(int) * re->nnfa);
+  re->mark = calloc(re->nnfa, sizeof(unsigned int));
+  int fstart = re->fwd.start, rstart = re->rev.start;
+  rxDfaInit(&re->fwd, fstart, 1);
+  rxDfaInit(&re->anch, fstart, 0);
+  rxDfaInit(&re->rev, rstart, 0);
+  rxDfaInit(&re->revu, rstart, 1);
+  for (int bol = 0; bol < 2; bol++)
+  {
+    struct rxdstate *st = &re->anch.st[rxDfaStart(re, &re->anch, bol)];
+    re->nullable |= st->accept || st->accept_eol;
+  }
+  return re;
+}
+int rxAccepts(struct rxdstate *st, int pos, int edge) // edge是扫描方向上行的边界位置
+{
+  return st->accept || (pos == edge && st->accept_eol);
+}
+int rxLongest(regex *re, const char *s, int from, int len) // 从from开始的最长匹配的结束位置，没有返回-1
+{
+  struct rxdfa *d = &re->anch;
+  int cur = rxDfaStart(re, d, from == 0);
+  int end = -1;
+  for (int i = from; i < len; i++)
+  {
+    cur = RX_STEP(re, d, cur, (unsigned char)s[i]);
+    if (d->st[cur].nnfa == 0) // 死状态
+      break;
+    if (rxAccepts(&d->st[cur], i + 1, len))
+      end = i + 1;
+  }
+  return end;
+}
+int rxSearchFrom(regex *re, const char *s, int from, int len, int *mstart, int *mlen) // 在s[from..len)中查找非空匹配，^只在行首s[0]处成立
+{
+  re->starts_s = NULL;
+  if (re->literal) // 纯字面量，不需要DFA
+  {
+    const char *p = NULL;
+    if (re->anchor_start)
+      p = (from == 0 && len >= re->litlen && !memcmp(s, re->lit, re->litlen)) ? s : NULL;
+    else if (re->anchor_end)
+      p = (len - from >= re->litlen && !memcmp(s + len - re->litlen, re->lit, re->litlen)) ? s + len - re->litlen : NULL;
+    else
+      p = memmem(s + from, len - from, re->lit, re->litlen);
+    if (p == NULL || (re->anchor_start && re->anchor_end && re->litlen != len))
+      return 0;
+    *mstart = p - s;
+    *mlen = re->litlen;
+    return 1;
+  }
+  if (re->litlen && memmem(s + from, len - from, re->lit, re->litlen) == NULL) // 预过滤：必需的字面量不在这一行中
+    return 0;
+  // 第一遍：非锚定正向DFA找到最早结束的匹配
+  struct rxdfa *d = &re->fwd;
+  int cur = rxDfaStart(re, d, from == 0);
+  int end = -1;
+  for (int i = from; i < len; i++)
+  {
+    cur = RX_STEP(re, d, cur, (unsigned char)s[i]);
+    if (d->st[cur].nnfa == 0) // 没有活着的线程，也不会再有新的开始
+      break;
+    if (rxAccepts(&d->st[cur], i + 1, len))
+    {
+      end = i + 1;
+      break;
+    }
+  }
+  if (end < 0)
+    return 0;
+  // 第二遍：最早结束的匹配不一定开始得最早，用非锚定反向DFA从行尾往回扫描，能开始匹配的最小位置就是最左的开始
+  // 能匹配空串的模式每个位置都能开始，只能从end往回找以end结尾的最左开始位置
+  // 非锚定扫描顺便记下每个位置能否开始匹配，同一行接着找下一个匹配时不用再从行尾扫一遍
+  int nullable = re->nullable;
+  d = nullable ? &re->rev : &re->revu;
+  int top = nullable ? end : len;
+  if (!nullable && re->startscap < len)
+  {
+    re->startscap = len;
+    free(re->starts);
+    re->starts = malloc(len);
+  }
+  cur = rxDfaStart(re, d, top == len);
+  int start = end;
+  int i;
+  for (i = top - 1; i >= from; i--)
+  {
+    cur = RX_STEP(re, d, cur, (unsigned char)s[i]);
+    if (d->st[cur].nnfa == 0)
+      break;
+    int acc = rxAccepts(&d->st[cur], i, 0);
+    if (acc)
+      start = i;
+    if (!nullable)
+      re->starts[i] = acc;
+  }
+  if (!nullable)
+  {
+    if (i >= from) // 没有活着的线程，前面的位置都不能开始匹配
+      memset(re->starts + from, 0, i - from + 1);
+    re->starts_s = s;
+    re->starts_from = from;
+    re->starts_len = len;
+  }
+  // 第三遍：从start开始取最长匹配
+  int longest = rxLongest(re, s, start, len);
+  if (longest > end)
+    end = longest;
+  *mstart = start;
+  *mlen = end - start;
+  return 1;
+}
+int rxSearch(regex *re, const char *s, int len, int *mstart, int *mlen) // 在s[0..len)中查找非空匹配，找到返回1
+{
+  return rxSearchFrom(re, s, 0, len, mstart, mlen);
+}
+int rxSearchNext(regex *re, const char *s, int from, int len, int *mstart, int *mlen) // 同rxSearchFrom，但s在上一次搜索之后没有变过：直接用记下的开始位置，s///g整行是线性的
+{
+  if (re->literal || re->starts_s != s || re->starts_len != len || from < re->starts_from)
+    return rxSearchFrom(re, s, from, len, mstart, mlen);
+  int i = from;
+  while (i < len && !re->starts[i])
+    i++;
+  if (i == len)
+    return 0;
+  *mstart = i;
+  *mlen = rxLongest(re, s, i, len) - i;
+  return 1;
+}
+int rxEmptyAt(regex *re, int at, int len) // 模式能否在位置at匹配空串，例如^、$、x*
+{
+  struct rxdfa *d = &re->anch;
+  return rxAccepts(&d->st[rxDfaStart(re, d, at == 0)], at, len);
+}
+
+/*** find ***/
+int find_regex = 0; // 1表示editorFind按正则表达式搜索
+
+void editorFindCallback(char *query, int key)
+{
+  static int last_match = -1; //-1向后搜索
+  static int direction = 1;   // 1向前搜索
+  static int saved_hl_line;
+  static char *saved_hl = NULL;
+  static regex *re = NULL; // 缓存编译好的正则，查询串变化时才重新编译
+  static char *re_src = NULL;
+  if (saved_hl)
+  {
+    struct rowView *v = E.row[saved_hl_line].view;
+    if (v) // 丢掉过view的行重建时高亮已经是原样
+      memcpy(v->hl, saved_hl, v->rsize);
+    E.row[saved_hl_line].flags &= ~ROW_DRAWN;
+    free(saved_hl);
+    saved_hl = NULL;
+  }
+  if (key == '\r' || key == '\x1b') // \r是enter键，\x1b是escape,按下这两个键意味着即将离开搜索模式
+  {
+    last_match = -1;
+    direction = 1;
+    return;
+  }
+  else if (key == ARROW_RIGHT || key == ARROW_DOWN)
+  {
+    direction = 1;
+  }
+  else if (key == ARROW_LEFT || key == ARROW_UP)
+  {
+    direction = -1;
+  }
+  else
+  {
+    last_match = -1;
+    direction = 1;
+  }
+  if (last_match == -1)
+    direction = 1;
+  if (find_regex && (re_src == NULL || strcmp(re_src, query)))
+  {
+    rxFree(re);
+    free(re_src);
+    re = rxCompile(query); // 模式不合法时为NULL，此时什么也匹配不到
+    re_src = strdup(query);
+  }
+  if (find_regex && (re == NULL || re->nullable)) // 能匹配空串的模式会停在每一行，不予搜索
+    return;
+  int current = last_match; // 当前索引为current，找到匹配项时将last_match设置为current,这样如果用户按下箭头键，我们将从该店开始下一次搜索
+  int i;
+  for (i = 0; i < E.numrows; i++)
+  {
+    current += direction;
+    if (current == -1)
+      current = E.numrows - 1;
+    else if (current == E.numrows)
+      current = 0;
+    erow *row = &E.row[current];
+    int mstart, mlen; // 匹配在render中的字节位置和长度
+    if (find_regex)
+    { // 正则直接在原始字节chars上匹配，再换算成render中的位置
+      int cstart, clen;
+      if (!rxSearch(re, row->chars, row->size, &cstart, &clen))
+        continue;
+      mstart = editorRowCxToRb(row, cstart);
+      mlen = editorRowCxToRb(row, cstart + clen) - mstart;
+    }
+    else
+    {
+      editorRowRender(row);
+      char *match = strstr(row->view->render, query);
+      if (match == NULL)
+        continue;
+      mstart = match - row->view->render;
+      mlen = strlen(query);
+    }
+    editorRowsFlush(current); // 要修改这一行的高亮，先把它算到最新
+    last_match = current;
+    E.cy = current;
+    E.cx = editorRowRbToCx(row, mstart);
+    E.rowoff = E.numrows;
+
+    saved_hl_line = current;       // 静态变量，知道哪一行的hl需要恢复
+    saved_hl = malloc(row->view->rsize); // 动态分配的数组，没有需要恢复的内容时，指向NULL
+    memcpy(saved_hl, row->view->hl, row->view->rsize);
+    editorRowUnshare(row);
+    memset(&row->view->hl[mstart], HL_MATCH, mlen);
+    row->flags &= ~ROW_DRAWN;
+    break;
+  }
+}
+void editorFind(int regex)
+{
+  find_regex = regex;
+  int saved_cx = E.cx; // 保存为了后序搜索取消后恢复这些值
+  int saved_cy = E.cy;
+  int saved_coloff = E.coloff;
+  int saved_rowoff = E.rowoff;
+  int saved_wrapoff = E.wrapoff;
+
+  char *query = editorPrompt(regex ? "Regex: %s (Use ESC/aRROWS/Enter)" : "Search: %s (Use ESC/aRROWS/Enter)", editorFindCallback, 0);
+  if (query)
+  {
+    free(query);
+  }
+  else
+  { // 如果query等于NULL,等于他们按了Escape，恢复保存的值
+    E.cx = saved_cx;
+    E.cy = saved_cy;
+    E.coloff = saved_coloff;
+    E.rowoff = saved_rowoff;
+    E.wrapoff = saved_wrapoff;
+  }
+}
+
+/*** replace ***/
+struct replaceJob
+{
+  int lo, hi; // 负责的行范围
+  const char *query;
+  int qlen;
+  const char *repl;
+  int rlen;
+  int *rows; // 有匹配的行号及其替换后的内容
+  struct undoLine *res;
+  int n, cap;
+  long count;
+};
+char *editorReplaceString(const char *s, int len, const char *q, int qlen, const char *r, int rlen, int *newlen, int *count) // 替换s中所有不重叠的q，没有匹配返回NULL
+{
+  const char *end = s + len;
+  const char *p = s;
+  int n = 0;
+  while ((p = memmem(p, end - p, q, qlen)) != NULL)
+  {
+    n++;
+    p += qlen;
+  }
+  if (n == 0)
+    return NULL;
+  int nl = len + n * (rlen - qlen);
+  char *out = malloc(nl + 1);
+  char *o = out;
+  const char *m;
+  p = s;
+  while ((m = memmem(p, end - p, q, qlen)) != NULL)
+  {
+    memcpy(o, p, m - p);
+    o += m - p;
+    memcpy(o, r, rlen);
+    o += rlen;
+    p = m + qlen;
+  }
+  memcpy(o, p, end - p);
+  out[nl] = '\0';
+  *newlen = nl;
+  *count = n;
+  return out;
+}
+void *editorReplaceWorker(void *arg) // 只读取E.row，在新缓冲区中生成替换结果
+{
+  struct replaceJob *job = arg;
+  for (int i = job->lo; i < job->hi; i++)
+  {
+    erow *row = &E.row[i];
+    int nl, cnt;
+    char *ns = editorReplaceString(row->chars, row->size, job->query, job->qlen, job->repl, job->rlen, &nl, &cnt);
+    if (ns == NULL)
+      continue;
+    if (job->n == job->cap)
+    {
+      job->cap = job->cap ? job->cap * 2 : 64;
+      job->rows = realloc(job->rows, sizeof(int) * job->cap);
+      job->res = realloc(job->res, sizeof(struct undoLine) * job->cap);
+    }
+    job->rows[job->n] = i;
+    job->res[job->n].chars = ns;
+    job->res[job->n].size = nl;
+    job->n++;
+    job->count += cnt;
+  }
+  return NULL;
+}
+long editorReplaceRun(const char *query, const char *repl) // 把所有行中的query换成repl，整体是一次撤销；返回替换的次数
+{
+  int nj = editorParallelJobs(E.numrows);
+  struct replaceJob *jobs = calloc(nj, sizeof(struct replaceJob));
+  for (int j = 0; j < nj; j++)
+  {
+    jobs[j].lo = (long)E.numrows * j / nj;
+    jobs[j].hi = (long)E.numrows * (j + 1) / nj;
+    jobs[j].query = query;
+    jobs[j].qlen = strlen(query);
+    jobs[j].repl = repl;
+    jobs[j].rlen = strlen(repl);
+  }
+  editorParallelRun(editorReplaceWorker, jobs, sizeof(struct replaceJob), nj);
+  long count = 0;
+  int lines = 0;
+  for (int j = 0; j < nj; j++)
+    lines += jobs[j].n;
+  int *rows = malloc(sizeof(int) * (lines > 0 ? lines : 1));
+  struct undoLine *res = malloc(sizeof(struct undoLine) * (lines > 0 ? lines : 1));
+  lines = 0;
+  for (int j = 0; j < nj; j++) // 各段的结果按行号顺序拼起来，一次批量替换
+  {
+    if (jobs[j].n > 0)
+    {
+      memcpy(rows + lines, jobs[j].rows, sizeof(int) * jobs[j].n);
+      memcpy(res + lines, jobs[j].res, sizeof(struct undoLine) * jobs[j].n);
+    }
+    lines += jobs[j].n;
+    count += jobs[j].count;
+    free(jobs[j].rows);
+    free(jobs[j].res);
+  }
+  free(jobs);
+  editorRowsReplace(rows, res, lines);
+  free(rows);
+  free(res);
+  if (E.cy < E.numrows && E.cx > E.row[E.cy].size)
+    E.cx = E.row[E.cy].size;
+  editorSetStatusMessage("Replaced %ld occurrences on %d lines", count, lines);
+  return count;
+}
+void editorReplaceAll()
+{
+  char *query = editorPrompt("Replace: %s (ESC to cancel)", NULL, 0);
+  if (query == NULL)
+    return;
+  char *repl = editorPrompt("Replace with: %s (ESC to cancel)", NULL, 1);
+  if (repl == NULL)
+  {
+    free(query);
+    return;
+  }
+  editorReplaceRun(query, repl);
+  free(query);
+  free(repl);
+}
+
+/*** multiple cursors ***/
+// 主光标是E.cx/E.cy，其余光标按(cy, cx)排序存放在E.cursors；按键按行分组，每行一次生成新内容，再批量替换
+struct multiEditJob
+{
+  const struct cursor *cur; // 全部光标，已排序
+  const int *first;         // 每个受影响行的第一个光标下标，最后多一项
+  int lo, hi;               // 负责的行组
+  int op, c;
+  struct undoLine *res; // 每个行组的新内容，没有变化时chars为NULL
+  int *newcx;           // 每个光标编辑后的位置
+};
+int editorCursorCmp(const void *a, const void *b)
+{
+  const struct cursor *x = a, *y = b;
+  if (x->cy != y->cy)
+    return x->cy < y->cy ? -1 : 1;
+  return x->cx < y->cx ? -1 : x->cx > y->cx;
+}
+void editorCursorsClear()
+{
+  free(E.cursors);
+  E.cursors = NULL;
+  E.ncursors = 0;
+}
+void editorCursorsNormalize() // 限制到有效位置、对齐字素簇、排序去重，去掉和主光标重合的
+{
+  int n = 0;
+  for (int k = 0; k < E.ncursors; k++)
+  {
+    struct cursor c = E.cursors[k];
+    if (c.cy < 0 || c.cy >= E.numrows)
+      continue;
+    erow *row = &E.row[c.cy];
+    c.cx = editorRowSnapCx(row, c.cx > row->size ? row->size : c.cx);
+    E.cursors[n++] = c;
+  }
+  qsort(E.cursors, n, sizeof(struct cursor), editorCursorCmp);
+  int m = 0;
+  for (int k = 0; k < n; k++)
+  {
+    if (m > 0 && !editorCursorCmp(&E.cursors[m - 1], &E.cursors[k]))
+      continue;
+    if (E.cursors[k].cx == E.cx && E.cursors[k].cy == E.cy)
+      continue;
+    E.cursors[m++] = E.cursors[k];
+  }
+  E.ncursors = m;
+  if (m == 0)
+  {
+    free(E.cursors);
+    E.cursors = NULL;
+  }
+}
+void editorCursorAdd(int cx, int cy)
+{
+  E.cursors = realloc(E.cursors, sizeof(struct cursor) * (E.ncursors + 1));
+  E.cursors[E.ncursors].cx = cx;
+  E.cursors[E.ncursors].cy = cy;
+  E.ncursors++;
+}
+int editorCursorFirst(int cy) // 第一个在cy行或之后的光标
+{
+  int lo = 0, hi = E.ncursors;
+  while (lo < hi)
+  {
+    int mid = (lo + hi) / 2;
+    if (E.cursors[mid].cy < cy)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+void editorAddCursorBelow() // 在当前位置留下一个光标，主光标移到下一行的同一显示列
+{
+  if (E.cy + 1 >= E.numrows)
+    return;
+  int rx = editorRowCxToRx(&E.row[E.cy], E.cx);
+  editorCursorAdd(E.cx, E.cy);
+  E.cy++;
+  E.cx = editorRowRxToCx(&E.row[E.cy], rx);
+  editorCursorsNormalize();
+  editorSetStatusMessage("%d cursors", E.ncursors + 1);
+}
+void editorColumnBlock() // 第一次按下记住起点，第二次在两行之间的每一行的当前显示列放一个光标，比该列短的行跳过
+{
+  if (E.cy >= E.numrows)
+    return;
+  int rx = editorRowCxToRx(&E.row[E.cy], E.cx);
+  if (E.block_row < 0)
+  {
+    E.block_row = E.cy;
+    editorSetStatusMessage("Block start at line %d, move and press ^K again", E.cy + 1);
+    return;
+  }
+  int r0 = E.block_row < E.cy ? E.block_row : E.cy;
+  int r1 = E.block_row < E.cy ? E.cy : E.block_row;
+  E.cursors = realloc(E.cursors, sizeof(struct cursor) * (E.ncursors + r1 - r0 + 1));
+  for (int r = r0; r <= r1 && r < E.numrows; r++)
+  {
+    erow *row = &E.row[r];
+    editorRowRender(row);
+    struct rowView *v = row->view;
+    int width = v->cells ? v->cells[v->ncells - 1].col : v->rsize;
+    if (r != E.cy && width >= rx)
+      editorCursorAdd(editorRowRxToCx(row, rx), r);
+  }
+  E.block_row = -1;
+  editorCursorsNormalize();
+  editorSetStatusMessage("%d cursors", E.ncursors + 1);
+}
+void editorCursorsMove(int key) // 其余光标做和主光标一样的移动
+{
+  int cx = E.cx, cy = E.cy;
+  for (int k = 0; k < E.ncursors; k++)
+  {
+    E.cx = E.cursors[k].cx;
+    E.cy = E.cursors[k].cy;
+    if (key == HOME_KEY)
+      E.cx = 0;
+    else if (key == END_KEY)
+      E.cx = E.row[E.cy].size;
+    else
+      editorMoveCursor(key);
+    E.cursors[k].cx = E.cx;
+    E.cursors[k].cy = E.cy;
+  }
+  E.cx = cx;
+  E.cy = cy;
+}
+void *editorMultiEditWorker(void *arg) // 只读取E.row，为每个行组在新缓冲区中一次应用该行所有光标的编辑
+{
+  struct multiEditJob *job = arg;
+  for (int g = job->lo; g < job->hi; g++)
+  {
+    int k0 = job->first[g], k1 = job->first[g + 1];
+    erow *row = &E.row[job->cur[k0].cy];
+    char *out = malloc(row->size + (k1 - k0) + 1);
+    int pos = 0, o = 0, changed = 0;
+    for (int k = k0; k < k1; k++)
+    {
+      int p = job->cur[k].cx;
+      int a = p, b = p; // 要删除的范围
+      if (job->op == 'b' && p > 0)
+        a = editorRowPrevCx(row, p);
+      else if (job->op == 'd' && p < row->size)
+        b = editorRowNextCx(row, p);
+      memcpy(out + o, row->chars + pos, a - pos);
+      o += a - pos;
+      if (job->op == 'i')
+        out[o++] = job->c;
+      job->newcx[k] = o;
+      changed |= job->op == 'i' || a != b;
+      pos = b;
+    }
+    memcpy(out + o, row->chars + pos, row->size - pos);
+    o += row->size - pos;
+    out[o] = '\0';
+    if (!changed)
+    {
+      free(out);
+      out = NULL;
+    }
+    job->res[g].chars = out;
+    job->res[g].size = o;
+  }
+  return NULL;
+}
+void editorMultiEdit(int op, int c) // op为'i'插入c，'b'删除光标前的字素簇，'d'删除光标处的字素簇；行首退格和行尾删除不合并行
+{
+  int n = E.ncursors;
+  struct cursor *all = malloc(sizeof(struct cursor) * (n + 1));
+  struct cursor cur = {E.cx, E.cy};
+  int primary = -1;
+  if (E.cy < E.numrows) // 其余光标已经有序，把主光标插到它的位置
+  {
+    int lo = 0, hi = n;
+    while (lo < hi)
+    {
+      int mid = (lo + hi) / 2;
+      if (editorCursorCmp(&E.cursors[mid], &cur) < 0)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    primary = lo;
+  }
+  if (primary < 0)
+    memcpy(all, E.cursors, sizeof(struct cursor) * n);
+  else
+  {
+    memcpy(all, E.cursors, sizeof(struct cursor) * primary);
+    all[primary] = cur;
+    memcpy(all + primary + 1, E.cursors + primary, sizeof(struct cursor) * (n - primary));
+    n++;
+  }
+  int *first = malloc(sizeof(int) * (n + 1));
+  int ngroups = 0;
+  for (int k = 0; k < n; k++)
+    if (k == 0 || all[k].cy != all[k - 1].cy)
+      first[ngroups++] = k;
+  first[ngroups] = n;
+
+  struct undoLine *res = malloc(sizeof(struct undoLine) * (ngroups > 0 ? ngroups : 1));
+  int *newcx = malloc(sizeof(int) * (n > 0 ? n : 1));
+  int nj = editorParallelJobs(ngroups);
+  struct multiEditJob jobs[KILO_MAX_THREADS];
+  for (int j = 0; j < nj; j++)
+  {
+    jobs[j] = (struct multiEditJob){all, first, (long)ngroups * j / nj, (long)ngroups * (j + 1) / nj, op, c, res, newcx};
+  }
+  editorParallelRun(editorMultiEditWorker, jobs, sizeof(struct multiEditJob), nj);
+
+  int *rows = malloc(sizeof(int) * (ngroups > 0 ? ngroups : 1));
+  int nrows = 0;
+  for (int g = 0; g < ngroups; g++) // 只替换有变化的行
+  {
+    if (res[g].chars == NULL)
+      continue;
+    rows[nrows] = all[first[g]].cy;
+    res[nrows++] = res[g];
+  }
+  editorRowsReplace(rows, res, nrows);
+
+  int m = 0;
+  for (int k = 0; k < n; k++) // 更新光标位置，主光标仍是原来那一个
+  {
+    if (k == primary)
+    {
+      E.cx = newcx[k];
+      continue;
+    }
+    E.cursors[m].cx = newcx[k];
+    E.cursors[m++].cy = all[k].cy;
+  }
+  E.ncursors = m;
+  editorCursorsNormalize(); // 删除后落到同一位置的光标合并成一个
+  free(all);
+  free(first);
+  free(res);
+  free(newcx);
+  free(rows);
+}
+
+/*** clipboard ***/
+// Ctrl-B在光标处开始或取消选择，Ctrl-C复制，Ctrl-X剪切，Ctrl-V粘贴
+// 剪贴板把选中的文本一次拷进一个textSpan；粘贴时中间的整行直接指向它，只有首尾两行要拼接
+int editorSelRange(int *y0, int *x0, int *y1, int *x1) // 选择按先后排好，光标在文件末尾之后时算作最后一行的行尾；没有选择或为空返回0
+{
+  if (!E.sel || E.numrows == 0)
+    return 0;
+  int ay = E.sel_cy, ax = E.sel_cx, by = E.cy, bx = E.cx;
+  if (ay >= E.numrows)
+  {
+    ay = E.numrows - 1;
+    ax = E.row[ay].size;
+  }
+  if (by >= E.numrows)
+  {
+    by = E.numrows - 1;
+    bx = E.row[by].size;
+  }
+  if (ay > by || (ay == by && ax > bx))
+  {
+    int t = ay;
+    ay = by;
+    by = t;
+    t = ax;
+    ax = bx;
+    bx = t;
+  }
+  *y0 = ay;
+  *x0 = ax;
+  *y1 = by;
+  *x1 = bx;
+  return ay != by || ax != bx;
+}
+int editorSelCols(int r, int *c0, int *c1) // 第r行被选中的显示列范围[c0, c1)
+{
+  int y0, x0, y1, x1;
+  if (!editorSelRange(&y0, &x0, &y1, &x1) || r < y0 || r > y1)
+    return 0;
+  erow *row = &E.row[r];
+  *c0 = r == y0 ? editorRowCxToRx(row, x0) : 0;
+  *c1 = r == y1 ? editorRowCxToRx(row, x1) : INT_MAX;
+  return 1;
+}
+void editorClipSet(int y0, int x0, int y1, int x1) // 把选中的文本拷进新的span，旧的剪贴板只减引用，粘贴出去的行不受影响
+{
+  struct clipboard *cb = &E.clip;
+  editorSpanUnref(cb->span, 1);
+  free(cb->lines);
+  cb->n = y1 - y0 + 1;
+  cb->lines = malloc(sizeof(struct undoLine) * cb->n);
+  size_t total = 0;
+  for (int r = y0; r <= y1; r++)
+    total += (r == y1 ? x1 : E.row[r].size) - (r == y0 ? x0 : 0) + 1;
+  cb->span = editorSpanNew(total);
+  char *p = cb->span->base;
+  for (int r = y0; r <= y1; r++)
+  {
+    int from = r == y0 ? x0 : 0;
+    int len = (r == y1 ? x1 : E.row[r].size) - from;
+    memcpy(p, &E.row[r].chars[from], len);
+    p[len] = '\0';
+    cb->lines[r - y0] = (struct undoLine){p, len};
+    p += len + 1;
+  }
+}
+void editorSelDelete(int y0, int x0, int y1, int x1) // 删除选中的文本，中间的行一次删掉
+{
+  if (y0 == y1)
+  {
+    editorRowDelChars(&E.row[y0], x0, x1 - x0);
+  }
+  else
+  {
+    erow *last = &E.row[y1];
+    int tlen = last->size - x1;
+    char *tail = malloc(tlen + 1);
+    memcpy(tail, &last->chars[x1], tlen);
+    editorDelRows(y0 + 1, y1 - y0);
+    erow *row = &E.row[y0];
+    editorRowDelChars(row, x0, row->size - x0);
+    editorRowAppendString(row, tail, tlen);
+    free(tail);
+  }
+  E.cy = y0;
+  E.cx = x0;
+}
+void editorClipCopy(int cut)
+{
+  int y0, x0, y1, x1;
+  if (!editorSelRange(&y0, &x0, &y1, &x1))
+  {
+    editorSetStatusMessage("No selection (^B to start one)");
+    return;
+  }
+  editorClipSet(y0, x0, y1, x1);
+  E.sel = 0;
+  if (cut)
+  {
+    editorCursorsClear();
+    editorSelDelete(y0, x0, y1, x1);
+  }
+  editorSetStatusMessage("%s %d lines", cut ? "Cut" : "Copied", E.clip.n);
+}
+void editorClipPaste() // 在光标处粘贴：首行接在光标前的内容后面，末行接上光标后的内容，中间的行不复制
+{
+  struct clipboard *cb = &E.clip;
+  if (cb->n == 0)
+  {
+    editorSetStatusMessage("Clipboard is empty");
+    return;
+  }
+  editorCursorsClear();
+  if (E.cy == E.numrows)
+    editorInsertRow(E.numrows, "", 0);
+  erow *row = &E.row[E.cy];
+  struct undoLine *first = &cb->lines[0], *last = &cb->lines[cb->n - 1];
+  int tlen = row->size - E.cx;
+  char *s = malloc(E.cx + first->size + (cb->n == 1 ? tlen : 0) + 1);
+  memcpy(s, row->chars, E.cx);
+  memcpy(s + E.cx, first->chars, first->size);
+  int len = E.cx + first->size;
+  if (cb->n == 1)
+  {
+    memcpy(s + len, &row->chars[E.cx], tlen);
+    len += tlen;
+    s[len] = '\0';
+    editorRowReplace(row, s, len);
+    E.cx += first->size;
+    return;
+  }
+  char *t = malloc(last->size + tlen + 1);
+  memcpy(t, last->chars, last->size);
+  memcpy(t + last->size, &row->chars[E.cx], tlen);
+  s[len] = '\0';
+  editorRowReplace(row, s, len);
+  editorInsertSpanRows(E.cy + 1, cb->lines + 1, cb->n - 2, cb->span);
+  editorInsertRow(E.cy + cb->n - 1, t, last->size + tlen);
+  free(t);
+  E.cy += cb->n - 1;
+  E.cx = last->size;
+}
+
+/*** append buffer ***/
+struct abuf
+{
+  char *b;
+  int len;
+  int cap; // 按倍数扩容，逐字节追加时不用每次realloc
+};
+
+#define ABUF_INIT {NULL, 0, 0}
+
+void abAppend(struct abuf *ab, const char *s, int len)
+{
+  if (len <= 0)
+    return;
+  if (ab->len + len > ab->cap)
+  {
+    int cap = ab->cap ? ab->cap : 64;
+    while (cap < ab->len + len)
+      cap *= 2;
+    char *new = realloc(ab->b, cap); // 请求realloc()给我们一块内存，大小至少是当前字符串的大小加上要追加的字符串大小
+    if (new == NULL)
+      return;
+    ab->b = new;
+    ab->cap = cap;
+  }
+  memcpy(&ab->b[ab->len], s, len); // 赋值缓冲区当前数据末尾的字符串s，并更新abuf的指针和长度
+  ab->len += len;
+}
+void abFree(struct abuf *ab)
+{ // 释放由abuf使用的动态内存
+  free(ab->b);
+}
+/*** soft wrap ***/
+// 折行模式下视口顶部是(rowoff, wrapoff)：第rowoff行的第wrapoff个屏幕行。每行的折行位置按需计算并缓存，编辑时失效
+int editorWrapLines(erow *row) // 行在当前宽度下占几个屏幕行；行尾光标也要有位置，所以正好填满时多一行
+{
+  if (row == NULL)
+    return 1;
+  editorRowRender(row);
+  struct rowView *v = row->view;
+  int width = editorTextCols() > 0 ? editorTextCols() : 1;
+  if (v->wrapw == width)
+    return v->nwraps;
+  v->wrapw = width;
+  free(v->wraps);
+  v->wraps = NULL;
+  if (!v->cells) // 纯ASCII行每列一个字节，折行位置是宽度的整数倍，不需要缓存
+  {
+    v->nwraps = v->rsize / width + 1;
+    return v->nwraps;
+  }
+  int n = 0, cap = 16, start = 0;
+  v->wraps = malloc(sizeof(int) * cap);
+  v->wraps[n++] = 0;
+  for (int k = 0; k <= v->ncells - 1; k++) // 哨兵当作宽度为1的行尾位置
+  {
+    int c0 = v->cells[k].col;
+    int c1 = k < v->ncells - 1 ? v->cells[k + 1].col : c0 + 1;
+    if (c1 - start > width && c0 > start) // 放不下的宽字符或制表符整个移到下一行
+    {
+      if (n == cap)
+      {
+        cap *= 2;
+        v->wraps = realloc(v->wraps, sizeof(int) * cap);
+      }
+      v->wraps[n++] = start = c0;
+    }
+  }
+  v->nwraps = n;
+  return n;
+}
+int editorWrapStart(erow *row, int line) // 第line个屏幕行的起始显示列
+{
+  if (row == NULL)
+    return 0;
+  editorWrapLines(row);
+  struct rowView *v = row->view;
+  if (line >= v->nwraps)
+    return v->cells ? v->cells[v->ncells - 1].col : v->rsize;
+  return v->wraps ? v->wraps[line] : line * v->wrapw;
+}
+int editorWrapLineOf(erow *row, int rx) // 显示列rx在第几个屏幕行，二分查找
+{
+  int n = editorWrapLines(row);
+  if (row == NULL)
+    return 0;
+  struct rowView *v = row->view;
+  if (!v->wraps)
+  {
+    int line = rx / v->wrapw;
+    return line < n ? line : n - 1;
+  }
+  int lo = 0, hi = n - 1;
+  while (lo < hi)
+  {
+    int mid = (lo + hi + 1) / 2;
+    if (v->wraps[mid] <= rx)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  return lo;
+}
+static erow *editorWrapRow(int r)
+{
+  return r < E.numrows ? &E.row[r] : NULL;
+}
+int editorWrapDistance(int r0, int k0, int r1, int k1, int limit) // 从(r0,k0)往下到(r1,k1)的屏幕行数，超过limit就不再数
+{
+  if (r0 == r1)
+    return k1 - k0;
+  int d = editorWrapLines(editorWrapRow(r0)) - k0;
+  for (int r = r0 + 1; r < r1 && d <= limit; r++)
+    d += editorWrapLines(editorWrapRow(r));
+  return d + k1;
+}
+void editorScrollWrap()
+{
+  erow *row = editorWrapRow(E.cy);
+  int line = editorWrapLineOf(row, E.rx);
+  E.coloff = 0;
+  int toplines = editorWrapLines(editorWrapRow(E.rowoff));
+  if (E.wrapoff >= toplines) // 顶部的行被编辑得更短了
+    E.wrapoff = toplines - 1;
+  if (E.cy < E.rowoff || (E.cy == E.rowoff && line < E.wrapoff))
+  {
+    E.rowoff = E.cy;
+    E.wrapoff = line;
+  }
+  int y = editorWrapDistance(E.rowoff, E.wrapoff, E.cy, line, E.screenrows);
+  if (y >= E.screenrows) // 光标在视口下方，从光标往回数一屏作为新的顶部
+  {
+    int r = E.cy, k = line, n = E.screenrows - 1;
+    while (n > 0)
+    {
+      if (k >= n)
+      {
+        k -= n;
+        break;
+      }
+      n -= k + 1;
+      if (r == 0)
+      {
+        k = 0;
+        break;
+      }
+      r--;
+      k = editorWrapLines(editorWrapRow(r)) - 1;
+    }
+    E.rowoff = r;
+    E.wrapoff = k;
+    y = editorWrapDistance(E.rowoff, E.wrapoff, E.cy, line, E.screenrows);
+  }
+  E.wrap_y = y;
+  E.wrap_x = E.rx - editorWrapStart(row, line);
+}
+int editorWrapMove(int dir) // 折行模式下上下移动一个屏幕行，保持在屏幕行内的列
+{
+  erow *row = editorWrapRow(E.cy);
+  int rx = row ? editorRowCxToRx(row, E.cx) : 0;
+  int line = editorWrapLineOf(row, rx);
+  int col = rx - editorWrapStart(row, line);
+  int cy = E.cy;
+  if (dir < 0 && line > 0)
+    line--;
+  else if (dir < 0 && cy > 0)
+    line = editorWrapLines(editorWrapRow(--cy)) - 1;
+  else if (dir > 0 && line < editorWrapLines(row) - 1)
+    line++;
+  else if (dir > 0 && cy < E.numrows)
+  {
+    cy++;
+    line = 0;
+  }
+  else
+    return 0;
+  E.cy = cy;
+  row = editorWrapRow(cy);
+  if (row == NULL)
+  {
+    E.cx = 0;
+    return 1;
+  }
+  int target = editorWrapStart(row, line) + col;
+  int end = line + 1 < editorWrapLines(row) ? editorWrapStart(row, line + 1) - 1 : target;
+  E.cx = editorRowRxToCx(row, target < end ? target : end); // 不要跑到下一个屏幕行
+  return 1;
+}
+
+/*** output ***/
+void editorScroll()
+{
+  E.rx = 0;
+  int width = 1; // 光标处字符的显示宽度，宽字符要整个可见
+  if (E.cy < E.numrows)
+  {
+    erow *row = &E.row[E.cy];
+    E.rx = editorRowCxToRx(row, E.cx);
+    if (row->view->cells && E.cx < row->size)
+      width = editorRowCxToRx(row, editorRowNextCx(row, E.cx)) - E.rx;
+  } // 设置E.rx为光标所在行的显示列
+  if (E.wrap)
+  {
+    editorScrollWrap();
+    return;
+  }
+  if (editorRowHidden(E.cy)) // 光标（比如搜索或撤销）跳进了收起的折叠，展开它
+    editorFoldReveal(E.cy);
+  if (editorRowHidden(E.rowoff))
+    E.rowoff = E.hidden[editorFoldRangeAt(E.rowoff)].lo - 1;
+  if (E.cy < E.rowoff) // 水平滚动，检查光标是否在可见窗口上发过，如果是，则向上滚动到光标位置
+  {
+    E.rowoff = E.cy;
+  }
+  if (editorRowVisIndex(E.cy) >= editorRowVisIndex(E.rowoff) + E.screenrows) // 检查光标是否在可见窗口底部，隐藏的行不算
+  {
+    E.rowoff = editorRowAtVisIndex(editorRowVisIndex(E.cy) - E.screenrows + 1);
+  }
+  if (E.rx < E.coloff) // 垂直滚动
+  {
+    E.coloff = E.rx;
+  }
+  if (E.rx + width > E.coloff + editorTextCols())
+  {
+    E.coloff = E.rx + width - editorTextCols();
+  }
+}
+void editorDrawRow(struct abuf *ab, erow *row, int coloff, int cols) // 绘制一行中[coloff, coloff+cols)列的内容
+{
+  int k, nunits; // 绘制单位：纯ASCII行是单个字节，其他行是字素簇
+  editorRowRender(row);
+  struct rowView *v = row->view;
+  if (v->cells)
+  {
+    k = editorRowCell(row, coloff, 2);
+    nunits = v->ncells - 1;
+  }
+  else
+  {
+    k = coloff;
+    nunits = v->rsize;
+  }
+  int limit = coloff + cols;
+  int current_color = -1; //-1是默认颜色
+  int ci = E.ncursors ? editorCursorFirst(ROW_INDEX(row)) : 0; // 本行的其他光标，反色显示
+  int s0 = 0, s1 = 0; // 本行被选中的显示列，也反色显示
+  if (E.sel && !E.view)
+    editorSelCols(ROW_INDEX(row), &s0, &s1);
+  int ccol = ci < E.ncursors && E.cursors[ci].cy == ROW_INDEX(row) ? editorRowCxToRx(row, E.cursors[ci].cx) : -1;
+  for (; k < nunits; k++)
+  {
+    int rb0 = k, rb1 = k + 1, c0 = k, c1 = k + 1;
+    if (v->cells)
+    {
+      rb0 = v->cells[k].rb;
+      rb1 = v->cells[k + 1].rb;
+      c0 = v->cells[k].col;
+      c1 = v->cells[k + 1].col;
+    }
+    while (ccol >= 0 && ccol < c0)
+    {
+      ci++;
+      ccol = ci < E.ncursors && E.cursors[ci].cy == ROW_INDEX(row) ? editorRowCxToRx(row, E.cursors[ci].cx) : -1;
+    }
+    int inverse = (ccol == c0 || (c0 >= s0 && c0 < s1)) && c1 <= limit && c0 >= coloff;
+    if (inverse)
+      abAppend(ab, "\x1b[7m", 4);
+    if (c1 > limit || c0 < coloff) // 宽字符或制表符被窗口边缘截断，用空格补齐可见部分
+    {
+      int pad = (c1 > limit ? limit : c1) - (c0 < coloff ? coloff : c0);
+      while (pad-- > 0)
+        abAppend(ab, " ", 1);
+      if (c1 > limit)
+        break;
+      continue;
+    }
+    char *c = &v->render[rb0];
+    unsigned char *hl = &v->hl[rb0];
+    int cp;
+    editorUtf8Decode(c, rb1 - rb0, &cp);
+    if (editorCharWidth(cp) < 0)
+    {
+      char sym = (cp >= 0 && cp <= 26) ? '@' + cp : '?';
+      abAppend(ab, "\x1b[7m", 4);
+      abAppend(ab, &sym, 1);
+      abAppend(ab, "\x1b[m", 3);
+      if (current_color != -1)
+      {
+        char buf[16];
+        int clen = snprintf(buf, sizeof(buf), "\x1b[%dm", current_color); // 打印当前颜色的转移序列
+        abAppend(ab, buf, clen);
+      }
+    }
+    else if (hl[0] == HL_NORMAL)
+    { // 如果当前字符是控制字符，那么我们将其显示为问号，否则我们将其显示为@加上字符的ASCII值
+      if (current_color != -1)
+      {
+        abAppend(ab, "\x1b[39m", 5);
+        current_color = -1;
+      }
+      abAppend(ab, c, rb1 - rb0);
+    }
+    else
+    {
+      int color = editorSyntaxToColor(hl[0]);
+      if (color != current_color)
+      {
+        current_color = color;
+        char buf[16];
+        int clen = snprintf(buf, sizeof(buf), "\x1b[%dm", color);
+        abAppend(ab, buf, clen);
+      }
+      abAppend(ab, c, rb1 - rb0);
+    }
+    if (inverse)
+      abAppend(ab, "\x1b[27m", 5);
+  }
+  int width = v->cells ? v->cells[v->ncells - 1].col : v->rsize;
+  while (ccol >= 0 && ccol < width)
+  {
+    ci++;
+    ccol = ci < E.ncursors && E.cursors[ci].cy == ROW_INDEX(row) ? editorRowCxToRx(row, E.cursors[ci].cx) : -1;
+  }
+  if (ccol == width && width >= coloff && width < limit) // 行尾的光标
+    abAppend(ab, "\x1b[7m \x1b[27m", 10);
+  abAppend(ab, "\x1b[39m", 5);
+}
+int editorRowCacheable(int r) // 有其他光标或被选中的行要反色显示，每帧重新生成
+{
+  int c0, c1;
+  if (E.sel && editorSelCols(r, &c0, &c1))
+    return 0;
+  if (!E.ncursors)
+    return 1;
+  int ci = editorCursorFirst(r);
+  return ci >= E.ncursors || E.cursors[ci].cy != r;
+}
+int editorRowDrawn(int r, int coloff, int cols) // 第r行的缓存对这个窗口仍然有效
+{
+  struct rowView *v = E.row[r].view; // 有ROW_DRAWN的行一定有view
+  return (E.row[r].flags & ROW_DRAWN) && v->draw.coloff == coloff && v->draw.cols == cols && editorRowCacheable(r);
+}
+void editorDrawCacheTrim() // 缓存太大时释放屏幕外各行的缓存
+{
+  if (E.drawbytes <= KILO_DRAW_CACHE)
+    return;
+  for (int r = 0; r < E.numrows; r++)
+    if (r < E.rowoff || r >= E.rowoff + E.screenrows)
+      editorRowDrawFree(&E.row[r]);
+}
+int editorDrawCachedRow(struct abuf *ab, int r, int coloff, int cols) // 行和窗口都没变时直接复制上次生成的字节，返回是否可以缓存
+{
+  if (!editorRowCacheable(r))
+  {
+    editorDrawRow(ab, &E.row[r], coloff, cols);
+    return 0;
+  }
+  editorRowRender(&E.row[r]);
+  struct rowDraw *d = &E.row[r].view->draw;
+  if (!editorRowDrawn(r, coloff, cols))
+  {
+    struct abuf line = {d->b, 0, d->cap}; // 复用上次的缓冲
+    editorDrawRow(&line, &E.row[r], coloff, cols);
+    E.drawbytes += line.cap - d->cap;
+    d->b = line.b;
+    d->len = line.len;
+    d->cap = line.cap;
+    d->coloff = coloff;
+    d->cols = cols;
+    E.row[r].flags |= ROW_DRAWN;
+  }
+  abAppend(ab, d->b, d->len);
+  return 1;
+}
+void editorDrawScroll(struct abuf *ab) // 垂直滚动时让终端在文本区域内整体滚动，之后只需画露出来的行
+{
+  int n = E.screenrows;
+  int d = E.rowoff - E.shown_rowoff;
+  if (editorFoldActive() && E.shown_rowoff >= 0) // 有折叠时按可见行滚动；折叠刚变过时滚错了也只是多画几行，每行还要比指针
+    d = editorRowVisIndex(E.rowoff) - editorRowVisIndex(E.shown_rowoff);
+  if (E.wrap || E.shown_rowoff < 0 || d >= n || d <= -n) // 折行模式或跳得太远，整屏重画
+    memset(E.shown, 0, sizeof(char *) * n);
+  else if (d > 0)
+  {
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "\x1b[1;%dr\x1b[%dS\x1b[r", n, d); // 设置滚动区域，上滚d行，再恢复
+    abAppend(ab, buf, len);
+    memmove(E.shown, E.shown + d, sizeof(char *) * (n - d));
+    memset(E.shown + n - d, 0, sizeof(char *) * d);
+  }
+  else if (d < 0)
+  {
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "\x1b[1;%dr\x1b[%dT\x1b[r", n, -d);
+    abAppend(ab, buf, len);
+    memmove(E.shown - d, E.shown, sizeof(char *) * (n + d));
+    memset(E.shown, 0, sizeof(char *) * -d);
+  }
+  E.shown_rowoff = E.wrap ? -1 : E.rowoff;
+}
+void editorDrawSign(struct abuf *ab, int r) // 画标记栏，r为-1时（折行的后续屏幕行）留空
+{
+  char sign = r < 0 ? 0 : editorDiffSign(r);
+  if (sign == 0)
+  {
+    abAppend(ab, "  ", 2);
+    return;
+  }
+  char buf[16];
+  int len = snprintf(buf, sizeof(buf), "\x1b[%dm%c\x1b[39m ", sign == '+' ? 32 : sign == '~' ? 33 : 31, sign);
+  abAppend(ab, buf, len);
+}
+void editorDrawRows(struct abuf *ab)
+{
+  int y;
+  int wrapline = E.wrapoff; // 折行模式下当前行的第几个屏幕行
+  int filerow = E.rowoff;
+  int textcols = editorTextCols();
+  char buf[32];
+  editorDrawCacheTrim();
+  editorDrawScroll(ab);
+  for (y = 0; y < E.screenrows; y++)
+  {
+    if (!E.wrap && y > 0)
+      filerow = editorRowNext(filerow); // 将屏幕行号转换为文本缓冲区行号，跳过收起的行
+    const char *shown = NULL;
+    if (filerow < E.numrows && !E.wrap && !editorRowFolded(filerow)) // 收起的折叠首行带着标记，每次都画
+    {
+      erow *row = &E.row[filerow];
+      shown = row->flags & ROW_SHARED ? (row->view ? (const char *)row->view->hl : NULL) : row->chars; // 共享行的chars相同，按行首注释状态不同的hl区分
+      if (E.shown[y] == shown && editorRowDrawn(filerow, E.coloff, textcols)) // 终端上已经是这一行，不用再发
+        continue;
+    }
+    int len = snprintf(buf, sizeof(buf), "\x1b[%d;1H", y + 1); // 跳过了没变的行，每行都要先定位
+    abAppend(ab, buf, len);
+    if (editorGutter() && filerow < E.numrows)
+      editorDrawSign(ab, E.wrap && wrapline > 0 ? -1 : filerow);
+    if (filerow >= E.numrows)   // 检查是否正在绘制属于文本缓冲区的行，或者是否正在绘制文本缓冲区结束后的行
+    {
+      if (E.numrows == 0 && y == E.screenrows / 3) // 待定，欢迎信息仅在用户不带参数启动程序时显示，而不是在打开文件时显示，以为欢迎信息可能会妨碍文件显示
+      {
+        char welcome[80];
+        int welcomelen = snprintf(welcome, sizeof(welcome),
+                                  "Kilo editor -- version %s", KILO_VERSION); // 欢迎信息
+        if (welcomelen > E.screencols)
+          welcomelen = E.screencols;
+        int padding = (E.screencols - welcomelen) / 2; // 居中
+        if (padding)
+        {
+          abAppend(ab, "~", 1);
+          padding--;
+        }
+        while (padding--)
+          abAppend(ab, " ", 1);
+        abAppend(ab, welcome, welcomelen);
+      }
+      else
+      {
+        abAppend(ab, "~", 1);
+      }
+    }
+    else if (E.wrap)
+    {
+      erow *row = &E.row[filerow];
+      int start = editorWrapStart(row, wrapline);
+      int cols = textcols;
+      if (wrapline + 1 < editorWrapLines(row))
+        cols = editorWrapStart(row, wrapline + 1) - start;
+      if (editorWrapLines(row) == 1) // 只占一个屏幕行的行也可以用缓存
+        editorDrawCachedRow(ab, filerow, start, cols);
+      else
+        editorDrawRow(ab, row, start, cols);
+      if (++wrapline >= editorWrapLines(row))
+      {
+        filerow++;
+        wrapline = 0;
+      }
+    }
+    else if (editorRowFolded(filerow)) // 收起的折叠首行后面标出藏了几行，不进缓存
+    {
+      erow *row = &E.row[filerow];
+      editorDrawRow(ab, row, E.coloff, textcols);
+      struct rowView *v = row->view;
+      int width = (v->cells ? v->cells[v->ncells - 1].col : v->rsize) - E.coloff;
+      char mark[32];
+      int mlen = snprintf(mark, sizeof(mark), " +%d lines", editorRowFolded(filerow));
+      if (width < 0)
+        width = 0;
+      if (width + mlen <= textcols)
+      {
+        abAppend(ab, "\x1b[7m", 4);
+        abAppend(ab, mark, mlen);
+        abAppend(ab, "\x1b[m", 3);
+      }
+      shown = NULL;
+    }
+    else if (!editorDrawCachedRow(ab, filerow, E.coloff, textcols))
+    {
+      shown = NULL;
+    }
+
+    abAppend(ab, "\x1b[K", 3); // K逐行删除
+    E.shown[y] = shown;
+  }
+  int len = snprintf(buf, sizeof(buf), "\x1b[%d;1H", E.screenrows + 1); // 移到状态栏
+  abAppend(ab, buf, len);
+}
+
+void editorDrawStatusBar(struct abuf *ab) // 状态栏反转颜色
+{
+  abAppend(ab, "\x1b[7m", 4);
+  char status[80], rstatus[80];
+  char loading[24] = "";
+  if (E.load) // 还在载入时显示进度，行数随之增长
+    snprintf(loading, sizeof(loading), " [loading %d%%]",
+             E.load->size ? (int)(E.load->done * 100 / E.load->size) : 0);
+  int len = snprintf(status, sizeof(status), "%.20s - %d lines%s %s",
+                     E.filename ? E.filename : editorGrepShown() ? "[grep]" : "[No Name]", E.numrows, loading,
+                     E.dirty ? "(modified)" : ""); // 状态栏显示文件修改状态，通过在文件名后显示 (modified) 来展示 E.dirty 的状态。
+  int rlen = snprintf(rstatus, sizeof(rstatus), "%s | %d/%d",
+                      E.syntax ? E.syntax->filetype : "no ft", E.cy + 1, E.numrows);
+  if (len > E.screencols)
+    len = E.screencols;
+  abAppend(ab, status, len); // 显示文件名前20个字符和行数，如果没有文件名则显示[No Name]
+  while (len < E.screencols)
+  {
+    if (E.screencols - len == rlen)
+    {
+      abAppend(ab, rstatus, rlen);
+      break;
+    }
+    else
+    {
+      abAppend(ab, " ", 1);
+      len++;
+    }
+  }
+  abAppend(ab, "\x1b[m", 3);
+  abAppend(ab, "\r\n", 2); // 状态栏下一行留出空间显示消息
+}
+void editorDrawMessageBar(struct abuf *ab)
+{
+  abAppend(ab, "\x1b[K", 3);
+  char progress[32];
+  int plen = 0;
+  if (E.save) // 后台保存的进度显示在消息栏右端
+  {
+    pthread_mutex_lock(&E.save->lock);
+    int pct = E.save->len ? (int)(E.save->written * 100 / E.save->len) : 100;
+    pthread_mutex_unlock(&E.save->lock);
+    plen = snprintf(progress, sizeof(progress), " [saving %d%%]", pct);
+    if (plen > E.screencols)
+      plen = 0;
+  }
+  int msglen = strlen(E.statusmsg);
+  if (msglen > E.screencols - plen)
+    msglen = E.screencols - plen;
+  if (msglen && time(NULL) - E.statusmsg_time < 5)
+    abAppend(ab, E.statusmsg, msglen);
+  else
+    msglen = 0;
+  if (plen)
+  {
+    for (; msglen < E.screencols - plen; msglen++)
+      abAppend(ab, " ", 1);
+    abAppend(ab, progress, plen);
+  }
+}
+void editorRefreshScreen()
+{
+  if (E.view)
+  {
+    editorViewRefresh();
+    return;
+  }
+  if (E.hex)
+  {
+    editorHexRefresh();
+    return;
+  }
+  editorScroll();
+  editorRowsFlush(editorRowAtVisIndex(editorRowVisIndex(E.rowoff) + E.screenrows - 1)); // 只重建到视口底部，后面的行等滚动到时再算
+  struct abuf ab = ABUF_INIT;    // 初始化一个新的abuf，称为ab，替换所有WRITE为abAppend
+  abAppend(&ab, "\x1b[?25l", 6); // 重置模式
+  // \x1b是住哪一字符,J命令清楚屏幕，参数是2，表示清楚整个屏幕，<esc>[1J 将清除屏幕到光标处，而 <esc>[0J 将清除从光标到屏幕末尾的屏幕。此外， 0 是 J 的默认参数，因此仅使用 <esc>[J 本身也会清除从光标到屏幕末尾的屏幕。
+  abAppend(&ab, "\x1b[H", 3); // 重新定位光标到屏幕左上角
+  editorDrawRows(&ab);
+  editorDrawStatusBar(&ab);
+  editorDrawMessageBar(&ab);
+
+  char buf[32];
+  if (E.wrap)
+    snprintf(buf, sizeof(buf), "\x1b[%d;%dH", E.wrap_y + 1, E.wrap_x + editorGutter() + 1);
+  else
+    snprintf(buf, sizeof(buf), "\x1b[%d;%dH", (editorRowVisIndex(E.cy) - editorRowVisIndex(E.rowoff)) + 1, (E.rx - E.coloff) + editorGutter() + 1); // E.cy不再指向屏幕上光标位置，而是光标在文本文件中的位置
+  abAppend(&ab, buf, strlen(buf));
+  // abAppend(&ab, "\x1b[H", 3);    // 绘制完成后，重新定位光标到屏幕左上角
+  abAppend(&ab, "\x1b[?25h", 6); // 设置模式
+  write(STDOUT_FILENO, ab.b, ab.len);
+  abFree(&ab);
+}
+void editorSetStatusMessage(const char *fmt, ...)
+{
+  va_list ap;
+  va_start(ap, fmt);
+  vsnprintf(E.statusmsg, sizeof(E.statusmsg), fmt, ap);
+  va_end(ap);
+  E.statusmsg_time = time(NULL);
+}
+
+/*** large file viewer ***/
+// 只读查看超大文件：后台线程建稀疏行索引，只解码屏幕附近的行块，按LRU在内存上限内淘汰；搜索直接在文件上分块扫描
+#define KILO_VIEW_STRIDE 1024               // 每隔多少行记一个偏移，也是一个行块的行数
+#define KILO_VIEW_CHUNK (1 << 20)           // 建索引、解码和搜索每次读入的字节数
+#define KILO_VIEW_LINE_MAX (1 << 16)        // 超长行只解码前面这么多字节
+#define KILO_VIEW_MEM_MB 64                 // 行块缓存的默认上限，可用环境变量KILO_VIEW_MEM（MB）修改
+struct viewBlock // 从first行开始的最多KILO_VIEW_STRIDE行，已经render和高亮
+{
+  long first;
+  erow *rows;
+  int nrows;
+  size_t bytes;
+  unsigned long used; // 最近一次使用时的帧号
+};
+struct viewer
+{
+  int fd;
+  off_t size;
+  pthread_t indexer;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  off_t *index; // index[k]是第k*KILO_VIEW_STRIDE行的起始偏移，由索引线程追加
+  long nindex, capindex;
+  long nlines;   // 索引建完之前为-1
+  off_t scanned; // 索引线程已经读过的字节数
+  int stop;
+  struct viewBlock *blocks;
+  int nblocks;
+  size_t bytes, limit;
+  unsigned long frame;
+  long top, cy; // 屏幕第一行和光标所在行
+  int cx, coloff;
+  char *query; // 上一次搜索的内容
+};
+void *editorViewIndexer(void *arg)
+{
+  struct viewer *v = arg;
+  char *buf = malloc(KILO_VIEW_CHUNK);
+  off_t *found = malloc(sizeof(off_t) * (KILO_VIEW_CHUNK / KILO_VIEW_STRIDE + 1));
+  off_t off = 0;
+  long line = 0;
+  ssize_t n = 0;
+  int stop = 0;
+  while (!stop && (n = pread(v->fd, buf, KILO_VIEW_CHUNK, off)) > 0)
+  {
+    int nfound = 0;
+    char *p = buf, *end = buf + n;
+    while ((p = memchr(p, '\n', end - p)) != NULL)
+    {
+      p++;
+      if (++line % KILO_VIEW_STRIDE == 0)
+        found[nfound++] = off + (p - buf);
+    }
+    off += n;
+    pthread_mutex_lock(&v->lock); // 只在追加时加锁，扫描本身不阻塞界面线程
+    if (v->nindex + nfound > v->capindex)
+    {
+      v->capindex = (v->nindex + nfound) * 2;
+      v->index = realloc(v->index, sizeof(off_t) * v->capindex);
+    }
+    memcpy(&v->index[v->nindex], found, sizeof(off_t) * nfound);
+    v->nindex += nfound;
+    v->scanned = off;
+    stop = v->stop;
+    pthread_cond_broadcast(&v->cond);
+    pthread_mutex_unlock(&v->lock);
+  }
+  char last = '\n';
+  if (off > 0)
+    pread(v->fd, &last, 1, off - 1);
+  pthread_mutex_lock(&v->lock);
+  v->nlines = line + (last != '\n'); // 最后一行没有换行符也算一行，与editorOpen一致
+  if (n < 0 || stop)
+    v->nlines = line;
+  v->scanned = v->size;
+  pthread_cond_broadcast(&v->cond);
+  pthread_mutex_unlock(&v->lock);
+  free(found);
+  free(buf);
+  return NULL;
+}
+int editorViewLocate(struct viewer *v, long b, off_t *start, off_t *end) // 第b块的字节范围，必要时等待索引线程；块不存在返回0
+{
+  pthread_mutex_lock(&v->lock);
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_nsec += 50 * 1000000L; // 索引线程马上就能赶到时不提示
+  if (ts.tv_nsec >= 1000000000L)
+  {
+    ts.tv_sec++;
+    ts.tv_nsec -= 1000000000L;
+  }
+  while (v->nindex <= b + 1 && v->nlines < 0 && pthread_cond_timedwait(&v->cond, &v->lock, &ts) == 0)
+    ;
+  if (v->nindex <= b + 1 && v->nlines < 0)
+  {
+    editorSetStatusMessage("Indexing %s ...", E.filename);
+    write(STDOUT_FILENO, "\x1b[999;1H\x1b[K", 11);
+    write(STDOUT_FILENO, E.statusmsg, strlen(E.statusmsg));
+  }
+  while (v->nindex <= b + 1 && v->nlines < 0) // 块的结尾是下一块的开头，没建到就等
+    pthread_cond_wait(&v->cond, &v->lock);
+  int ok = b < v->nindex && b * KILO_VIEW_STRIDE < (v->nlines < 0 ? LONG_MAX : v->nlines);
+  if (ok)
+  {
+    *start = v->index[b];
+    *end = b + 1 < v->nindex ? v->index[b + 1] : v->size;
+  }
+  pthread_mutex_unlock(&v->lock);
+  return ok;
+}
+void editorViewAddRow(struct viewBlock *blk, const char *s, int len)
+{
+  while (len > 0 && s[len - 1] == '\r')
+    len--;
+  erow *row = &blk->rows[blk->nrows++];
+  memset(row, 0, sizeof(erow));
+  row->chars = malloc(len + 1);
+  memcpy(row->chars, s, len);
+  row->chars[len] = '\0';
+  row->size = len;
+  row->flags = ROW_DIRTY;
+}
+void editorViewEvict(struct viewer *v) // 超过内存上限时淘汰最久没用的块，本帧用到的块不动
+{
+  while (v->bytes > v->limit)
+  {
+    int lru = -1;
+    for (int i = 0; i < v->nblocks; i++)
+      if (v->blocks[i].used < v->frame && (lru < 0 || v->blocks[i].used < v->blocks[lru].used))
+        lru = i;
+    if (lru < 0)
+      return;
+    struct viewBlock *blk = &v->blocks[lru];
+    for (int k = 0; k < blk->nrows; k++)
+      editorFreeRow(&blk->rows[k]);
+    free(blk->rows);
+    v->bytes -= blk->bytes;
+    v->blocks[lru] = v->blocks[--v->nblocks];
+  }
+}
+struct viewBlock *editorViewBlock(struct viewer *v, long b)
+{
+  for (int i = 0; i < v->nblocks; i++)
+  {
+    if (v->blocks[i].first == b * KILO_VIEW_STRIDE)
+    {
+      v->blocks[i].used = v->frame;
+      return &v->blocks[i];
+    }
+  }
+  off_t off, end;
+  if (!editorViewLocate(v, b, &off, &end))
+    return NULL;
+  struct viewBlock blk = {b * KILO_VIEW_STRIDE, malloc(sizeof(erow) * KILO_VIEW_STRIDE), 0, 0, v->frame};
+  char *buf = malloc(KILO_VIEW_CHUNK);
+  char *line = malloc(KILO_VIEW_LINE_MAX);
+  int linelen = 0;
+  ssize_t n;
+  while (off < end && blk.nrows < KILO_VIEW_STRIDE)
+  {
+    size_t want = end - off < KILO_VIEW_CHUNK ? (size_t)(end - off) : KILO_VIEW_CHUNK;
+    if ((n = pread(v->fd, buf, want, off)) <= 0)
+      break;
+    off += n;
+    for (char *p = buf, *stop = buf + n; p < stop && blk.nrows < KILO_VIEW_STRIDE;)
+    {
+      char *nl = memchr(p, '\n', stop - p);
+      int len = (nl ? nl : stop) - p;
+      if (len > KILO_VIEW_LINE_MAX - linelen)
+        len = KILO_VIEW_LINE_MAX - linelen;
+      memcpy(line + linelen, p, len);
+      linelen += len;
+      if (!nl)
+        break;
+      editorViewAddRow(&blk, line, linelen);
+      linelen = 0;
+      p = nl + 1;
+    }
+  }
+  if (linelen > 0 && blk.nrows < KILO_VIEW_STRIDE) // 文件最后一行没有换行符
+    editorViewAddRow(&blk, line, linelen);
+  free(line);
+  free(buf);
+  int in = 0; // 多行注释状态从上一块接过来，上一块不在内存中时按不在注释中处理
+  for (int i = 0; i < v->nblocks; i++)
+    if (v->blocks[i].first + v->blocks[i].nrows == blk.first && v->blocks[i].nrows > 0)
+      in = (v->blocks[i].rows[v->blocks[i].nrows - 1].flags & ROW_OPEN_COMMENT) != 0;
+  for (int k = 0; k < blk.nrows; k++)
+  {
+    erow *row = &blk.rows[k];
+    editorRowRender(row);
+    in = editorHighlightRow(row, in);
+    row->flags = in ? ROW_OPEN_COMMENT : 0;
+    blk.bytes += sizeof(erow) + sizeof(struct rowView) + row->size + 2 * row->view->rsize + sizeof(struct rowcell) * row->view->ncells;
+  }
+  v->bytes += blk.bytes;
+  editorViewEvict(v);
+  v->blocks = realloc(v->blocks, sizeof(struct viewBlock) * (v->nblocks + 1));
+  v->blocks[v->nblocks] = blk;
+  return &v->blocks[v->nblocks++];
+}
+erow *editorViewRow(struct viewer *v, long line) // 第line行，超出文件末尾返回NULL
+{
+  if (line < 0)
+    return NULL;
+  struct viewBlock *blk = editorViewBlock(v, line / KILO_VIEW_STRIDE);
+  if (blk == NULL || line - blk->first >= blk->nrows)
+    return NULL;
+  return &blk->rows[line - blk->first];
+}
+void editorViewOpen(char *filename)
+{
+  struct viewer *v = calloc(1, sizeof(struct viewer));
+  v->fd = open(filename, O_RDONLY);
+  if (v->fd == -1)
+    die("open");
+  struct stat st;
+  fstat(v->fd, &st);
+  v->size = st.st_size;
+  v->index = malloc(sizeof(off_t) * 16);
+  v->capindex = 16;
+  v->index[v->nindex++] = 0;
+  v->nlines = -1;
+  char *mem = getenv("KILO_VIEW_MEM");
+  v->limit = (size_t)(mem && atol(mem) > 0 ? atol(mem) : KILO_VIEW_MEM_MB) << 20;
+  pthread_mutex_init(&v->lock, NULL);
+  pthread_cond_init(&v->cond, NULL);
+  free(E.filename);
+  E.filename = strdup(filename);
+  editorSelectSyntaxHighlight();
+  E.view = v;
+  if (pthread_create(&v->indexer, NULL, editorViewIndexer, v) != 0)
+    die("pthread_create");
+  editorSetStatusMessage("Read-only view | ^F find | ^Q quit");
+}
+void editorViewClose()
+{
+  struct viewer *v = E.view;
+  pthread_mutex_lock(&v->lock);
+  v->stop = 1;
+  pthread_mutex_unlock(&v->lock);
+  pthread_join(v->indexer, NULL);
+  v->limit = 0;
+  v->frame++;
+  editorViewEvict(v);
+  free(v->blocks);
+  free(v->index);
+  free(v->query);
+  close(v->fd);
+  free(v);
+  E.view = NULL;
+}
+void editorViewScroll(struct viewer *v)
+{
+  erow *row = editorViewRow(v, v->cy);
+  int rx = row ? editorRowCxToRx(row, v->cx) : 0;
+  if (v->cy < v->top)
+    v->top = v->cy;
+  if (v->cy >= v->top + E.screenrows)
+    v->top = v->cy - E.screenrows + 1;
+  if (rx < v->coloff)
+    v->coloff = rx;
+  if (rx >= v->coloff + E.screencols)
+    v->coloff = rx - E.screencols + 1;
+}
+void editorViewRefresh()
+{
+  struct viewer *v = E.view;
+  v->frame++;
+  editorViewScroll(v);
+  struct abuf ab = ABUF_INIT;
+  abAppend(&ab, "\x1b[?25l", 6);
+  abAppend(&ab, "\x1b[H", 3);
+  for (int y = 0; y < E.screenrows; y++)
+  {
+    erow *row = editorViewRow(v, v->top + y);
+    if (row)
+      editorDrawRow(&ab, row, v->coloff, E.screencols);
+    else
+      abAppend(&ab, "~", 1);
+    abAppend(&ab, "\x1b[K\r\n", 5);
+  }
+  char status[80], rstatus[80], total[24];
+  pthread_mutex_lock(&v->lock);
+  if (v->nlines >= 0)
+    snprintf(total, sizeof(total), "%ld", v->nlines);
+  else
+    snprintf(total, sizeof(total), "%d%%", (int)(v->size ? v->scanned * 100 / v->size : 100));
+  pthread_mutex_unlock(&v->lock);
+  int len = snprintf(status, sizeof(status), "%.20s - %s lines [read-only]", E.filename, total);
+  int rlen = snprintf(rstatus, sizeof(rstatus), "%s | %ld/%s %zuM",
+                      E.syntax ? E.syntax->filetype : "no ft", v->cy + 1, total, v->bytes >> 20);
+  if (len > E.screencols)
+    len = E.screencols;
+  abAppend(&ab, "\x1b[7m", 4);
+  abAppend(&ab, status, len);
+  for (; len < E.screencols; len++)
+  {
+    if (E.screencols - len == rlen)
+    {
+      abAppend(&ab, rstatus, rlen);
+      break;
+    }
+    abAppend(&ab, " ", 1);
+  }
+  abAppend(&ab, "\x1b[m\r\n", 5);
+  editorDrawMessageBar(&ab);
+  erow *row = editorViewRow(v, v->cy);
+  char buf[32];
+  snprintf(buf, sizeof(buf), "\x1b[%d;%dH", (int)(v->cy - v->top) + 1, (row ? editorRowCxToRx(row, v->cx) : 0) - v->coloff + 1);
+  abAppend(&ab, buf, strlen(buf));
+  abAppend(&ab, "\x1b[?25h", 6);
+  write(STDOUT_FILENO, ab.b, ab.len);
+  abFree(&ab);
+}
+void editorViewFind(struct viewer *v) // 从光标所在块的开头往后分块扫描文件，跳过光标之前的匹配，到末尾后从头再找
+{
+  char *query = editorPrompt("View search: %s (ESC to cancel, Enter repeats)", NULL, 1);
+  if (query == NULL)
+    return;
+  if (query[0] == '\0')
+  {
+    free(query);
+    if (v->query == NULL)
+      return;
+  }
+  else
+  {
+    free(v->query);
+    v->query = query;
+  }
+  int qlen = strlen(v->query);
+  long b = v->cy / KILO_VIEW_STRIDE;
+  off_t from, end;
+  if (!editorViewLocate(v, b, &from, &end))
+    return;
+  editorSetStatusMessage("Searching...");
+  editorViewRefresh();
+  char *buf = malloc(KILO_VIEW_CHUNK + qlen);
+  for (int pass = 0; pass < 2; pass++) // 找到末尾还没有，再从文件开头找到光标所在块的结尾
+  {
+    off_t off = pass ? 0 : from;
+    off_t stop = pass ? (end + qlen - 1 < v->size ? end + qlen - 1 : v->size) : v->size;
+    long line = pass ? 0 : b * KILO_VIEW_STRIDE;
+    off_t linestart = off;
+    while (off < stop)
+    {
+      size_t want = KILO_VIEW_CHUNK + qlen - 1 < stop - off ? (size_t)KILO_VIEW_CHUNK + qlen - 1 : (size_t)(stop - off);
+      ssize_t n = pread(v->fd, buf, want, off);
+      if (n <= 0)
+        break;
+      ssize_t used = off + n < stop && n > KILO_VIEW_CHUNK ? KILO_VIEW_CHUNK : n; // 块尾qlen-1字节下一轮重读，跨块的匹配不会漏
+      char *scan = buf, *match;
+      while ((match = memmem(scan, buf + n - scan, v->query, qlen)) != NULL && match < buf + used)
+      {
+        for (char *p = scan; (p = memchr(p, '\n', match - p)) != NULL; p++, line++) // 数出匹配所在的行
+          linestart = off + (p - buf) + 1;
+        int cx = off + (match - buf) - linestart;
+        if (pass || line > v->cy || (line == v->cy && cx > v->cx))
+        {
+          erow *row = editorViewRow(v, line);
+          v->cy = line;
+          v->cx = row ? editorRowSnapCx(row, cx < row->size ? cx : row->size) : 0;
+          editorSetStatusMessage(pass ? "Search wrapped to top" : "");
+          free(buf);
+          return;
+        }
+        scan = match + 1;
+      }
+      for (char *p = scan; (p = memchr(p, '\n', buf + used - p)) != NULL; p++, line++)
+        linestart = off + (p - buf) + 1;
+      off += used;
+    }
+  }
+  free(buf);
+  editorSetStatusMessage("Not found: %s", v->query);
+}
+void editorViewProcessKeypress()
+{
+  struct viewer *v = E.view;
+  int c = editorReadKey();
+  erow *row = editorViewRow(v, v->cy);
+  switch (c)
+  {
+  case CTRL_KEY('q'):
+    editorViewClose();
+    write(STDOUT_FILENO, "\x1b[2J", 4);
+    write(STDOUT_FILENO, "\x1b[H", 3);
+    exit(0);
+    break;
+  case CTRL_KEY('f'):
+    editorViewFind(v);
+    return;
+  case ARROW_UP:
+  case ARROW_DOWN:
+  case PAGE_UP:
+  case PAGE_DOWN:
+  {
+    long step = c == PAGE_UP || c == PAGE_DOWN ? E.screenrows : 1;
+    long target = v->cy + (c == ARROW_UP || c == PAGE_UP ? -step : step);
+    if (target < 0)
+      target = 0;
+    while (target > v->cy && editorViewRow(v, target) == NULL) // 越过末尾时停在最后一行
+      target = v->nlines > 0 ? v->nlines - 1 : 0;
+    v->cy = target;
+    row = editorViewRow(v, v->cy);
+    if (row)
+      v->cx = editorRowSnapCx(row, v->cx);
+    break;
+  }
+  case ARROW_LEFT:
+    if (row)
+      v->cx = editorRowPrevCx(row, v->cx);
+    break;
+  case ARROW_RIGHT:
+    if (row)
+      v->cx = editorRowNextCx(row, v->cx);
+    break;
+  case HOME_KEY:
+    v->cx = 0;
+    break;
+  case END_KEY:
+    v->cx = row ? row->size : 0;
+    break;
+  case '\x1b':
+    break;
+  default:
+    editorSetStatusMessage("Read-only view | ^F find | ^Q quit");
+    break;
+  }
+}
+
+/*** hex view ***/
+// 二进制文件按固定宽度的字节行显示：行不存储，每帧从mmap中取出屏幕上的几行现场格式化；
+// 修改是逐字节覆盖，按偏移有序地记在补丁表里，保存时写回原位置，文件大小不变
+#define KILO_HEX_PROBE 8192   // 看文件开头这么多字节判断是不是二进制文件
+#define KILO_HEX_BINARY 32     // 其中超过这么多分之一是'\0'或文本里不会有的控制字符才算二进制，偶尔混进一个'\0'的文本文件照常编辑
+#define KILO_HEX_MAX_WIDTH 64  // 屏幕够宽时每行最多显示的字节数
+struct hexPatch
+{
+  off_t off;
+  unsigned char byte;
+};
+struct hexEdit // 撤销记录：修改前这个偏移有没有补丁、补丁的值
+{
+  off_t off;
+  int had;
+  unsigned char prev;
+};
+struct hexView
+{
+  int fd;
+  off_t size;
+  const unsigned char *map; // 整个文件只读映射，空文件为NULL
+  struct hexPatch *patches; // 按off排序
+  int npatches, cappatches;
+  struct hexEdit *edits;
+  int nedits, capedits;
+  int width;   // 每行字节数，16的倍数
+  off_t top;   // 屏幕第一行的行号
+  off_t cur;   // 光标所在字节
+  int nibble;  // 十六进制栏里光标在高(0)还是低(1)四位
+  int ascii;   // 光标在右边的字符栏
+  char *query; // 上一次搜索的内容
+};
+int editorIsBinary(const char *filename)
+{
+  int fd = open(filename, O_RDONLY);
+  if (fd == -1)
+    return 0;
+  char buf[KILO_HEX_PROBE];
+  ssize_t n = read(fd, buf, sizeof(buf));
+  close(fd);
+  int odd = 0;
+  for (ssize_t i = 0; i < n; i++)
+  {
+    unsigned char c = buf[i];
+    odd += c == '\0' || c == 0x7f || (c < 0x20 && !strchr("\t\n\r\f\v\b\x1b", c)); // strchr会找到结尾的'\0'，所以'\0'单独判断
+  }
+  return n > 0 && (long)odd * KILO_HEX_BINARY > n;
+}
+static void editorHexFormat(const unsigned char *s, char *hex, char *text) // 16字节格式化成32个十六进制字符和16个可显示字符
+{
+#ifdef __SSE2__
+  __m128i v = _mm_loadu_si128((const __m128i *)s);
+  __m128i nib = _mm_set1_epi8(0x0f), nine = _mm_set1_epi8(9);
+  __m128i zero = _mm_set1_epi8('0'), gap = _mm_set1_epi8('a' - '0' - 10);
+  __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), nib);
+  __m128i lo = _mm_and_si128(v, nib);
+  hi = _mm_add_epi8(_mm_add_epi8(hi, zero), _mm_and_si128(_mm_cmpgt_epi8(hi, nine), gap)); // 大于9的跳到'a'
+  lo = _mm_add_epi8(_mm_add_epi8(lo, zero), _mm_and_si128(_mm_cmpgt_epi8(lo, nine), gap));
+  _mm_storeu_si128((__m128i *)hex, _mm_unpacklo_epi8(hi, lo)); // 高低四位交错
+  _mm_storeu_si128((__m128i *)(hex + 16), _mm_unpackhi_epi8(hi, lo));
+  __m128i ok = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(0x1f)), _mm_cmplt_epi8(v, _mm_set1_epi8(0x7f))); // 有符号比较，>=0x80的为负
+  _mm_storeu_si128((__m128i *)text, _mm_or_si128(_mm_and_si128(ok, v), _mm_andnot_si128(ok, _mm_set1_epi8('.'))));
+#else
+  static const char digits[] = "0123456789abcdef";
+  for (int i = 0; i < 16; i++)
+  {
+    hex[2 * i] = digits[s[i] >> 4];
+    hex[2 * i + 1] = digits[s[i] & 15];
+    text[i] = s[i] >= 0x20 && s[i] < 0x7f ? s[i] : '.';
+  }
+#endif
+}
+int editorHexPatchAt(struct hexView *h, off_t off) // 第一个偏移不小于off的补丁
+{
+  int lo = 0, hi = h->npatches;
+  while (lo < hi)
+  {
+    int mid = (lo + hi) / 2;
+    if (h->patches[mid].off < off)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+int editorHexByte(struct hexView *h, off_t off) // 打过补丁后的字节
+{
+  int i = editorHexPatchAt(h, off);
+  if (i < h->npatches && h->patches[i].off == off)
+    return h->patches[i].byte;
+  return h->map[off];
+}
+void editorHexSet(struct hexView *h, off_t off, int had, unsigned char byte) // had为0时去掉off处的补丁
+{
+  int i = editorHexPatchAt(h, off);
+  int exists = i < h->npatches && h->patches[i].off == off;
+  if (!had)
+  {
+    if (exists)
+    {
+      memmove(&h->patches[i], &h->patches[i + 1], sizeof(struct hexPatch) * (h->npatches - i - 1));
+      h->npatches--;
+    }
+    return;
+  }
+  if (!exists)
+  {
+    if (h->npatches == h->cappatches)
+    {
+      h->cappatches = h->cappatches ? h->cappatches * 2 : 64;
+      h->patches = realloc(h->patches, sizeof(struct hexPatch) * h->cappatches);
+    }
+    memmove(&h->patches[i + 1], &h->patches[i], sizeof(struct hexPatch) * (h->npatches - i));
+    h->npatches++;
+  }
+  h->patches[i].off = off;
+  h->patches[i].byte = byte;
+}
+void editorHexWrite(struct hexView *h, unsigned char byte) // 覆盖光标处的字节，记下撤销
+{
+  int i = editorHexPatchAt(h, h->cur);
+  int had = i < h->npatches && h->patches[i].off == h->cur;
+  if (h->nedits == h->capedits)
+  {
+    h->capedits = h->capedits ? h->capedits * 2 : 64;
+    h->edits = realloc(h->edits, sizeof(struct hexEdit) * h->capedits);
+  }
+  h->edits[h->nedits++] = (struct hexEdit){h->cur, had, had ? h->patches[i].byte : 0};
+  editorHexSet(h, h->cur, 1, byte);
+  E.dirty++;
+}
+int editorHexDigits(struct hexView *h) // 偏移栏的宽度
+{
+  int d = 8;
+  while (d < 16 && (h->size >> (4 * d)) > 0)
+    d++;
+  return d;
+}
+int editorHexCol(struct hexView *h, int i) // 行内第i个字节在十六进制栏的列，每8字节多空一格
+{
+  return editorHexDigits(h) + 2 + 3 * i + i / 8;
+}
+int editorHexFit(struct hexView *h) // 屏幕放得下的最大行宽：偏移栏、十六进制栏、两边的竖线和字符栏
+{
+  int w = KILO_HEX_MAX_WIDTH;
+  while (w > 16 && editorHexCol(h, w) + w + 2 > E.screencols)
+    w -= 16;
+  return w;
+}
+void editorHexOpen(char *filename)
+{
+  struct hexView *h = calloc(1, sizeof(struct hexView));
+  h->fd = open(filename, O_RDONLY);
+  if (h->fd == -1)
+    die("open");
+  struct stat st;
+  fstat(h->fd, &st);
+  h->size = st.st_size;
+  if (h->size > 0)
+  {
+    void *p = mmap(NULL, h->size, PROT_READ, MAP_SHARED, h->fd, 0); // 共享映射，保存写回的字节直接可见
+    if (p == MAP_FAILED)
+      die("mmap");
+    madvise(p, h->size, MADV_RANDOM); // 只看屏幕上的几页，不要预读
+    h->map = p;
+  }
+  h->width = editorHexFit(h);
+  free(E.filename);
+  E.filename = strdup(filename);
+  E.hex = h;
+  editorSetStatusMessage("Hex view | Tab hex/text | ^S save | ^Z undo | ^F find | ^G goto | ^W width");
+}
+void editorHexClose()
+{
+  struct hexView *h = E.hex;
+  if (h->map)
+    munmap((void *)h->map, h->size);
+  close(h->fd);
+  free(h->patches);
+  free(h->edits);
+  free(h->query);
+  free(h);
+  E.hex = NULL;
+}
+void editorHexSave(struct hexView *h)
+{
+  int fd = open(E.filename, O_WRONLY);
+  if (fd == -1)
+  {
+    editorSetStatusMessage("Can't save! I/O error: %s", strerror(errno));
+    return;
+  }
+  int i = 0;
+  for (; i < h->npatches; i++)
+    if (pwrite(fd, &h->patches[i].byte, 1, h->patches[i].off) != 1)
+      break;
+  close(fd);
+  if (i < h->npatches)
+  {
+    editorSetStatusMessage("Can't save! I/O error: %s", strerror(errno));
+    return;
+  }
+  editorSetStatusMessage("%d bytes written to disk", h->npatches);
+  h->npatches = 0;
+  h->nedits = 0; // 写回以后补丁表空了，撤销记录跟着作废
+  E.dirty = 0;
+}
+void editorHexScroll(struct hexView *h)
+{
+  if (h->width > editorHexFit(h)) // 窗口变窄了
+    h->width = editorHexFit(h);
+  off_t row = h->cur / h->width;
+  if (row < h->top)
+    h->top = row;
+  if (row >= h->top + E.screenrows)
+    h->top = row - E.screenrows + 1;
+}
+void editorHexDrawRow(struct abuf *ab, struct hexView *h, off_t off)
+{
+  unsigned char bytes[KILO_HEX_MAX_WIDTH];
+  char hex[2 * KILO_HEX_MAX_WIDTH], text[KILO_HEX_MAX_WIDTH], buf[32];
+  int n = h->size - off < h->width ? (int)(h->size - off) : h->width;
+  memcpy(bytes, h->map + off, n);
+  memset(bytes + n, 0, h->width - n);
+  int p = editorHexPatchAt(h, off); // 本行的补丁覆盖上去，并标出位置
+  unsigned long long patched = 0;
+  for (; p < h->npatches && h->patches[p].off < off + n; p++)
+  {
+    bytes[h->patches[p].off - off] = h->patches[p].byte;
+    patched |= 1ull << (h->patches[p].off - off);
+  }
+  for (int i = 0; i < h->width; i += 16)
+    editorHexFormat(bytes + i, hex + 2 * i, text + i);
+  int len = snprintf(buf, sizeof(buf), "%0*llx  ", editorHexDigits(h), (unsigned long long)off);
+  abAppend(ab, buf, len);
+  for (int i = 0; i < h->width; i++)
+  {
+    if (i && i % 8 == 0)
+      abAppend(ab, " ", 1);
+    if (i >= n)
+      abAppend(ab, "   ", 3);
+    else if (patched & (1ull << i)) // 改过的字节用红色
+    {
+      abAppend(ab, "\x1b[31m", 5);
+      abAppend(ab, hex + 2 * i, 2);
+      abAppend(ab, "\x1b[39m ", 6);
+    }
+    else
+    {
+      abAppend(ab, hex + 2 * i, 2);
+      abAppend(ab, " ", 1);
+    }
+  }
+  abAppend(ab, " |", 2);
+  abAppend(ab, text, n);
+  abAppend(ab, "|", 1);
+}
+void editorHexRefresh()
+{
+  struct hexView *h = E.hex;
+  editorHexScroll(h);
+  struct abuf ab = ABUF_INIT;
+  abAppend(&ab, "\x1b[?25l", 6);
+  abAppend(&ab, "\x1b[H", 3);
+  for (int y = 0; y < E.screenrows; y++)
+  {
+    off_t off = (h->top + y) * h->width;
+    if (off < h->size)
+      editorHexDrawRow(&ab, h, off);
+    else
+      abAppend(&ab, "~", 1);
+    abAppend(&ab, "\x1b[K\r\n", 5);
+  }
+  char status[80], rstatus[80];
+  int len = snprintf(status, sizeof(status), "%.20s - %lld bytes [hex] %s", E.filename, (long long)h->size,
+                     h->npatches ? "(modified)" : "");
+  int rlen = snprintf(rstatus, sizeof(rstatus), "%d patched | 0x%llx", h->npatches, (unsigned long long)h->cur);
+  if (len > E.screencols)
+    len = E.screencols;
+  abAppend(&ab, "\x1b[7m", 4);
+  abAppend(&ab, status, len);
+  for (; len < E.screencols; len++)
+  {
+    if (E.screencols - len == rlen)
+    {
+      abAppend(&ab, rstatus, rlen);
+      break;
+    }
+    abAppend(&ab, " ", 1);
+  }
+  abAppend(&ab, "\x1b[m\r\n", 5);
+  editorDrawMessageBar(&ab);
+  int i = h->cur % h->width;
+  int x = h->ascii ? editorHexCol(h, h->width) + 1 + i : editorHexCol(h, i) + h->nibble;
+  char buf[32];
+  snprintf(buf, sizeof(buf), "\x1b[%d;%dH", (int)(h->cur / h->width - h->top) + 1, x + 1);
+  abAppend(&ab, buf, strlen(buf));
+  abAppend(&ab, "\x1b[?25h", 6);
+  write(STDOUT_FILENO, ab.b, ab.len);
+  abFree(&ab);
+}
+int editorHexMatch(struct hexView *h, off_t at, const char *q, size_t qlen) // 打过补丁后的字节从at开始是不是q
+{
+  if (at < 0 || at + (off_t)qlen > h->size)
+    return 0;
+  for (size_t i = 0; i < qlen; i++)
+    if (editorHexByte(h, at + i) != (unsigned char)q[i])
+      return 0;
+  return 1;
+}
+off_t editorHexSearch(struct hexView *h, off_t from, off_t to, const char *q, size_t qlen) // 在[from, to)里找打过补丁后的第一个匹配，没有返回-1
+{
+  off_t best = -1;
+  off_t end = to + (off_t)qlen - 1 < h->size ? to + (off_t)qlen - 1 : h->size;
+  for (off_t pos = from; pos < to;) // 映射上的匹配可能被补丁破坏，逐个核对
+  {
+    const unsigned char *m = memmem(h->map + pos, end - pos, q, qlen);
+    if (m == NULL || m - h->map >= to)
+      break;
+    if (editorHexMatch(h, m - h->map, q, qlen))
+    {
+      best = m - h->map;
+      break;
+    }
+    pos = m - h->map + 1;
+  }
+  if (best >= 0)
+    to = best;
+  off_t lo = from - (off_t)qlen + 1; // 补丁也可能拼出映射上没有的匹配，只需看和补丁重叠的起点
+  for (int p = editorHexPatchAt(h, lo > 0 ? lo : 0); p < h->npatches && h->patches[p].off - (off_t)qlen + 1 < to; p++)
+  {
+    off_t at = h->patches[p].off - (off_t)qlen + 1;
+    for (at = at > from ? at : from; at <= h->patches[p].off && at < to; at++)
+      if (editorHexMatch(h, at, q, qlen))
+        return at; // 补丁按偏移排序，先找到的就是最靠前的
+  }
+  return best;
+}
+void editorHexFind(struct hexView *h) // 从光标之后找，找到末尾再从头找；按打过补丁后的字节匹配
+{
+  char *query = editorPrompt("Hex search: %s (ESC to cancel, Enter repeats)", NULL, 1);
+  if (query == NULL)
+    return;
+  if (query[0] == '\0')
+  {
+    free(query);
+    if (h->query == NULL)
+      return;
+  }
+  else
+  {
+    free(h->query);
+    h->query = query;
+  }
+  size_t qlen = strlen(h->query);
+  off_t at = editorHexSearch(h, h->cur + 1, h->size, h->query, qlen);
+  if (at < 0)
+    at = editorHexSearch(h, 0, h->cur + 1, h->query, qlen);
+  if (at < 0)
+  {
+    editorSetStatusMessage("Not found: %s", h->query);
+    return;
+  }
+  h->cur = at;
+  h->nibble = 0;
+}
+void editorHexGoto(struct hexView *h)
+{
+  char *s = editorPrompt("Goto offset (hex): %s", NULL, 0);
+  if (s == NULL)
+    return;
+  char *end;
+  long long off = strtoll(s, &end, 16);
+  if (*end != '\0' || off < 0 || off >= h->size)
+    editorSetStatusMessage("Bad offset: %s", s);
+  else
+  {
+    h->cur = off;
+    h->nibble = 0;
+  }
+  free(s);
+}
+void editorHexProcessKeypress()
+{
+  static int quit_times = KILO_QUIT_TIMES;
+  struct hexView *h = E.hex;
+  int c = editorReadKey();
+  off_t last = h->size > 0 ? h->size - 1 : 0;
+  switch (c)
+  {
+  case CTRL_KEY('q'):
+    if (h->npatches && quit_times > 0)
+    {
+      editorSetStatusMessage("WARNING!!! File has unsaved changes. "
+                             "Press Ctrl-Q %d more times to quit.",
+                             quit_times);
+      quit_times--;
+      return;
+    }
+    editorHexClose();
+    write(STDOUT_FILENO, "\x1b[2J", 4);
+    write(STDOUT_FILENO, "\x1b[H", 3);
+    exit(0);
+    break;
+  case CTRL_KEY('s'):
+    editorHexSave(h);
+    break;
+  case CTRL_KEY('f'):
+    editorHexFind(h);
+    break;
+  case CTRL_KEY('g'):
+    editorHexGoto(h);
+    break;
+  case CTRL_KEY('w'): // 在每行16字节和屏幕放得下的最大行宽之间切换
+    h->width = h->width == 16 ? editorHexFit(h) : 16;
+    break;
+  case CTRL_KEY('z'):
+    if (h->nedits == 0)
+    {
+      editorSetStatusMessage("Already at oldest change");
+      break;
+    }
+    h->nedits--;
+    editorHexSet(h, h->edits[h->nedits].off, h->edits[h->nedits].had, h->edits[h->nedits].prev);
+    h->cur = h->edits[h->nedits].off;
+    h->nibble = 0;
+    break;
+  case '\t':
+    h->ascii = !h->ascii;
+    h->nibble = 0;
+    break;
+  case ARROW_LEFT:
+  case ARROW_RIGHT:
+  case ARROW_UP:
+  case ARROW_DOWN:
+  case PAGE_UP:
+  case PAGE_DOWN:
+  {
+    off_t step = c == ARROW_LEFT || c == ARROW_RIGHT ? 1 : c == ARROW_UP || c == ARROW_DOWN ? h->width : (off_t)h->width * E.screenrows;
+    off_t to = h->cur + (c == ARROW_LEFT || c == ARROW_UP || c == PAGE_UP ? -step : step);
+    h->cur = to < 0 ? (c == ARROW_UP ? h->cur : 0) : to > last ? (c == ARROW_DOWN ? h->cur : last) : to;
+    h->nibble = 0;
+    break;
+  }
+  case HOME_KEY:
+    h->cur -= h->cur % h->width;
+    h->nibble = 0;
+    break;
+  case END_KEY:
+    h->cur = h->cur - h->cur % h->width + h->width - 1;
+    if (h->cur > last)
+      h->cur = last;
+    h->nibble = 0;
+    break;
+  case '\x1b':
+    break;
+  default:
+    if (h->size == 0 || c < 0x20 || c >= 0x7f)
+      break;
+    if (h->ascii) // 字符栏里输入的字符直接覆盖
+    {
+      editorHexWrite(h, c);
+      if (h->cur < last)
+        h->cur++;
+    }
+    else if (isxdigit(c)) // 十六进制栏先改高四位再改低四位
+    {
+      int d = isdigit(c) ? c - '0' : tolower(c) - 'a' + 10;
+      int b = editorHexByte(h, h->cur);
+      editorHexWrite(h, h->nibble ? (b & 0xf0) | d : (d << 4) | (b & 0x0f));
+      if (h->nibble == 0)
+        h->nibble = 1;
+      else if (h->cur < last)
+      {
+        h->cur++;
+        h->nibble = 0;
+      }
+    }
+    break;
+  }
+  quit_times = KILO_QUIT_TIMES;
+}
+
+/*** batch mode ***/
+// kilo -e 脚本 / -f 脚本文件 [文件]：不进入终端，逐行流过输入执行类似sed的命令，不构造erow，不做render和高亮
+// 命令格式：[地址[,地址]]命令，地址是行号、$或/正则/；命令有d、s/正则/替换/[g]、i 文本、a 文本
+struct batchAddr
+{
+  int type; // 0没有地址，'n'行号，'$'最后一行，'/'正则
+  long line;
+  regex *re;
+};
+struct batchCmd
+{
+  struct batchAddr a1, a2;
+  int active; // 1范围已经开始，还没遇到结束地址；-1行号开始的范围已经结束
+  int op;
+  regex *re; // s命令的模式
+  char *text; // s命令的替换串（保留转义，执行时解释）或i/a命令的文本
+  int tlen;
+  int global;
+};
+static void editorBatchError(int lineno, const char *msg)
+{
+  fprintf(stderr, "kilo: script line %d: %s\n", lineno, msg);
+}
+static char *editorBatchDelimited(char **pp, int delim) // 读到未转义的delim为止，\delim变成delim，其他转义原样保留
+{
+  char *p = *pp;
+  char *out = malloc(strlen(p) + 1);
+  int n = 0;
+  while (*p && *p != delim)
+  {
+    if (*p == '\\' && p[1] == delim)
+      p++;
+    else if (*p == '\\' && p[1])
+      out[n++] = *p++;
+    out[n++] = *p++;
+  }
+  out[n] = '\0';
+  if (*p != delim)
+  {
+    free(out);
+    return NULL;
+  }
+  *pp = p + 1;
+  return out;
+}
+static int editorBatchParseAddr(char **pp, struct batchAddr *a)
+{
+  char *p = *pp;
+  if (isdigit((unsigned char)*p))
+  {
+    a->type = 'n';
+    a->line = strtol(p, &p, 10);
+  }
+  else if (*p == '$')
+  {
+    a->type = '$';
+    p++;
+  }
+  else if (*p == '/')
+  {
+    p++;
+    char *pat = editorBatchDelimited(&p, '/');
+    if (pat == NULL || (a->re = rxCompile(pat)) == NULL)
+    {
+      free(pat);
+      return -1;
+    }
+    free(pat);
+    a->type = '/';
+  }
+  *pp = p;
+  return 0;
+}
+static int editorBatchParse(char *script, struct batchCmd **cmds, int *ncmds)
+{
+  int lineno = 0;
+  for (char *line = strtok(script, "\n"); line; line = strtok(NULL, "\n"))
+  {
+    lineno++;
+    char *p = line;
+    while (isspace((unsigned char)*p))
+      p++;
+    if (*p == '\0' || *p == '#')
+      continue;
+    struct batchCmd c;
+    memset(&c, 0, sizeof(c));
+    if (editorBatchParseAddr(&p, &c.a1) == -1)
+      return editorBatchError(lineno, "bad address"), -1;
+    if (*p == ',')
+    {
+      p++;
+      if (editorBatchParseAddr(&p, &c.a2) == -1 || c.a2.type == 0)
+        return editorBatchError(lineno, "bad address"), -1;
+    }
+    while (isspace((unsigned char)*p))
+      p++;
+    c.op = *p ? *p++ : 0;
+    switch (c.op)
+    {
+    case 'd':
+      break;
+    case 'i':
+    case 'a':
+      while (*p == ' ' || *p == '\t')
+        p++;
+      if (*p == '\\' && *++p == '\0') // 和sed一样，i\或a\后面的文本可以在下一行
+      {
+        p = strtok(NULL, "\n");
+        lineno++;
+        if (p == NULL)
+          return editorBatchError(lineno, "expected text after i\\ or a\\"), -1;
+      }
+      c.text = strdup(p);
+      c.tlen = strlen(p);
+      break;
+    case 's':
+    {
+      int delim = *p ? *p++ : 0;
+      char *pat = delim && delim != '\\' ? editorBatchDelimited(&p, delim) : NULL;
+      char *repl = pat ? editorBatchDelimited(&p, delim) : NULL;
+      if (repl == NULL)
+      {
+        free(pat);
+        return editorBatchError(lineno, "unterminated s command"), -1;
+      }
+      c.re = rxCompile(pat);
+      free(pat);
+      if (c.re == NULL)
+      {
+        free(repl);
+        return editorBatchError(lineno, "bad regex"), -1;
+      }
+      c.text = repl;
+      c.tlen = strlen(repl);
+      c.global = *p == 'g';
+      p += c.global;
+      break;
+    }
+    default:
+      return editorBatchError(lineno, "unknown command"), -1;
+    }
+    while (c.op != 'i' && c.op != 'a' && isspace((unsigned char)*p))
+      p++;
+    if (c.op != 'i' && c.op != 'a' && *p)
+      return editorBatchError(lineno, "trailing characters"), -1;
+    *cmds = realloc(*cmds, sizeof(struct batchCmd) * (*ncmds + 1));
+    (*cmds)[(*ncmds)++] = c;
+  }
+  return 0;
+}
+static int editorBatchHas(regex *re, const char *s, int len) // 行中是否有匹配，包括空匹配
+{
+  int ms, ml;
+  if (rxSearch(re, s, len, &ms, &ml))
+    return 1;
+  for (int i = 0; re->nullable && i <= len; i++)
+    if (rxEmptyAt(re, i, len))
+      return 1;
+  return 0;
+}
+static int editorBatchAddr(struct batchAddr *a, long lineno, int last, const char *s, int len)
+{
+  if (a->type == 'n')
+    return lineno == a->line;
+  if (a->type == '$')
+    return last;
+  return editorBatchHas(a->re, s, len);
+}
+static int editorBatchSelect(struct batchCmd *c, long lineno, int last, const char *s, int len) // 与sed相同的范围语义
+{
+  if (c->a1.type == 0)
+    return 1;
+  if (c->a2.type == 0)
+    return editorBatchAddr(&c->a1, lineno, last, s, len);
+  if (c->active == 1)
+  {
+    if (c->a2.type == 'n' ? lineno >= c->a2.line : editorBatchAddr(&c->a2, lineno, last, s, len))
+      c->active = c->a1.type == 'n' ? -1 : 0;
+    return c->a2.type != 'n' || lineno <= c->a2.line; // 结束行被跳过时，范围在它之后的行不再生效
+  }
+  if (c->a1.type == 'n' ? c->active == -1 || lineno < c->a1.line : !editorBatchAddr(&c->a1, lineno, last, s, len))
+    return 0; // 起始行号被前面的d跳过时，从之后的第一行开始
+  if (c->a1.type == 'n' && lineno > c->a1.line && c->a2.type == 'n' && lineno > c->a2.line)
+  {
+    c->active = -1; // 整个范围都被跳过了
+    return 0;
+  }
+  c->active = 1;
+  if ((c->a2.type == 'n' && c->a2.line <= lineno) || (c->a2.type == '$' && last))
+    c->active = c->a1.type == 'n' ? -1 : 0;
+  return 1;
+}
+static void editorBatchAppendRepl(struct abuf *ab, const struct batchCmd *c, const char *m, int mlen) // &是匹配到的文本，\n、\t是换行和制表符
+{
+  for (int i = 0; i < c->tlen; i++)
+  {
+    char ch = c->text[i];
+    if (ch == '&')
+      abAppend(ab, m, mlen);
+    else if (ch == '\\' && i + 1 < c->tlen)
+    {
+      ch = c->text[++i];
+      ch = ch == 'n' ? '\n' : ch == 't' ? '\t' : ch;
+      abAppend(ab, &ch, 1);
+    }
+    else
+      abAppend(ab, &ch, 1);
+  }
+}
+static int editorBatchSubst(struct batchCmd *c, const char *s, int len, struct abuf *out) // 结果写到out，没有替换返回0
+{
+  int pos = 0, n = 0, prev = -1; // prev是上一个非空匹配的结束位置，紧接着它的空匹配不算
+  while (pos <= len)
+  {
+    int ms = len, ml = 0, found = 0;
+    if (!c->re->nullable)
+      found = pos == 0 ? rxSearch(c->re, s, len, &ms, &ml) : rxSearchNext(c->re, s, pos, len, &ms, &ml);
+    for (int i = pos; c->re->nullable && !found && i <= len; i++) // 能匹配空串的模式逐个位置取最长匹配
+    {
+      int end = i < len ? rxLongest(c->re, s, i, len) : -1;
+      if (end > i || (i != prev && rxEmptyAt(c->re, i, len)))
+      {
+        found = 1;
+        ms = i;
+        ml = end > i ? end - i : 0;
+      }
+    }
+    if (!found)
+      break;
+    abAppend(out, s + pos, ms - pos);
+    editorBatchAppendRepl(out, c, s + ms, ml);
+    n++;
+    pos = ms + ml;
+    prev = ml ? pos : -1;
+    if (ml == 0) // 空匹配之后至少前进一个字节
+    {
+      if (pos < len)
+        abAppend(out, s + pos, 1);
+      pos++;
+    }
+    if (!c->global)
+      break;
+  }
+  if (n && pos < len)
+    abAppend(out, s + pos, len - pos);
+  return n;
+}
+static void editorBatchFree(struct batchCmd *cmds, int ncmds)
+{
+  for (int k = 0; k < ncmds; k++)
+  {
+    rxFree(cmds[k].a1.re);
+    rxFree(cmds[k].a2.re);
+    rxFree(cmds[k].re);
+    free(cmds[k].text);
+  }
+  free(cmds);
+}
+int editorBatchMain(int argc, char *argv[]) // 返回进程退出码
+{
+  struct abuf script = ABUF_INIT;
+  char *path = NULL;
+  for (int i = 1; i < argc; i++)
+  {
+    if ((strcmp(argv[i], "-e") == 0 || strcmp(argv[i], "-f") == 0) && i + 1 < argc)
+    {
+      const char *arg = argv[++i];
+      if (argv[i - 1][1] == 'e')
+        abAppend(&script, arg, strlen(arg));
+      else
+      {
+        FILE *fp = fopen(arg, "r");
+        if (!fp)
+          return perror(arg), 2;
+        char chunk[4096];
+        size_t n;
+        while ((n = fread(chunk, 1, sizeof(chunk), fp)) > 0)
+          abAppend(&script, chunk, n);
+        fclose(fp);
+      }
+      abAppend(&script, "\n", 1);
+    }
+    else if (path == NULL)
+      path = argv[i];
+    else
+      return fprintf(stderr, "usage: kilo -e script | -f file [file]\n"), 2;
+  }
+  struct batchCmd *cmds = NULL;
+  int ncmds = 0;
+  abAppend(&script, "", 1);
+  if (editorBatchParse(script.b, &cmds, &ncmds) == -1)
+    return 2;
+  int inplace = path && strcmp(path, "-") != 0;
+  FILE *in = inplace ? fopen(path, "r") : stdin;
+  if (!in)
+    return perror(path), 1;
+  char *tmp = NULL;
+  FILE *out = stdout;
+  struct stat st;
+  if (inplace) // 写到同目录的临时文件，成功后改名替换，中途出错原文件不受影响
+  {
+    tmp = editorJournalPath(path);
+    strcpy(tmp + strlen(tmp) - 5, ".kbat");
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd == -1 || (out = fdopen(fd, "w")) == NULL)
+      return perror(tmp), 1;
+    if (fstat(fileno(in), &st) == 0)
+      fchmod(fd, st.st_mode & 07777);
+  }
+  setvbuf(in, NULL, _IOFBF, KILO_SAVE_CHUNK);
+  setvbuf(out, NULL, _IOFBF, KILO_SAVE_CHUNK);
+  struct abuf ab = ABUF_INIT, sub = ABUF_INIT;
+  char *line = NULL, *next = NULL;
+  size_t cap = 0, nextcap = 0;
+  ssize_t len = getline(&line, &cap, in), nextlen = 0;
+  long lineno = 0;
+  while (len != -1)
+  {
+    nextlen = getline(&next, &nextcap, in); // 多读一行，才知道当前行是不是$
+    int last = nextlen == -1;
+    int nl = len > 0 && line[len - 1] == '\n'; // 没有换行符的最后一行原样输出
+    int size = len - nl;
+    lineno++;
+    ab.len = 0;
+    abAppend(&ab, line, size);
+    int deleted = 0;
+    struct abuf after = ABUF_INIT;
+    for (int k = 0; k < ncmds && !deleted; k++)
+    {
+      struct batchCmd *c = &cmds[k];
+      if (!editorBatchSelect(c, lineno, last, ab.b, ab.len))
+        continue;
+      if (c->op == 'd')
+        deleted = 1;
+      else if (c->op == 'i')
+      {
+        fwrite(c->text, 1, c->tlen, out);
+        fputc('\n', out);
+      }
+      else if (c->op == 'a')
+      {
+        abAppend(&after, c->text, c->tlen);
+        abAppend(&after, "\n", 1);
+      }
+      else
+      {
+        sub.len = 0;
+        if (editorBatchSubst(c, ab.b, ab.len, &sub))
+        {
+          struct abuf t = ab;
+          ab = sub;
+          sub = t;
+        }
+      }
+    }
+    if (!deleted)
+    {
+      if (ab.len)
+        fwrite(ab.b, 1, ab.len, out);
+      if (nl)
+        fputc('\n', out);
+    }
+    if (after.len && !nl && !deleted) // 与sed一样，追加的文本另起一行
+      fputc('\n', out);
+    if (after.len)
+      fwrite(after.b, 1, after.len, out);
+    abFree(&after);
+    char *t = line;
+    line = next;
+    next = t;
+    size_t tc = cap;
+    cap = nextcap;
+    nextcap = tc;
+    len = nextlen;
+  }
+  int status = ferror(in) ? 1 : 0;
+  if (fflush(out) == EOF || ferror(out))
+    status = 1;
+  if (inplace) // 和保存一样先fsync临时文件再改名，然后fsync目录，崩溃时不会只剩一个空文件
+  {
+    fclose(in);
+    if (status == 0 && fsync(fileno(out)) == -1)
+      status = 1;
+    if (fclose(out) == EOF)
+      status = 1;
+    if (status == 0 && rename(tmp, path) == -1)
+      status = 1;
+    if (status)
+    {
+      perror(path);
+      unlink(tmp);
+    }
+    else
+      editorSyncDir(path);
+    free(tmp);
+  }
+  free(line);
+  free(next);
+  abFree(&ab);
+  abFree(&sub);
+  abFree(&script);
+  editorBatchFree(cmds, ncmds);
+  return status;
+}
+
+/*** line commands ***/
+// Ctrl-E对选中的行（没有选择时是全部行）执行：sort [-r] [-u]排序，uniq像uniq(1)那样合并相邻的重复行，dedup去掉所有重复的行只留第一次出现的，
+// keep 正则/drop 正则筛选
+// 结果都是原来各行的一个排列或子序列，交给editorRowsArrange搬行结构，不复制行内容
+// 排序时各线程先用MSD基数排序排好自己的一片：每层按一个字节分桶，键里缓存着当前8字节，跨过8字节边界才回去读行内容，
+// 有长公共前缀的日志行也只是顺序地多扫几遍；然后一轮轮两两归并，每轮的输出位置均分给各线程，各自二分出在两段中的起止
+struct lineKey // pre是前8字节按大端拼成的整数，比较时先比它，相同时再比较整行，最后比较原来的行号，所以排序是稳定的
+{
+  unsigned long long pre;
+  const char *s;
+  int len;
+  int row;
+};
+struct lineItem // 基数排序时搬动的项：当前深度所在的8字节，和对应的键
+{
+  unsigned long long cur;
+  int len;
+  int row;
+};
+struct linesJob
+{
+  int lo, hi; // 建键、找重复和筛选时是行的范围，归并时是输出位置的范围
+  int at;
+  struct lineKey *in, *out;
+  struct lineItem *item, *tmp;
+  int *perm;
+  int n;
+  long w;              // 归并时把in中相邻两段宽为w的有序段合到out
+  const char *pattern; // 筛选用的正则，每个线程各自编译，DFA缓存不能共用
+  unsigned char *mark; // 按行：筛选时为1表示匹配，找重复时为1表示前面（uniq是紧挨着的上一行）已经有相同的行
+};
+static int lines_rev = 0; // 倒序排序，排序期间各线程只读
+static int editorLinesCmp(const void *a, const void *b)
+{
+  const struct lineKey *x = a, *y = b;
+  int c = 0;
+  if (x->pre != y->pre)
+    c = x->pre < y->pre ? -1 : 1;
+  else
+  {
+    int n = x->len < y->len ? x->len : y->len;
+    if (n > 8)
+      c = memcmp(x->s + 8, y->s + 8, n - 8);
+    if (c == 0)
+      c = (x->len > y->len) - (x->len < y->len);
+  }
+  if (lines_rev)
+    c = -c;
+  return c ? c : (x->row > y->row) - (x->row < y->row);
+}
+static int editorLinesSame(const struct lineKey *x, const struct lineKey *y)
+{
+  return x->pre == y->pre && x->len == y->len && (x->len <= 8 || memcmp(x->s + 8, y->s + 8, x->len - 8) == 0);
+}
+static unsigned long long editorLinesWord(const char *s, int len, int at) // s[at..at+8)按大端拼成整数，行尾之后补0
+{
+  unsigned long long w = 0;
+  for (int b = at; b < at + 8; b++)
+    w = w << 8 | (b < len ? (unsigned char)s[b] : 0);
+  return w;
+}
+static void editorLinesRadix(struct lineItem *a, struct lineItem *b, int n, int depth, const struct lineKey *key, int *out) // a中各行的前depth字节都相同，按之后的内容稳定排序，排好的键下标依次写到out；b是同样大小的临时空间，两边轮流用
+{
+  while (n > 1)
+  {
+    if (depth > 0 && depth % 8 == 0) // 跨过8字节边界，回去读行内容；搬过之后是随机访问，提前取键和行
+    {
+      for (int i = 0; i < n; i++)
+      {
+        if (i + 16 < n)
+          __builtin_prefetch(&key[a[i + 16].row]);
+        if (i + 8 < n)
+          __builtin_prefetch(key[a[i + 8].row].s + depth);
+        a[i].cur = editorLinesWord(key[a[i].row].s, a[i].len, depth);
+      }
+    }
+    if (n < 32) // 小段插入排序，大多数情况比较缓存的8字节就分出来了
+    {
+      for (int i = 1; i < n; i++)
+      {
+        struct lineItem x = a[i];
+        int j = i;
+        for (; j > 0; j--)
+        {
+          int c = a[j - 1].cur == x.cur ? editorLinesCmp(&key[a[j - 1].row], &key[x.row]) : (a[j - 1].cur > x.cur) != lines_rev;
+          if (c <= 0)
+            break;
+          a[j] = a[j - 1];
+        }
+        a[j] = x;
+      }
+      break;
+    }
+    int shift = 56 - 8 * (depth % 8);
+    int cnt[257] = {0}; // 桶0是到depth正好结束的行，它们内容都相同，排在最前
+    unsigned long long diff = 0;
+    int minlen = INT_MAX;
+    for (int i = 0; i < n; i++)
+    {
+      cnt[a[i].len <= depth ? 0 : 1 + (int)((a[i].cur >> shift) & 0xff)]++;
+      diff |= a[i].cur ^ a[0].cur;
+      if (a[i].len < minlen)
+        minlen = a[i].len;
+    }
+    int big = 0;
+    for (int c = 1; c < 257; c++)
+      if (cnt[c] > cnt[big])
+        big = c;
+    if (cnt[big] == n) // 全在一个桶里，不用搬；这8字节里后面还相同的字节一起跳过
+    {
+      if (big == 0)
+        break;
+      int same = depth - depth % 8 + (diff ? __builtin_clzll(diff) / 8 : 8);
+      depth = same < minlen ? same : minlen;
+      continue;
+    }
+    int off[257], pos = 0;
+    for (int c = 0; c < 257; c++) // 倒序时桶也倒过来，行尾结束的排在最后
+    {
+      int cc = lines_rev ? 256 - c : c;
+      off[cc] = pos;
+      pos += cnt[cc];
+    }
+    for (int i = 0; i < n; i++)
+      b[off[a[i].len <= depth ? 0 : 1 + (int)((a[i].cur >> shift) & 0xff)]++] = a[i];
+    for (int c = 0; c < 257; c++) // 小桶递归，最大的桶接着循环，递归深度是对数级的
+    {
+      int start = off[c] - cnt[c];
+      if (c != big && cnt[c] > 0)
+        editorLinesRadix(b + start, a + start, cnt[c], depth + 1, key, out + start);
+    }
+    int start = off[big] - cnt[big];
+    struct lineItem *t = a;
+    a = b + start;
+    b = t + start;
+    out += start;
+    n = cnt[big];
+    depth++;
+  }
+  for (int i = 0; i < n; i++)
+    out[i] = a[i].row;
+}
+void *editorLinesKeyWorker(void *arg) // 建一片的键，排好后按顺序放到out
+{
+  struct linesJob *job = arg;
+  for (int i = job->lo; i < job->hi; i++)
+  {
+    erow *row = &E.row[job->at + i];
+    unsigned long long pre = editorLinesWord(row->chars, row->size, 0);
+    job->in[i] = (struct lineKey){pre, row->chars, row->size, i};
+    job->item[i] = (struct lineItem){pre, row->size, i};
+  }
+  editorLinesRadix(job->item + job->lo, job->tmp + job->lo, job->hi - job->lo, 0, job->in, job->perm + job->lo);
+  for (int i = job->lo; i < job->hi; i++)
+    job->out[i] = job->in[job->perm[i]];
+  return NULL;
+}
+static int editorLinesSplit(const struct lineKey *a, int la, const struct lineKey *b, int lb, int k) // a、b合并后的前k个中有几个来自a；键互不相同，答案唯一
+{
+  int lo = k > lb ? k - lb : 0, hi = k < la ? k : la;
+  while (lo < hi)
+  {
+    int mid = (lo + hi) / 2;
+    if (editorLinesCmp(&b[k - mid - 1], &a[mid]) < 0)
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+  return lo;
+}
+void *editorLinesMergeWorker(void *arg) // 负责的输出位置可能跨过几对段
+{
+  struct linesJob *job = arg;
+  for (long base = job->lo / (2 * job->w) * (2 * job->w); base < job->hi; base += 2 * job->w)
+  {
+    int mid = base + job->w < job->n ? base + job->w : job->n;
+    int end = base + 2 * job->w < job->n ? base + 2 * job->w : job->n;
+    const struct lineKey *a = job->in + base, *b = job->in + mid;
+    int s = (job->lo > base ? job->lo : base) - base;
+    int e = (job->hi < end ? job->hi : end) - base;
+    int i = editorLinesSplit(a, mid - base, b, end - mid, s), j = s - i;
+    int ie = editorLinesSplit(a, mid - base, b, end - mid, e), je = e - ie;
+    struct lineKey *o = job->out + base + s;
+    while (i < ie && j < je)
+      *o++ = editorLinesCmp(&a[i], &b[j]) < 0 ? a[i++] : b[j++];
+    while (i < ie)
+      *o++ = a[i++];
+    while (j < je)
+      *o++ = b[j++];
+  }
+  return NULL;
+}
+void *editorLinesDupWorker(void *arg) // 排好序后和前一个相同的就是重复的，前一个的行号一定更小
+{
+  struct linesJob *job = arg;
+  for (int i = job->lo; i < job->hi; i++)
+    job->mark[job->in[i].row] = i > 0 && editorLinesSame(&job->in[i - 1], &job->in[i]);
+  return NULL;
+}
+void *editorLinesAdjacentWorker(void *arg) // uniq：和上一行相同的是重复的
+{
+  struct linesJob *job = arg;
+  for (int i = job->lo; i < job->hi; i++)
+  {
+    erow *a = &E.row[job->at + i - 1], *b = a + 1;
+    job->mark[i] = i > 0 && a->size == b->size && memcmp(a->chars, b->chars, b->size) == 0;
+  }
+  return NULL;
+}
+void *editorLinesMatchWorker(void *arg)
+{
+  struct linesJob *job = arg;
+  regex *re = rxCompile(job->pattern);
+  for (int i = job->lo; i < job->hi; i++)
+  {
+    erow *row = &E.row[job->at + i];
+    job->mark[i] = editorBatchHas(re, row->chars, row->size);
+  }
+  rxFree(re);
+  return NULL;
+}
+static struct lineKey *editorLinesSort(int at, int n, int rev) // 返回[at, at+n)行排好序的键，调用者释放
+{
+  struct lineKey *k = malloc(sizeof(struct lineKey) * n);
+  struct lineKey *t = malloc(sizeof(struct lineKey) * n);
+  struct linesJob jobs[KILO_MAX_THREADS];
+  int nj = editorParallelJobs(n);
+  long w = (n + nj - 1) / nj;
+  struct lineItem *item = malloc(sizeof(struct lineItem) * n * 2);
+  int *perm = malloc(sizeof(int) * (n > 0 ? n : 1));
+  lines_rev = rev;
+  memset(jobs, 0, sizeof(jobs));
+  for (int j = 0; j < nj; j++)
+  {
+    jobs[j].lo = w * j < n ? w * j : n;
+    jobs[j].hi = w * (j + 1) < n ? w * (j + 1) : n;
+    jobs[j].at = at;
+    jobs[j].in = t;
+    jobs[j].out = k;
+    jobs[j].item = item;
+    jobs[j].tmp = item + n;
+    jobs[j].perm = perm;
+  }
+  editorParallelRun(editorLinesKeyWorker, jobs, sizeof(struct linesJob), nj);
+  free(item);
+  free(perm);
+  for (; w < n; w *= 2) // 每轮段宽翻倍
+  {
+    for (int j = 0; j < nj; j++)
+    {
+      jobs[j].lo = (long)n * j / nj;
+      jobs[j].hi = (long)n * (j + 1) / nj;
+      jobs[j].in = k;
+      jobs[j].out = t;
+      jobs[j].n = n;
+      jobs[j].w = w;
+    }
+    editorParallelRun(editorLinesMergeWorker, jobs, sizeof(struct linesJob), nj);
+    struct lineKey *x = k;
+    k = t;
+    t = x;
+  }
+  free(t);
+  return k;
+}
+void editorLinesRun(const char *cmd) // 执行一条行命令，Ctrl-E和测试程序都用它
+{
+  int at = 0, n = E.numrows;
+  int y0, x0, y1, x1;
+  if (editorSelRange(&y0, &x0, &y1, &x1)) // 选择结束在行首时，那一行不算
+  {
+    at = y0;
+    n = y1 - y0 + (x1 > 0 || y1 == y0);
+  }
+  E.sel = 0;
+  const char *p = cmd + strspn(cmd, " ");
+  int wl = strcspn(p, " ");
+  const char *arg = p + wl + strspn(p + wl, " ");
+  int op = 0, rev = 0, unique = 0;
+  if (wl == 4 && strncmp(p, "sort", 4) == 0)
+  {
+    op = 's';
+    for (const char *o = arg; *o && op; o++)
+    {
+      if (*o == 'r')
+        rev = 1;
+      else if (*o == 'u')
+        unique = 1;
+      else if (*o != '-' && *o != ' ')
+        op = 0;
+    }
+  }
+  else if (wl == 4 && strncmp(p, "uniq", 4) == 0 && *arg == '\0')
+    op = 'u';
+  else if (wl == 5 && strncmp(p, "dedup", 5) == 0 && *arg == '\0')
+    op = 'D';
+  else if (wl == 4 && (strncmp(p, "keep", 4) == 0 || strncmp(p, "drop", 4) == 0) && *arg)
+    op = p[0];
+  if (op == 0)
+  {
+    editorSetStatusMessage("Unknown line command: %s", cmd);
+    return;
+  }
+  regex *re = op == 'k' || op == 'd' ? rxCompile(arg) : NULL;
+  if ((op == 'k' || op == 'd') && re == NULL)
+  {
+    editorSetStatusMessage("Bad regex: %s", arg);
+    return;
+  }
+  rxFree(re);
+  if (n == 0)
+  {
+    editorSetStatusMessage("No lines");
+    return;
+  }
+  editorCursorsClear();
+  int *src = malloc(sizeof(int) * (n > 0 ? n : 1));
+  unsigned char *mark = malloc(n);
+  int m = 0;
+  int nj = editorParallelJobs(n);
+  struct linesJob jobs[KILO_MAX_THREADS];
+  memset(jobs, 0, sizeof(jobs));
+  if (op == 'k' || op == 'd')
+  {
+    for (int j = 0; j < nj; j++)
+    {
+      jobs[j].lo = (long)n * j / nj;
+      jobs[j].hi = (long)n * (j + 1) / nj;
+      jobs[j].at = at;
+      jobs[j].pattern = arg;
+      jobs[j].mark = mark;
+    }
+    editorParallelRun(editorLinesMatchWorker, jobs, sizeof(struct linesJob), nj);
+    for (int i = 0; i < n; i++)
+      if (mark[i] == (op == 'k'))
+        src[m++] = i;
+  }
+  else if (op == 'u') // 不用排序，逐行和上一行比
+  {
+    for (int j = 0; j < nj; j++)
+    {
+      jobs[j].lo = (long)n * j / nj;
+      jobs[j].hi = (long)n * (j + 1) / nj;
+      jobs[j].at = at;
+      jobs[j].mark = mark;
+    }
+    editorParallelRun(editorLinesAdjacentWorker, jobs, sizeof(struct linesJob), nj);
+    for (int i = 0; i < n; i++)
+      if (!mark[i])
+        src[m++] = i;
+  }
+  else
+  {
+    struct lineKey *k = editorLinesSort(at, n, rev);
+    if (op == 'D' || unique)
+    {
+      for (int j = 0; j < nj; j++)
+      {
+        jobs[j].lo = (long)n * j / nj;
+        jobs[j].hi = (long)n * (j + 1) / nj;
+        jobs[j].in = k;
+        jobs[j].mark = mark;
+      }
+      editorParallelRun(editorLinesDupWorker, jobs, sizeof(struct linesJob), nj);
+    }
+    for (int i = 0; i < n; i++)
+    {
+      if (op == 's' && !(unique && mark[k[i].row]))
+        src[m++] = k[i].row;
+      else if (op == 'D' && !mark[i])
+        src[m++] = i;
+    }
+    free(k);
+  }
+  int same = m == n;
+  for (int i = 0; i < m && same; i++)
+    same = src[i] == i;
+  if (!same)
+  {
+    editorRowsArrange(at, n, src, m);
+    E.cy = at;
+    E.cx = 0;
+  }
+  if (op == 's')
+    editorSetStatusMessage(unique ? "Sorted %d lines, removed %d duplicates" : "Sorted %d lines", m, n - m);
+  else if (op == 'u' || op == 'D')
+    editorSetStatusMessage("Removed %d duplicate lines", n - m);
+  else
+    editorSetStatusMessage("Kept %d of %d lines", m, n);
+  free(src);
+  free(mark);
+}
+void editorLines()
+{
+  char *cmd = editorPrompt("Lines: %s (sort [-r] [-u], uniq, dedup, keep RE, drop RE)", NULL, 0);
+  if (cmd == NULL)
+    return;
+  editorLinesRun(cmd);
+  free(cmd);
+}
+
+/*** grep ***/
+// 在当前目录树中并行查找固定字符串。每个工作线程有自己的队列，从队尾取，空了从别的队列头部偷；结果分批交给主线程追加到结果缓冲
+#define KILO_GREP_TEXT 200            // 结果行里最多带上匹配行的这么多字节
+#define KILO_GREP_CHUNK (256 * 1024)   // 每次read的大小，行比它长时缓冲加倍
+struct grepIgnore // .gitignore中的一条规则；先是本目录的（后写的在前），再接上级目录的，第一条匹配的规则决定结果
+{
+  struct grepIgnore *next;
+  struct grepIgnore *all; // 任务中所有规则串成一条，用来释放
+  int baselen;            // .gitignore所在目录的路径长度，含/的规则按相对它的路径匹配
+  int neg;                // !开头，重新包含
+  int dironly;            // /结尾，只匹配目录
+  int anchored;           // 含/，按相对路径匹配；否则只匹配文件名
+  char pat[];
+};
+struct grepItem
+{
+  char *path; // 相对当前目录，根目录是"."
+  struct grepIgnore *ign;
+  int isdir;
+};
+struct grepQueue
+{
+  pthread_mutex_t lock;
+  struct grepItem *items; // [head, tail)是还没处理的项
+  int head, tail, cap;
+  struct grepJob *job;
+  int self;
+};
+struct grepJob // 后台搜索一棵目录树；结果缓冲不在前台时，它的行暂存在这里
+{
+  char *query;
+  int qlen;
+  int nthreads; // 0表示工作线程都已经回收
+  pthread_t threads[KILO_MAX_THREADS];
+  struct grepQueue queues[KILO_MAX_THREADS];
+  long pending;      // 已经入队还没处理完的项，为0时全部完成；原子操作
+  volatile int stop; // 要求工作线程尽快退出
+  pthread_mutex_t lock; // 保护running、out和rules
+  int running;
+  char *out; // 还没交给主线程的结果行，每行以\n结尾
+  size_t outlen, outcap;
+  struct grepIgnore *rules;
+  int wake[2]; // 有新结果或全部完成时写一个字节，主循环poll读端
+  long files, matched; // 原子操作
+  long long start;
+  int shown; // 结果缓冲在前台
+  erow *row;
+  int numrows, rowcap, cy, rowoff;
+};
+
+int editorGrepShown() // 前台是结果缓冲
+{
+  return E.grep && E.grep->shown;
+}
+static struct grepIgnore *editorGrepLoadIgnore(struct grepJob *job, const char *dir, struct grepIgnore *parent) // 读入dir/.gitignore，接在上级目录的规则前面
+{
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/.gitignore", dir);
+  FILE *fp = fopen(path, "r");
+  if (fp == NULL)
+    return parent;
+  int baselen = strcmp(dir, ".") == 0 ? 0 : strlen(dir);
+  char *line = NULL;
+  size_t cap = 0;
+  ssize_t len;
+  struct grepIgnore *head = parent;
+  while ((len = getline(&line, &cap, fp)) != -1)
+  {
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r' || line[len - 1] == ' '))
+      line[--len] = '\0';
+    char *p = line;
+    if (len == 0 || p[0] == '#')
+      continue;
+    int neg = p[0] == '!';
+    p += neg;
+    int dironly = len > 0 && line[len - 1] == '/';
+    if (dironly)
+      line[--len] = '\0';
+    int anywhere = strncmp(p, "**/", 3) == 0; // 任意层目录下，和不含/的规则一样只看文件名
+    if (anywhere)
+      p += 3;
+    len = strlen(p);
+    int contents = len >= 3 && strcmp(p + len - 3, "/**") == 0; // 目录下的所有内容：不进入这个目录就行了
+    if (contents)
+    {
+      p[len -= 3] = '\0';
+      dironly = 1;
+    }
+    int anchored = strchr(p, '/') != NULL || (contents && !anywhere); // foo/**去掉/**后仍然相对.gitignore所在目录
+    if (p[0] == '/')
+      p++;
+    if (p[0] == '\0')
+      continue;
+    struct grepIgnore *r = malloc(sizeof(struct grepIgnore) + strlen(p) + 1);
+    strcpy(r->pat, p);
+    r->baselen = baselen;
+    r->neg = neg;
+    r->dironly = dironly;
+    r->anchored = anchored;
+    r->next = head;
+    head = r;
+    pthread_mutex_lock(&job->lock);
+    r->all = job->rules;
+    job->rules = r;
+    pthread_mutex_unlock(&job->lock);
+  }
+  free(line);
+  fclose(fp);
+  return head;
+}
+static int editorGrepIgnored(const struct grepIgnore *r, const char *path, int isdir)
+{
+  const char *name = strrchr(path, '/');
+  name = name ? name + 1 : path;
+  for (; r; r = r->next)
+  {
+    if (r->dironly && !isdir)
+      continue;
+    const char *rel = path + (r->baselen ? r->baselen + 1 : 0);
+    if (fnmatch(r->pat, r->anchored ? rel : name, r->anchored ? FNM_PATHNAME : 0) == 0)
+      return !r->neg;
+  }
+  return 0;
+}
+static void editorGrepPush(struct grepQueue *q, char *path, struct grepIgnore *ign, int isdir)
+{
+  __sync_fetch_and_add(&q->job->pending, 1);
+  pthread_mutex_lock(&q->lock);
+  if (q->tail == q->cap)
+  {
+    if (q->head > 0) // 头部被偷空的位置先挪回来
+    {
+      memmove(q->items, q->items + q->head, sizeof(struct grepItem) * (q->tail - q->head));
+      q->tail -= q->head;
+      q->head = 0;
+    }
+    else
+    {
+      q->cap = q->cap ? q->cap * 2 : 64;
+      q->items = realloc(q->items, sizeof(struct grepItem) * q->cap);
+    }
+  }
+  q->items[q->tail++] = (struct grepItem){path, ign, isdir};
+  pthread_mutex_unlock(&q->lock);
+}
+static int editorGrepPop(struct grepJob *job, int self, struct grepItem *it) // 先从自己的队尾取（深度优先，路径还在缓存里），空了从别人的队头偷（靠近根的目录，一次偷到一大片）
+{
+  for (int k = 0; k < job->nthreads; k++)
+  {
+    struct grepQueue *q = &job->queues[(self + k) % job->nthreads];
+    pthread_mutex_lock(&q->lock);
+    int got = q->head < q->tail;
+    if (got)
+      *it = k == 0 ? q->items[--q->tail] : q->items[q->head++];
+    if (q->head == q->tail)
+      q->head = q->tail = 0;
+    pthread_mutex_unlock(&q->lock);
+    if (got)
+      return 1;
+  }
+  return 0;
+}
+static void editorGrepDir(struct grepQueue *q, struct grepItem *it)
+{
+  DIR *d = opendir(it->path);
+  if (d == NULL)
+    return;
+  struct grepIgnore *ign = editorGrepLoadIgnore(q->job, it->path, it->ign);
+  int root = strcmp(it->path, ".") == 0;
+  struct dirent *de;
+  while ((de = readdir(d)) != NULL && !q->job->stop)
+  {
+    const char *name = de->d_name;
+    size_t nlen = strlen(name);
+    if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0 || strcmp(name, ".git") == 0 ||
+        (name[0] == '.' && nlen > 5 && strcmp(name + nlen - 5, ".kswp") == 0)) // 交换日志不搜
+      continue;
+    char *path = malloc(strlen(it->path) + strlen(name) + 2);
+    if (root)
+      strcpy(path, name);
+    else
+      sprintf(path, "%s/%s", it->path, name);
+    int isdir = de->d_type == DT_DIR ? 1 : de->d_type == DT_REG ? 0 : -1; // 只要目录和普通文件，符号链接不跟，免得绕圈
+    struct stat st;
+    if (de->d_type == DT_UNKNOWN && lstat(path, &st) == 0) // 有的文件系统不填d_type
+      isdir = S_ISDIR(st.st_mode) ? 1 : S_ISREG(st.st_mode) ? 0 : -1;
+    if (isdir < 0 || editorGrepIgnored(ign, path, isdir))
+      free(path);
+    else
+      editorGrepPush(q, path, ign, isdir);
+  }
+  closedir(d);
+}
+static long editorGrepScan(struct grepJob *job, const char *path, const char *p, const char *end, long *line, struct abuf *ab) // 在[p, end)这些完整的行中找，返回匹配的行数
+{
+  const char *counted = p; // 行号已经数到这里
+  long n = 0;
+  const char *m = p;
+  while (m < end && (m = memmem(m, end - m, job->query, job->qlen)) != NULL)
+  {
+    const char *ls = memrchr(p, '\n', m - p);
+    ls = ls ? ls + 1 : p;
+    const char *le = memchr(m, '\n', end - m);
+    if (le == NULL)
+      le = end;
+    for (const char *nl; (nl = memchr(counted, '\n', ls - counted)) != NULL; counted = nl + 1)
+      (*line)++;
+    counted = ls;
+    char head[PATH_MAX + 24];
+    abAppend(ab, head, snprintf(head, sizeof(head), "%s:%ld:", path, *line));
+    int len = le - ls;
+    if (len > 0 && ls[len - 1] == '\r')
+      len--;
+    abAppend(ab, ls, len < KILO_GREP_TEXT ? len : KILO_GREP_TEXT);
+    abAppend(ab, "\n", 1);
+    n++;
+    m = le + 1; // 一行只报一次
+  }
+  for (const char *nl; (nl = memchr(counted, '\n', end - counted)) != NULL; counted = nl + 1)
+    (*line)++;
+  return n;
+}
+static void editorGrepFile(struct grepJob *job, const char *path) // 分块read，每次只扫描完整的行；不用mmap，文件被截短时不会SIGBUS
+{
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    return;
+  size_t cap = KILO_GREP_CHUNK, have = 0;
+  char *buf = malloc(cap);
+  struct abuf ab = ABUF_INIT;
+  long line = 1, n = 0;
+  int first = 1;
+  for (;;)
+  {
+    if (have == cap) // 一行比缓冲还长
+    {
+      cap *= 2;
+      buf = realloc(buf, cap);
+    }
+    ssize_t got = read(fd, buf + have, cap - have);
+    if (got == -1 && errno == EINTR)
+      continue;
+    if (got == -1 || (got == 0 && have == 0))
+      break;
+    have += got;
+    if (first)
+    {
+      first = 0;
+      __sync_fetch_and_add(&job->files, 1);
+      if (memchr(buf, '\0', have < 8192 ? have : 8192)) // 和grep一样，前8K里有NUL的当作二进制文件跳过
+        break;
+    }
+    size_t upto = have; // 读到文件尾时最后不完整的一行也扫描
+    if (got > 0)
+    {
+      const char *nl = memrchr(buf, '\n', have);
+      if (nl == NULL)
+        continue;
+      upto = nl + 1 - buf;
+    }
+    n += editorGrepScan(job, path, buf, buf + upto, &line, &ab);
+    memmove(buf, buf + upto, have - upto);
+    have -= upto;
+    if (got == 0)
+      break;
+  }
+  close(fd);
+  free(buf);
+  if (n == 0)
+  {
+    abFree(&ab);
+    return;
+  }
+  __sync_fetch_and_add(&job->matched, n);
+  pthread_mutex_lock(&job->lock);
+  int idle = job->outlen == 0; // 主线程已经取空了，需要叫醒它
+  if (job->outlen + ab.len > job->outcap)
+  {
+    while (job->outlen + ab.len > job->outcap)
+      job->outcap = job->outcap ? job->outcap * 2 : 65536;
+    job->out = realloc(job->out, job->outcap);
+  }
+  memcpy(job->out + job->outlen, ab.b, ab.len);
+  job->outlen += ab.len;
+  pthread_mutex_unlock(&job->lock);
+  abFree(&ab);
+  if (idle && write(job->wake[1], "g", 1) == -1)
+    return;
+}
+void *editorGrepWorker(void *arg)
+{
+  struct grepQueue *q = arg;
+  struct grepJob *job = q->job;
+  struct grepItem it;
+  while (!job->stop && __sync_fetch_and_add(&job->pending, 0) > 0)
+  {
+    if (!editorGrepPop(job, q->self, &it)) // 别的线程还在展开目录，稍等再偷
+    {
+      struct timespec ts = {0, 100000};
+      nanosleep(&ts, NULL);
+      continue;
+    }
+    if (it.isdir)
+      editorGrepDir(q, &it);
+    else
+      editorGrepFile(job, it.path);
+    free(it.path);
+    __sync_fetch_and_sub(&job->pending, 1);
+  }
+  pthread_mutex_lock(&job->lock);
+  int last = --job->running == 0;
+  pthread_mutex_unlock(&job->lock);
+  if (last && write(job->wake[1], "d", 1) == -1)
+    return NULL;
+  return NULL;
+}
+void editorGrepStop(struct grepJob *job) // 停下并回收工作线程，没取走的结果留在out里
+{
+  if (job->nthreads == 0)
+    return;
+  job->stop = 1;
+  for (int j = 0; j < job->nthreads; j++)
+    pthread_join(job->threads[j], NULL);
+  for (int j = 0; j < job->nthreads; j++)
+  {
+    struct grepQueue *q = &job->queues[j];
+    for (int k = q->head; k < q->tail; k++)
+      free(q->items[k].path);
+    free(q->items);
+    pthread_mutex_destroy(&q->lock);
+  }
+  job->nthreads = 0;
+  while (job->rules)
+  {
+    struct grepIgnore *r = job->rules;
+    job->rules = r->all;
+    free(r);
+  }
+}
+void editorGrepDrain() // 把工作线程攒下的结果行追加到结果缓冲，全部完成时回收线程
+{
+  struct grepJob *job = E.grep;
+  char c[64];
+  while (read(job->wake[0], c, sizeof(c)) > 0)
+    ;
+  pthread_mutex_lock(&job->lock);
+  char *out = job->out;
+  size_t len = job->outlen;
+  int finished = job->running == 0;
+  job->out = NULL;
+  job->outlen = job->outcap = 0;
+  pthread_mutex_unlock(&job->lock);
+  int dirty = E.dirty;
+  E.undo_lock++; // 结果不是可撤销的修改
+  for (char *p = out, *stop = out + len; p < stop;)
+  {
+    char *nl = memchr(p, '\n', stop - p);
+    editorInsertRow(E.numrows, p, nl - p);
+    p = nl + 1;
+  }
+  E.undo_lock--;
+  E.dirty = dirty;
+  free(out);
+  if (finished && job->nthreads)
+  {
+    int stopped = job->stop;
+    editorGrepStop(job);
+    editorSetStatusMessage("Grep \"%s\": %ld lines in %ld files, %.2fs%s", job->query, job->matched, job->files,
+                           (editorNow() - job->start) / 1e6, stopped ? " (stopped)" : "");
+  }
+  E.frame.pending = 1;
+}
+void editorGrepFree(struct grepJob *job) // 只释放任务本身，暂存的行由调用者处理
+{
+  if (job == NULL)
+    return;
+  editorGrepStop(job);
+  close(job->wake[0]);
+  close(job->wake[1]);
+  pthread_mutex_destroy(&job->lock);
+  free(job->out);
+  free(job->query);
+  free(job);
+}
+void editorBufferClose() // 换缓冲之前放下当前的：等后台保存写完，停掉载入和日志，释放所有行
+{
+  editorSavePoll(1);
+  if (E.load)
+  {
+    fclose(E.load->fp);
+    free(E.load->line);
+    free(E.load);
+    E.load = NULL;
+  }
+  editorJournalClose(1);
+  for (int r = 0; r < E.numrows; r++)
+    editorFreeRow(&E.row[r]);
+  free(E.row);
+  E.row = NULL;
+  E.numrows = E.rowcap = 0;
+  E.cx = E.cy = E.rx = E.rowoff = E.coloff = E.wrapoff = 0;
+  E.dirty = 0;
+  E.stale_from = INT_MAX;
+  E.sel = 0;
+  E.block_row = -1;
+  E.nfolds = 0;
+  editorFoldIndex();
+  editorWordsClear();
+  editorDiffClear();
+  editorCursorsClear();
+  editorUndoClear(&E.undo);
+  editorUndoClear(&E.redo);
+  E.shown_rowoff = -1;
+  memset(E.shown, 0, sizeof(char *) * (E.screenrows > 0 ? E.screenrows : 1));
+  free(E.filename);
+  E.filename = NULL;
+  E.syntax = NULL;
+}
+void editorGrepStash() // 离开结果缓冲：搜索停在这里，已有的结果连同光标位置暂存到任务里
+{
+  struct grepJob *job = E.grep;
+  editorGrepStop(job);
+  editorGrepDrain();
+  for (int r = 0; r < E.numrows; r++) // 暂存期间不占绘制缓存
+    editorRowDrawFree(&E.row[r]);
+  job->row = E.row;
+  job->numrows = E.numrows;
+  job->rowcap = E.rowcap;
+  job->cy = E.cy;
+  job->rowoff = E.rowoff;
+  job->shown = 0;
+  E.row = NULL;
+  E.numrows = E.rowcap = 0;
+  editorBufferClose();
+}
+void editorGrepUnstash()
+{
+  struct grepJob *job = E.grep;
+  editorBufferClose();
+  E.row = job->row;
+  E.numrows = job->numrows;
+  E.rowcap = job->rowcap;
+  E.cy = job->cy;
+  E.rowoff = job->rowoff;
+  job->row = NULL;
+  job->shown = 1;
+  for (int r = 0; r < E.numrows; r++) // editorBufferClose把stale_from置成了全部最新，从第一个过期的行重新算起
+    if (E.row[r].flags & ROW_DIRTY)
+    {
+      E.stale_from = r;
+      break;
+    }
+  editorWordsClear(); // 暂存前收录过的行带着标记，重新收录
+}
+void editorGrepDiscard() // 丢掉上一次搜索，前台是结果缓冲时它的行由editorBufferClose释放
+{
+  struct grepJob *job = E.grep;
+  if (job == NULL)
+    return;
+  if (!job->shown)
+  {
+    for (int r = 0; r < job->numrows; r++)
+      editorFreeRow(&job->row[r]);
+    free(job->row);
+  }
+  editorGrepFree(job);
+  E.grep = NULL;
+}
+void editorGrep()
+{
+  int back = E.grep && !E.grep->shown;
+  char *query = editorPrompt(back ? "Grep: %s (Enter: back to results, ESC: cancel)" : "Grep: %s (ESC to cancel)", NULL, back);
+  if (query == NULL)
+    return;
+  if (E.dirty && !editorGrepShown()) // 只有一个缓冲，离开之前要先保存
+  {
+    editorSetStatusMessage("Unsaved changes, save with ^S before grep");
+    free(query);
+    return;
+  }
+  if (query[0] == '\0')
+  {
+    editorGrepUnstash();
+    free(query);
+    return;
+  }
+  editorBufferClose();
+  editorGrepDiscard();
+  struct grepJob *job = calloc(1, sizeof(struct grepJob));
+  job->query = query;
+  job->qlen = strlen(query);
+  job->start = editorNow();
+  job->shown = 1;
+  pthread_mutex_init(&job->lock, NULL);
+  if (pipe(job->wake) == -1)
+    die("pipe");
+  fcntl(job->wake[0], F_SETFL, O_NONBLOCK);
+  fcntl(job->wake[1], F_SETFL, O_NONBLOCK);
+  long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+  job->nthreads = ncpu < 1 ? 1 : ncpu > KILO_MAX_THREADS ? KILO_MAX_THREADS : ncpu;
+  for (int j = 0; j < job->nthreads; j++)
+  {
+    pthread_mutex_init(&job->queues[j].lock, NULL);
+    job->queues[j].job = job;
+    job->queues[j].self = j;
+  }
+  editorGrepPush(&job->queues[0], strdup("."), NULL, 1);
+  job->running = job->nthreads;
+  E.grep = job;
+  for (int j = 0; j < job->nthreads; j++)
+    if (pthread_create(&job->threads[j], NULL, editorGrepWorker, &job->queues[j]) != 0)
+      die("pthread_create");
+  editorSetStatusMessage("Grep \"%s\"... Enter opens a result, ^G Enter comes back", query);
+}
+void editorGrepOpen() // 结果缓冲中按回车：打开光标所在结果行的文件并跳到那一行
+{
+  if (E.cy >= E.numrows)
+    return;
+  erow *row = &E.row[E.cy];
+  char *p = row->chars, *colon = p;
+  long line = 0;
+  while ((colon = memchr(colon, ':', row->size - (colon - p))) != NULL) // 文件名里也可能有冒号，找第一个":数字:"
+  {
+    char *q = colon + 1;
+    line = 0;
+    while (q < p + row->size && isdigit((unsigned char)*q))
+      line = line * 10 + (*q++ - '0');
+    if (q > colon + 1 && q < p + row->size && *q == ':')
+      break;
+    colon++;
+  }
+  if (colon == NULL || line < 1)
+    return;
+  char *path = strndup(p, colon - p);
+  if (access(path, R_OK) != 0)
+  {
+    editorSetStatusMessage("Can't open %s: %s", path, strerror(errno));
+    free(path);
+    return;
+  }
+  editorGrepStash();
+  editorOpen(path);
+  free(path);
+  while (E.load && E.numrows < line)
+    editorLoadSlice(KILO_LOAD_ROWS);
+  E.cy = line - 1 < E.numrows ? line - 1 : E.numrows;
+  if (E.cy < E.numrows)
+  {
+    char *m = strstr(E.row[E.cy].chars, E.grep->query);
+    E.cx = m ? m - E.row[E.cy].chars : 0;
+  }
+  E.rowoff = E.cy > E.screenrows / 2 ? E.cy - E.screenrows / 2 : 0; // 目标行放在屏幕中间
+  editorSetStatusMessage("^G Enter: back to grep results");
+}
+
+/*** memory budget ***/
+void editorShed(long target) // 从离视口最远的行开始丢掉派生数据，直到总量不超过target；只动已经算到最新的行
+{
+  int limit = E.stale_from < E.numrows ? E.stale_from : E.numrows;
+  int top = E.rowoff < limit ? E.rowoff : limit;
+  int bot = E.rowoff + E.screenrows;
+  int lo = 0, hi = limit - 1;
+  while (E.derived > target && (lo < top || hi >= bot))
+  {
+    if (lo < top && (hi < bot || top - lo > hi - bot))
+      editorRowShed(&E.row[lo++]);
+    else
+      editorRowShed(&E.row[hi--]);
+  }
+}
+int editorPressureOpen() // 在本cgroup的memory.pressure上注册PSI触发器，2秒内累计停顿150ms时poll返回POLLPRI；不支持时返回-1
+{
+  char path[PATH_MAX] = "/proc/pressure/memory";
+  char line[PATH_MAX - 32];
+  FILE *fp = fopen("/proc/self/cgroup", "r");
+  while (fp && fgets(line, sizeof(line), fp))
+  {
+    if (strncmp(line, "0::", 3) != 0) // 只有cgroup v2才有memory.pressure
+      continue;
+    line[strcspn(line, "\n")] = '\0';
+    snprintf(path, sizeof(path), "/sys/fs/cgroup%s/memory.pressure", line + 3);
+    if (access(path, W_OK) != 0)
+      strcpy(path, "/proc/pressure/memory");
+    break;
+  }
+  if (fp)
+    fclose(fp);
+  int fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+  if (fd == -1)
+    return -1;
+  const char trig[] = "some 150000 2000000";
+  if (write(fd, trig, sizeof(trig)) == -1)
+  {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+void editorPressure() // 内存紧张：视口以外的派生数据和绘制缓存全部丢掉，需要时再重建，免得被OOM杀掉
+{
+  long before = E.derived + E.drawbytes;
+  long shed = E.shed;
+  editorShed(0);
+  for (int r = 0; r < E.numrows; r++)
+    if (r < E.rowoff || r >= E.rowoff + E.screenrows)
+      editorRowDrawFree(&E.row[r]);
+  editorSetStatusMessage("Memory pressure: dropped caches of %ld rows, %ldKB freed",
+                         E.shed - shed, (before - E.derived - E.drawbytes) / 1024);
+  E.frame.pending = 1;
+}
+
+/*** scheduler ***/
+long long editorNow() // 单调时钟，微秒
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+int editorInputPending(long long timeout) // 等待输入最多timeout微秒，-1表示一直等
+{
+  struct pollfd p[4] = {{STDIN_FILENO, POLLIN, 0}, {E.pressure_fd, POLLPRI, 0}, // fd为-1时poll忽略这一项
+                        {E.grep && E.grep->nthreads ? E.grep->wake[0] : -1, POLLIN, 0},
+                        {diff.job ? diff.job->wake[0] : -1, POLLIN, 0}};
+  int ms = timeout < 0 ? -1 : (int)((timeout + 999) / 1000);
+  if (poll(p, 4, ms) <= 0)
+    return 0;
+  if (p[0].revents)
+    return 1;
+  if (p[1].revents & (POLLERR | POLLNVAL)) // cgroup没了，不再监听
+  {
+    close(E.pressure_fd);
+    E.pressure_fd = -1;
+  }
+  else if (p[1].revents)
+    editorPressure();
+  if (p[2].revents)
+    editorGrepDrain();
+  if (p[3].revents)
+    editorDiffDrain();
+  return 0; // 不是输入，不补算剩下的时间，由调度循环重新决定
+}
+void editorFrameInput() // 处理一个按键之前调用；上一个按键的画面还没画出来就被这次取代了
+{
+  struct frameStats *f = &E.frame;
+  if (f->pending && f->input)
+    f->dropped++;
+  if (!f->input)
+    f->input = editorNow();
+  f->pending = 1;
+}
+void editorFrameDraw()
+{
+  struct frameStats *f = &E.frame;
+  editorRefreshScreen();
+  f->last = editorNow();
+  f->frames++;
+  if (f->input)
+  {
+    long long lat = f->last - f->input;
+    f->lat_sum += lat;
+    if (lat > f->lat_max)
+      f->lat_max = lat;
+    f->nlat++;
+    f->input = 0;
+  }
+  f->pending = 0;
+  if (!f->first)
+    f->first = f->last - f->start;
+}
+int editorIdle() // 一个空闲片：先接着载入文件，再把视口附近还没高亮的行往后算一段，返回是否做了事
+{
+  if (E.load)
+  {
+    editorLoadSlice(KILO_LOAD_ROWS);
+    E.frame.pending = 1; // 更新行数和进度
+    return 1;
+  }
+  if (E.view || E.hex)
+    return 0;
+  if (editorDiffStart()) // 比较在线程里做，这里只交出改过的段
+    return 1;
+  if (E.derived > E.derived_limit) // 高亮都算完以后，翻页和跳转时按需重建的行仍会超出预算
+    editorShed(E.derived_limit / 4 * 3);
+  int ahead = E.rowoff + E.screenrows * (KILO_IDLE_AHEAD + 1) - 1; // 高亮是从上往下串联的，视口之前的行总要算，之后只算几屏
+  if (E.stale_from >= E.numrows || E.stale_from > ahead) // 视口附近的高亮算完了再收录补全用的词
+  {
+    if (!words.on || (words.from >= E.numrows && words.nsorted == words.n && words.dead <= words.n / 2))
+      return 0;
+    if (words.from < E.numrows)
+      editorWordsSlice(KILO_WORD_ROWS);
+    else // 收录完了顺便排好序，补全时就只剩零星的新词要并入
+      editorWordsSort();
+    return 1;
+  }
+  editorRowsFlush(E.stale_from + KILO_IDLE_ROWS - 1 < ahead ? E.stale_from + KILO_IDLE_ROWS - 1 : ahead);
+  if (E.derived > E.derived_limit) // 留四分之一余量，不用每一片都丢
+    editorShed(E.derived_limit / 4 * 3);
+  return 1;
+}
+void editorSchedule() // 已到的输入优先处理完；有修改时按帧率上限重画；没事时在空闲片里做后台工作，直到有新输入
+{
+  struct frameStats *f = &E.frame;
+  if (!E.view && !E.hex) // 跳过的帧也要更新滚动位置，翻页等按键依赖它
+    editorScroll();
+  while (!editorInputPending(0))
+  {
+    long long wait = f->last + f->interval - editorNow();
+    if (f->pending && wait <= 0)
+      editorFrameDraw();
+    else if (f->pending && E.load) // 等下一帧的时间用来接着载入
+      editorIdle();
+    else if (f->pending)
+    {
+      if (editorInputPending(wait)) // 这一帧还没到时间，等待期间来了输入就不画了
+        return;
+    }
+    else if (E.save) // 后台保存时定期刷新进度
+    {
+      if (editorInputPending(100000))
+        return;
+      editorSavePoll(0);
+      f->pending = 1;
+    }
+    else if (!editorIdle() && editorInputPending(-1))
+      return;
+  }
+}
+void editorFrameStats()
+{
+  struct frameStats *f = &E.frame;
+  editorSetStatusMessage("first frame %.1fms, %ld frames, %ld dropped, latency avg %.1fms max %.1fms, cap %dfps",
+                         f->first / 1000.0, f->frames, f->dropped, f->nlat ? f->lat_sum / 1000.0 / f->nlat : 0.0,
+                         f->lat_max / 1000.0, f->interval ? (int)(1000000 / f->interval) : 0);
+}
+
+/*** input ***/
+char *editorPrompt(char *prompt, void (*callback)(char *, int), int allow_empty) // 提示用户在保存新文件是输入文件名，在状态栏中显示提示，允许用户在提示后输入一行文本
+{
+  size_t bufsize = 128;
+  char *buf = malloc(bufsize);
+  size_t buflen = 0;
+  buf[0] = '\0';
+  while (1)
+  {
+    editorSetStatusMessage(prompt, buf);
+    editorRefreshScreen();
+    int c = editorReadKey();
+    if (c == DEL_KEY || c == CTRL_KEY('h') || c == BACKSPACE) // 允许在输入提示中按下backspace
+    {
+      if (buflen != 0)
+        buf[--buflen] = '\0';
+    }
+    else if (c == '\x1b')
+    {
+
+      editorSetStatusMessage("");
+      if (callback)
+        callback(buf, c);
+      free(buf);
+      return NULL;
+    }
+    else if (c == '\r')
+    {
+      if (buflen != 0 || allow_empty) // allow_empty允许直接回车得到空串
+      {
+        editorSetStatusMessage("");
+        if (callback)
+          callback(buf, c);
+        return buf;
+      }
+    }
+    else if (!iscntrl(c) && c < 128)
+    {
+      if (buflen == bufsize - 1)
+      {
+        bufsize *= 2;
+        buf = realloc(buf, bufsize);
+      }
+      buf[buflen++] = c;
+      buf[buflen] = '\0';
+    }
+    if (callback && (c == ARROW_UP || c == ARROW_DOWN || c == ARROW_LEFT || c == ARROW_RIGHT || !editorInputPending(0)))
+      callback(buf, c); // 还在连续输入时这次搜索会被下一个字符取代，不用做
+  } //??
+}
+void editorMoveCursor(int key)
+{
+  erow *row = (E.cy >= E.numrows) ? NULL : &E.row[E.cy]; // 由于 E.cy 允许位于文件最后一行之后，我们使用三元运算符来检查光标是否位于实际行上。如果是，则 row 变量将指向光标所在的 erow ，在我们允许光标向右移动之前，我们会检查 E.cx 是否位于该行末尾的左侧。
+  switch (key)
+  {
+  case ARROW_LEFT:
+    if (E.cx != 0)
+    {
+      E.cx = editorRowPrevCx(row, E.cx); // 按字素簇移动
+    }
+    else if (E.cy > 0)
+    {
+      E.cy = editorRowPrev(E.cy);
+      E.cx = E.row[E.cy].size; // 允许用户在行首按下左箭头移动到上一行的末尾
+    }
+    break;
+  case ARROW_RIGHT:
+    // if (E.cx != E.screencols - 1)//允许滚动到右侧
+    //{
+    // E.cx++;
+    //}
+    if (row && E.cx < row->size)
+    {
+      E.cx = editorRowNextCx(row, E.cx);
+    }
+    else if (row && E.cx == row->size)
+    {
+      E.cy = editorRowNext(E.cy);
+      E.cx = 0;
+    }
+    break;
+  case ARROW_UP:
+    if (E.wrap)
+      editorWrapMove(-1);
+    else if (E.cy != 0)
+    {
+      E.cy = editorRowPrev(E.cy); // 跳过收起的行
+    }
+    break;
+  case ARROW_DOWN:
+    if (E.wrap)
+      editorWrapMove(1);
+    else if (E.cy < E.numrows)
+    {
+      E.cy = editorRowNext(E.cy);
+    }
+    break;
+  }
+  // 纠正如果最终超出了所在行的末尾情况
+  row = (E.cy >= E.numrows) ? NULL : &E.row[E.cy];
+  int rowlen = row ? row->size : 0;
+  if (E.cx > rowlen)
+  {
+    E.cx = rowlen;
+  }
+  if (row)
+    E.cx = editorRowSnapCx(row, E.cx); // 上下移动后可能落在多字节字符中间
+}
+int editorKeyViews(int c) // 不修改文本的按键
+{
+  switch (c)
+  {
+  case ARROW_UP:
+  case ARROW_DOWN:
+  case ARROW_LEFT:
+  case ARROW_RIGHT:
+  case PAGE_UP:
+  case PAGE_DOWN:
+  case HOME_KEY:
+  case END_KEY:
+  case CTRL_KEY('f'):
+  case CTRL_KEY('r'):
+  case CTRL_KEY('w'):
+  case CTRL_KEY('t'):
+  case CTRL_KEY('l'):
+  case CTRL_KEY('q'):
+  case CTRL_KEY('b'):
+  case CTRL_KEY('c'):
+  case CTRL_KEY('g'):
+  case CTRL_KEY('o'):
+  case CTRL_KEY('p'):
+  case CTRL_KEY('d'):
+  case '\x1b':
+    return 1;
+  }
+  return 0;
+}
+void editorProcessKeypress()
+{ // 等待按键，将把各种ctrl键组合和其他特殊键映射到不同的编辑器功能，并将任何字母数字和其他可打印键的字符插入到正在编辑的文本中
+  static int quit_times = KILO_QUIT_TIMES;
+  static int typing = 0; // 上一个键是普通字符输入，连续输入合并为一次撤销
+  static int completing = 0; // 上一个键是补全，再按换下一个候选
+  if (E.view)
+  {
+    editorViewProcessKeypress();
+    return;
+  }
+  if (E.hex)
+  {
+    editorHexProcessKeypress();
+    return;
+  }
+  int c = editorReadKey();
+  if (E.load && !editorKeyViews(c)) // 还在载入时只能移动和搜索，修改前先读完
+    editorLoadFinish();
+  if (!editorKeyViews(c) && c != CTRL_KEY('x') && c != CTRL_KEY('e')) // 修改之后选择的位置就不对了
+    E.sel = 0;
+  int was_typing = typing, was_completing = completing;
+  typing = completing = 0;
+  E.undo_break = 1; // 每个按键默认是一次独立的撤销
+  switch (c)
+  {
+  case '\r':
+    if (editorGrepShown())
+    {
+      editorGrepOpen();
+      break;
+    }
+    editorCursorsClear(); // 改变行结构的操作只作用于主光标
+    editorInsertNewline();
+    break;
+  case CTRL_KEY('q'):
+    editorSavePoll(1); // 等后台保存写完，否则文件只写了一半
+    if (E.dirty && quit_times > 0)
+    {
+      editorSetStatusMessage("WARNING!!! File has unsaved changes. "
+                             "Press Ctrl-Q %d more times to quit.",
+                             quit_times);
+      quit_times--;
+      return;
+    }
+    write(STDOUT_FILENO, "\x1b[2J", 4);
+    write(STDOUT_FILENO, "\x1b[H", 3);
+    editorJournalClose(1);
+    exit(0);
+    break;
+  case CTRL_KEY('S'):
+    editorSave();
+    break;
+  case HOME_KEY:
+    editorCursorsMove(c);
+    E.cx = 0;
+    editorCursorsNormalize();
+    break;
+  case END_KEY:
+    editorCursorsMove(c);
+    if (E.cy < E.numrows)
+      E.cx = E.row[E.cy].size;
+    editorCursorsNormalize();
+    break;
+  case CTRL_KEY('f'): // 搜索
+    editorFind(0);
+    break;
+  case CTRL_KEY('r'): // 正则搜索
+    editorFind(1);
+    break;
+  case CTRL_KEY('g'): // 在目录树中搜索
+    editorGrep();
+    break;
+  case CTRL_KEY('\\'): // 全部替换
+    editorCursorsClear();
+    editorReplaceAll();
+    break;
+  case CTRL_KEY('w'): // 切换软折行
+    E.wrap = !E.wrap;
+    E.wrapoff = 0;
+    E.coloff = 0;
+    editorSetStatusMessage("Soft wrap %s", E.wrap ? "on" : "off");
+    break;
+  case CTRL_KEY(' '): // 补全光标前的标识符
+    editorCursorsClear();
+    editorComplete(was_completing);
+    completing = 1;
+    break;
+  case CTRL_KEY('o'): // 收起或展开光标处的折叠
+    editorFoldToggle();
+    break;
+  case CTRL_KEY('p'): // 收起或展开全部顶层折叠
+    editorFoldAll();
+    break;
+  case CTRL_KEY('d'): // 显示或隐藏和磁盘文件的差异标记
+    editorDiffToggle();
+    break;
+  case CTRL_KEY('e'): // 排序、去重或筛选行
+    editorLines();
+    break;
+  case CTRL_KEY('z'):
+    editorCursorsClear();
+    editorUndoRedo(&E.undo, &E.redo);
+    break;
+  case CTRL_KEY('y'):
+    editorCursorsClear();
+    editorUndoRedo(&E.redo, &E.undo);
+    break;
+  case CTRL_KEY('n'): // 在下一行添加光标
+    editorAddCursorBelow();
+    break;
+  case CTRL_KEY('k'): // 列块选择
+    editorColumnBlock();
+    break;
+  case BACKSPACE:
+  case CTRL_KEY('h'):
+  case DEL_KEY:
+    if (E.ncursors)
+    {
+      editorMultiEdit(c == DEL_KEY ? 'd' : 'b', 0);
+      break;
+    }
+    if (c == DEL_KEY)
+      editorMoveCursor(ARROW_RIGHT);
+    editorDelChar();
+    break;
+  case PAGE_UP:
+  case PAGE_DOWN:
+  {
+    if (E.wrap) // 先移到视口的第一个或最后一个屏幕行
+    {
+      int n = c == PAGE_UP ? E.wrap_y : E.screenrows - 1 - E.wrap_y;
+      while (n-- > 0)
+        editorMoveCursor(c == PAGE_UP ? ARROW_UP : ARROW_DOWN);
+    }
+    else if (c == PAGE_UP)
+    {
+      E.cy = E.rowoff;
+    }
+    else if (c == PAGE_DOWN)
+    {
+      E.cy = editorRowAtVisIndex(editorRowVisIndex(E.rowoff) + E.screenrows - 1);
+      if (E.cy > E.numrows)
+        E.cy = E.numrows;
+    }
+    int times = E.screenrows;
+    while (times--)
+      editorMoveCursor(c == PAGE_UP ? ARROW_UP : ARROW_DOWN);
+  }
+  break;
+
+  case ARROW_UP:
+  case ARROW_DOWN:
+  case ARROW_LEFT:
+  case ARROW_RIGHT:
+    editorCursorsMove(c);
+    editorMoveCursor(c);
+    editorCursorsNormalize();
+    break;
+
+  case '\x1b':
+    editorCursorsClear(); // ESC取消多光标、列块选择和选择
+    E.block_row = -1;
+    E.sel = 0;
+    break;
+  case CTRL_KEY('l'):
+    break;
+  case CTRL_KEY('t'): // 显示帧率和延迟统计
+    editorFrameStats();
+    break;
+  case CTRL_KEY('b'): // 开始或取消选择
+    E.sel = !E.sel;
+    E.sel_cx = E.cx;
+    E.sel_cy = E.cy;
+    break;
+  case CTRL_KEY('c'):
+    editorClipCopy(0);
+    break;
+  case CTRL_KEY('x'):
+    editorClipCopy(1);
+    break;
+  case CTRL_KEY('v'):
+    editorClipPaste();
+    break;
+
+  default:
+    E.undo_break = !was_typing;
+    if (E.ncursors)
+      editorMultiEdit('i', c);
+    else
+      editorInsertChar(c);
+    typing = 1;
+    break;
+  }
+  quit_times = KILO_QUIT_TIMES; // 当按下除ctrl_q之外的任何键时，重置退出次数
+}
+
+void editorInitState() // 初始化E中与终端无关的字段，测试程序也用它
+{
+  E.cx = 0; // 光标水平，列
+  E.cy = 0; // 光标垂直，行
+  E.rx = 0;
+  E.rowoff = 0; // 默认情况下将滚动到文件顶部
+  E.coloff = 0;
+  E.wrap = 0;
+  E.wrapoff = 0;
+  E.numrows = 0;
+  E.rowcap = 0;
+  E.row = NULL;
+  E.dirty = 0;
+  E.filename = NULL;
+  E.statusmsg[0] = '\0';
+  E.statusmsg_time = 0;
+  E.syntax = NULL;
+  memset(&E.undo, 0, sizeof(E.undo));
+  memset(&E.redo, 0, sizeof(E.redo));
+  E.undo_break = 1;
+  E.undo_lock = 0;
+  E.journal = NULL;
+  E.view = NULL;
+  E.hex = NULL;
+  E.save = NULL;
+  E.load = NULL;
+  E.cursors = NULL;
+  E.ncursors = 0;
+  E.block_row = -1;
+  E.sel = 0;
+  memset(&E.clip, 0, sizeof(E.clip));
+  E.stale_from = INT_MAX;
+  E.drawbytes = 0;
+  E.shown_rowoff = -1;
+  memset(&E.frame, 0, sizeof(E.frame));
+  E.frame.start = editorNow();
+  char *fps = getenv("KILO_FPS");
+  int rate = fps ? atoi(fps) : KILO_FPS;
+  E.frame.interval = rate > 0 ? 1000000 / rate : 0;
+  char *mem = getenv("KILO_ROW_MEM");
+  E.derived = 0;
+  E.derived_limit = (long)(mem && atol(mem) > 0 ? atol(mem) : KILO_ROW_MEM_MB) << 20;
+  E.shed = 0;
+  E.pressure_fd = editorPressureOpen();
+  E.grep = NULL;
+  char *in = getenv("KILO_INTERN");
+  intern.on = in && atoi(in) > 0;
+  char *wd = getenv("KILO_WORDS");
+  words.on = !(wd && atoi(wd) == 0);
+}
+void initEditor()
+{
+  editorInitState();
+  if (getWindowSize(&E.screenrows, &E.screencols) == -1)
+    die("getWindowSize");
+  E.screenrows -= 2; // 空出两行显示状态栏和消息
+  E.shown = calloc(E.screenrows > 0 ? E.screenrows : 1, sizeof(char *));
+}
+int main(int argc, char *argv[])
+{
+  if (argc >= 2 && (strcmp(argv[1], "-e") == 0 || strcmp(argv[1], "-f") == 0)) // 批处理模式，不碰终端
+    return editorBatchMain(argc, argv);
+  enableRawMode();
+  initEditor(); // 初始化E结构体中的所有字段
+  struct stat st;
+  if (argc >= 3 && strcmp(argv[1], "-v") == 0) // kilo -v 文件：只读查看
+    editorViewOpen(argv[2]);
+  else if (argc >= 3 && strcmp(argv[1], "-x") == 0) // kilo -x 文件：按十六进制查看和修改
+    editorHexOpen(argv[2]);
+  else if (argc >= 2 && stat(argv[1], &st) == 0 && S_ISREG(st.st_mode) && editorIsBinary(argv[1]))
+    editorHexOpen(argv[1]);
+  else if (argc >= 2)
+  {
+    editorOpen(argv[1]);
+  }
+  if (E.statusmsg[0] == '\0') // 打开文件时可能已有提示，例如恢复了交换日志
+    editorSetStatusMessage("HELP: ^S save | ^Q quit | ^F find | ^R regex | ^\\ replace | ^Z undo | ^Y redo");
+  E.frame.pending = 1;
+  while (1)
+  {
+    editorSchedule();
+    editorFrameInput();
+    editorProcessKeypress();
+  }
+
+  return 0;
+}
@@ -0,0 +1,888 @@
+// kilo的单元测试：把kilo.c整个包含进来，直接调用内部函数，不需要终端
+// make test编译并运行，有失败的检查时退出码非0
+#define main kilo_main
+#include "kilo.c"
+#undef main
+
+static int checks = 0, failures = 0;
+#define CHECK(cond)                                                                  \
+  do                                                                                 \
+  {                                                                                  \
+    checks++;                                                                        \
+    if (!(cond))                                                                     \
+    {                                                                                \
+      failures++;                                                                    \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);      \
+    }                                                                                \
+  } while (0)
+
+static void testSetup() // 每个测试从空缓冲开始，屏幕大小固定
+{
+  E.screenrows = 22;
+  E.screencols = 80;
+  if (E.shown == NULL)
+    E.shown = calloc(E.screenrows, sizeof(char *));
+  editorBufferClose();
+}
+static void testRows(const char **lines, int n)
+{
+  E.undo_lock++;
+  for (int i = 0; i < n; i++)
+    editorInsertRow(E.numrows, (char *)lines[i], strlen(lines[i]));
+  E.undo_lock--;
+}
+static int testText(const char *want) // 缓冲的全文（每行后跟换行）是否等于want
+{
+  size_t len;
+  char *buf = editorRowsToString(&len);
+  int same = len == strlen(want) && memcmp(buf, want, len) == 0;
+  if (!same)
+    fprintf(stderr, "  got \"%.*s\", want \"%s\"\n", (int)len, buf, want);
+  free(buf);
+  return same;
+}
+
+/*** regex ***/
+static void testRegexSearch()
+{
+  struct
+  {
+    const char *pattern, *s;
+    int found, start, len;
+  } cases[] = {
+      {"a.*b|c", "aXcb", 1, 0, 4}, // 最早结束的是c，但最左的匹配从a开始
+      {"(a|bc)?c+.", "abbccb", 1, 2, 4},
+      {"x|abc", "zabcx", 1, 1, 3},
+      {"b+", "abbbc", 1, 1, 3},
+      {"^ab", "xab", 0, 0, 0},
+      {"b$", "abab", 1, 3, 1},
+      {"\\d+", "ab 123 45", 1, 3, 3},
+      {"foo", "xfoofoo", 1, 1, 3},
+      {"[a-c]{2,3}", "xxabcab", 1, 2, 3},
+  };
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+  {
+    regex *re = rxCompile(cases[i].pattern);
+    CHECK(re != NULL);
+    if (re == NULL)
+      continue;
+    int start = -1, len = -1;
+    int found = rxSearch(re, cases[i].s, strlen(cases[i].s), &start, &len);
+    CHECK(found == cases[i].found);
+    if (found && cases[i].found && (start != cases[i].start || len != cases[i].len))
+    {
+      fprintf(stderr, "  /%s/ on \"%s\": got %d+%d, want %d+%d\n", cases[i].pattern, cases[i].s,
+              start, len, cases[i].start, cases[i].len);
+      CHECK(0);
+    }
+    rxFree(re);
+  }
+}
+static void testRegexCache() // 状态多的模式：DFA缓存从小容量翻倍，满了清空重建，结果不变
+{
+  regex *re = rxCompile("(a|b)*a(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)x");
+  CHECK(re->fwd.cap == RX_MIN_DSTATES);
+  int n = 100000;
+  char *s = malloc(n + 11);
+  unsigned int seed = 1;
+  for (int i = 0; i < n; i++)
+  {
+    seed = seed * 1103515245u + 12345u;
+    s[i] = "ab"[(seed >> 16) & 1];
+  }
+  memcpy(s + n, "abbbbbbbbbx", 11);
+  int start, len;
+  CHECK(rxSearch(re, s, n + 11, &start, &len) && start == 0 && len == n + 11);
+  CHECK(re->fwd.cap > RX_MIN_DSTATES && re->fwd.cap <= RX_MAX_DSTATES);
+  CHECK(!rxSearch(re, s, n + 10, &start, &len));
+  free(s);
+  rxFree(re);
+}
+static void testRegexSearchFrom() // 从偏移继续找：^只在行首成立，每次都是剩余部分中最左最长的匹配
+{
+  regex *re = rxCompile("a+|bx*c");
+  const char *s = "aa bxc aaa bc";
+  int want[][2] = {{0, 2}, {3, 3}, {7, 3}, {11, 2}};
+  int from = 0, k = 0, start, len;
+  while (rxSearchFrom(re, s, from, strlen(s), &start, &len))
+  {
+    CHECK(k < 4 && start == want[k][0] && len == want[k][1]);
+    k++;
+    from = start + len;
+  }
+  CHECK(k == 4);
+  from = k = 0; // rxSearchNext用第一次扫描记下的开始位置，结果必须一样
+  while (from == 0 ? rxSearch(re, s, strlen(s), &start, &len) : rxSearchNext(re, s, from, strlen(s), &start, &len))
+  {
+    CHECK(k < 4 && start == want[k][0] && len == want[k][1]);
+    k++;
+    from = start + len;
+  }
+  CHECK(k == 4);
+  rxFree(re);
+  re = rxCompile("^a");
+  CHECK(rxSearchFrom(re, "aaa", 0, 3, &start, &len) && start == 0);
+  CHECK(!rxSearchFrom(re, "aaa", 1, 3, &start, &len));
+  rxFree(re);
+}
+
+/*** replace all ***/
+static void testReplaceAll() // 各行中不重叠的匹配全部替换；一次撤销恢复所有行，重做再换回来
+{
+  testSetup();
+  const char *lines[] = {"foo bar foo", "bar", "aaa", "foofoo"};
+  testRows(lines, 4);
+  CHECK(editorReplaceRun("foo", "X") == 4);
+  CHECK(testText("X bar X\nbar\naaa\nXX\n"));
+  E.undo_break = 1; // 和按键一样，下一个命令开始新的撤销组
+  CHECK(editorReplaceRun("aa", "") == 1); // 不重叠，替换成空串
+  CHECK(testText("X bar X\nbar\na\nXX\n"));
+  editorUndoRedo(&E.undo, &E.redo);
+  CHECK(testText("X bar X\nbar\naaa\nXX\n"));
+  editorUndoRedo(&E.undo, &E.redo);
+  CHECK(testText("foo bar foo\nbar\naaa\nfoofoo\n"));
+  editorUndoRedo(&E.redo, &E.undo);
+  CHECK(testText("X bar X\nbar\naaa\nXX\n"));
+  E.undo_break = 1;
+  CHECK(editorReplaceRun("zzz", "y") == 0 && E.undo.n == 1); // 没有匹配不留撤销
+
+  testSetup(); // 行数多时分给工作线程，结果按行号拼回去
+  E.undo_lock++;
+  char buf[32];
+  for (int r = 0; r < 3 * KILO_PAR_MIN_ROWS; r++)
+  {
+    int len = snprintf(buf, sizeof(buf), r % 3 ? "row %d" : "row %d key", r);
+    editorInsertRow(E.numrows, buf, len);
+  }
+  E.undo_lock--;
+  CHECK(editorReplaceRun("key", "value") == KILO_PAR_MIN_ROWS);
+  int same = 1;
+  for (int r = 0; r < E.numrows && same; r++)
+  {
+    int len = snprintf(buf, sizeof(buf), r % 3 ? "row %d" : "row %d value", r);
+    same = E.row[r].size == len && memcmp(E.row[r].chars, buf, len) == 0;
+  }
+  CHECK(same);
+  editorUndoRedo(&E.undo, &E.redo);
+  for (int r = 0; r < E.numrows && same; r++)
+  {
+    int len = snprintf(buf, sizeof(buf), r % 3 ? "row %d" : "row %d key", r);
+    same = E.row[r].size == len && memcmp(E.row[r].chars, buf, len) == 0;
+  }
+  CHECK(same && E.undo.n == 0);
+}
+
+/*** UTF-8 render ***/
+static void testUtf8Render()
+{
+  testSetup();
+  const char *lines[] = {"\xe4\xb8\xad\tx", "e\xcc\x81z", "\xcc\x81" "a"};
+  testRows(lines, 3);
+  editorRowsFlush(E.numrows - 1);
+  erow *row = &E.row[0]; // 中占两列，制表符补到第8列
+  CHECK(row->view->rsize == 3 + 6 + 1);
+  CHECK(editorRowCxToRx(row, 4) == 8);
+  row = &E.row[1]; // e和组合重音是一个字素簇
+  CHECK(row->view->ncells == 3);
+  CHECK(editorRowCxToRx(row, 3) == 1);
+  row = &E.row[2]; // 行首孤立的组合字符前补一个空格
+  CHECK(row->view->rsize == 4 && row->view->render[0] == ' ');
+  CHECK(editorRowCxToRx(row, 2) == 1);
+  testSetup(); // 非法字节、制表符之后的组合字符都各自开始一个字素簇，每个都补空格
+  char s[600]; // 前一半是100个非法字节加组合字符，没有制表符留出的余量；后一半和制表符交替
+  for (int k = 0; k < 200; k++)
+    memcpy(s + k * 3, k >= 100 && k % 2 ? "\t\xcc\x81" : "\xff\xcc\x81", 3);
+  E.undo_lock++;
+  editorInsertRow(0, s, 600);
+  E.undo_lock--;
+  editorRowsFlush(0);
+  row = &E.row[0];
+  int rsize = 0, col = 0, pads = 0;
+  for (int k = 0; k < 200; k++)
+  {
+    int tab = k >= 100 && k % 2;
+    int w = tab ? KILO_TAB_STOP - col % KILO_TAB_STOP : 1; // 制表符或显示为一列的非法字节
+    rsize += (tab ? w : 1) + 3;
+    col += w + 1;
+  }
+  for (int i = 0; i + 1 < row->view->rsize; i++)
+    pads += row->view->render[i] == ' ' && (unsigned char)row->view->render[i + 1] == 0xcc;
+  CHECK(row->view->ncells == 400 + 1);
+  CHECK(pads == 200);
+  CHECK(row->view->rsize == rsize);
+  CHECK(editorRowCxToRx(row, 600) == col);
+}
+
+/*** soft wrap ***/
+static int testWrapLineSlow(erow *row, int rx) // 线性扫描折行位置，和二分查找对照
+{
+  int line = 0;
+  while (line + 1 < editorWrapLines(row) && editorWrapStart(row, line + 1) <= rx)
+    line++;
+  return line;
+}
+static void testSoftWrap() // 宽字符和放不下的制表符整个移到下一行，正好填满时行尾多一行；按屏幕行滚动和上下移动
+{
+  testSetup();
+  E.screencols = 10;
+  E.screenrows = 4;
+  const char *lines[] = {
+      "abcdefghijklmnopqrst",        // 纯ASCII，正好两行宽
+      "abcdefghi\xe4\xb8\xad" "xyz", // 中字放不下，移到第二行
+      "\xc3\xa9" "abcdefg\tx",       // 制表符从第8列到第16列，整个移到第二行
+      "\xe4\xb8\xad\xe4\xb8\xad\xe4\xb8\xad\xe4\xb8\xad\xe4\xb8\xad\xe4\xb8\xad",
+  };
+  testRows(lines, 4);
+  erow *r0 = &E.row[0], *r1 = &E.row[1], *r2 = &E.row[2], *r3 = &E.row[3];
+  CHECK(editorWrapLines(r0) == 3 && editorWrapStart(r0, 1) == 10 && editorWrapStart(r0, 2) == 20);
+  CHECK(editorWrapLineOf(r0, 9) == 0 && editorWrapLineOf(r0, 10) == 1 && editorWrapLineOf(r0, 20) == 2);
+  CHECK(editorWrapLines(r1) == 2 && editorWrapStart(r1, 1) == 9);
+  CHECK(editorWrapLineOf(r1, 8) == 0 && editorWrapLineOf(r1, 9) == 1 && editorWrapLineOf(r1, 14) == 1);
+  CHECK(editorWrapLines(r2) == 2 && editorWrapStart(r2, 1) == 8 && editorWrapLineOf(r2, 16) == 1);
+  CHECK(editorWrapLines(r3) == 2 && editorWrapStart(r3, 1) == 10);
+  E.screencols = 7; // 宽度变了重新计算；行尾位置在最后一个屏幕行还放得下
+  CHECK(editorWrapLines(r3) == 2 && editorWrapStart(r3, 1) == 6 && editorWrapLineOf(r3, 12) == 1);
+  E.screencols = 10;
+
+  char buf[400]; // 长行的二分查找和线性扫描一致
+  int len = 0;
+  srand(3);
+  for (int i = 0; i < 120; i++)
+  {
+    int k = rand() % 4;
+    const char *piece = k == 0 ? "\xe4\xb8\xad" : k == 1 ? "\t" : k == 2 ? "\xc3\xa9" : "a";
+    memcpy(buf + len, piece, strlen(piece));
+    len += strlen(piece);
+  }
+  editorInsertRow(E.numrows, buf, len);
+  erow *rl = &E.row[E.numrows - 1];
+  editorRowRender(rl);
+  int end = rl->view->cells[rl->view->ncells - 1].col, same = 1;
+  for (int rx = 0; rx <= end; rx++)
+    same &= editorWrapLineOf(rl, rx) == testWrapLineSlow(rl, rx);
+  for (int k = 1; k < editorWrapLines(rl); k++) // 每个屏幕行都放得下，也没有能提前放下的字符
+    same &= editorWrapStart(rl, k) - editorWrapStart(rl, k - 1) <= 10 && editorWrapStart(rl, k) > editorWrapStart(rl, k - 1);
+  CHECK(same);
+  editorDelRow(E.numrows - 1);
+
+  E.wrap = 1; // 光标在第0行的行尾，视口往下滚到光标正好在最后一个屏幕行
+  E.cy = 0;
+  E.cx = r0->size;
+  editorScroll();
+  CHECK(E.rowoff == 0 && E.wrapoff == 0 && E.wrap_y == 2 && E.wrap_x == 0);
+  E.cy = 1;
+  E.cx = 13; // y所在的第二个屏幕行
+  editorScroll();
+  CHECK(E.rowoff == 0 && E.wrapoff == 1 && E.wrap_y == 3 && E.wrap_x == 3);
+  E.cy = 3;
+  E.cx = 0;
+  editorScroll();
+  CHECK(E.rowoff == 1 && E.wrapoff == 1 && E.wrap_y == 3);
+  E.cy = 0;
+  E.cx = 0;
+  editorScroll(); // 回到上面时顶部就是光标所在的屏幕行
+  CHECK(E.rowoff == 0 && E.wrapoff == 0 && E.wrap_y == 0);
+
+  E.cy = 1; // 上下按屏幕行移动，保持屏幕行内的列
+  E.cx = 3;
+  CHECK(editorWrapMove(1) && E.cy == 1 && E.cx == 13);
+  CHECK(editorWrapMove(-1) && E.cy == 1 && E.cx == 3);
+  CHECK(editorWrapMove(-1) && E.cy == 0 && E.cx == 20); // 上一行的最后一个屏幕行是行尾多出的那一行
+  E.cy = 1;
+  E.cx = 13;
+  CHECK(editorWrapMove(1) && E.cy == 2 && E.cx == 4); // 第3列是c，é占两个字节
+  E.cy = 2;
+  E.cx = 10; // 第二个屏幕行的制表符之后，屏幕行内第8列
+  CHECK(editorWrapMove(1) && E.cy == 3 && E.cx == 12); // 第8列是第5个中字
+  CHECK(editorWrapMove(1) && E.cy == 3 && E.cx == 18); // 最后一个屏幕行比目标列短，停在行尾
+  E.cx = 3; // 第2列，往上到制表符占着的第10列，停在制表符上
+  CHECK(editorWrapMove(-1) && E.cy == 2 && E.cx == 9);
+  E.wrap = 0;
+}
+
+/*** multi-cursor ***/
+static void testMultiCursor() // 每个光标处同时输入；退格或删除后重合的光标合并，之后只输入一次
+{
+  testSetup();
+  const char *lines[] = {"abc", "abc", "ab"};
+  testRows(lines, 3);
+  E.cy = 0;
+  E.cx = 1;
+  editorCursorAdd(1, 1);
+  editorCursorAdd(1, 2);
+  editorMultiEdit('i', 'x');
+  CHECK(testText("axbc\naxbc\naxb\n") && E.cx == 2 && E.ncursors == 2);
+  editorUndoRedo(&E.undo, &E.redo); // 所有光标处的修改是一次撤销
+  CHECK(testText("abc\nabc\nab\n"));
+  editorUndoRedo(&E.redo, &E.undo);
+  E.cx = 2;
+  editorCursorsClear();
+  editorCursorAdd(2, 1);
+  editorCursorAdd(2, 2);
+  editorMultiEdit('b', 0);
+  CHECK(testText("abc\nabc\nab\n") && E.cx == 1 && E.ncursors == 2);
+  testSetup();
+  const char *one[] = {"abc"};
+  testRows(one, 1);
+  E.cy = 0;
+  E.cx = 2;
+  editorCursorAdd(1, 0);
+  editorMultiEdit('b', 0);
+  CHECK(testText("c\n") && E.cx == 0 && E.ncursors == 0);
+  editorInsertChar('x'); // 只剩主光标，按键走普通输入
+  CHECK(testText("xc\n"));
+  testSetup();
+  testRows(one, 1);
+  E.cy = 0;
+  E.cx = 0;
+  editorCursorAdd(1, 0);
+  editorMultiEdit('d', 0);
+  CHECK(testText("c\n") && E.cx == 0 && E.ncursors == 0);
+}
+
+/*** clipboard ***/
+static void testClipboard() // 跨行剪切；粘贴出的中间行指向剪贴板的span，原来的行改掉或释放后再粘贴仍然正确
+{
+  testSetup();
+  const char *lines[] = {"one two", "three", "four five", "six"};
+  testRows(lines, 4);
+  E.sel = 1;
+  E.sel_cy = 0;
+  E.sel_cx = 4;
+  E.cy = 2;
+  E.cx = 5;
+  editorClipCopy(1);
+  CHECK(testText("one five\nsix\n") && E.cy == 0 && E.cx == 4 && E.clip.n == 3);
+  editorUndoRedo(&E.undo, &E.redo); // 剪切是一次撤销
+  CHECK(testText("one two\nthree\nfour five\nsix\n"));
+  editorUndoRedo(&E.redo, &E.undo);
+  CHECK(testText("one five\nsix\n"));
+  E.undo_break = 1;
+  E.cy = 1;
+  E.cx = 3;
+  editorClipPaste();
+  CHECK(testText("one five\nsixtwo\nthree\nfour \n") && E.cy == 3 && E.cx == 5);
+  CHECK(editorSpanOf(E.row[2].chars) == E.clip.span); // 中间的行直接指向span
+  E.undo_break = 1;
+  E.cy = 0;
+  E.cx = 0;
+  editorClipPaste(); // 再粘贴一次，共用同一个span
+  CHECK(testText("two\nthree\nfour one five\nsixtwo\nthree\nfour \n") && E.clip.span->refs == 3);
+  E.undo_break = 1;
+  E.cy = 1;
+  E.cx = 5;
+  editorInsertChar('!'); // 原地修改之前复制出来，另一处粘贴和剪贴板不受影响
+  CHECK(testText("two\nthree!\nfour one five\nsixtwo\nthree\nfour \n"));
+  CHECK(editorSpanOf(E.row[1].chars) == NULL && editorSpanOf(E.row[4].chars) == E.clip.span);
+  editorDelRows(0, E.numrows); // 原来的行全部释放
+  editorUndoClear(&E.undo);
+  editorUndoClear(&E.redo);
+  CHECK(E.clip.span->refs == 1);
+  E.cy = E.cx = 0;
+  editorClipPaste();
+  CHECK(testText("two\nthree\nfour \n"));
+  E.sel = 1; // 复制别的内容后，旧span只剩粘贴出的行引用它
+  E.sel_cy = 0;
+  E.sel_cx = 0;
+  E.cy = 0;
+  E.cx = 3;
+  struct textSpan *old = E.clip.span;
+  editorClipCopy(0);
+  CHECK(E.clip.span != old && old->refs == 1 && E.clip.n == 1);
+  editorDelRows(0, E.numrows); // 旧span在撤销记录释放时随之释放
+  editorUndoClear(&E.undo);
+  CHECK(nspans == 1 && spans[0] == E.clip.span);
+  E.cy = E.cx = 0;
+  editorClipPaste();
+  CHECK(testText("two\n"));
+}
+
+/*** memory budget ***/
+static void testShedAfterFlush() // 空闲高亮只跟着视口走；全部算完后再按需重建的行，空闲时也要按预算丢掉
+{
+  testSetup();
+  long limit = E.derived_limit;
+  E.derived_limit = 64 * 1024;
+  E.undo_lock++;
+  for (int i = 0; i < 20000; i++)
+    editorInsertRow(E.numrows, "int a = 1; /* some text */", 26);
+  E.undo_lock--;
+  while (editorIdle())
+    ;
+  CHECK(E.stale_from < E.numrows && E.stale_from > E.screenrows * KILO_IDLE_AHEAD); // 空闲时只算到视口以下几屏
+  E.rowoff = E.numrows - E.screenrows; // 翻到文件末尾，空闲时接着往下算
+  while (editorIdle())
+    ;
+  CHECK(E.stale_from >= E.numrows && E.derived <= E.derived_limit);
+  for (int i = 0; i < E.numrows; i++) // 像来回翻页那样把丢掉的行都重建
+    editorRowRender(&E.row[i]);
+  CHECK(E.derived > E.derived_limit);
+  editorIdle();
+  CHECK(E.derived <= E.derived_limit);
+  E.derived_limit = limit;
+}
+
+/*** syntax ***/
+static void testSyntaxMissing() // 没有语法文件的扩展名只找一次，之后不再open
+{
+  char dir[] = "/tmp/kilo_testXXXXXX";
+  CHECK(mkdtemp(dir) != NULL);
+  setenv("KILO_SYNTAX_DIR", dir, 1);
+  int n = syntax_nmissing;
+  CHECK(editorFindSyntax("a.nosuch") == NULL);
+  CHECK(syntax_nmissing == n + 1);
+  CHECK(editorFindSyntax("b.nosuch") == NULL);
+  CHECK(syntax_nmissing == n + 1);
+  CHECK(editorFindSyntax("a.c") == &HLDB[0]); // 没有文件时仍回退到内置定义
+  CHECK(editorFindSyntax("b.c") == &HLDB[0] && syntax_nmissing == n + 2);
+  unsetenv("KILO_SYNTAX_DIR");
+  rmdir(dir);
+}
+static void testSyntaxMatchLine() // 没有<ext>.syn时按各文件的match行找；没有设置目录时最后找程序旁边的syntax/
+{
+  char dir[] = "/tmp/kilo_testXXXXXX";
+  CHECK(mkdtemp(dir) != NULL);
+  char path[64];
+  snprintf(path, sizeof(path), "%s/yaml.syn", dir);
+  FILE *fp = fopen(path, "w");
+  fputs("filetype yaml\nmatch .yaml .yml\ncomment #\n", fp);
+  fclose(fp);
+  setenv("KILO_SYNTAX_DIR", dir, 1);
+  struct editorSyntax *s = editorFindSyntax("conf.yml");
+  CHECK(s != NULL && !strcmp(s->filetype, "yaml"));
+  CHECK(editorFindSyntax("b.yaml") == s && editorFindSyntax("x.yml") == s); // 只解析一次
+  CHECK(editorFindSyntax("a.nomatch") == NULL);
+  unsetenv("KILO_SYNTAX_DIR");
+  const char *dirs[2];
+  int n = editorSyntaxDirs(dirs);
+  char exe[1024];
+  ssize_t len = readlink("/proc/self/exe", exe, sizeof(exe) - 8);
+  exe[len > 0 ? len : 0] = '\0';
+  strcpy(strrchr(exe, '/') + 1, "syntax");
+  CHECK(n >= 1 && !strcmp(dirs[n - 1], exe));
+  unlink(path);
+  rmdir(dir);
+}
+
+/*** intern ***/
+static void testInternSyntaxSwitch() // 换语法后先重算一行，共享同一条目的其他行不能还指着条目上释放掉的高亮
+{
+  testSetup();
+  E.undo_lock++;
+  for (int i = 0; i < 3; i++)
+    CHECK(editorInternRow(E.numrows, "int a; /* x */", 14));
+  E.undo_lock--;
+  editorRowsFlush(E.numrows - 1);
+  CHECK(E.row[0].view->hl == E.row[2].view->hl);
+  E.filename = strdup("a.c");
+  editorSelectSyntaxHighlight();
+  editorRowsFlush(0);
+  CHECK(E.row[2].view->hl == NULL);
+  int opens, closes;
+  editorRowBraces(&E.row[2], &opens, &closes);
+  editorRowsFlush(E.numrows - 1);
+  CHECK(E.row[2].view->hl == E.row[0].view->hl && E.row[2].view->hl[0] != HL_NORMAL);
+}
+
+/*** hex ***/
+static void testHexView() // 偶尔一个'\0'的文本不进十六进制视图；搜索看得到补丁；行宽跟着屏幕宽度
+{
+  testSetup();
+  char dir[] = "/tmp/kilo_testXXXXXX";
+  CHECK(mkdtemp(dir) != NULL);
+  char path[64];
+  snprintf(path, sizeof(path), "%s/a.bin", dir);
+  FILE *fp = fopen(path, "w");
+  for (int i = 0; i < 200; i++)
+    fputs("plain text line\n", fp);
+  fputc('\0', fp);
+  fclose(fp);
+  CHECK(!editorIsBinary(path));
+  fp = fopen(path, "w");
+  fwrite("abcd\0\0\0\0abxd\0\0\0\0", 1, 16, fp);
+  fclose(fp);
+  CHECK(editorIsBinary(path));
+  E.screencols = 80;
+  editorHexOpen(path);
+  struct hexView *h = E.hex;
+  CHECK(h->width == 16);
+  E.screencols = 300;
+  CHECK(editorHexFit(h) == KILO_HEX_MAX_WIDTH);
+  CHECK(editorHexSearch(h, 0, h->size, "abcd", 4) == 0);
+  h->cur = 0;
+  editorHexWrite(h, 'x'); // 原来的匹配被补丁破坏
+  h->cur = 10;
+  editorHexWrite(h, 'c'); // 补丁拼出映射上没有的匹配
+  CHECK(editorHexSearch(h, 0, h->size, "abcd", 4) == 8);
+  CHECK(editorHexSearch(h, 9, h->size, "abcd", 4) == -1);
+  CHECK(editorHexSearch(h, 2, h->size, "bcd\0", 4) == 9);
+  editorHexClose();
+  E.dirty = 0;
+  E.screencols = 80;
+  unlink(path);
+  rmdir(dir);
+}
+
+/*** diff ***/
+static void testDiffRowNow() // 改一行时当场和磁盘上的行比较，标记栏不等比较线程
+{
+  testSetup();
+  char dir[] = "/tmp/kilo_testXXXXXX";
+  CHECK(mkdtemp(dir) != NULL);
+  char path[64];
+  snprintf(path, sizeof(path), "%s/a.txt", dir);
+  FILE *fp = fopen(path, "w");
+  fputs("one\ntwo\nthree\n", fp);
+  fclose(fp);
+  editorOpen(path);
+  editorLoadSlice(INT_MAX);
+  diff.on = 1;
+  diff.full = 1; // 先整个比一次，读进磁盘上各行的哈希
+  CHECK(editorDiffStart());
+  editorDiffDrain();
+  CHECK(diff.disk_ok && diff.nsegs == 0);
+  editorInsertRow(0, "new", 3); // 插入行后面的行号和磁盘错开一行
+  editorRowInsertChar(&E.row[2], 0, 'x');
+  CHECK(editorDiffSign(2) == '~');
+  editorRowDelChars(&E.row[2], 0, 1); // 改回原样，标记当场消失
+  CHECK(editorDiffSign(2) == 0 && editorDiffSign(0) == '+');
+  editorBufferClose();
+  diff.on = 0;
+  unlink(path);
+  rmdir(dir);
+}
+
+/*** journal ***/
+static void testJournalReplay() // 编辑后不保存就丢掉缓冲，重新打开时日志恢复出同样的内容
+{
+  testSetup();
+  char dir[] = "/tmp/kilo_testXXXXXX";
+  CHECK(mkdtemp(dir) != NULL);
+  char path[64];
+  snprintf(path, sizeof(path), "%s/a.txt", dir);
+  FILE *fp = fopen(path, "w");
+  fputs("one\ntwo\nthree\n", fp);
+  fclose(fp);
+  editorOpen(path);
+  editorLoadSlice(INT_MAX);
+  CHECK(E.journal != NULL);
+  editorRowInsertChar(&E.row[0], 0, 'X');
+  editorInsertRow(1, "new", 3);
+  editorDelRow(3);
+  editorRowAppendString(&E.row[2], "!", 1);
+  editorRowDelChars(&E.row[0], 1, 2); // 同一行连续几个补丁按顺序重放
+  editorRowInsertChar(&E.row[0], 2, 'y');
+  E.cy = 1;
+  E.cx = 1;
+  editorInsertNewline(); // 截断当前行也是补丁
+  const char *want = "Xey\nn\new\ntwo!\n";
+  CHECK(testText(want));
+  editorJournalClose(0); // 模拟崩溃：写完日志但不删除
+  editorBufferClose();
+  editorOpen(path);
+  editorLoadSlice(INT_MAX);
+  CHECK(testText(want));
+  CHECK(E.undo.n == 0); // 恢复的修改不进入撤销历史
+  editorBufferClose(); // 正常关闭删除日志
+  char *jpath = editorJournalPath(path);
+  CHECK(access(jpath, F_OK) == -1);
+  free(jpath);
+  unlink(path);
+  rmdir(dir);
+}
+
+static void testSave() // 保存写临时文件再改名：符号链接和权限保留，不留临时文件；出错时报告errno
+{
+  char dir[] = "/tmp/kilo_testXXXXXX";
+  CHECK(mkdtemp(dir) != NULL);
+  char real[64], link[64], tmp[64];
+  snprintf(real, sizeof(real), "%s/real.txt", dir);
+  snprintf(link, sizeof(link), "%s/link.txt", dir);
+  snprintf(tmp, sizeof(tmp), "%s/.real.txt.ksav", dir);
+  FILE *fp = fopen(real, "w");
+  fputs("old\n", fp);
+  fclose(fp);
+  chmod(real, 0640);
+  CHECK(symlink("real.txt", link) == 0);
+  testSetup();
+  const char *lines[] = {"new", "text"};
+  testRows(lines, 2);
+  E.filename = strdup(link);
+  struct saveJob *s = editorSaveSnapshot(link);
+  E.save = s;
+  editorSaveWriter(s);
+  CHECK(s->done && s->error == 0 && s->written == s->len && s->len == 9);
+  struct stat st;
+  CHECK(lstat(link, &st) == 0 && S_ISLNK(st.st_mode));
+  CHECK(stat(real, &st) == 0 && (st.st_mode & 07777) == 0640 && st.st_size == (off_t)s->len);
+  CHECK(access(tmp, F_OK) == -1);
+  editorSavePoll(1);
+  char missing[64]; // 目录不存在，建不了临时文件
+  snprintf(missing, sizeof(missing), "%s/no/such.txt", dir);
+  s = editorSaveSnapshot(missing);
+  E.save = s;
+  editorSaveWriter(s);
+  CHECK(s->done && s->error == ENOENT);
+  editorSavePoll(1);
+  unlink(link);
+  unlink(real);
+  unlink(tmp);
+  rmdir(dir);
+}
+static void testSaveSnapshot() // 快照只记行指针：保存期间改行、删行、丢掉撤销，写出的仍是开始保存时的内容
+{
+  char path[] = "/tmp/kilo_testXXXXXX";
+  int fd = mkstemp(path);
+  CHECK(fd != -1);
+  close(fd);
+  testSetup();
+  const char *lines[] = {"alpha", "beta", "gamma", "delta"};
+  testRows(lines, 4);
+  E.filename = strdup(path);
+  struct saveJob *s = editorSaveSnapshot(path);
+  E.save = s;
+  E.cy = 0;
+  E.cx = 5;
+  editorInsertChar('!'); // 原地改的行先复制出来
+  editorInsertChar('?'); // 已经复制过的行直接改
+  editorDelRow(1);
+  editorRowReplace(&E.row[1], strdup("GAMMA"), 5);
+  editorUndoClear(&E.undo); // 撤销记录里的旧行被释放，要等写完
+  editorSaveWriter(s);
+  editorSavePoll(1);
+  FILE *fp = fopen(path, "r");
+  char buf[64] = {0};
+  size_t n = fp ? fread(buf, 1, sizeof(buf) - 1, fp) : 0;
+  if (fp)
+    fclose(fp);
+  CHECK(n == 23 && strcmp(buf, "alpha\nbeta\ngamma\ndelta\n") == 0);
+  CHECK(testText("alpha!?\nGAMMA\ndelta\n"));
+  unlink(path);
+}
+
+/*** batch ***/
+static int testBatchRun(const char *script, const char *in, const char *want) // 原地改写一个临时文件，结果和GNU sed -E一样
+{
+  char path[] = "/tmp/kilo_testXXXXXX";
+  int fd = mkstemp(path);
+  if (fd == -1 || write(fd, in, strlen(in)) != (ssize_t)strlen(in))
+    return 0;
+  close(fd);
+  char *argv[] = {"kilo", "-e", (char *)script, path, NULL};
+  int status = editorBatchMain(4, argv);
+  char buf[256] = {0};
+  FILE *fp = fopen(path, "r");
+  size_t n = fp ? fread(buf, 1, sizeof(buf) - 1, fp) : 0;
+  if (fp)
+    fclose(fp);
+  char *tmp = editorJournalPath(path); // 改名之后不留临时文件
+  strcpy(tmp + strlen(tmp) - 5, ".kbat");
+  int same = status == 0 && n == strlen(want) && memcmp(buf, want, n) == 0 && access(tmp, F_OK) == -1;
+  if (!same)
+    fprintf(stderr, "  %s: got \"%s\", want \"%s\"\n", script, buf, want);
+  free(tmp);
+  unlink(path);
+  return same;
+}
+static void testBatch()
+{
+  CHECK(testBatchRun("2d", "a\nb\nc\n", "a\nc\n"));
+  CHECK(testBatchRun("$d", "a\nb\nc\n", "a\nb\n"));
+  CHECK(testBatchRun("/b/d", "a\nb\nc\n", "a\nc\n"));
+  CHECK(testBatchRun("1,2d", "a\nb\nc\n", "c\n"));
+  CHECK(testBatchRun("2,$s/$/!/", "a\nb\nc\n", "a\nb!\nc!\n"));
+  CHECK(testBatchRun("/a/,/b/s/^/>/", "a\nb\nc\na\n", ">a\n>b\nc\n>a\n")); // 范围结束后还能再开始，到文件尾没遇到结束地址
+  CHECK(testBatchRun("/b/,/zz/d", "a\nb\nc\n", "a\n"));
+  CHECK(testBatchRun("/b/,2s/./#/", "a\nb\nc\n", "a\n#\nc\n")); // 结束行号不大于开始行时只有一行
+  CHECK(testBatchRun("s/x*/-/g", "abc\n", "-a-b-c-\n"));
+  CHECK(testBatchRun("s/b*/-/g", "abc\n", "-a-c-\n")); // 紧接着非空匹配的空匹配不算
+  CHECK(testBatchRun("s/^a|b/X/g", "bab\n", "XaX\n")); // ^只在行首成立，其余分支照常全局替换
+  CHECK(testBatchRun("s/^a/X/g", "aaa\n", "Xaa\n"));
+  CHECK(testBatchRun("s/(a|b)+/[&]/g", "xabbxa\n", "x[abb]x[a]\n"));
+  CHECK(testBatchRun("2i\\new", "a\nb\nc\n", "a\nnew\nb\nc\n"));
+  CHECK(testBatchRun("2a\\\nmore", "a\nb\nc\n", "a\nb\nmore\nc\n"));
+  CHECK(testBatchRun("$a\\z", "a\nb", "a\nb\nz\n")); // 没有换行结尾的最后一行，追加的文本另起一行
+  CHECK(testBatchRun("1i  sp", "a\n", "sp\na\n"));
+  CHECK(testBatchRun("1d\n$s/c/C/", "a\nb\nc\n", "b\nC\n"));
+}
+
+/*** line commands ***/
+static void testLines()
+{
+  struct
+  {
+    const char *cmd, *want;
+  } cases[] = {
+      {"uniq", "b\na\nb\na\n"}, // 和uniq(1)一样只合并相邻的重复行
+      {"dedup", "b\na\n"},
+      {"sort", "a\na\na\nb\nb\n"},
+      {"sort -r", "b\nb\na\na\na\n"},
+      {"sort -u", "a\nb\n"},
+      {"keep ^a", "a\na\na\n"},
+      {"drop ^a", "b\nb\n"},
+  };
+  const char *lines[] = {"b", "a", "a", "b", "a"};
+  const char *orig = "b\na\na\nb\na\n";
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+  {
+    testSetup();
+    testRows(lines, 5);
+    editorLinesRun(cases[i].cmd);
+    CHECK(testText(cases[i].want));
+    editorUndoRedo(&E.undo, &E.redo); // 整个命令是一次撤销
+    CHECK(testText(orig));
+    editorUndoRedo(&E.redo, &E.undo);
+    CHECK(testText(cases[i].want));
+  }
+}
+
+/*** fold ***/
+static void testFoldShift() // 插入删除行时原地移动的隐藏区间和从头重建的一样
+{
+  testSetup();
+  srand(1);
+  int same = 1;
+  for (int round = 0; round < 200; round++)
+  {
+    E.nfolds = 0;
+    for (int i = rand() % 8; i > 0; i--)
+    {
+      int start = rand() % 60;
+      editorFoldAdd((struct fold){start, start + 1 + rand() % 10});
+    }
+    editorFoldIndex();
+    for (int step = 0; step < 20 && E.nfolds > 0; step++)
+    {
+      int at = rand() % 80, n = rand() % 2 ? 1 + rand() % 5 : -(1 + rand() % 5);
+      editorFoldShift(at, n);
+      int nhidden = E.nhidden;
+      struct foldRange hidden[8];
+      memcpy(hidden, E.hidden, sizeof(struct foldRange) * nhidden);
+      editorFoldIndex();
+      same &= nhidden == E.nhidden && memcmp(hidden, E.hidden, sizeof(struct foldRange) * nhidden) == 0;
+    }
+  }
+  CHECK(same);
+  E.nfolds = 0;
+  editorFoldIndex();
+}
+
+/*** grep ***/
+static void testGrepIgnore()
+{
+  struct grepJob job;
+  memset(&job, 0, sizeof(job));
+  pthread_mutex_init(&job.lock, NULL);
+  char dir[] = "/tmp/kilo_testXXXXXX";
+  CHECK(mkdtemp(dir) != NULL);
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/.gitignore", dir);
+  FILE *fp = fopen(path, "w");
+  fputs("build/**\n**/tmp/**\n*.o\n", fp);
+  fclose(fp);
+  struct grepIgnore *ign = editorGrepLoadIgnore(&job, dir, NULL);
+  struct
+  {
+    const char *rel;
+    int isdir, ignored;
+  } cases[] = {
+      {"build", 1, 1},
+      {"src/build", 1, 0}, // foo/**只管.gitignore所在目录下的foo
+      {"build", 0, 0},     // 只匹配目录
+      {"tmp", 1, 1},
+      {"a/b/tmp", 1, 1},   // **/tmp/**在任意层
+      {"a/x.o", 0, 1},
+      {"a/x.c", 0, 0},
+  };
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+  {
+    snprintf(path, sizeof(path), "%s/%s", dir, cases[i].rel);
+    if (editorGrepIgnored(ign, path, cases[i].isdir) != cases[i].ignored)
+    {
+      fprintf(stderr, "  %s%s\n", cases[i].rel, cases[i].isdir ? "/" : "");
+      CHECK(0);
+    }
+  }
+  while (job.rules)
+  {
+    struct grepIgnore *r = job.rules;
+    job.rules = r->all;
+    free(r);
+  }
+  snprintf(path, sizeof(path), "%s/.gitignore", dir);
+  unlink(path);
+  rmdir(dir);
+  pthread_mutex_destroy(&job.lock);
+}
+static void testGrepFile() // 分块读：跨块边界的行、比一块还长的行、没有换行结尾的最后一行都要找到，行号连续
+{
+  struct grepJob job;
+  memset(&job, 0, sizeof(job));
+  pthread_mutex_init(&job.lock, NULL);
+  job.query = "needle";
+  job.qlen = 6;
+  CHECK(pipe(job.wake) == 0);
+  char path[] = "/tmp/kilo_testXXXXXX";
+  int fd = mkstemp(path);
+  struct abuf ab = ABUF_INIT;
+  char want[4096] = "";
+  long line = 1;
+  char filler[100];
+  memset(filler, 'x', sizeof(filler) - 1);
+  filler[sizeof(filler) - 1] = '\n';
+  for (; ab.len < KILO_GREP_CHUNK - 3; line++) // 第一块的末尾正好切在needle中间
+    abAppend(&ab, filler, ab.len + 100 < KILO_GREP_CHUNK - 3 ? 100 : KILO_GREP_CHUNK - 3 - ab.len);
+  abAppend(&ab, "\n", 1);
+  abAppend(&ab, "needle\n", 7);
+  sprintf(want + strlen(want), "%s:%ld:needle\n", path, line++);
+  for (int i = 0; i < 3 * KILO_GREP_CHUNK / 99; i++) // 一行比缓冲还长
+    abAppend(&ab, filler, 99);
+  abAppend(&ab, "needle\n", 7);
+  sprintf(want + strlen(want), "%s:%ld:", path, line++); // 结果只带行首KILO_GREP_TEXT个字节
+  memset(want + strlen(want), 'x', KILO_GREP_TEXT);
+  strcat(want, "\n");
+  abAppend(&ab, "no\nlast needle", 14);
+  line++;
+  sprintf(want + strlen(want), "%s:%ld:last needle\n", path, line);
+  CHECK(write(fd, ab.b, ab.len) == ab.len);
+  close(fd);
+  abFree(&ab);
+  editorGrepFile(&job, path);
+  CHECK(job.files == 1 && job.matched == 3);
+  CHECK(job.outlen == strlen(want) && memcmp(job.out, want, job.outlen) == 0);
+  free(job.out);
+  close(job.wake[0]);
+  close(job.wake[1]);
+  unlink(path);
+  pthread_mutex_destroy(&job.lock);
+}
+
+int main()
+{
+  editorInitState();
+  testRegexSearch();
+  testRegexCache();
+  testRegexSearchFrom();
+  testReplaceAll();
+  testUtf8Render();
+  testSoftWrap();
+  testMultiCursor();
+  testClipboard();
+  testShedAfterFlush();
+  testSyntaxMissing();
+  testSyntaxMatchLine();
+  testInternSyntaxSwitch();
+  testHexView();
+  testDiffRowNow();
+  testJournalReplay();
+  testSave();
+  testSaveSnapshot();
+  testBatch();
+  testLines();
+  testFoldShift();
+  testGrepIgnore();
+  testGrepFile();
+  editorBufferClose();
+  printf("%d checks, %d failed\n", checks, failures);
+  return failures > 0;
+}